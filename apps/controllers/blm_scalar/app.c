@@ -325,6 +325,30 @@ void APP_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t midi_
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// This function is called by the SysEx parser when a bulk frame has been
+// received. It sets the LED patterns of the given rows and colour plane
+// (same layout like the packed CC format)
+/////////////////////////////////////////////////////////////////////////////
+void APP_LED_RowsSet(u8 plane, u8 first_row, u8 num_rows, u16 *rows)
+{
+  if( plane >= BLM_SCALAR_NUM_COLOURS )
+    return;
+
+  int i;
+  for(i=0; i<num_rows; ++i) {
+    u8 row = first_row + i;
+    if( row >= 4*BLM_SCALAR_NUM_MODULES )
+      break;
+
+    blm_scalar_led[row>>2][((row&3)<<1) + 0][plane] = rows[i] & 0xff;
+    blm_scalar_led[row>>2][((row&3)<<1) + 1][plane] = rows[i] >> 8;
+  }
+
+  notifyDataReceived();
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // This hook is called before the shift register chain is scanned
 /////////////////////////////////////////////////////////////////////////////
@@ -38,6 +38,8 @@ extern void APP_DIN_NotifyToggle(u32 pin, u32 pin_value);
 extern void APP_ENC_NotifyChange(u32 encoder, s32 incrementer);
 extern void APP_AIN_NotifyChange(u32 pin, u32 pin_value);
 
+extern void APP_LED_RowsSet(u8 plane, u8 first_row, u8 num_rows, u16 *rows);
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Export global variables
@@ -19,6 +19,7 @@
 
 #include "app.h"
 #include "sysex.h"
+#include <blm_scalar_frame.h>
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -31,6 +32,7 @@ static s32 SYSEX_Cmd(u8 cmd_state, u8 midi_in);
 
 static s32 SYSEX_Cmd_InfoRequest(u8 cmd_state, u8 midi_in);
 static s32 SYSEX_Cmd_Ping(u8 cmd_state, u8 midi_in);
+static s32 SYSEX_Cmd_Frame(u8 cmd_state, u8 midi_in);
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -42,6 +44,8 @@ static u8 sysex_cmd;
 
 static mios32_midi_port_t sysex_port = DEFAULT;
 
+static blm_scalar_frame_decoder_t frame_decoder;
+
 
 /////////////////////////////////////////////////////////////////////////////
 // constant definitions
@@ -105,6 +109,9 @@ s32 SYSEX_SendLayoutInfo(mios32_midi_port_t port)
   // number of extra buttons (e.g. shift)
   sysex_buffer[sysex_buffer_ix++] = 1;
 
+  // capabilities
+  sysex_buffer[sysex_buffer_ix++] = BLM_SCALAR_FRAME_CAP_BULK;
+
   // footer
   sysex_buffer[sysex_buffer_ix++] = 0xf7;
 
@@ -232,6 +239,9 @@ s32 SYSEX_Cmd(u8 cmd_state, u8 midi_in)
     case 0x00:
       SYSEX_Cmd_InfoRequest(cmd_state, midi_in);
       break;
+    case BLM_SCALAR_FRAME_SYSEX_CMD:
+      SYSEX_Cmd_Frame(cmd_state, midi_in);
+      break;
     case 0x01: // Layout Info
     case 0x0e: // error
       // ignore to avoid feedback loops
@@ -304,3 +314,32 @@ s32 SYSEX_Cmd_Ping(u8 cmd_state, u8 midi_in)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Command 02: LED bulk frame (see modules/blm_scalar_master/blm_scalar_frame.c)
+/////////////////////////////////////////////////////////////////////////////
+s32 SYSEX_Cmd_Frame(u8 cmd_state, u8 midi_in)
+{
+  switch( cmd_state ) {
+
+    case SYSEX_CMD_STATE_BEGIN:
+      BLM_SCALAR_FRAME_DecoderInit(&frame_decoder);
+      break;
+
+    case SYSEX_CMD_STATE_CONT:
+      BLM_SCALAR_FRAME_DecoderPut(&frame_decoder, midi_in);
+      break;
+
+    default: // SYSEX_CMD_STATE_END
+      SYSEX_SendFooter(0);
+
+      // take over the LED patterns if the frame is valid (no acknowledge to save bandwidth)
+      if( BLM_SCALAR_FRAME_DecoderFinish(&frame_decoder) > 0 ) {
+	APP_LED_RowsSet(frame_decoder.mode & 0x0f, frame_decoder.first_row, frame_decoder.num_rows, frame_decoder.row);
+      }
+      break;
+  }
+
+  return 0; // no error
+}
+
+
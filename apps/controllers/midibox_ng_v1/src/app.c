@@ -279,6 +279,11 @@ void APP_Background(void)
     // MIDI In/Out monitor
     MIDI_PORT_Period1mS();
 
+    // format events captured by the MIDI monitor
+    MUTEX_MIDIOUT_TAKE;
+    MIDIMON_Handler();
+    MUTEX_MIDIOUT_GIVE;
+
     // RGB LEDs
     MBNG_RGBLED_Periodic_1mS();
 
@@ -58,9 +58,10 @@ s32 MBNG_DIN_NotifyToggle(u32 pin, u32 pin_value)
 
   // get ID
   mbng_event_item_t item;
+  mbng_event_view_t view;
   u32 continue_ix = 0;
   do {
-    if( MBNG_EVENT_ItemSearchByHwId(hw_id, 0, &item, &continue_ix) < 0 ) {
+    if( MBNG_EVENT_ViewSearchByHwId(hw_id, 0, &view, &continue_ix) < 0 ) {
       if( continue_ix )
 	return 0; // ok: at least one event was assigned
       if( debug_verbose_level >= DEBUG_VERBOSE_LEVEL_INFO ) {
@@ -69,21 +70,25 @@ s32 MBNG_DIN_NotifyToggle(u32 pin, u32 pin_value)
       return -2; // no event assigned
     }
 
-    if( debug_verbose_level >= DEBUG_VERBOSE_LEVEL_INFO ) {
-      MBNG_EVENT_ItemPrint(&item, 0);
-    }
-
     // button depressed?
+    mbng_event_custom_flags_t custom_flags = MBNG_EVENT_ViewCustomFlagsGet(view);
     u8 depressed = pin_value ? 1 : 0;
-    if( item.custom_flags.DIN.inverted ) {
+    if( custom_flags.DIN.inverted ) {
       depressed ^= 1;
     }
 
+    // toggle mode: depressed button is ignored, no need to copy the item
+    if( custom_flags.DIN.button_mode == MBNG_EVENT_BUTTON_MODE_TOGGLE && depressed )
+      return 0;
+
+    MBNG_EVENT_ViewCopy2User(view, &item);
+
+    if( debug_verbose_level >= DEBUG_VERBOSE_LEVEL_INFO ) {
+      MBNG_EVENT_ItemPrint(&item, 0);
+    }
+
     // toggle mode?
     if( item.custom_flags.DIN.button_mode == MBNG_EVENT_BUTTON_MODE_TOGGLE ) {
-      if( depressed )
-	return 0;
-
       if( MBNG_EVENT_MapItemValueInc(item.map, &item, 1, 1) < 0 ) {
 	if( item.min <= item.max ) {
 	  int range = item.max - item.min + 1;
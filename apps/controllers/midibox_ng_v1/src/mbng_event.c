@@ -129,6 +129,19 @@ static u16 event_pool_maps_begin;
 static u16 event_pool_num_items;
 static u16 event_pool_num_maps;
 
+// receive index: pool offsets of all items which can receive MIDI events,
+// grouped by the status byte (first stream byte). Within a group, items
+// which don't depend on the first data byte come first, followed by the
+// items sorted by their first data byte. Both parts are in pool order.
+// The index doesn't take RAM of its own: it's stored in the unused end of the
+// pool, and invalidated whenever the pool grows. If it doesn't fit, the pool
+// is scanned instead.
+#define MBNG_EVENT_RX_BUCKETS_OFFSET (MBNG_EVENT_POOL_MAX_SIZE - (128+1+128)*sizeof(u16))
+static u16 * const event_rx_bucket = (u16 *)&event_pool[MBNG_EVENT_RX_BUCKETS_OFFSET]; // 128+1 entries: first index of each status byte 0x80..0xff
+static u16 * const event_rx_keyed = (u16 *)&event_pool[MBNG_EVENT_RX_BUCKETS_OFFSET + (128+1)*sizeof(u16)]; // 128 entries: first index sorted by data byte
+static u16 *event_rx_index; // below event_rx_bucket
+static u8 event_rx_index_valid; // 0: has to be updated, 1: valid, 2: no space for the index, pool is scanned
+
 // last active event
 mbng_event_item_id_t last_event_item_id;
 
@@ -185,6 +198,9 @@ static u8 lc_meters[LC_METERS_NUM_PORTS][LC_METERS_NUM_ITEMS];
 static s32 MBNG_EVENT_ItemCopy2User(mbng_event_pool_item_t* pool_item, mbng_event_item_t *item);
 static s32 MBNG_EVENT_ItemCopy2Pool(mbng_event_item_t *item, mbng_event_pool_item_t* pool_item);
 
+static s32 MBNG_EVENT_RxIndexUpdate(void);
+static u16 MBNG_EVENT_RxIndexKeySearch(u16 begin, u16 end, u8 key);
+
 static s32 MBNG_EVENT_LCMeters_Update(void);
 static s32 MBNG_EVENT_LCMeters_Set(u8 port_ix, u8 lc_meter_value);
 static s32 MBNG_EVENT_LCMeters_Tick(void);
@@ -370,6 +386,7 @@ s32 MBNG_EVENT_PoolClear(void)
   event_pool_maps_begin = 0;
   event_pool_num_items = 0;
   event_pool_num_maps = 0;
+  event_rx_index_valid = 0;
 
   last_event_item_id = 0;
 
@@ -406,9 +423,171 @@ s32 MBNG_EVENT_PoolUpdate(void)
     pool_ptr += pool_item->len;
   }
 
+  MBNG_EVENT_RxIndexUpdate();
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: returns the first data byte of an item in the receive index
+/////////////////////////////////////////////////////////////////////////////
+static inline u8 MBNG_EVENT_RxIndexKey(u16 offset)
+{
+  mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)&event_pool[offset];
+  return (&pool_item->data_begin)[1];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: returns 0 if the item doesn't receive MIDI events,
+// 1 if it has to be checked on any event with its status byte, and 2 if it
+// only matches on its first data byte
+/////////////////////////////////////////////////////////////////////////////
+static u8 MBNG_EVENT_RxIndexClass(mbng_event_pool_item_t *pool_item)
+{
+  if( !pool_item->len_stream || !(pool_item->data_begin & 0x80) )
+    return 0;
+
+  if( (pool_item->hw_id & 0xf000) == MBNG_EVENT_CONTROLLER_SENDER ) // a sender doesn't receive
+    return 0;
+
+  mbng_event_type_t event_type = ((mbng_event_flags_t)pool_item->flags).type;
+  if( event_type <= MBNG_EVENT_TYPE_CC ) {
+    if( pool_item->len_stream < 2 || pool_item->flags.use_any_key_or_cc )
+      return 1;
+
+    // button/led matrices receive a range of data bytes
+    u16 controller = pool_item->hw_id & 0xf000;
+    if( controller == MBNG_EVENT_CONTROLLER_BUTTON_MATRIX || controller == MBNG_EVENT_CONTROLLER_LED_MATRIX )
+      return 1;
+
+    return 2;
+  }
+
+  if( event_type <= MBNG_EVENT_TYPE_PITCHBEND ||
+      event_type == MBNG_EVENT_TYPE_NRPN ||
+      (event_type >= MBNG_EVENT_TYPE_CLOCK && event_type <= MBNG_EVENT_TYPE_CONT) )
+    return 1;
+
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: returns everything which determines the place of an item
+// in the receive index (apart from its offset in the pool)
+/////////////////////////////////////////////////////////////////////////////
+static u32 MBNG_EVENT_RxIndexSortKey(mbng_event_pool_item_t *pool_item)
+{
+  u8 rx_class = MBNG_EVENT_RxIndexClass(pool_item);
+  if( !rx_class )
+    return 0;
+
+  u8 key = (rx_class == 2) ? (&pool_item->data_begin)[1] : 0;
+  return ((u32)rx_class << 16) | ((u32)pool_item->data_begin << 8) | key;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: (re)creates the receive index of the event pool
+/////////////////////////////////////////////////////////////////////////////
+static s32 MBNG_EVENT_RxIndexUpdate(void)
+{
+  u32 i;
+  u8 *pool_ptr;
+
+  if( event_pool_size > MBNG_EVENT_RX_BUCKETS_OFFSET ) {
+    event_rx_index_valid = 2;
+    return -1; // no space for the index
+  }
+
+  // count the items of each status byte
+  memset(event_rx_bucket, 0, (128+1)*sizeof(u16));
+  memset(event_rx_keyed, 0, 128*sizeof(u16));
+  pool_ptr = (u8 *)&event_pool[0];
+  for(i=0; i<event_pool_num_items; ++i) {
+    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
+    u8 rx_class = MBNG_EVENT_RxIndexClass(pool_item);
+    if( rx_class ) {
+      u8 bucket = pool_item->data_begin & 0x7f;
+      ++event_rx_bucket[bucket+1];
+      if( rx_class == 1 )
+	++event_rx_keyed[bucket]; // temporary: number of items which don't depend on the data byte
+    }
+    pool_ptr += pool_item->len;
+  }
+
+  for(i=0; i<128; ++i)
+    event_rx_bucket[i+1] += event_rx_bucket[i];
+
+  if( (u32)event_pool_size + event_rx_bucket[128]*sizeof(u16) > MBNG_EVENT_RX_BUCKETS_OFFSET ) {
+    event_rx_index_valid = 2;
+    return -1; // no space for the index
+  }
+  event_rx_index = event_rx_bucket - event_rx_bucket[128];
+
+  for(i=0; i<128; ++i)
+    event_rx_keyed[i] += event_rx_bucket[i];
+
+  // fill the index in pool order, the bucket tables are used as write positions:
+  // event_rx_bucket for the items which don't depend on the data byte...
+  pool_ptr = (u8 *)&event_pool[0];
+  for(i=0; i<event_pool_num_items; ++i) {
+    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
+    if( MBNG_EVENT_RxIndexClass(pool_item) == 1 ) {
+      u8 bucket = pool_item->data_begin & 0x7f;
+      event_rx_index[event_rx_bucket[bucket]++] = (u16)(pool_ptr - (u8 *)&event_pool[0]);
+    }
+    pool_ptr += pool_item->len;
+  }
+
+  // ...which moves it to the begin of the sorted part, and event_rx_keyed for these
+  pool_ptr = (u8 *)&event_pool[0];
+  for(i=0; i<event_pool_num_items; ++i) {
+    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
+    if( MBNG_EVENT_RxIndexClass(pool_item) == 2 ) {
+      // insertion sort by data byte, stable so that the pool order is kept
+      u8 bucket = pool_item->data_begin & 0x7f;
+      u16 ix = event_rx_keyed[bucket]++;
+      u8 key = (&pool_item->data_begin)[1];
+      while( ix > event_rx_bucket[bucket] && MBNG_EVENT_RxIndexKey(event_rx_index[ix-1]) > key ) {
+	event_rx_index[ix] = event_rx_index[ix-1];
+	--ix;
+      }
+      event_rx_index[ix] = (u16)(pool_ptr - (u8 *)&event_pool[0]);
+    }
+    pool_ptr += pool_item->len;
+  }
+
+  // now event_rx_bucket contains the begin of the sorted parts, and
+  // event_rx_keyed the ends of the status bytes: move them back
+  for(i=128; i>0; --i) {
+    u16 bucket_end = event_rx_keyed[i-1];
+    event_rx_keyed[i-1] = event_rx_bucket[i-1];
+    event_rx_bucket[i] = bucket_end;
+  }
+  event_rx_bucket[0] = 0;
+
+  event_rx_index_valid = 1;
+
   return 0; // no error
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Local function: returns the first index between begin and end which
+// is sorted under a data byte >= key
+/////////////////////////////////////////////////////////////////////////////
+static u16 MBNG_EVENT_RxIndexKeySearch(u16 begin, u16 end, u8 key)
+{
+  while( begin < end ) {
+    u16 mid = begin + (end - begin) / 2;
+    if( MBNG_EVENT_RxIndexKey(event_rx_index[mid]) < key )
+      begin = mid + 1;
+    else
+      end = mid;
+  }
+
+  return begin;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //! Sends the event pool to debug terminal
@@ -549,6 +728,7 @@ s32 MBNG_EVENT_MapAdd(u8 map, mbng_event_map_type_t map_type, u8 *map_values, u1
   memcpy(pool_ptr, (u8 *)map_values, len);
 
   event_pool_size += len + 4;
+  event_rx_index_valid = 0; // might have overwritten the receive index
 
   return 0; // no error
 }
@@ -1426,6 +1606,7 @@ s32 MBNG_EVENT_ItemAdd(mbng_event_item_t *item)
   event_pool_size += pool_item->len;
   ++event_pool_num_items;
   event_pool_maps_begin += pool_item_len;
+  event_rx_index_valid = 0;
 
   return 0; // no error
 }
@@ -1452,6 +1633,9 @@ s32 MBNG_EVENT_ItemModify(mbng_event_item_t *item)
 	return -2; // out of storage 
 
       if( len_diff != 0 ) {
+	// offsets of the following items change
+	event_rx_index_valid = 0;
+
 	// make room
 	u8 *old_next_pool_item = (u8 *)((u32)pool_item + pool_item->len);
 	u8 *new_next_pool_item = (u8 *)((u32)pool_item + pool_item_len);
@@ -1482,7 +1666,11 @@ s32 MBNG_EVENT_ItemModify(mbng_event_item_t *item)
 	event_pool_maps_begin += len_diff;
       } else {
 	// no size change - copy new item directly into pool
+	// the receive index only has to be updated if the item has to be sorted in differently
+	u32 rx_sort_key = MBNG_EVENT_RxIndexSortKey(pool_item);
 	MBNG_EVENT_ItemCopy2Pool(item, pool_item);
+	if( MBNG_EVENT_RxIndexSortKey(pool_item) != rx_sort_key )
+	  event_rx_index_valid = 0;
       }
 
       return 0; // operation was successfull
@@ -1542,39 +1730,13 @@ s32 MBNG_EVENT_ItemSearchById(mbng_event_item_id_t id, mbng_event_item_id_t id_e
 /////////////////////////////////////////////////////////////////////////////
 s32 MBNG_EVENT_ItemSearchByHwId(mbng_event_item_id_t hw_id, mbng_event_item_id_t hw_id_end_range, mbng_event_item_t *item, u32 *continue_ix)
 {
-  u8 *pool_ptr = (u8 *)&event_pool[0];
-  u32 i = 0;
-
-  if( *continue_ix ) {
-    // lower half: pointer offset to pool item
-    // upper half: index of pool item
-    pool_ptr += (*continue_ix & 0xffff);
-    i = *continue_ix >> 16;
-  }
-
-  for(; i<event_pool_num_items; ++i) {
-    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
-
-    if( pool_item->flags.active &&
-        ((!hw_id_end_range && pool_item->hw_id == hw_id) ||
-         (hw_id_end_range && pool_item->hw_id >= hw_id && pool_item->hw_id <= hw_id_end_range)) ) {
-      MBNG_EVENT_ItemCopy2User(pool_item, item);
+  mbng_event_view_t view;
 
-      // pass pointer offset to pool item + index of pool item in continue_ix for continued search
-      // skip this if the new values exceeding the 16bit boundary, or if this is the last pool item
-      u32 next_pool_offset = (u32)pool_ptr - (u32)event_pool + pool_item->len;
-      u32 next_pool_i = i + 1;
-      if( next_pool_i > 65535 || next_pool_i >= event_pool_num_items || next_pool_offset > 65535 )
-	*continue_ix = 0;
-      else
-	*continue_ix = (next_pool_i << 16) | next_pool_offset;
-
-      return 0; // item found
-    }
-    pool_ptr += pool_item->len;
-  }
+  if( MBNG_EVENT_ViewSearchByHwId(hw_id, hw_id_end_range, &view, continue_ix) < 0 )
+    return -1; // not found
 
-  return -1; // not found
+  MBNG_EVENT_ItemCopy2User((mbng_event_pool_item_t *)&event_pool[view], item);
+  return 0; // item found
 }
 
 
@@ -1637,6 +1799,159 @@ s32 MBNG_EVENT_ItemCopyValueToPool(mbng_event_item_t *item)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Item views: the functions below access pool items in place. They are
+// intended for timing critical code which only needs a few item fields
+// and would otherwise copy the complete item with MBNG_EVENT_ItemSearch*()
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: returns the pool item of a view
+/////////////////////////////////////////////////////////////////////////////
+static inline mbng_event_pool_item_t *MBNG_EVENT_ViewPoolItem(mbng_event_view_t view)
+{
+  return (mbng_event_pool_item_t *)&event_pool[view];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! Search an active item in event pool based on hardware ID (optional within
+//! a range if hw_id_end_range != 0) like MBNG_EVENT_ItemSearchByHwId(), but
+//! without copying the item
+//! \returns 0 and the view of the item in *view if found
+//! \returns -1 if item not found
+/////////////////////////////////////////////////////////////////////////////
+s32 MBNG_EVENT_ViewSearchByHwId(mbng_event_item_id_t hw_id, mbng_event_item_id_t hw_id_end_range, mbng_event_view_t *view, u32 *continue_ix)
+{
+  u8 *pool_ptr = (u8 *)&event_pool[0];
+  u32 i = 0;
+
+  if( *continue_ix ) {
+    // lower half: pointer offset to pool item
+    // upper half: index of pool item
+    pool_ptr += (*continue_ix & 0xffff);
+    i = *continue_ix >> 16;
+  }
+
+  for(; i<event_pool_num_items; ++i) {
+    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
+
+    if( pool_item->flags.active &&
+        ((!hw_id_end_range && pool_item->hw_id == hw_id) ||
+         (hw_id_end_range && pool_item->hw_id >= hw_id && pool_item->hw_id <= hw_id_end_range)) ) {
+      *view = (mbng_event_view_t)((u32)pool_ptr - (u32)event_pool);
+
+      // pass pointer offset to pool item + index of pool item in continue_ix for continued search
+      // skip this if the new values exceeding the 16bit boundary, or if this is the last pool item
+      u32 next_pool_offset = (u32)pool_ptr - (u32)event_pool + pool_item->len;
+      u32 next_pool_i = i + 1;
+      if( next_pool_i > 65535 || next_pool_i >= event_pool_num_items || next_pool_offset > 65535 )
+	*continue_ix = 0;
+      else
+	*continue_ix = (next_pool_i << 16) | next_pool_offset;
+
+      return 0; // item found
+    }
+    pool_ptr += pool_item->len;
+  }
+
+  return -1; // not found
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! Copies the viewed item into *item if all parameters are required
+/////////////////////////////////////////////////////////////////////////////
+s32 MBNG_EVENT_ViewCopy2User(mbng_event_view_t view, mbng_event_item_t *item)
+{
+  return MBNG_EVENT_ItemCopy2User(MBNG_EVENT_ViewPoolItem(view), item);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! Typed accessors to the viewed item
+/////////////////////////////////////////////////////////////////////////////
+mbng_event_item_id_t MBNG_EVENT_ViewIdGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->id;
+}
+
+mbng_event_item_id_t MBNG_EVENT_ViewHwIdGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->hw_id;
+}
+
+mbng_event_flags_t MBNG_EVENT_ViewFlagsGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->flags;
+}
+
+mbng_event_custom_flags_t MBNG_EVENT_ViewCustomFlagsGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->custom_flags;
+}
+
+u8 *MBNG_EVENT_ViewStreamGet(mbng_event_view_t view, u8 *stream_size)
+{
+  mbng_event_pool_item_t *pool_item = MBNG_EVENT_ViewPoolItem(view);
+  *stream_size = pool_item->len_stream;
+  return pool_item->len_stream ? (u8 *)&pool_item->data_begin : NULL;
+}
+
+u16 MBNG_EVENT_ViewValueGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->value;
+}
+
+s32 MBNG_EVENT_ViewValueSet(mbng_event_view_t view, u16 value)
+{
+  mbng_event_pool_item_t *pool_item = MBNG_EVENT_ViewPoolItem(view);
+  pool_item->value = value;
+  pool_item->flags.value_from_midi = 0;
+  return 0; // no error
+}
+
+u8 MBNG_EVENT_ViewSecondaryValueGet(mbng_event_view_t view)
+{
+  return MBNG_EVENT_ViewPoolItem(view)->secondary_value;
+}
+
+s32 MBNG_EVENT_ViewSecondaryValueSet(mbng_event_view_t view, u8 secondary_value)
+{
+  MBNG_EVENT_ViewPoolItem(view)->secondary_value = secondary_value;
+  return 0; // no error
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! Same as MBNG_EVENT_ItemReceive() for a viewed item.\n
+//! Write locked and inactive items (e.g. of other banks) are handled in
+//! place, only items which have to notify their controller are copied.
+//! \param[in] secondary_value the new secondary value, or -1 to keep the
+//!             value which is stored in the pool
+//! \returns same values like MBNG_EVENT_ItemReceive()
+/////////////////////////////////////////////////////////////////////////////
+s32 MBNG_EVENT_ViewReceive(mbng_event_view_t view, u16 value, s16 secondary_value, u8 from_midi, u8 fwd_enabled)
+{
+  mbng_event_pool_item_t *pool_item = MBNG_EVENT_ViewPoolItem(view);
+
+  // write operation locked?
+  if( from_midi && pool_item->flags.write_locked )
+    return 0; // stop here
+
+  // inactive item without map: only take over the value
+  if( !pool_item->flags.active && !pool_item->extra_par_available.has_map ) {
+    pool_item->value = value;
+    if( secondary_value >= 0 && pool_item->flags.use_key_or_cc ) // only change secondary value if key_or_cc option selected
+      pool_item->secondary_value = secondary_value;
+    pool_item->flags.value_from_midi = from_midi;
+    return 0; // stop here
+  }
+
+  mbng_event_item_t item;
+  MBNG_EVENT_ItemCopy2User(pool_item, &item);
+  if( secondary_value >= 0 )
+    item.secondary_value = secondary_value;
+  return MBNG_EVENT_ItemReceive(&item, value, from_midi, fwd_enabled);
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! activates/deactivates an event (like bank mechanism)
 /////////////////////////////////////////////////////////////////////////////
@@ -4470,6 +4785,100 @@ s32 MBNG_EVENT_Dump(void)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Local function: checks a pool item against a received MIDI event and
+// forwards it to MBNG_EVENT_ItemReceive() if matching
+/////////////////////////////////////////////////////////////////////////////
+static s32 MBNG_EVENT_MIDI_ReceivePoolItem(mbng_event_pool_item_t *pool_item, u32 port_mask, mios32_midi_package_t midi_package, u16 nrpn_address, u16 nrpn_value, u8 nrpn_msb_only)
+{
+  u8 evnt0 = midi_package.evnt0;
+  u8 evnt1 = midi_package.evnt1;
+  mbng_event_view_t view = (mbng_event_view_t)((u32)pool_item - (u32)event_pool);
+
+  if( pool_item->data_begin == evnt0 && pool_item->len_stream ) { // timing critical
+    // first byte is matching - now we've a bit more time for checking
+
+    if( (pool_item->hw_id & 0xf000) == MBNG_EVENT_CONTROLLER_SENDER ) { // a sender doesn't receive
+      return 0;
+    }
+
+    if( !(pool_item->enabled_ports & port_mask) ) { // port not enabled
+      return 0;
+    }
+
+    mbng_event_type_t event_type = ((mbng_event_flags_t)pool_item->flags).type;
+    if( event_type <= MBNG_EVENT_TYPE_CC ) {
+      u8 *stream = &pool_item->data_begin;
+      if( pool_item->flags.use_any_key_or_cc || stream[1] == evnt1 ) { // || pool_item->secondary_value >= 128 || evnt1 == pool_item->secondary_value ) {
+	if( pool_item->flags.use_key_or_cc ) {
+	  MBNG_EVENT_ViewReceive(view, midi_package.evnt1, midi_package.value, 1, 1);
+	} else {
+	  MBNG_EVENT_ViewReceive(view, midi_package.value, midi_package.evnt1, 1, 1);
+	}
+      } else {
+	// EXTRA for button/led matrices
+	int matrix = (pool_item->hw_id & 0x0fff) - 1;
+	int num_pins = -1;
+
+	switch( pool_item->hw_id & 0xf000 ) {
+	case MBNG_EVENT_CONTROLLER_BUTTON_MATRIX: {
+	  if( matrix >= 0 && matrix < MBNG_PATCH_NUM_MATRIX_DIN ) {
+	    mbng_patch_matrix_din_entry_t *m = (mbng_patch_matrix_din_entry_t *)&mbng_patch_matrix_din[matrix];
+
+	    if( m->sr_din1 ) {
+	      u8 row_size = m->sr_din2 ? 16 : 8;
+	      num_pins = row_size * row_size;
+	    }
+	  }
+	} break;
+	case MBNG_EVENT_CONTROLLER_LED_MATRIX: {
+	  if( matrix >= 0 && matrix < MBNG_PATCH_NUM_MATRIX_DOUT ) {
+	    mbng_patch_matrix_dout_entry_t *m = (mbng_patch_matrix_dout_entry_t *)&mbng_patch_matrix_dout[matrix];
+
+	    if( m->sr_dout_r1 && !pool_item->flags.led_matrix_pattern ) {
+	      u8 row_size = m->sr_dout_r2 ? 16 : 8; // we assume that the same condition is valid for dout_g2 and dout_b2
+	      num_pins = row_size * row_size;
+	    }
+	  }
+	} break;
+	}
+
+	if( num_pins >= 0 ) {
+	  int first_evnt1 = stream[1];
+	  if( evnt1 >= first_evnt1 && evnt1 < (first_evnt1 + num_pins) ) {
+	    mbng_event_item_t item;
+	    MBNG_EVENT_ItemCopy2User(pool_item, &item);
+	    item.matrix_pin = evnt1 - first_evnt1;
+	    MBNG_EVENT_ItemReceive(&item, midi_package.value, 1, 1);
+	  }
+	}
+      }
+    } else if( event_type <= MBNG_EVENT_TYPE_AFTERTOUCH ) {
+      MBNG_EVENT_ViewReceive(view, evnt1, -1, 1, 1);
+    } else if( event_type == MBNG_EVENT_TYPE_PITCHBEND ) {
+      MBNG_EVENT_ViewReceive(view, evnt1 | ((u16)midi_package.value << 7), -1, 1, 1);
+    } else if( event_type == MBNG_EVENT_TYPE_NRPN ) {
+      u8 *stream = &pool_item->data_begin;
+      u16 expected_address = stream[1] | ((u16)stream[2] << 7);
+      mbng_event_nrpn_format_t nrpn_format = stream[3];
+      if( nrpn_address == expected_address &&
+	  (!nrpn_msb_only || nrpn_format == MBNG_EVENT_NRPN_FORMAT_MSB_ONLY) ) {
+	if( nrpn_format == MBNG_EVENT_NRPN_FORMAT_MSB_ONLY )
+	  MBNG_EVENT_ViewReceive(view, nrpn_value / 128, -1, 1, 1);
+	else
+	  MBNG_EVENT_ViewReceive(view, nrpn_value, -1, 1, 1);
+      }
+    } else if( event_type >= MBNG_EVENT_TYPE_CLOCK && event_type <= MBNG_EVENT_TYPE_CONT ) {
+      MBNG_EVENT_ViewReceive(view, 0, -1, 1, 1);
+    } else {
+      // no additional event types yet...
+    }
+  }
+
+  return 0; // no error
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! This function should be called from APP_MIDI_NotifyPackage whenver a new
 //! MIDI event has been received
@@ -4664,107 +5073,51 @@ s32 MBNG_EVENT_MIDI_NotifyPackage(mios32_midi_port_t port, mios32_midi_package_t
   }
 
   // search in pool for matching events
-  u8 evnt0 = midi_package.evnt0;
-  u8 evnt1 = midi_package.evnt1;
-  u8 *pool_ptr = (u8 *)&event_pool[0];
-  u32 i;
-  for(i=0; i<event_pool_num_items; ++i) {
-    mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
-    if( pool_item->data_begin == evnt0 && pool_item->len_stream ) { // timing critical
-      // first byte is matching - now we've a bit more time for checking
-      
-      if( (pool_item->hw_id & 0xf000) == MBNG_EVENT_CONTROLLER_SENDER ) { // a sender doesn't receive
-	pool_ptr += pool_item->len;
-	continue;
+  if( !event_rx_index_valid )
+    MBNG_EVENT_RxIndexUpdate();
+
+  if( event_rx_index_valid == 1 ) {
+    // only the items which are listed for the status byte are checked:
+    // items which don't depend on the first data byte, and items which are
+    // stored under the received data byte. Both lists are sorted by pool
+    // offset, they are merged to keep the pool order
+    u8 evnt0 = midi_package.evnt0;
+    u8 evnt1 = midi_package.evnt1;
+    if( !(evnt0 & 0x80) )
+      return 0; // no status byte
+
+    u8 bucket = evnt0 & 0x7f;
+    u16 any_ix = event_rx_bucket[bucket];
+    u16 any_end = event_rx_keyed[bucket];
+    u16 key_ix = MBNG_EVENT_RxIndexKeySearch(event_rx_keyed[bucket], event_rx_bucket[bucket+1], evnt1);
+    u16 key_end = event_rx_bucket[bucket+1];
+    if( key_ix < key_end && MBNG_EVENT_RxIndexKey(event_rx_index[key_ix]) != evnt1 )
+      key_ix = key_end; // no item for this data byte
+
+    while( any_ix < any_end || key_ix < key_end ) {
+      u16 offset;
+      if( key_ix >= key_end || (any_ix < any_end && event_rx_index[any_ix] < event_rx_index[key_ix]) ) {
+	offset = event_rx_index[any_ix++];
+      } else {
+	offset = event_rx_index[key_ix++];
+	if( key_ix < key_end && MBNG_EVENT_RxIndexKey(event_rx_index[key_ix]) != evnt1 )
+	  key_end = key_ix; // end of run
       }
 
-      if( !(pool_item->enabled_ports & port_mask) ) { // port not enabled
-	pool_ptr += pool_item->len;
-	continue;
-      }
+      MBNG_EVENT_MIDI_ReceivePoolItem((mbng_event_pool_item_t *)&event_pool[offset], port_mask, midi_package, nrpn_address, nrpn_value, nrpn_msb_only);
 
-      mbng_event_type_t event_type = ((mbng_event_flags_t)pool_item->flags).type;
-      if( event_type <= MBNG_EVENT_TYPE_CC ) {
-	u8 *stream = &pool_item->data_begin;
-	if( pool_item->flags.use_any_key_or_cc || stream[1] == evnt1 ) { // || pool_item->secondary_value >= 128 || evnt1 == pool_item->secondary_value ) {
-	  mbng_event_item_t item;
-	  MBNG_EVENT_ItemCopy2User(pool_item, &item);
-	  if( item.flags.use_key_or_cc ) {
-	    item.secondary_value = midi_package.value;
-	    MBNG_EVENT_ItemReceive(&item, midi_package.evnt1, 1, 1);
-	  } else {
-	    item.secondary_value = midi_package.evnt1;
-	    MBNG_EVENT_ItemReceive(&item, midi_package.value, 1, 1);
-	  }
-	} else {
-	  // EXTRA for button/led matrices
-	  int matrix = (pool_item->hw_id & 0x0fff) - 1;
-	  int num_pins = -1;
-
-	  switch( pool_item->hw_id & 0xf000 ) {
-	  case MBNG_EVENT_CONTROLLER_BUTTON_MATRIX: {
-	    if( matrix >= 0 && matrix < MBNG_PATCH_NUM_MATRIX_DIN ) {
-	      mbng_patch_matrix_din_entry_t *m = (mbng_patch_matrix_din_entry_t *)&mbng_patch_matrix_din[matrix];
-
-	      if( m->sr_din1 ) {
-		u8 row_size = m->sr_din2 ? 16 : 8;
-		num_pins = row_size * row_size;
-	      }
-	    }
-	  } break;
-	  case MBNG_EVENT_CONTROLLER_LED_MATRIX: {
-	    if( matrix >= 0 && matrix < MBNG_PATCH_NUM_MATRIX_DOUT ) {
-	      mbng_patch_matrix_dout_entry_t *m = (mbng_patch_matrix_dout_entry_t *)&mbng_patch_matrix_dout[matrix];
-
-	      if( m->sr_dout_r1 && !pool_item->flags.led_matrix_pattern ) {
-		u8 row_size = m->sr_dout_r2 ? 16 : 8; // we assume that the same condition is valid for dout_g2 and dout_b2
-		num_pins = row_size * row_size;
-	      }
-	    }
-	  } break;
-	  }
-
-	  if( num_pins >= 0 ) {
-	    int first_evnt1 = stream[1];
-	    if( evnt1 >= first_evnt1 && evnt1 < (first_evnt1 + num_pins) ) {
-	      mbng_event_item_t item;
-	      MBNG_EVENT_ItemCopy2User(pool_item, &item);
-	      item.matrix_pin = evnt1 - first_evnt1;
-	      MBNG_EVENT_ItemReceive(&item, midi_package.value, 1, 1);
-	    }
-	  }
-	}
-      } else if( event_type <= MBNG_EVENT_TYPE_AFTERTOUCH ) {
-	mbng_event_item_t item;
-	MBNG_EVENT_ItemCopy2User(pool_item, &item);
-	MBNG_EVENT_ItemReceive(&item, evnt1, 1, 1);
-      } else if( event_type == MBNG_EVENT_TYPE_PITCHBEND ) {
-	mbng_event_item_t item;
-	MBNG_EVENT_ItemCopy2User(pool_item, &item);
-	MBNG_EVENT_ItemReceive(&item, evnt1 | ((u16)midi_package.value << 7), 1, 1);
-      } else if( event_type == MBNG_EVENT_TYPE_NRPN ) {
-	u8 *stream = &pool_item->data_begin;
-	u16 expected_address = stream[1] | ((u16)stream[2] << 7);
-	mbng_event_nrpn_format_t nrpn_format = stream[3];
-	if( nrpn_address == expected_address &&
-	    (!nrpn_msb_only || nrpn_format == MBNG_EVENT_NRPN_FORMAT_MSB_ONLY) ) {
-	  mbng_event_item_t item;
-	  MBNG_EVENT_ItemCopy2User(pool_item, &item);
-
-	  if( nrpn_format == MBNG_EVENT_NRPN_FORMAT_MSB_ONLY )
-	    MBNG_EVENT_ItemReceive(&item, nrpn_value / 128, 1, 1);
-	  else
-	    MBNG_EVENT_ItemReceive(&item, nrpn_value, 1, 1);
-	}
-      } else if( event_type >= MBNG_EVENT_TYPE_CLOCK && event_type <= MBNG_EVENT_TYPE_CONT ) {
-	mbng_event_item_t item;
-	MBNG_EVENT_ItemCopy2User(pool_item, &item);
-	MBNG_EVENT_ItemReceive(&item, 0, 1, 1);
-      } else {
-	// no additional event types yet...
-      }
+      if( !event_rx_index_valid )
+	break; // pool has been modified by the event
+    }
+  } else {
+    // index couldn't be created: scan the whole pool
+    u8 *pool_ptr = (u8 *)&event_pool[0];
+    u32 i;
+    for(i=0; i<event_pool_num_items; ++i) {
+      mbng_event_pool_item_t *pool_item = (mbng_event_pool_item_t *)pool_ptr;
+      MBNG_EVENT_MIDI_ReceivePoolItem(pool_item, port_mask, midi_package, nrpn_address, nrpn_value, nrpn_msb_only);
+      pool_ptr += pool_item->len;
     }
-    pool_ptr += pool_item->len;
   }
 
   return 0; // no error
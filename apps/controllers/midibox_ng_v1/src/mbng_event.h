@@ -406,6 +406,11 @@ typedef struct {
   char *label;
 } mbng_event_item_t;
 
+// pool address of an item, it allows to access the item in place without
+// copying it into a mbng_event_item_t (see MBNG_EVENT_View* functions).
+// Only valid until the pool is modified (MBNG_EVENT_ItemAdd/Modify, PoolClear)
+typedef u16 mbng_event_view_t;
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Prototypes
@@ -448,6 +453,19 @@ extern s32 MBNG_EVENT_ItemSearchById(mbng_event_item_id_t id, mbng_event_item_id
 extern s32 MBNG_EVENT_ItemSearchByHwId(mbng_event_item_id_t hw_id, mbng_event_item_id_t hw_id_end_range, mbng_event_item_t *item, u32 *continue_ix);
 extern s32 MBNG_EVENT_ItemRetrieveValues(mbng_event_item_id_t *id, s16 *value, u8 *secondary_value, u32 *continue_ix);
 extern s32 MBNG_EVENT_ItemCopyValueToPool(mbng_event_item_t *item);
+
+extern s32 MBNG_EVENT_ViewSearchByHwId(mbng_event_item_id_t hw_id, mbng_event_item_id_t hw_id_end_range, mbng_event_view_t *view, u32 *continue_ix);
+extern s32 MBNG_EVENT_ViewCopy2User(mbng_event_view_t view, mbng_event_item_t *item);
+extern mbng_event_item_id_t MBNG_EVENT_ViewIdGet(mbng_event_view_t view);
+extern mbng_event_item_id_t MBNG_EVENT_ViewHwIdGet(mbng_event_view_t view);
+extern mbng_event_flags_t MBNG_EVENT_ViewFlagsGet(mbng_event_view_t view);
+extern mbng_event_custom_flags_t MBNG_EVENT_ViewCustomFlagsGet(mbng_event_view_t view);
+extern u8 *MBNG_EVENT_ViewStreamGet(mbng_event_view_t view, u8 *stream_size);
+extern u16 MBNG_EVENT_ViewValueGet(mbng_event_view_t view);
+extern s32 MBNG_EVENT_ViewValueSet(mbng_event_view_t view, u16 value);
+extern u8 MBNG_EVENT_ViewSecondaryValueGet(mbng_event_view_t view);
+extern s32 MBNG_EVENT_ViewSecondaryValueSet(mbng_event_view_t view, u8 secondary_value);
+extern s32 MBNG_EVENT_ViewReceive(mbng_event_view_t view, u16 value, s16 secondary_value, u8 from_midi, u8 fwd_enabled);
 extern s32 MBNG_EVENT_ItemSetLock(mbng_event_item_t *item, u8 lock);
 extern s32 MBNG_EVENT_ItemSetActive(mbng_event_item_t *item, u8 active);
 extern s32 MBNG_EVENT_ItemSetNoDump(mbng_event_item_t *item, u8 no_dump);
@@ -63,10 +63,12 @@ s32 MBNG_RGBLED_Periodic_1mS(void)
     if( ++ctr >= 360 )
       ctr = 0;
 
+    // integer HSV conversion: avoids floating point maths for each LED
     int led;
-    float h = ctr;
+    u32 h = ctr;
+    u8 v = (rainbow_brightness * 255 + 50) / 100;
     for(led=0; led<WS2812_NUM_LEDS; ++led) {
-      WS2812_LED_SetHSV(led, h, 1, (float)rainbow_brightness / 100.0);
+      WS2812_LED_SetHSVi(led, (h * WS2812_HUE_RANGE) / 360, 255, v);
       h += rainbow_speed;
       if( h >= 360 ) h -= 360;
     }
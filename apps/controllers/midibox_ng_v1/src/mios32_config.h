@@ -90,6 +90,9 @@
 // enable two AINSER modules
 #define AINSER_NUM_MODULES 2
 
+// enable the capture mode of the MIDI monitor (256 events, 3 kB RAM)
+#define MIDIMON_CAPTURE_SIZE 256
+
 // enable 32 AOUT channels
 #define AOUT_NUM_CHANNELS 32
 // configurable chip select pin
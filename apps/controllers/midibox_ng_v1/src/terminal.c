@@ -22,6 +22,7 @@
 #include <midi_port.h>
 #include <midi_router.h>
 #include <midimon.h>
+#include <midimon_capture.h>
 #include <keyboard.h>
 #include <aout.h>
 #include <file.h>
@@ -75,6 +76,7 @@ static s16 ngr_value;
 static s32 TERMINAL_ParseFilebrowser(mios32_midi_port_t port, char byte);
 
 static s32 TERMINAL_BrowserUploadCallback(char *filename);
+static s32 TERMINAL_MidimonExport(char *filename);
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -246,6 +248,29 @@ static s32 TERMINAL_BrowserUploadCallback(char *filename)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//! Exports the MIDI monitor capture as Standard MIDI File
+/////////////////////////////////////////////////////////////////////////////
+static s32 TERMINAL_MidimonExport(char *filename)
+{
+  char filepath[20];
+  sprintf(filepath, "/%s.MID", filename);
+
+  s32 status;
+  MUTEX_SDCARD_TAKE;
+  if( (status=FILE_WriteOpen(filepath, 1)) >= 0 ) {
+    status = MIDIMON_CAPTURE_ExportSmf(0, FILE_WriteBuffer);
+    if( FILE_WriteClose() < 0 && status >= 0 )
+      status = -3;
+  } else {
+    FILE_WriteClose(); // important to free memory given by malloc
+  }
+  MUTEX_SDCARD_GIVE;
+
+  return status;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! Parser for a complete line - also used by shell.c for telnet
 /////////////////////////////////////////////////////////////////////////////
@@ -301,6 +326,7 @@ s32 TERMINAL_ParseLine(char *input, void *_output_function)
       out("  save <name>:                      stores current config on SD Card");
       out("  load <name>:                      restores config from SD Card");
       out("  save_ngk <name>:                  only store keyboard calibration data");
+      out("  midimon_export <name>:            stores the MIDI monitor capture as .MID file");
       out("  show file:                        shows the current configuration file");
       out("  show pool:                        shows the items of the event pool");
       out("  show poolbin:                     shows the event pool in binary format");
@@ -500,6 +526,23 @@ s32 TERMINAL_ParseLine(char *input, void *_output_function)
           }
         }
       }
+    } else if( strcmp(parameter, "midimon_export") == 0 ) {
+      if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
+	out("ERROR: please specify filename for capture (up to 8 characters)!");
+      } else {
+	if( strlen(parameter) > 8 ) {
+	  out("ERROR: 8 characters maximum!");
+	} else if( MIDIMON_CAPTURE_StateGet() != MIDIMON_CAPTURE_STATE_STOPPED ) {
+	  out("ERROR: stop the capture with 'set midimon_capture off' first!");
+	} else {
+	  s32 status = TERMINAL_MidimonExport(parameter);
+	  if( status >= 0 ) {
+	    out("%d captured events stored in '%s.MID' on SD Card!", status, parameter);
+	  } else {
+	    out("ERROR: failed to store capture '%s.MID' on SD Card (status %d)!", parameter, status);
+	  }
+	}
+      }
     } else if( strcmp(parameter, "load") == 0 ) {
       if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
 	out("ERROR: please specify filename for patch (up to 8 characters)!");
@@ -208,6 +208,15 @@ void APP_Init(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_Background(void)
 {
+#if MIDIMON_CAPTURE_SIZE > 0
+  // format events captured by the MIDI monitor
+  // APP_Background runs in the idle hook which mustn't block: skipped while
+  // another task owns the MIDI OUT mutex, the events stay in the capture ring
+  if( xMIDIOUTSemaphore && xSemaphoreTakeRecursive(xMIDIOUTSemaphore, 0) == pdTRUE ) {
+    MIDIMON_Handler();
+    MUTEX_MIDIOUT_GIVE;
+  }
+#endif
 }
 
 
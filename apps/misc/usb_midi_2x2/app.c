@@ -94,7 +94,8 @@ void APP_Background(void)
 
   // endless loop
   while( 1 ) {
-    // do nothing
+    // format events captured by the MIDI monitor
+    MIDIMON_Handler();
   }
 }
 
@@ -45,26 +45,21 @@ MbCvVoiceQueue::~MbCvVoiceQueue()
 
 /////////////////////////////////////////////////////////////////////////////
 //  This function initializes the voice queue and the assigned instruments
-//  The queue contains a number for each voice. So long the ASSIGNED flag is 
-//  set, the voice is assigned to an instrument, if bit ASSIGNED is not set, 
-//  the voice can be allocated by a new instrument
+//  Voices are handled by the voice allocator (modules/voice_alloc):
+//  so long a voice is assigned to an instrument, it's in the list of
+//  assigned voices, otherwise it's in the list of free voices which can be
+//  allocated by a new instrument
 // 
-//  The instrument number is stored in the queue as well, it is especially
+//  The instrument number is stored as tag of the voice, it is especially
 //  important for mono voices
 // 
-//  The first voice in the queue is the first which will be taken.
-//  To realize a "drop longest note first" algorithm, the take number should
-//  always be moved to the end of the queue
+//  Free voices are taken first. If no voice is free, the voice which has been
+//  assigned at first will be taken ("drop longest note first")
 /////////////////////////////////////////////////////////////////////////////
 void MbCvVoiceQueue::init(cv_patch_t *patch)
 {
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item) {
-        item->voice = voice;
-        item->ASSIGNED = 0;
-        item->EXCLUSIVE = 0;
-        item->instrument = 0xff; // invalid instrument
-    }
+    // all voices are free, instruments are invalid (VOICE_ALLOC_NONE)
+    VOICE_ALLOC_Init(&voiceAlloc, VOICE_ALLOC_STEAL_OLDEST, voices, CV_SE_NUM_VOICES, NULL);
 
     // initialize exclusive flags
     initExclusive(patch);
@@ -77,25 +72,19 @@ void MbCvVoiceQueue::init(cv_patch_t *patch)
 void MbCvVoiceQueue::initExclusive(cv_patch_t *patch)
 {
     // by default, allow non-exclusive access
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item)
-        item->EXCLUSIVE = 0;
+    exclusiveVoices = 0;
 }
 
 
-// get/release functions
 /////////////////////////////////////////////////////////////////////////////
-// This function searches for a voice which is not allocated, or drops the
-// voice which played the longest note.
-// Note: this function will always return a valid voice, and never a negative
-// result (therefore u8)
+// Returns the voices which are allowed for the instrument depending on the
+// voice assignment (each voice has a dedicated flag)
 /////////////////////////////////////////////////////////////////////////////
-u8 MbCvVoiceQueue::get(u8 instrument, u8 voice_asg, u8 num_voices)
+u32 MbCvVoiceQueue::allowedVoices(u8 instrument, u8 voice_asg, u8 num_voices)
 {
     if( num_voices > CV_SE_NUM_VOICES )
         num_voices = CV_SE_NUM_VOICES;
 
-    // determine allowed voices (each voice has a dedicated flag)
     u32 allowed_voice_mask;
     switch( voice_asg ) {
     case 0: // all voices
@@ -116,43 +105,53 @@ u8 MbCvVoiceQueue::get(u8 instrument, u8 voice_asg, u8 num_voices)
     default: { // dedicated voice
         u8 dedicated_voice = (voice_asg-3) % num_voices; // if mono mode: take left voice
         allowed_voice_mask = (1 << dedicated_voice);
+        return allowed_voice_mask; // exclusive voices can be taken
     }
     }
 
-    // search for voice and allocate it
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item) {
-        if( allowed_voice_mask & (1 << item->voice) &&
-            (!item->EXCLUSIVE || (item->instrument == instrument) || (voice_asg >= 3)) ) {
-            // assign voice and save instrument number
-            item->ASSIGNED = 1;
-            item->EXCLUSIVE = (voice_asg >= 3) ? 1 : 0; // exclusive assignment?
-            item->instrument = instrument;
-
-            // if this isn't already the last voice, put this item to the end of the queue
-            if( voice < (CV_SE_NUM_VOICES-1) ) {
-                mbcv_voice_queue_item_t stored_item = *item;
-                int i;
-                for(i=voice; i<(CV_SE_NUM_VOICES-1); ++i)
-                    queue.item[i] = queue.item[i+1];
-                queue.item[CV_SE_NUM_VOICES-1] = stored_item;
-            }
+    // voices which are exclusively assigned to another instrument can't be taken
+    u32 exclusive = exclusiveVoices & allowed_voice_mask;
+    for(int voice=0; exclusive; ++voice, exclusive >>= 1)
+        if( (exclusive & 1) && voices[voice].tag != instrument )
+            allowed_voice_mask &= ~(1 << voice);
 
-#if DEBUG_VERBOSE_LEVEL >= 2
-            sendDebugMessage(cv);
-#endif
+    return allowed_voice_mask;
+}
 
-            // return with voice number
-            return queue.item[CV_SE_NUM_VOICES-1].voice;
-        }
-    }
 
-    // we should never reach this part!
+// get/release functions
+/////////////////////////////////////////////////////////////////////////////
+// This function takes a voice which is not allocated, or drops the
+// voice which played the longest note.
+// Note: this function will always return a valid voice, and never a negative
+// result (therefore u8)
+/////////////////////////////////////////////////////////////////////////////
+u8 MbCvVoiceQueue::get(u8 instrument, u8 voice_asg, u8 num_voices)
+{
+    u32 allowed_voice_mask = allowedVoices(instrument, voice_asg, num_voices);
+
+    // allocate voice and save instrument number
+    s32 voice = VOICE_ALLOC_Assign(&voiceAlloc, VOICE_ALLOC_NONE, 0x7f, instrument, allowed_voice_mask);
+    if( voice < 0 ) {
+        // we should never reach this part!
 #if DEBUG_VERBOSE_LEVEL >= 1
-    DEBUG_MSG("[VoiceQueueGet] voice not in queue anymore (voice_asg: 0x%02x, allowed_mask: 0x%02x)\n", voice_asg, allowed_voice_mask);
+        DEBUG_MSG("[VoiceQueueGet] no voice available (voice_asg: 0x%02x, allowed_mask: 0x%02x)\n", voice_asg, allowed_voice_mask);
 #endif
+        return 0; // take first voice on this error case
+    }
+
+    // exclusive assignment?
+    if( voice_asg >= 3 )
+        exclusiveVoices |= (1 << voice);
+    else
+        exclusiveVoices &= ~(1 << voice);
 
-    return 0; // take first voice on this error case
+#if DEBUG_VERBOSE_LEVEL >= 2
+    sendDebugMessage();
+#endif
+
+    // return with voice number
+    return voice;
 }
 
 
@@ -164,41 +163,24 @@ u8 MbCvVoiceQueue::get(u8 instrument, u8 voice_asg, u8 num_voices)
 /////////////////////////////////////////////////////////////////////////////
 u8 MbCvVoiceQueue::getLast(u8 instrument, u8 voice_asg, u8 num_voices, u8 search_voice)
 {
-    // search in queue for selected voice
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item)
-        if( item->voice == search_voice ) {
-            // selected voice found
-            // if instrument number not equal, we should get a new voice
-            if( item->instrument != instrument )
-                break;
-            // if number of available voices has changed meanwhile (e.g. Stereo->Mono switch):
-            // check that voice number still < n
-            if( item->voice >= num_voices )
-                break;
-
-            // it's mine!
-
-            // assign voice (again)
-            item->ASSIGNED = 1;
-
-            // if this isn't already the last voice, put this item to the end of the queue
-            if( voice < (CV_SE_NUM_VOICES-1) ) {
-                mbcv_voice_queue_item_t stored_item = *item;
-                int i;
-                for(i=voice; i<(CV_SE_NUM_VOICES-1); ++i)
-                    queue.item[i] = queue.item[i+1];
-                queue.item[CV_SE_NUM_VOICES-1] = stored_item;
-            }
+    // if instrument number not equal, we should get a new voice
+    // if number of available voices has changed meanwhile (e.g. Stereo->Mono switch):
+    // check that voice number still < n
+    if( search_voice < CV_SE_NUM_VOICES &&
+        voices[search_voice].tag == instrument &&
+        search_voice < num_voices ) {
+        // it's mine!
+
+        // assign voice (again)
+        VOICE_ALLOC_Touch(&voiceAlloc, search_voice);
 
 #if DEBUG_VERBOSE_LEVEL >= 2
-            sendDebugMessage(cv);
+        sendDebugMessage();
 #endif
 
-            // return with voice number
-            return queue.item[CV_SE_NUM_VOICES-1].voice;
-
-        }
+        // return with voice number
+        return search_voice;
+    }
 
     // voice not found, continue at get()
     return get(instrument, voice_asg, num_voices);
@@ -212,26 +194,19 @@ u8 MbCvVoiceQueue::getLast(u8 instrument, u8 voice_asg, u8 num_voices, u8 search
 /////////////////////////////////////////////////////////////////////////////
 u8 MbCvVoiceQueue::release(u8 release_voice)
 {
-    // search in voice queue for the voice
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item)
-        if( item->voice == release_voice ) {
-            item->ASSIGNED = 0;
-
-#if DEBUG_VERBOSE_LEVEL >= 2
-            sendDebugMessage();
-#endif
-
-            return item->voice;
-        }
-
-    // we should never reach this part!
+    if( VOICE_ALLOC_Release(&voiceAlloc, release_voice) < 0 ) {
+        // we should never reach this part!
 #if DEBUG_VERBOSE_LEVEL >= 1
-    DEBUG_MSG("[voiceRelease] voice %d not in queue anymore!\n", release_voice);
+        DEBUG_MSG("[voiceRelease] voice %d not available!\n", release_voice);
 #endif
+        return 0; // take first voice on this error case
+    }
 
-    return 0; // take first voice on this error case
+#if DEBUG_VERBOSE_LEVEL >= 2
+    sendDebugMessage();
+#endif
 
+    return release_voice;
 }
 
 
@@ -241,8 +216,7 @@ u8 MbCvVoiceQueue::release(u8 release_voice)
 void MbCvVoiceQueue::sendDebugMessage(void)
 {
     DEBUG_MSG("Voice Queue content:\n");
-    mbcv_voice_queue_item_t *item = (mbcv_voice_queue_item_t *)&queue.item[0];
-    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice, ++item)
-        DEBUG_MSG("  [%d] V:%d  A:%d  E:%d  I:%d\n",
-                  voice, item->voice, item->ASSIGNED, item->EXCLUSIVE, item->instrument);
+    for(int voice=0; voice<CV_SE_NUM_VOICES; ++voice)
+        DEBUG_MSG("  V:%d  A:%d  E:%d  I:%d\n",
+                  voice, voices[voice].assigned, (exclusiveVoices >> voice) & 1, voices[voice].tag);
 }
@@ -153,6 +153,9 @@ void APP_Init(void)
    LoopA_MIDI_OUT_Init(0);
    seqInit(0);
 
+   // stopwatch with 1 uS resolution, measures the OLED frame push time
+   MIOS32_STOPWATCH_Init(1);
+
    // install four encoders...
    mios32_enc_config_t enc_config = MIOS32_ENC_ConfigGet(enc_scene_id);
    enc_config.cfg.type = DETENTED3;
@@ -203,6 +206,15 @@ void APP_Init(void)
 /////////////////////////////////////////////////////////////////////////////
 void APP_Background(void)
 {
+#if MIDIMON_CAPTURE_SIZE > 0
+  // format events captured by the MIDI monitor
+  // APP_Background runs in the idle hook which mustn't block: skipped while
+  // another task owns the MIDI OUT mutex, the events stay in the capture ring
+  if( xMIDIOUTSemaphore && xSemaphoreTakeRecursive(xMIDIOUTSemaphore, 0) == pdTRUE ) {
+    MIDIMON_Handler();
+    MUTEX_MIDIOUT_GIVE;
+  }
+#endif
 }
 
 
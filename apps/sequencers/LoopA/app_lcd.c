@@ -413,6 +413,35 @@ s32 APP_LCD_Data(u8 data)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Sends a block of data bytes to LCD, selecting it only once
+// IN: <len> bytes at <data>
+// OUT: returns < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 APP_LCD_DataBlock(const u8 *data, u16 len)
+{
+  u8 cs=0;
+
+  // chip select and DC
+#if APP_LCD_USE_J10_FOR_CS
+  MIOS32_BOARD_J10_Set(~(1 << cs));
+#else
+  MIOS32_BOARD_J15_DataSet(~(1 << cs));
+#endif
+  MIOS32_BOARD_J15_RS_Set(1); // RS pin used to control DC
+
+  // send data
+  u16 i;
+  for(i=0; i<len; ++i)
+    MIOS32_BOARD_J15_SerDataShift(data[i]);
+
+  // increment graphical cursor
+  mios32_lcd_x += len;
+
+  return 0; // no error
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // Sends command byte to LCD
 // IN: command byte in <cmd>
@@ -16,6 +16,27 @@
 
 // --  Local types ---
 
+// Play order of the active scene clip of one track: transformed (stretched, scrolled, quantized, swung)
+// note times sorted ascending, with a cursor to the next note due. The clip settings the index was built
+// with are kept, so that it can be rebuilt lazily once any of them changes
+typedef struct
+{
+   u16 time[MAXNOTES];                // transformed note time within the clip
+   u16 noteNumber[MAXNOTES];          // index into clipNotes_
+   u16 size;                          // number of entries in use
+   u16 cursor;                        // next entry to check for playing
+   s32 lastTime;                      // clip time of the last tick (-1: cursor needs a seek)
+
+   u8 valid;
+   u8 scene;
+   u16 steps;
+   u32 quantize;
+   s16 scroll;
+   u8 stretch;
+   s8 swing;
+   u16 notesSize;
+} ClipIndex;
+
 // --- Tables ---
 s8 liveTransposeSemitones_[15] = { -36, -24, -19, -17, -12,  -7,  -5,   0,   5,   7,  12,  17,  19,  24,  36};
 
@@ -92,6 +113,8 @@ s8 liveTransposeRequested_ = 0;       // If != active liveTranspose_, perform a
 u16 clipActiveNote_[TRACKS][SCENES];  // currently active edited note number, when in noteroll editor
 s8 valueEncoderAccel_ = 0;            // 1: value encoder pushed (while turning) -> accellerate data inputs
 
+static ClipIndex clipIndex_[TRACKS];  // time sorted play index of each track's active scene clip
+
 // =================================================================================================
 
 
@@ -175,16 +198,12 @@ u32 quantize(u32 tick, u32 quantizeMeasure, s8 swingPercent, u32 clipLengthInTic
 
 
 /**
- * Transform (stretch, scroll, probabilities/random) and then quantize/apply swing to a note in a clip
+ * Transform (stretch, scroll) and then quantize/apply swing to a note in a clip, without the
+ * probabilities/random note drops. Returns the same time for as long as the clip settings stay unchanged
  *
  */
-s32 quantizeTransform(u8 clip, u16 noteNumber)
+static s32 quantizeTransformTime(u8 clip, u16 noteNumber)
 {
-   // Idea: scroll first, and modulo-map to trackstart/end boundaries
-   //       scale afterwards
-   //       apply track len afterwards
-   //       drop notes with ticks < 0 and ticks > tracklen
-
    s32 tick = clipNotes_[clip][activeScene_][noteNumber].tick;
    s16 quantizeMeasure = clipFxQuantize_[clip][activeScene_];
    s32 clipLengthInTicks = getClipLengthInTicks(clip);
@@ -197,24 +216,189 @@ s32 quantizeTransform(u8 clip, u16 noteNumber)
    if (tick >= clipLengthInTicks)
       return -1;
 
+   // scroll
+   tick += clipScroll_[clip][activeScene_] * TICKS_PER_STEP;
+
+   while (tick < 0)
+      tick += clipLengthInTicks;
+
+   tick %= clipLengthInTicks;
+
+   return quantize(tick, quantizeMeasure, clipFxSwing_[clip][activeScene_], clipLengthInTicks);
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Probabilities/random test of a note in a clip, returns 1, if the note should be dropped
+ *
+ */
+static u8 probabilityDrop(u8 clip, u16 noteNumber)
+{
    // if clip fx probabilities/randomization is on, only consider notes that pass the random test
    s8 randomMinimum = clipFxProbability_[clip][activeScene_];
    if (randomMinimum)
    {
       srand(((millisecondsSinceStartup_ >> 5U) << 8U) + noteNumber);  // Newly rerandomize every ~ 32ms
       if ((rand() % 100) < randomMinimum)
-         return -1;
+         return 1;
    }
 
-   // scroll
-   tick += clipScroll_[clip][activeScene_] * TICKS_PER_STEP;
+   return 0;
+}
+// -------------------------------------------------------------------------------------------------
 
-   while (tick < 0)
-      tick += clipLengthInTicks;
 
-   tick %= clipLengthInTicks;
+/**
+ * Transform (stretch, scroll, probabilities/random) and then quantize/apply swing to a note in a clip
+ *
+ */
+s32 quantizeTransform(u8 clip, u16 noteNumber)
+{
+   // Idea: scroll first, and modulo-map to trackstart/end boundaries
+   //       scale afterwards
+   //       apply track len afterwards
+   //       drop notes with ticks < 0 and ticks > tracklen
 
-   return quantize(tick, quantizeMeasure, clipFxSwing_[clip][activeScene_], clipLengthInTicks);
+   s32 tick = quantizeTransformTime(clip, noteNumber);
+
+   if (tick < 0 || probabilityDrop(clip, noteNumber))
+      return -1;
+
+   return tick;
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Insert a note into the play index of a clip, behind all notes with the same time, so that
+ * notes due at the same tick keep playing in recording order
+ *
+ */
+static void clipIndexInsert(ClipIndex *ci, u16 time, u16 noteNumber)
+{
+   u16 pos = ci->size;
+
+   while (pos > 0 && ci->time[pos - 1] > time)
+   {
+      ci->time[pos] = ci->time[pos - 1];
+      ci->noteNumber[pos] = ci->noteNumber[pos - 1];
+      pos--;
+   }
+
+   ci->time[pos] = time;
+   ci->noteNumber[pos] = noteNumber;
+   ci->size++;
+
+   if (pos < ci->cursor)
+      ci->cursor++; // keep pointing at the same note
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Make sure the play index of a track is up to date with its active scene clip, rebuild it if
+ * the clip or its transformation settings have changed
+ *
+ */
+static ClipIndex *clipIndexGet(u8 clip)
+{
+   ClipIndex *ci = &clipIndex_[clip];
+
+   if (ci->valid &&
+       ci->scene == activeScene_ &&
+       ci->steps == clipSteps_[clip][activeScene_] &&
+       ci->quantize == clipFxQuantize_[clip][activeScene_] &&
+       ci->scroll == clipScroll_[clip][activeScene_] &&
+       ci->stretch == clipStretch_[clip][activeScene_] &&
+       ci->swing == clipFxSwing_[clip][activeScene_] &&
+       ci->notesSize == clipNotesSize_[clip][activeScene_])
+      return ci;
+
+   ci->scene = activeScene_;
+   ci->steps = clipSteps_[clip][activeScene_];
+   ci->quantize = clipFxQuantize_[clip][activeScene_];
+   ci->scroll = clipScroll_[clip][activeScene_];
+   ci->stretch = clipStretch_[clip][activeScene_];
+   ci->swing = clipFxSwing_[clip][activeScene_];
+   ci->notesSize = clipNotesSize_[clip][activeScene_];
+
+   ci->size = 0;
+   ci->cursor = 0;
+   ci->lastTime = -1;
+
+   u16 i;
+   for (i = 0; i < ci->notesSize; i++)
+   {
+      s32 time = quantizeTransformTime(clip, i);
+      if (time >= 0)
+         clipIndexInsert(ci, time, i);
+   }
+
+   ci->valid = 1;
+   return ci;
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Mark the play index of a clip as outdated (call after editing notes in place)
+ *
+ */
+void clipIndexInvalidate(u8 clip)
+{
+   clipIndex_[clip].valid = 0;
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Add a freshly recorded note to the play index of the active scene clip without a full rebuild
+ *
+ */
+static void clipIndexAddRecordedNote(u8 clip, u16 noteNumber)
+{
+   ClipIndex *ci = &clipIndex_[clip];
+
+   if (ci->valid && ci->scene == activeScene_ && ci->notesSize == noteNumber)
+   {
+      s32 time = quantizeTransformTime(clip, noteNumber);
+      if (time >= 0)
+         clipIndexInsert(ci, time, noteNumber);
+      ci->notesSize = noteNumber + 1;
+   }
+}
+// -------------------------------------------------------------------------------------------------
+
+
+/**
+ * Move the play cursor of a clip index to the first note due at or after clipNoteTime
+ *
+ */
+static void clipIndexSeek(ClipIndex *ci, u32 clipNoteTime)
+{
+   if (ci->lastTime >= 0 && clipNoteTime == (u32)ci->lastTime + 1)
+   {
+      // common case: one tick further, skip the notes we have passed
+      while (ci->cursor < ci->size && ci->time[ci->cursor] < clipNoteTime)
+         ci->cursor++;
+   }
+   else
+   {
+      // wrapped, beatlooped or otherwise jumped: binary search
+      u16 lo = 0, hi = ci->size;
+      while (lo < hi)
+      {
+         u16 mid = (lo + hi) >> 1U;
+         if (ci->time[mid] < clipNoteTime)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      ci->cursor = lo;
+   }
+
+   ci->lastTime = clipNoteTime;
 }
 // -------------------------------------------------------------------------------------------------
 
@@ -538,6 +722,10 @@ void loadSession(u16 sessionNumber)
       status |= FILE_ReadClose(&file);
    }
 
+   u8 clip;
+   for (clip = 0; clip < TRACKS; clip++)
+      clipIndexInvalidate(clip);
+
    if (status == 0)
       screenFormattedFlashMessage("Loaded Session %d", sessionNumber);
    else
@@ -747,13 +935,16 @@ s32 loopaSeqTick(u32 bpmTick)
          if (!trackMute_[track])
          {
             u32 clipNoteTime = boundTickToClipSteps(bpmTick, track);
-            u16 i;
+            ClipIndex *ci = clipIndexGet(track);
 
-            for (i = 0; i < clipNotesSize_[track][activeScene_]; i++)
+            // only visit the notes due now
+            for (clipIndexSeek(ci, clipNoteTime); ci->cursor < ci->size && ci->time[ci->cursor] == clipNoteTime; ci->cursor++)
             {
+               u16 i = ci->noteNumber[ci->cursor];
+
                if (clipNotes_[track][activeScene_][i].length > 0) // not still being held/recorded!
                {
-                  if (quantizeTransform(track, i) == clipNoteTime)
+                  if (!probabilityDrop(track, i))
                   {
                      s16 note = clipNotes_[track][activeScene_][i].note + clipTranspose_[track][activeScene_] +
                                 liveTransposeSemi;
@@ -1013,6 +1204,7 @@ void loopaRecord(mios32_midi_port_t port, mios32_midi_package_t midi_package)
                notePtrsOn_[midi_package.note] = clipNoteNumber;
 
                // screenFormattedFlashMessage("Note %d on - ptr %d", midi_package.note, clipNoteNumber);
+               clipIndexAddRecordedNote(activeTrack_, clipNoteNumber);
                clipNotesSize_[activeTrack_][activeScene_]++;
             }
             else if (midi_package.type == NoteOff || (midi_package.type == NoteOn && midi_package.velocity == 0))
@@ -129,6 +129,9 @@ s32 quantizeTransform(u8 clip, u16 noteNumber);
 // Get the clip length in ticks
 u32 getClipLengthInTicks(u8 clip);
 
+// Mark the play index of a clip as outdated (call after editing notes in place)
+void clipIndexInvalidate(u8 clip);
+
 // Request (or cancel) a synced mute/unmute toggle
 void toggleMute(u8 clipNumber);
 
@@ -19,6 +19,12 @@
 // --- globals ---
 
 u8 screen[64][128];             // Screen buffer [y][x]
+static u8 screenSent_[64][128]; // Last frame pushed to the OLED (after inversion/flash), to only send changed row spans
+static u8 screenSentValid_ = 0; // 0: OLED content unknown, send the next frame completely
+static u8 invertLUT_[256];      // Inverted value of each pixel pair (built on first display() call)
+static u8 invertLUTReady_ = 0;
+u32 screenFrameTime_ = 0;       // duration of the last display() push in uS
+u32 screenFrameBytes_ = 0;      // bytes (commands and data) sent to the OLED by the last display() push
 
 u8 screenShowLoopaLogo_;
 u8 screenShowShift_ = 0;
@@ -1909,43 +1915,69 @@ void display()
       screenshotRequested_ = 0;
    }
 
-   // Push screen buffer to screen
-   for (j = 0; j < 64; j++)
+   // Push screen buffer to screen: only the span of each row that changed since the last frame
+   if (!invertLUTReady_)
    {
-      APP_LCD_Cmd(0x15);
-      APP_LCD_Data(0+0x1c);
+      // Screen inversion table for white frontpanels :)
+      u16 v;
+      for (v = 0; v < 256; v++)
+         invertLUT_[v] = ((15 - (v >> 4U)) << 4U) + (15 - (v % 16));
+      invertLUTReady_ = 1;
+   }
 
-      APP_LCD_Cmd(0x75);
-      APP_LCD_Data(j);
+   MIOS32_STOPWATCH_Reset();
+   u32 bytesSent = 0;
 
-      APP_LCD_Cmd(0x5c);
+   for (j = 0; j < 64; j++)
+   {
+      s16 first = -1;
+      s16 last = -1;
 
       u8 bgcol = 0;
       for (i = 0; i < 128; i++)
       {
          // two pixels at once...
-         u8 out = screen[j][i];
+         u8 out = gcInvertOLED_ ? invertLUT_[screen[j][i]] : screen[j][i];
 
-         if (gcInvertOLED_)
-         {
-            // Screen inversion routine for white frontpanels :)
-            u8 first = out >> 4U;
-            u8 second = out % 16;
+         if (flash && out == 0)
+            out = flash; // normally raise dark level slightly, but more intensively after 16 16th notes during flash
 
-            first = 15 - first;
-            second = 15 - second;
-            out = (first << 4U) + second;
+         if (out != screenSent_[j][i] || !screenSentValid_)
+         {
+            if (first < 0)
+               first = i;
+            last = i;
+            screenSent_[j][i] = out;
          }
 
-         if (flash && out == 0)
-            APP_LCD_Data(flash); // normally raise dark level slightly, but more intensively after 16 16th notes during flash
-         else
-            APP_LCD_Data(out);
-
          screen[j][i] = bgcol; // clear written pixels
       }
+
+      if (first >= 0)
+      {
+         // column addresses cover four pixels (two bytes)
+         first &= ~1;
+         last |= 1;
+
+         APP_LCD_Cmd(0x15);
+         APP_LCD_Data(0x1c + (first >> 1U));
+         APP_LCD_Data(0x1c + (last >> 1U));
+
+         APP_LCD_Cmd(0x75);
+         APP_LCD_Data(j);
+         APP_LCD_Data(j);
+
+         APP_LCD_Cmd(0x5c);
+         APP_LCD_DataBlock(&screenSent_[j][first], last - first + 1);
+
+         bytesSent += 7 + last - first + 1;
+      }
    }
 
+   screenSentValid_ = 1;
+   screenFrameBytes_ = bytesSent;
+   screenFrameTime_ = MIOS32_STOPWATCH_ValueGet();
+
    if (flash)
       oledBeatFlashState_ = 0;
 }
@@ -2016,13 +2048,17 @@ void testScreen()
   u16 x = 0;
   u16 y = 0;
 
+  screenSentValid_ = 0; // bypasses the frame buffer, next display() has to send everything
+
   for (y = 0; y < 64; y++)
   {
      APP_LCD_Cmd(0x15);
      APP_LCD_Data(0x1c);
+     APP_LCD_Data(0x5b);
 
      APP_LCD_Cmd(0x75);
      APP_LCD_Data(y);
+     APP_LCD_Data(y);
 
      APP_LCD_Cmd(0x5c);
 
@@ -2,6 +2,8 @@
 
 extern u8 screen[64][128];             // Screen buffer [y][x]
 extern u8 screenshotRequested_;        // if set to 1, will write screenshot to sd card when the next frame is rendered
+extern u32 screenFrameTime_;           // duration of the last display() push in uS
+extern u32 screenFrameBytes_;          // bytes sent to the OLED by the last display() push
 
 // If showLogo is true, draw the LoopA Logo (usually during unit startup)
 void screenShowLoopaLogo(u8 showLogo);
@@ -29,6 +29,7 @@
 #include "terminal.h"
 #include "uip_terminal.h"
 #include "tasks.h"
+#include "screen.h"
 
 /*
 #if !defined(MIOS32_FAMILY_EMULATION)
@@ -374,6 +375,8 @@ s32 TERMINAL_PrintSystem(void *_output_function)
 
   MIDIMON_TerminalPrintConfig(out);
 
+  out("OLED: last frame took %d uS, %d bytes sent", screenFrameTime_, screenFrameBytes_);
+
 #if !defined(MIOS32_FAMILY_EMULATION) && configGENERATE_RUN_TIME_STATS
   // send Run Time Stats to MIOS terminal
   out("FreeRTOS Task RunTime Stats:\n");
@@ -749,6 +749,7 @@ void clipZoom()
 void clipClear()
 {
    clipNotesSize_[activeTrack_][activeScene_] = 0;
+   clipIndexInvalidate(activeTrack_);
 
    u8 i;
    for (i=0; i<128; i++)
@@ -811,6 +812,7 @@ void clipFreeze()
 
    optimizedAmount = clipNotesSize_[activeTrack_][activeScene_] - optimizedNotes;
    clipNotesSize_[activeTrack_][activeScene_] = optimizedNotes;
+   clipIndexInvalidate(activeTrack_);
 
    screenFormattedFlashMessage("%d notes optimized", optimizedAmount);
 }
@@ -1335,6 +1337,7 @@ void loopaButtonPressed(s32 pin)
                clipStretch_[activeTrack_][activeScene_] = copiedClipStretch_;
                memcpy(clipNotes_[activeTrack_][activeScene_], copiedClipNotes_, sizeof(copiedClipNotes_));
                clipNotesSize_[activeTrack_][activeScene_] = copiedClipNotesSize_;
+               clipIndexInvalidate(activeTrack_);
                screenFormattedFlashMessage("pasted clip from buffer");
             }
             else
@@ -1982,6 +1985,7 @@ void loopaEncoderTurned(s32 encoder, s32 incrementer)
                newTick = (newTick / TICKS_PER_STEP) * TICKS_PER_STEP;
 
                clipNotes_[activeTrack_][activeScene_][activeNote].tick = (u16) newTick;
+               clipIndexInvalidate(activeTrack_);
             }
          } else if (command_ == COMMAND_NOTE_KEY)
          {
@@ -464,6 +464,7 @@ s32 SEQ_CC_LinkUpdate(u8 track)
   tcc->link_par_layer_nth2 = -1;
   tcc->link_par_layer_root = -1;
   tcc->link_par_layer_scale = -1;
+  tcc->link_par_layer_event_mask = 0;
 
   u8 num_layers = SEQ_PAR_NumLayersGet(track);
   if( num_layers ) {
@@ -486,6 +487,26 @@ s32 SEQ_CC_LinkUpdate(u8 track)
         case SEQ_PAR_Type_Root: tcc->link_par_layer_root = layer; break;
         case SEQ_PAR_Type_Scale: tcc->link_par_layer_scale = layer; break;
       }
+
+      // layers which are scanned by SEQ_LAYER_GetEvents() for each step
+      switch( (seq_par_layer_type_t)par_asg[layer] ) {
+        case SEQ_PAR_Type_Note:
+        case SEQ_PAR_Type_Chord1:
+        case SEQ_PAR_Type_Chord2:
+        case SEQ_PAR_Type_Chord3:
+	  if( tcc->event_mode == SEQ_EVENT_MODE_Drum )
+	    break; // notes are taken from the drum instruments
+	  // no break!
+        case SEQ_PAR_Type_CC:
+        case SEQ_PAR_Type_Ctrl:
+        case SEQ_PAR_Type_PitchBend:
+        case SEQ_PAR_Type_ProgramChange:
+        case SEQ_PAR_Type_Aftertouch:
+	  tcc->link_par_layer_event_mask |= (1 << layer);
+	  break;
+        default:
+	  break;
+      }
     }
   }
 
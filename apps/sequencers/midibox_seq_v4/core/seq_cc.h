@@ -285,6 +285,7 @@ typedef struct {
   s8 link_par_layer_nth2;        // parameter layer which stores nth2 value (-1 if not assigned)
   s8 link_par_layer_root;        // parameter layer which stores root value (-1 if not assigned)
   s8 link_par_layer_scale;       // parameter layer which stores scale value (-1 if not assigned)
+  u16 link_par_layer_event_mask; // parameter layers which generate MIDI events (Note/Chord/CC/PitchBend/...)
 } seq_cc_trk_t;
 
 
@@ -381,7 +381,7 @@ s32 SEQ_LAYER_GetEvents(u8 track, u16 step, seq_layer_evnt_t layer_events[16], u
 	}
       }
 
-      if( !insert_empty_notes ) {
+      if( !insert_empty_notes && tcc->link_par_layer_probability >= 0 ) {
 	u8 rnd_probability;
 	if( (rnd_probability=SEQ_PAR_ProbabilityGet(track, step, drum, layer_muted)) < 100 &&
 	    SEQ_RANDOM_Gen_Range(0, 99) >= rnd_probability )
@@ -413,15 +413,19 @@ s32 SEQ_LAYER_GetEvents(u8 track, u16 step, seq_layer_evnt_t layer_events[16], u
 
 #ifdef MBSEQV4P
     // CC, PitchBend, etc only supported by V4+
-    u8 num_p_layers = SEQ_PAR_NumLayersGet(track);
+    // only the layers which have been marked by SEQ_CC_LinkUpdate() are scanned
+    u16 event_layers = tcc->link_par_layer_event_mask;
     u8 pb_sent = 0;
     u8 at_sent = 0;
     u8 pc_sent = 0;
 
-    for(drum=0; drum<num_instruments; ++drum) {
+    for(drum=0; event_layers && drum<num_instruments; ++drum) {
       u8 *layer_type_ptr = (u8 *)&tcc->par_assignment_drum[0];
+      u16 layers = event_layers;
       int par_layer;
-      for(par_layer=0; par_layer<num_p_layers; ++par_layer, ++layer_type_ptr) {
+      for(par_layer=0; layers; ++par_layer, ++layer_type_ptr, layers >>= 1) {
+	if( !(layers & 1) )
+	  continue;
 
 	switch( *layer_type_ptr ) {
 	case SEQ_PAR_Type_CC: {
@@ -658,12 +662,12 @@ s32 SEQ_LAYER_GetEvents(u8 track, u16 step, seq_layer_evnt_t layer_events[16], u
     }
 
     // go through all layers to generate events
+    // usually most layers don't generate events - SEQ_CC_LinkUpdate() has marked the remaining ones
     u8 *layer_type_ptr = (u8 *)&tcc->lay_const[0*16];
-    u8 num_p_layers = SEQ_PAR_NumLayersGet(track);
-    for(par_layer=0; par_layer<num_p_layers; ++par_layer, ++layer_type_ptr) {
+    u16 event_layers = tcc->link_par_layer_event_mask;
+    for(par_layer=0; event_layers; ++par_layer, ++layer_type_ptr, event_layers >>= 1) {
 
-      // usually no function assigned to layer - skip it immediately to speed up the loop
-      if( *layer_type_ptr == SEQ_PAR_Type_None )
+      if( !(event_layers & 1) )
 	continue;
 
       // branch depending on layer type
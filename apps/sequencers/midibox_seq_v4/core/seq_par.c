@@ -179,6 +179,9 @@ s32 SEQ_PAR_TrackInit(u8 track, u16 steps, u8 par_layers, u8 instruments)
   // init parameter layer values
   memset((u8 *)&seq_par_layer_value[track], 0, SEQ_PAR_MAX_BYTES);
 
+  // layer links depend on the number of layers
+  SEQ_CC_LinkUpdate(track);
+
   return 0; // no error
 }
 
@@ -0,0 +1,297 @@
+// Session replay test of the event generating layers (link_par_layer_event_mask)
+//
+// A random edit/playback session is replayed through SEQ_LAYER_GetEvents()
+// (SEQ_LAYER_GetEventsPlus() with MBSEQV4P): step and trigger edits, layer
+// and drum assignments, layer mutes, morph/LFO flags, event mode changes
+// with new layer partitions, and UI pages which select the VU meters.
+// All generated events, sent MIDI events and VU meters are hashed, the hash
+// has to match with the hash of the layer loop which visited all layers
+// (REPLAY_REFERENCE_HASH).
+//
+// Afterwards the time per step of 8 note and 8 drum tracks is measured.
+//   seq_layer_replay_test [<rounds> [<playback steps>]]
+// Different numbers of rounds print the hash without checking it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <mios32.h>
+
+#include "seq_core.h"
+#include "seq_cc.h"
+#include "seq_par.h"
+#include "seq_trg.h"
+#include "seq_layer.h"
+#include "seq_ui.h"
+#include "seq_live.h"
+#include "seq_record.h"
+
+#define NUM_ROUNDS 200000
+#define NUM_PLAYBACK_STEPS 200000
+
+// hashes of the session with the layer loop over all layers
+#ifdef MBSEQV4P
+#define REPLAY_REFERENCE_HASH 0x15d2740b
+#else
+#define REPLAY_REFERENCE_HASH 0x789f01b4
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Variables and functions of the modules which aren't linked
+/////////////////////////////////////////////////////////////////////////////
+
+seq_core_trk_t seq_core_trk[SEQ_CORE_NUM_TRACKS];
+seq_core_options_t seq_core_options;
+u8 seq_core_global_scale;
+seq_record_options_t seq_record_options;
+seq_live_pattern_slot_t seq_live_pattern_slot[SEQ_LIVE_PATTERN_SLOTS];
+seq_live_arp_pattern_t seq_live_arp_pattern[SEQ_LIVE_NUM_ARP_PATTERNS];
+u8 seq_ui_display_update_req;
+seq_ui_page_t ui_page;
+
+// 32bit FNV-1a (u32 is an unsigned long with MIOS32_FAMILY_EMULATION)
+static uint32_t hash;
+static void hash_add(u32 value)
+{
+  hash = (hash ^ value) * 16777619u;
+}
+
+static u32 random_state;
+u32 SEQ_RANDOM_Gen_Range(u32 min, u32 max)
+{
+  random_state = random_state * 1103515245u + 12345u;
+  return min + ((random_state >> 16) % (max - min + 1));
+}
+
+u8 SEQ_CORE_TrimNote(s32 note, u8 lower, u8 upper)
+{
+  if( note < lower )
+    return lower;
+  if( note > upper )
+    return upper;
+  return note;
+}
+
+u8 SEQ_UI_VisibleTrackGet(void) { return 3; }
+
+s32 TASKS_MIDIOUTSemaphoreGive(void) { return 0; }
+s32 TASKS_MIDIOUTSemaphoreTake(void) { return 0; }
+void portENTER_CRITICAL(void) {}
+void portEXIT_CRITICAL(void) {}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs: sent MIDI events are hashed
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_MIDI_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc, u8 val)
+{
+  hash_add(0xcc000000 | (chn << 16) | (cc << 8) | val);
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendProgramChange(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 prg)
+{
+  hash_add(0xcd000000 | (chn << 8) | prg);
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+  hash_add(package.ALL);
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Helpers
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 session_state;
+static u32 rnd(u32 n)
+{
+  session_state = session_state * 1664525u + 1013904223u;
+  return n ? ((session_state >> 8) % n) : 0;
+}
+
+static double now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static s32 get_events(u8 track, u16 step, seq_layer_evnt_t *layer_events, u8 insert_empty_notes)
+{
+#ifdef MBSEQV4P
+  return SEQ_LAYER_GetEventsPlus(track, step, layer_events, insert_empty_notes);
+#else
+  return SEQ_LAYER_GetEvents(track, step, layer_events, insert_empty_notes);
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Random edits of a track
+/////////////////////////////////////////////////////////////////////////////
+
+static void edit(u8 track)
+{
+  switch( rnd(12) ) {
+  case 0: case 1: case 2: case 3:
+    SEQ_PAR_Set(track, rnd(64), rnd(SEQ_PAR_NumLayersGet(track)), rnd(SEQ_PAR_NumInstrumentsGet(track)),
+		rnd(8) ? rnd(100) : 0x80 + rnd(2));
+    break;
+
+  case 4: case 5:
+    SEQ_TRG_Set(track, rnd(64), rnd(SEQ_TRG_NumLayersGet(track)), rnd(SEQ_TRG_NumInstrumentsGet(track)), rnd(2));
+    break;
+
+  case 6: // layer assignments
+    if( SEQ_CC_Get(track, SEQ_CC_MIDI_EVENT_MODE) != SEQ_EVENT_MODE_Drum )
+      SEQ_CC_Set(track, SEQ_CC_LAY_CONST_A1 + rnd(16), rnd(SEQ_PAR_NUM_TYPES));
+    else
+      SEQ_CC_Set(track, SEQ_CC_PAR_ASG_DRUM_LAYER_A + rnd(4), rnd(SEQ_PAR_NUM_TYPES));
+    break;
+
+  case 7:
+    SEQ_CC_Set(track, SEQ_CC_LAY_CONST_B1 + rnd(16), rnd(0x84));
+    break;
+
+  case 8:
+    seq_core_trk[track].layer_muted = rnd(4) ? 0 : rnd(0x10000);
+    break;
+
+  case 9:
+    SEQ_CC_Set(track, SEQ_CC_MORPH_MODE, rnd(4) == 0);
+    SEQ_CC_Set(track, SEQ_CC_LFO_ENABLE_FLAGS, rnd(2) ? 0 : 0xff);
+    break;
+
+  case 10: // pattern change with a new event mode and layer partition
+    if( rnd(8) == 0 ) {
+      u8 mode = rnd(5);
+      if( mode == SEQ_EVENT_MODE_Combined && (track & 7) > 2 )
+	mode = SEQ_EVENT_MODE_Note;
+
+      if( mode == SEQ_EVENT_MODE_Drum ) {
+	SEQ_PAR_TrackInit(track, 64, 4, 4);
+	SEQ_TRG_TrackInit(track, 64, 2, 4);
+      } else {
+	u8 layers = 4 << rnd(3);
+	SEQ_PAR_TrackInit(track, (1024 / layers) > 256 ? 256 : (1024 / layers), layers, 1);
+	SEQ_TRG_TrackInit(track, 256, 8, 1);
+      }
+      SEQ_CC_Set(track, SEQ_CC_MIDI_EVENT_MODE, mode);
+      SEQ_LAYER_CopyPreset(track, 0, rnd(2), 1);
+    }
+    break;
+
+  case 11:
+    ui_page = rnd(3) ? SEQ_UI_PAGE_EDIT : SEQ_UI_PAGE_PARSEL;
+    break;
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Replays the session: edits, then one step of all tracks per round
+/////////////////////////////////////////////////////////////////////////////
+
+static uint32_t replay(int num_rounds)
+{
+  u32 num_calls = 0, num_events = 0;
+  double t_total = 0;
+  int round, track, i;
+
+  hash = 2166136261u;
+  random_state = 1;
+  session_state = 12345;
+  SEQ_LAYER_Init(0);
+
+  for(round=0; round<num_rounds; ++round) {
+    int num_edits = rnd(4);
+    for(i=0; i<num_edits; ++i)
+      edit(rnd(16));
+
+    for(track=0; track<16; ++track) {
+      seq_layer_evnt_t layer_events[83];
+      double t0 = now_ns();
+      s32 n = get_events(track, round % 64, layer_events, (round % 13) == 0);
+      t_total += now_ns() - t0;
+      ++num_calls;
+
+      hash_add(n);
+      for(i=0; i<n; ++i) {
+	hash_add(layer_events[i].midi_package.ALL);
+	hash_add((u8)layer_events[i].len);
+	hash_add(layer_events[i].layer_tag);
+      }
+      if( n > 0 )
+	num_events += n;
+    }
+
+    for(i=0; i<16; ++i)
+      hash_add(seq_layer_vu_meter[i]);
+  }
+
+  printf("Session: %d rounds, %u events, hash %08x, %.1f nS per call\n", num_rounds, (unsigned)num_events, hash, t_total / num_calls);
+  return hash;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Steady playback of 8 note tracks (16 layers) and 8 drum tracks
+/////////////////////////////////////////////////////////////////////////////
+
+static void playback(int num_steps)
+{
+  int step, track, i;
+
+  SEQ_LAYER_Init(0);
+  for(track=0; track<16; ++track) {
+    if( track >= 8 ) {
+      SEQ_PAR_TrackInit(track, 64, 2, 16);
+      SEQ_TRG_TrackInit(track, 64, 2, 16);
+      SEQ_CC_Set(track, SEQ_CC_MIDI_EVENT_MODE, SEQ_EVENT_MODE_Drum);
+    } else {
+      SEQ_PAR_TrackInit(track, 64, 16, 1);
+      SEQ_CC_Set(track, SEQ_CC_MIDI_EVENT_MODE, SEQ_EVENT_MODE_Note);
+    }
+    SEQ_LAYER_CopyPreset(track, 0, 0, 1);
+    for(i=0; i<64; ++i)
+      SEQ_PAR_Set(track, i, 0, 0, 0x3c + (i % 12));
+  }
+
+  double t0 = now_ns();
+  for(step=0; step<num_steps; ++step) {
+    for(track=0; track<16; ++track) {
+      seq_layer_evnt_t layer_events[83];
+      s32 n = get_events(track, step % 64, layer_events, 0);
+      hash_add(n);
+    }
+  }
+
+  printf("Playback: %.1f nS per step of 16 tracks\n", (now_ns() - t0) / num_steps);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int num_rounds = (argc > 1) ? atoi(argv[1]) : NUM_ROUNDS;
+  int num_steps = (argc > 2) ? atoi(argv[2]) : NUM_PLAYBACK_STEPS;
+
+  uint32_t session_hash = replay(num_rounds);
+  playback(num_steps);
+
+  if( num_rounds == NUM_ROUNDS && session_hash != REPLAY_REFERENCE_HASH ) {
+    printf("FAILED: events differ from the layer loop over all layers (hash %08x)\n", REPLAY_REFERENCE_HASH);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -46,8 +46,9 @@ static void TASK_BANKSWITCH_SCAN(void *pvParameters);
 #define DEBUG_VERBOSE_LEVEL 10
 #define DEBUG_MSG MIOS32_MIDI_SendDebugMessage
 
-// Now mandatory to have this set as legacy read code removed
-#define CLUSTER_CACHE_SIZE 32 // typically for 32 * 64*512 bytes = max sample file length of 1 MB !!!
+// Size of the cluster link map of each sample (see FILE_ReadOpenIndexed) - sample length is not limited,
+// but each fragment of the sample file on the SD card needs 2 words: 16 words allow 7 fragments
+#define SAMPLE_CLMAP_SIZE 16
 
 // set to 1 to perform right channel inversion for PCM1725 DAC
 #define DAC_FIX 0
@@ -91,7 +92,7 @@ static u8 no_decay;								// Used to speed up decay routine if this bank has no
 static u8 hold_sample[NUM_SAMPLES_TO_OPEN];		// Used to hold sample (for drums)
 static file_t samplefile_fileinfo[NUM_SAMPLES_TO_OPEN];	// Create the right number of file descriptors
 static u8 samplebyte_buf[POLYPHONY][SAMPLE_BUFFER_SIZE];	// Create a buffer for each voice
-static u32 sample_cluster_cache[NUM_SAMPLES_TO_OPEN][CLUSTER_CACHE_SIZE];	// Array of sample cluster positions on SD card
+static u32 sample_clmap[NUM_SAMPLES_TO_OPEN][SAMPLE_CLMAP_SIZE];	// Cluster link map of each sample file on SD card
 
 static u8 sample_bank_no=1;	// The sample bank number being played
 static u8 switch_bank_no=1;	// The sample bank selected via switch for J10 
@@ -118,11 +119,16 @@ static const u8 velocity_curve[128] = {
 s32 SAMP_FILE_open(u8 sample_n, char fname[])
 {
   DEBUG_MSG("Filename is %s.",fname);
-  s32 status = FILE_ReadOpen(&samplefile_fileinfo[sample_n], fname);
-  FILE_ReadClose(&samplefile_fileinfo[sample_n]); // close again - file will be reopened by read handler
+  s32 status = FILE_ReadOpenIndexed(&samplefile_fileinfo[sample_n], fname, sample_clmap[sample_n], SAMPLE_CLMAP_SIZE);
+  if( status >= 0 )
+    FILE_ReadClose(&samplefile_fileinfo[sample_n]); // close again - sectors are read directly via cluster map
 
   if( status < 0 ) {
-    DEBUG_MSG("[APP] failed to open file, status: %d\n", status);
+    if( status == FILE_ERR_CLUSTER_MAP )
+      DEBUG_MSG("[APP] sample file too fragmented (%d map words needed) - please copy it again\n", sample_clmap[sample_n][0]);
+    else
+      DEBUG_MSG("[APP] failed to open file, status: %d\n", status);
+    sample_clmap[sample_n][1] = 0; // empty map: reads will fail
   } else {
 
     // got it
@@ -142,15 +148,10 @@ s32 SAMP_FILE_open(u8 sample_n, char fname[])
 int SAMP_FILE_read(void *buffer, u32 len, u8 sample_n)
 {
   // determine sector based on sample position
-  u32 pos = samplefile_pos[sample_n];
-  u32 sector_ix = pos / 512;
-  u32 sectors_per_cluster = FILE_VolumeSectorsPerCluster();
-  u32 cluster_ix = sector_ix / sectors_per_cluster;
-  if( cluster_ix >= CLUSTER_CACHE_SIZE )
+  s32 phys_sector = FILE_IndexedSectorGet(sample_clmap[sample_n], samplefile_pos[sample_n]);
+  if( phys_sector < 0 )
     return -1;
 
-  u32 cluster = sample_cluster_cache[sample_n][cluster_ix];
-  u32 phys_sector = FILE_VolumeCluster2Sector(cluster) + (sector_ix % sectors_per_cluster);
   if( MIOS32_SDCARD_SectorRead(phys_sector, buffer) < 0 )
     return -2;
   return len;
@@ -199,32 +200,6 @@ void Open_Bank(u8 b_num)	// Open the bank number passed and parse the bank infor
 		 {
 		   if(SAMP_FILE_open(samp_no,sample_filenames[samp_no])) {
 		   DEBUG_MSG("Open sample file failed.");
-		   } else {
-			 // Pre-read all the cluster positions for all samples to open
-			 u32 num_sectors_per_cluster = FILE_VolumeSectorsPerCluster();
-			 u32 cluster_ix;
-			 for(cluster_ix=0; cluster_ix < CLUSTER_CACHE_SIZE; ++cluster_ix) {
-			   u32 pos = cluster_ix*num_sectors_per_cluster*SAMPLE_BUFFER_SIZE;
-
-			   if( pos >= samplefile_len[samp_no] )
-			 break; // end of file reached
-			   else {
-			 s32 status;
-			 if( (status=FILE_ReadReOpen(&samplefile_fileinfo[samp_no])) >= 0 ) {
-			   status = FILE_ReadSeek(pos);
-			   if( status >= 0 ) {
-				 u8 dummy; // dummy read to update cluster
-				 status = FILE_ReadBuffer(&dummy, 1);
-			   }
-			   FILE_ReadClose(&samplefile_fileinfo[samp_no]);
-			 }
-			 if( status < 0 )
-			   break;
-			   }
-
-			   sample_cluster_cache[samp_no][cluster_ix] = samplefile_fileinfo[samp_no].curr_clust;
-			   DEBUG_MSG("Cluster %d: %d ", cluster_ix, sample_cluster_cache[samp_no][cluster_ix]);
-			 }
 		   }
 
 		   sample_on[samp_no]=0;	// Set sample to off
@@ -295,6 +295,16 @@ void APP_Background(void)
     // call MIDI event tick
     MBNG_EVENT_Tick();
 
+#if MIDIMON_CAPTURE_SIZE > 0
+    // format events captured by the MIDI monitor
+    // APP_Background runs in the idle hook which mustn't block: skipped while
+    // another task owns the MIDI OUT mutex, the events stay in the capture ring
+    if( xMIDIOUTSemaphore && xSemaphoreTakeRecursive(xMIDIOUTSemaphore, 0) == pdTRUE ) {
+      MIDIMON_Handler();
+      MUTEX_MIDIOUT_GIVE;
+    }
+#endif
+
     // each second: check if SD Card (still) available
     if( msd_state == MSD_DISABLED && ++sdcard_check_ctr >= sdcard_check_delay ) {
       sdcard_check_ctr = 0;
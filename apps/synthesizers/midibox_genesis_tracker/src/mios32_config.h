@@ -38,5 +38,8 @@
 // GENMDM compatibility
 #define GENMDM_ALIGN_MSB 1
 
+// VGM streaming: files kept open by the stream sources (see modules/file/file.h)
+#define FILE_HANDLE_NUM 4
+
 
 #endif /* _MIOS32_CONFIG_H */
@@ -50,6 +50,9 @@
 
 #define FRONTPANEL_REVERSE_ROWS 1
 
+// VGM streaming: files kept open by the stream sources (see modules/file/file.h)
+#define FILE_HANDLE_NUM 4
+
 // Miscellaneous
 #define PRINT_SUPPORT_BINARY 1
 
@@ -552,13 +552,19 @@ void Mode_Vgm_BtnSystem(u8 button, u8 state){
                 FrontPanel_LEDSet(FP_LED_PLAY, 0);
                 synproginstance_t* pi = &proginstances[vgmpreviewpi];
                 pi->head->playing = 0;
+                VGM_Player_Reschedule();
                 SyEng_SilencePI(pi);
                 playing = 0;
             }else{
                 FrontPanel_LEDSet(FP_LED_PLAY, 1);
                 synproginstance_t* pi = &proginstances[vgmpreviewpi];
+                //The head may still be queued by the player, don't let it see
+                //the new ticks before the schedule is rebuilt
+                MIOS32_IRQ_Disable();
                 pi->head->ticks = VGM_Player_GetVGMTime();
                 pi->head->playing = 1;
+                VGM_Player_Reschedule();
+                MIOS32_IRQ_Enable();
                 playing = 1;
             }
             return;
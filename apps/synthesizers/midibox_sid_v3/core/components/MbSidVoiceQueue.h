@@ -16,25 +16,9 @@
 #define _MB_SID_VOICE_QUEUE_H
 
 #include <mios32.h>
+#include <voice_alloc.h>
 #include "MbSidStructs.h"
 
-typedef union {
-  struct {
-    u16 ALL;
-  };
-  struct {
-    u8 voice:6;
-    u8 ASSIGNED:1;
-    u8 EXCLUSIVE:1;
-    u8 instrument;
-  };
-} mbsid_voice_queue_item_t;
-
-
-typedef struct {
-  mbsid_voice_queue_item_t item[6]; // SID_SE_NUM_VOICES
-} mbsid_voice_queue_t;
-
 
 class MbSidVoiceQueue
 {
@@ -58,7 +42,14 @@ public:
     void sendDebugMessage(void);
 
 private:
-    mbsid_voice_queue_t queue;
+    voice_alloc_t voiceAlloc;
+    voice_alloc_voice_t voices[6]; // SID_SE_NUM_VOICES
+
+    // each bit marks a voice which is exclusively assigned to its instrument
+    u32 exclusiveVoices;
+
+    // returns the voices which can be allocated by the instrument
+    u32 allowedVoices(u8 instrument, u8 voice_asg, u8 num_voices);
 
 };
 
@@ -35,5 +35,8 @@
 #define MIOS32_SRIO_NUM_DOUT_PAGES 1
 #define MIOS32_ENC_NUM_MAX 8
 
+// VGM streaming: files kept open by the stream sources (see modules/file/file.h)
+#define FILE_HANDLE_NUM 4
+
 
 #endif /* _MIOS32_CONFIG_H */
@@ -151,6 +151,7 @@
 #include "app.h"
 #include "sysex.h"
 #include "envelope.h"
+#include "terminal.h"
 
 /////////////////////////////////////////////////////////////////////////////
 // Version/app info 
@@ -457,6 +458,9 @@ void APP_Init(void)
    // init sysex handler
 	SYSEX_Init();
 
+	// init terminal (profile commands)
+	TERMINAL_Init(0);
+
     // load the default patch
 	APP_loadPatch(0, 0);
 
@@ -78,6 +78,9 @@
 #define SAMPLE_BUFFER_SIZE 32  
 #define CHANNELS 2
 
+// samples rendered per ENGINE_ReloadSampleBuffer call
+#define BLOCK_SIZE (SAMPLE_BUFFER_SIZE/CHANNELS)
+
 #define ENVELOPE_RESOLUTION 		100 // divider for the envelope clock (48kHz/(X+1))
 #define LFO_RESOLUTION 				100  // divider for the lfo clock (48kHz/(X+1))
 
@@ -20,6 +20,8 @@
 #include <math.h>
 #include <FreeRTOS.h>
 #include <portmacro.h>
+#include <voice_alloc.h>
+#include <profile.h>
 
 #include "defs.h"
 #include "engine.h"
@@ -27,6 +29,19 @@
 #include "filter.h"
 #include "drum.h"
 
+/////////////////////////////////////////////////////////////////////////////
+// Local Defines
+/////////////////////////////////////////////////////////////////////////////
+
+// use the Cortex-M4 DSP instructions (CMSIS) if available
+#if defined(__PKHBT) && defined(__SSAT)
+# define ENGINE_PACK_STEREO(s)	__PKHBT((u32)(s), (u32)(s), 16)
+# define ENGINE_SAT16(x)		__SSAT((x), 16)
+#else
+# define ENGINE_PACK_STEREO(s)	(((u32)(s) << 16) | (u32)(s))
+# define ENGINE_SAT16(x)		(((x) < -32768) ? -32768 : (((x) > 32767) ? 32767 : (x)))
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 // Local Variables
 /////////////////////////////////////////////////////////////////////////////
@@ -36,9 +51,9 @@ su16 route_outs[ROUTE_OUTS]; 				// from lfo, ... / out = values to
 											// be read where a mod target is needed
 route_t routes[ROUTES];						// the modulation paths
 u32 sample_buffer[SAMPLE_BUFFER_SIZE]; 		// sample buffer Tx
-static note_t noteStack[NOTESTACK_SIZE];	// last played notes
-static u8 noteStackIndex;					// index of last note
-static s8 noteStackLen;						// number of notes playing
+static voice_alloc_t voiceAlloc;			// mono voice, last note priority
+static voice_alloc_voice_t voiceAllocVoice;	// the playing note
+static voice_alloc_held_t voiceAllocHeld;	// order of the held notes
 
 	   u16 envelopeTime;					// divider for the 48kHz sample clock that clocks the env
        u16 lfoTime;							// divider for the 48kHz sample clock that clocks the lfof
@@ -57,6 +72,11 @@ static u8 delaysampled;					    // counter for downsampling of delay
 
 static u16 bcpattern;						// the bitcrush pattern
 
+static u16 blockAccu[OSC_COUNT][BLOCK_SIZE];	// oscillator accumulators of the current block
+static u16 blockSubAccu[OSC_COUNT][BLOCK_SIZE];	// sub oscillator accumulators of the current block
+static s32 blockSample[OSC_COUNT][BLOCK_SIZE];	// oscillator outputs of the current block
+static u8  blockHold[BLOCK_SIZE];				// set if the last sample is repeated (downsampling)
+
 	   u8 	  route_update_req[ROUTE_INS];
 	   char   routing_signed[ROUTE_SOURCES] = {0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // signs for correct routing behaviour when scaling
 	   u8*    routing_signed_ptr = &routing_signed[0];
@@ -355,16 +375,13 @@ void ENGINE_init(void) {
 	for (n=0; n<32; n++)
 		p.d.name[n] = 'A' + n % 26;
 
-	noteStackLen = 0; 
-	for (n=0; n<NOTESTACK_SIZE; n++) {
-		noteStack[n].note = 0;
-	}
+	VOICE_ALLOC_Init(&voiceAlloc, VOICE_ALLOC_STEAL_OLDEST, &voiceAllocVoice, 1, &voiceAllocHeld);
 	
 	engine = ENGINE_SYNTH;
 
 	#ifdef ENGINE_VERBOSE_MAX
-    // debug: initialize the stopwatch for 100 uS resolution
-    MIOS32_STOPWATCH_Init(1);
+    // debug: enable the cycle counter for the profiling zones
+    PROFILE_Init(0);
 	#endif
 
 	route_ins[RS_CONSTANT] = 32768;
@@ -379,58 +396,37 @@ void ENGINE_init(void) {
 // This function removes a note from the stack
 /////////////////////////////////////////////////////////////////////////////
 void ENGINE_noteOff(u8 note) {
-	u8 n, m, j, p;
+	s32 voice, prev;
+	u8 vel;
 	
-	noteStackLen--;
-
-	if (noteStackLen < 0)
-	  noteStackLen = 0;
+	// release the note, the voice is only released if it's the note that was played last
+	voice = VOICE_ALLOC_NoteOff(&voiceAlloc, note);
 
    	#ifdef ENGINE_VERBOSE
-	MIOS32_MIDI_SendDebugMessage("noteStackLen = %d", noteStackLen);
+	MIOS32_MIDI_SendDebugMessage("noteStackLen = %d", VOICE_ALLOC_NumHeld(&voiceAlloc));
 	#endif
+
+	if (voice < 0)
+		return;
 	
-	// find the note in the stack
-	for (n=0; n<NOTESTACK_SIZE; n++) {
-		// get the note
-		m = noteStack[n].note;
+	// it's the note that was played last, change to a prior one 
+	// if there's another key still pressed
+	prev = VOICE_ALLOC_HeldLast(&voiceAlloc, &vel);
+	if (prev >= 0) {
+		// switch to that note
+		ENGINE_noteOn(prev, vel, STEAL);
 		
-		if (m == note) {
-			// found the note, let's see what we do with it
-			
-			// zero it
-			noteStack[n].note = 0;
-			
-			// is it the last note that was played?
-			if (n == noteStackIndex) {
-				// yes, it's the note that was played last, change to a prior one 
-				// if there's another key still pressed
-				for (j=n+NOTESTACK_SIZE; j>n; j--) {
-					// we're walking backwards from n to n - NOTESTACK_SIZE (offsetted), 
-					p = j & (NOTESTACK_SIZE - 1);
-					
-					if (noteStack[p].note > 0) {
-						// switch to that note
-						noteStackIndex = (p-1) & (NOTESTACK_SIZE - 1);
-						ENGINE_noteOn(noteStack[p].note, noteStack[p].velocity, STEAL);
-						
-						// kthxbye
-						return;
-					}
-				}
-				
-				// if we get here we have not found a playable note 
-				// kill the output by going to envelope decay
-				#ifdef TRIGGER_VERBOSE
-				MIOS32_MIDI_SendDebugMessage("ENGINE_noteOff(): triggering NOTE OFF");
-				#endif		
-
-				ENGINE_trigger(TRIGGER_NOTEOFF);
-			} 
-			
-			break;
-		}
+		// kthxbye
+		return;
 	}
+	
+	// if we get here we have not found a playable note 
+	// kill the output by going to envelope decay
+	#ifdef TRIGGER_VERBOSE
+	MIOS32_MIDI_SendDebugMessage("ENGINE_noteOff(): triggering NOTE OFF");
+	#endif		
+
+	ENGINE_trigger(TRIGGER_NOTEOFF);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -479,12 +475,12 @@ void ENGINE_noteOn(u8 note, u8 vel, u8 steal)
 	// is this not just a transpose rushing through?
 	if (note || vel) {
 		// it's a real note, set the stuff
-		noteStackIndex = (noteStackIndex + 1) & (NOTESTACK_SIZE - 1);
-		noteStack[noteStackIndex].note = note;
-		noteStack[noteStackIndex].velocity = vel;
+		// (no other note held: the first note; on steal the note is already held)
+		u8 firstNote = VOICE_ALLOC_NumHeld(&voiceAlloc) == 0;
+		VOICE_ALLOC_NoteOn(&voiceAlloc, note, vel, 0);
 
 		// fixme: reset envelope if desired should be from trigger / same for porta
-		if ((noteStackLen == 0) || p.d.engineFlags.reattackOnSteal) {
+		if (firstNote || p.d.engineFlags.reattackOnSteal) {
 			// trigger matrix NOTE_ON
 			#ifdef TRIGGER_VERBOSE
 			MIOS32_MIDI_SendDebugMessage("ENGINE_noteOn(): triggering NOTE ON");
@@ -492,9 +488,6 @@ void ENGINE_noteOn(u8 note, u8 vel, u8 steal)
 
 			ENGINE_trigger(TRIGGER_NOTEON); 
 		}
-
-		if (!steal)
-			noteStackLen++;
 	}
 	
 	// calculate new upper and lower boundaries for pitchbend 
@@ -508,13 +501,13 @@ void ENGINE_noteOn(u8 note, u8 vel, u8 steal)
 	}
 		
 	#ifdef ENGINE_VERBOSE
-	MIOS32_MIDI_SendDebugMessage("noteStackLen = %d", noteStackLen);
+	MIOS32_MIDI_SendDebugMessage("noteStackLen = %d", VOICE_ALLOC_NumHeld(&voiceAlloc));
 	#endif
 
 	// set pitch bend for both oscs
 	ENGINE_setPitchbend(2, p.d.oscillators[0].pitchbend.value);
 
-	reattack = (noteStackLen > 1) || steal;
+	reattack = (VOICE_ALLOC_NumHeld(&voiceAlloc) > 1) || steal;
 	
 	if ((p.d.oscillators[0].portaMode) && reattack) {
 		p.d.oscillators[0].portaStart = pA1;
@@ -677,116 +670,93 @@ void ENGINE_updateRoutingOutputs() {
 */
 
 /////////////////////////////////////////////////////////////////////////////
-// Fills the buffer with nicey sample sounds ;D
+// Block rendering helpers, all of them work on BLOCK_SIZE samples.
+// route_outs are only updated once per block, so the oscillators
+// can be computed in separate passes without changing the output.
 /////////////////////////////////////////////////////////////////////////////
-void ENGINE_ReloadSampleBuffer(u32 state) {
-	// transfer new samples to the lower/upper sample buffer range
-	int i;
-	u16 out;
-	s32 tout, tout2;
-	u32 utout, utout2;
-	u32 ac;
-	u32 *buffer = (u32	*)&sample_buffer[state ? (SAMPLE_BUFFER_SIZE/CHANNELS) : 0];
 
-	// debug: measure time it takes for 8 samples
-	// decrease counter
-	#ifdef ENGINE_VERBOSE_MAX
-	dead--;
-	MIOS32_STOPWATCH_Reset();
-	#endif 
-
-	// check for routing update requests
-	// ENGINE_updateRoutingOutputs();
-	// new one again
-	ENGINE_updateModPaths();
-
-	// generate new samples to output
-	for(i=0; i<SAMPLE_BUFFER_SIZE/CHANNELS; ++i) {
-		u8 osc;
-		oscillator_t *o;
+// ticks the envelopes and lfos for a whole block at once
+// (they only write to route_ins which are read at the next block)
+static void ENGINE_tickControl(void) {
+	envelopeTime += BLOCK_SIZE;
+	
+	while (envelopeTime > ENVELOPE_RESOLUTION) {
+		envelopeTime -= ENVELOPE_RESOLUTION + 1;
+		ENV_tick();
+	}
 
-		// tick the envelopes
-		envelopeTime++;
-		
-		if (envelopeTime > ENVELOPE_RESOLUTION) {
-			envelopeTime = 0;
-			ENV_tick();
-		}
+	lfoTime += BLOCK_SIZE;
+	
+	while (lfoTime > LFO_RESOLUTION) {
+		lfoTime -= LFO_RESOLUTION + 1;
+		LFO_tick();
+	}
+}
 
-		// tick the lfos
-		lfoTime++;
-		
-		if (lfoTime > LFO_RESOLUTION) {
-			lfoTime = 0;
-			LFO_tick();
-		}
-		
-		/* OSCILLATOR ACCUMULATORS *******************************************/
-		// calculate oscillator accumulators individually
-		o = &p.d.oscillators[0];
-		utout2 = o->accumulator;
-		ac = o->pitchedAccumValue;
+// advances the oscillator accumulators, has to run sample by sample because of 
+// portamento and osc2 sync
+static void ENGINE_renderPhases(void) {
+	int i;
+	s32 tout;
+	u32 utout2;
+	u32 ac;
+	oscillator_t *o1 = &p.d.oscillators[0];
+	oscillator_t *o2 = &p.d.oscillators[1];
+	
+	for (i=0; i<BLOCK_SIZE; i++) {
+		// oscillator 1
+		utout2 = o1->accumulator;
+		ac = o1->pitchedAccumValue;
 
 		// porta mode?
-		if (o->portaMode != PORTA_NONE)
-		if (o->portaStart != o->pitchedAccumValue) {
-			ac = o->portaStart + (o->accumValue - o->pitchedAccumValue);
-			o->portaTick += o->portaRate;
+		if (o1->portaMode != PORTA_NONE)
+		if (o1->portaStart != o1->pitchedAccumValue) {
+			ac = o1->portaStart + (o1->accumValue - o1->pitchedAccumValue);
+			o1->portaTick += o1->portaRate;
 			
-			if (o->portaTick > 0xFFFFE) {
-				o->portaTick = 0;
+			if (o1->portaTick > 0xFFFFE) {
+				o1->portaTick = 0;
 				
 				// porta time up
-				if (o->portaStart < o->pitchedAccumValue)
-					o->portaStart += 1;
+				if (o1->portaStart < o1->pitchedAccumValue)
+					o1->portaStart += 1;
 				else
-					o->portaStart -= 1;
+					o1->portaStart -= 1;
 			}
 		}
 
-/*
-		if (p.d.routing[T_OSC1_PITCH].source) {
-			// there's a source assigned
-			ac = ENGINE_modulateU(ac, ENGINE_getModulator(p.d.routing[T_OSC1_PITCH].source), p.d.routing[T_OSC1_PITCH].depth);
-			// ac += (ENGINE_getModulator(p.d.routing[T_OSC1_PITCH].source) >> 3);
-			// ac >>= 1;
-			// fixme: blend it in!
-		} 
-*/
 		// pitch mod
 		tout = route_outs[RT_OSC1_PITCH].s16;
 		tout *= ac;
 		tout >>= 15;
 		ac += tout;
 
-		ac += o->finetune;
-		o->accumulator += ac;
+		ac += o1->finetune;
+		o1->accumulator += ac;
 		ac >>= 1;
-		o->subAccumulator += ac;
+		o1->subAccumulator += ac;
 		
 		// oscillator 2
-		o = &p.d.oscillators[1];
-		
-		if ((p.d.engineFlags.syncOsc2) && (p.d.oscillators[0].accumulator < utout2)) 
-			o->accumulator = 0;
+		if ((p.d.engineFlags.syncOsc2) && (o1->accumulator < utout2)) 
+			o2->accumulator = 0;
 		else {
 			// T_OSC2_PITCH is right here
-			utout2 = o->pitchedAccumValue;
+			utout2 = o2->pitchedAccumValue;
 			
 			// porta mode?
-			if (o->portaMode != PORTA_NONE)
-			if (o->portaStart != o->pitchedAccumValue) {
-				utout2 = o->portaStart  + (o->accumValue - o->pitchedAccumValue);
-				o->portaTick += o->portaRate;
+			if (o2->portaMode != PORTA_NONE)
+			if (o2->portaStart != o2->pitchedAccumValue) {
+				utout2 = o2->portaStart  + (o2->accumValue - o2->pitchedAccumValue);
+				o2->portaTick += o2->portaRate;
 				
-				if (o->portaTick >= 0xFFFF) {
-					o->portaTick = 0;
+				if (o2->portaTick >= 0xFFFF) {
+					o2->portaTick = 0;
 					
 					// porta time up
-					if (o->portaStart < o->pitchedAccumValue)
-						o->portaStart += 1;
+					if (o2->portaStart < o2->pitchedAccumValue)
+						o2->portaStart += 1;
 					else
-						o->portaStart -= 1;
+						o2->portaStart -= 1;
 				}
 			}
 			
@@ -796,114 +766,188 @@ void ENGINE_ReloadSampleBuffer(u32 state) {
 			tout /= 32768;
 			utout2 += tout;
 
-
-			utout2 += o->finetune;
-			o->accumulator += utout2;
+			utout2 += o2->finetune;
+			o2->accumulator += utout2;
 			utout2 >>= 1;
-			o->subAccumulator += utout2;
+			o2->subAccumulator += utout2;
 		}
+
+		blockAccu[0][i] = o1->accumulator;
+		blockSubAccu[0][i] = o1->subAccumulator;
+		blockAccu[1][i] = o2->accumulator;
+		blockSubAccu[1][i] = o2->subAccumulator;
+	}
+}
+
+// marks the samples which repeat the last sample because of downsampling
+static void ENGINE_renderDownsampling(void) {
+	int i;
+	u32 utout;
+
+	// T_SAMPLERATE is right here
+	utout = p.d.voice.downsample;
+	utout *= route_outs[RT_DOWNSAMPLE].u16;
+	utout /= 65536;
+	utout >>= 15;
 	
-		// downsampling ***********************************************************
-		// T_SAMPLERATE is right here
-		utout = p.d.voice.downsample;
-		utout *= route_outs[RT_DOWNSAMPLE].u16;
-		utout /= 65536;
-		utout >>= 15;
+	for (i=0; i<BLOCK_SIZE; i++) {
 		if (downsampled > utout)
 			downsampled = utout;
 		
 		if (utout != downsampled) {
-			out = p.d.voice.lastSample;
-			*buffer++ = out << 16 | out;
+			blockHold[i] = 1;
 			downsampled++;
-			continue;
-		} else
+		} else {
+			blockHold[i] = 0;
 			downsampled = 0;
+		}
+	}
+}
 
-		/***************************************************************
-		 * calculate the oscillators                                   *
-		 ***************************************************************/
-		for (osc=0; osc<OSC_COUNT; osc++) {
-			u16 acc;
-			s32 acc32;
-			o = &p.d.oscillators[osc];
-
-			/***********************************************************
-			 * calculate sub oscillator                                *
-			 ***********************************************************/
-			acc = o->subAccumulator;
-			// triangle
-			if (acc < 32768) o->subSample = (acc * 2) - 32768;
-			else 		  	 o->subSample = 32767 - ((acc - 32768) * 2);
- 
-            /********************************************************** 
-			 * get raw waveforms                                      *
-             **********************************************************/
-			acc = o->accumulator;
-
-			// triangle
-			if (acc < 32768) o->triangle = (acc * 2) - 32768;
-			else 		  	 o->triangle = 32767 - ((acc - 32768) * 2);
-			// saw
-			o->saw = acc - 32768;
-			// ramp
-			o->ramp = (32768 - acc);
-			// sine
-			o->sine = ssineTable512[(acc >> 7)];
-			// square
-
-			o->square = (acc > 32768) ? 32767 : -32768;
-			// pulse
-			o->pulse = (acc > o->pulsewidth) ? 32767 : -32768;
-			// white noise
-			o->white_noise = sineTable512[acc >> 6] * acc - acc;
-			// "pink" noise
-			o->pink_noise = o->white_noise;
-
-			// we got all the bare waveforms now
-            /********************************************************** 
-			 * mix/blend waveforms                                    *
-             **********************************************************/
-			// fixme: mush em all together, missing mix blend and so on
-			acc32 = 0;
-			if (o->waveforms.triangle)		acc32 += o->triangle;  	
-			if (o->waveforms.saw)			acc32 += o->saw;
-			if (o->waveforms.ramp)			acc32 += o->ramp;
-			if (o->waveforms.sine)			acc32 += o->sine;
-			if (o->waveforms.square)		acc32 += o->square;
-			if (o->waveforms.pulse)			acc32 += o->pulse;
-			if (o->waveforms.white_noise)	acc32 += o->white_noise;
-			if (o->waveforms.pink_noise)	acc32 += o->pink_noise;
-			if (!o->waveformCount)                  
-				// no waveforms... mute
-				acc32 = 0;
-
-			// merge with sub osc
-			acc32 += (o->subSample * o->subOscVolume) / 65536;
-			acc32 /= 2;
-
-			// fixme: vel curve
-			// acc = (o->velocity > 0x40) ? o->velocity : 0x40; 
-			// set velocity
-			acc32 *= o->velocity;
-			acc32 /= 128;
-
-			// do more magic here
-			// ...
-			// end of magic
-			
-			o->sample = acc32;
-		} // individual oscillators
+// calculates the waveforms of one oscillator incl. sub oscillator and velocity
+static void ENGINE_renderOscillator(u8 osc) {
+	int i;
+	u16 acc;
+	oscillator_t *o = &p.d.oscillators[osc];
+	u16 *accu = blockAccu[osc];
+	u16 *subAccu = blockSubAccu[osc];
+	s32 *out = blockSample[osc];
+
+	for (i=0; i<BLOCK_SIZE; i++)
+		out[i] = 0;
+
+	/********************************************************** 
+	 * get raw waveforms and mix them                         *
+	 **********************************************************/
+	// fixme: mush em all together, missing mix blend and so on
+	// no waveforms... mute
+	if (o->waveformCount) {
+		// triangle
+		if (o->waveforms.triangle)
+		for (i=0; i<BLOCK_SIZE; i++) {
+			acc = accu[i];
+			if (acc < 32768) out[i] += (acc * 2) - 32768;
+			else 		  	 out[i] += 32767 - ((acc - 32768) * 2);
+		}
+		// saw
+		if (o->waveforms.saw)
+		for (i=0; i<BLOCK_SIZE; i++)
+			out[i] += accu[i] - 32768;
+		// ramp
+		if (o->waveforms.ramp)
+		for (i=0; i<BLOCK_SIZE; i++)
+			out[i] += (32768 - accu[i]);
+		// sine
+		if (o->waveforms.sine)
+		for (i=0; i<BLOCK_SIZE; i++)
+			out[i] += ssineTable512[(accu[i] >> 7)];
+		// square
+		if (o->waveforms.square)
+		for (i=0; i<BLOCK_SIZE; i++)
+			out[i] += (accu[i] > 32768) ? 32767 : -32768;
+		// pulse
+		if (o->waveforms.pulse)
+		for (i=0; i<BLOCK_SIZE; i++)
+			out[i] += (accu[i] > o->pulsewidth) ? 32767 : -32768;
+		// white noise
+		if (o->waveforms.white_noise)
+		for (i=0; i<BLOCK_SIZE; i++) {
+			acc = accu[i];
+			out[i] += sineTable512[acc >> 6] * acc - acc;
+		}
+		// "pink" noise
+		if (o->waveforms.pink_noise)
+		for (i=0; i<BLOCK_SIZE; i++) {
+			acc = accu[i];
+			out[i] += sineTable512[acc >> 6] * acc - acc;
+		}
+	}
+
+	/***********************************************************
+	 * merge with sub oscillator (triangle), set velocity      *
+	 ***********************************************************/
+	for (i=0; i<BLOCK_SIZE; i++) {
+		s32 acc32;
+		s32 subSample;
+
+		acc = subAccu[i];
+		if (acc < 32768) subSample = (acc * 2) - 32768;
+		else 		  	 subSample = 32767 - ((acc - 32768) * 2);
+
+		acc32 = out[i];
+		acc32 += (subSample * o->subOscVolume) / 65536;
+		acc32 /= 2;
 
-		// merge the two oscillators into one stream
-		o = &p.d.oscillators[0];
-		tout = o->sample;
-		tout *= o->volume;
+		// fixme: vel curve
+		acc32 *= o->velocity;
+		acc32 /= 128;
+
+		out[i] = acc32;
+	}
+
+	// keep the last values for whoever wants to see them
+	acc = subAccu[BLOCK_SIZE-1];
+	if (acc < 32768) o->subSample = (acc * 2) - 32768;
+	else 		  	 o->subSample = 32767 - ((acc - 32768) * 2);
+	o->sample = out[BLOCK_SIZE-1];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Fills the buffer with nicey sample sounds ;D
+/////////////////////////////////////////////////////////////////////////////
+void ENGINE_ReloadSampleBuffer(u32 state) {
+	// transfer new samples to the lower/upper sample buffer range
+	int i;
+	u16 out;
+	s32 tout, tout2;
+	s32 volume1, volume2;
+	u8 osc;
+	u32 *buffer = (u32	*)&sample_buffer[state ? BLOCK_SIZE : 0];
+
+	// debug: measure time it takes for 8 samples
+	// decrease counter
+	#ifdef ENGINE_VERBOSE_MAX
+	dead--;
+	PROFILE_BEGIN(engine_reload);
+	#endif 
+
+	/* CONTROL RATE ******************************************************/
+	// check for routing update requests
+	// ENGINE_updateRoutingOutputs();
+	// new one again
+	ENGINE_updateModPaths();
+
+	// tick the envelopes and lfos
+	ENGINE_tickControl();
+
+	/* AUDIO RATE ********************************************************/
+	// calculate oscillator accumulators
+	ENGINE_renderPhases();
+
+	// downsampling
+	ENGINE_renderDownsampling();
+
+	// calculate the oscillators
+	for (osc=0; osc<OSC_COUNT; osc++)
+		ENGINE_renderOscillator(osc);
+
+	// merge the two oscillators into one stream and hand it over to the fx
+	volume1 = p.d.oscillators[0].volume;
+	volume2 = p.d.oscillators[1].volume;
+
+	for (i=0; i<BLOCK_SIZE; i++) {
+		if (blockHold[i]) {
+			out = p.d.voice.lastSample;
+			*buffer++ = ENGINE_PACK_STEREO(out);
+			continue;
+		}
+
+		tout = blockSample[0][i];
+		tout *= volume1;
 		tout >>= 14;
 
-		o = &p.d.oscillators[1];
-		tout2 = o->sample;
-		tout2 *= o->volume;
+		tout2 = blockSample[1][i];
+		tout2 *= volume2;
 		tout2 >>= 14;
 		
 		if (p.d.engineFlags.ringmod) {
@@ -916,21 +960,6 @@ void ENGINE_ReloadSampleBuffer(u32 state) {
 			tout /= 8;
 		}
 
-/* PHASE DISTORTION FUN
-		tout = p.d.oscillators[0].sample;
-		tout *= p.d.oscillators[0].volume;
-		tout /= 32768;
-
-		tout2 = p.d.oscillators[1].sample;
-		tout2 *= p.d.oscillators[0].accumValue;
-		tout2 /= 65536;
-		tout2 *= p.d.oscillators[1].volume;
-		tout2 /= 32768;
-
-		tout += tout2;
-		tout /= 4;
-*/  
-
 		// hand over merged sample to ENGINE_postProcess for fx
 		tout = ENGINE_postProcess(tout);
 		
@@ -940,17 +969,27 @@ void ENGINE_ReloadSampleBuffer(u32 state) {
 		// write sample to output buffer 
 		out = tout;
  
-		*buffer++ = out << 16 | out;
+		*buffer++ = ENGINE_PACK_STEREO(out);
 	}
 
 	// debug: stop measuring time here
 	#ifdef ENGINE_VERBOSE_MAX
+	PROFILE_END(engine_reload);
+
 	if (!dead) {
-		// send execution time via MIDI interface
-		u32 delay = MIOS32_STOPWATCH_ValueGet();
-		delay *= 1000;
-		delay /= 333;
-		MIOS32_MIDI_SendDebugMessage("%d.%d%%", delay/10, delay % 10);	
+		// send mean and max. execution time since last report via MIDI interface
+		profile_zone_t stats;
+		if (PROFILE_ZoneGet(profile_zone_engine_reload, &stats) >= 0 && stats.count) {
+			PROFILE_ZoneReset(profile_zone_engine_reload);
+
+			u32 delay = (u32)(stats.sum / stats.count) / PROFILE_TICKS_PER_US;
+			delay *= 1000;
+			delay /= 333;
+			u32 delay_max = stats.max / PROFILE_TICKS_PER_US;
+			delay_max *= 1000;
+			delay_max /= 333;
+			MIOS32_MIDI_SendDebugMessage("%d.%d%% (max %d.%d%%)", delay/10, delay % 10, delay_max/10, delay_max % 10);	
+		}
 
 		// reset timer to measure every 12000th iteration (0.5Hz)
 		dead = 12000;
@@ -998,11 +1037,12 @@ void ENGINE_setOscTranspose(u8 osc, s8 trans) {
 	p.d.oscillators[osc].transpose = trans;
 
 	// update accum values
-	p.d.oscillators[osc].accumValue = accumValueByNote[noteStack[noteStackIndex].note + p.d.oscillators[osc].transpose];
+	u8 note = (voiceAllocVoice.note == VOICE_ALLOC_NONE) ? 0 : voiceAllocVoice.note;
+	p.d.oscillators[osc].accumValue = accumValueByNote[note + p.d.oscillators[osc].transpose];
 
 	// ENGINE_setPitchbend(2, 0);
 	// if there's a note playing only reset the pitch, do not affect the noteStack
-	if (noteStackLen)
+	if (VOICE_ALLOC_NumHeld(&voiceAlloc))
 		ENGINE_noteOn(0, 0, STEAL);
 
 	#ifdef ENGINE_VERBOSE
@@ -1278,11 +1318,7 @@ s16 ENGINE_postProcess(s16 sample) {
 		tout /= 2048;
 
 		// clip
-		if (tout < -32768)
-			tout = -32768;
-		else
-		if (tout > 32767)
-			tout = 32767;
+		tout = ENGINE_SAT16(tout);
 	} // drive
 
 	// filter
@@ -0,0 +1,186 @@
+// Bit-exact render test of the nI2S synth engine
+//
+// ENGINE_ReloadSampleBuffer() renders 40 random patches (waveforms,
+// portamento, sync/ringmod flags, mod paths, envelopes, LFOs, filters,
+// overdrive, bitcrush, downsampling, chorus and delay) with notes and
+// mod wheel changes, 3000 blocks each. The FNV-1a hash over all samples
+// has to match with the hash of the per-sample engine which was used
+// before the block-wise rendering (RENDER_REFERENCE_HASH).
+//
+// The time spent in ENGINE_ReloadSampleBuffer() is printed per sample.
+// Optionally the rendered samples are written into a raw file (stereo,
+// 16bit) for listening or for a comparison with another build:
+//   engine_render_test out.raw
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mios32.h>
+
+#include "defs.h"
+#include "types.h"
+#include "engine.h"
+#include "envelope.h"
+#include "filter.h"
+#include "lfo.h"
+
+// hash of the per-sample engine
+#define RENDER_REFERENCE_HASH 0xaad7ab508154d573ULL
+
+#define NUM_PATCHES 40
+#define NUM_BLOCKS  3000
+
+extern void ENGINE_ReloadSampleBuffer(u32 state);
+extern void ENGINE_setChorusTime(u16 time);
+extern void ENGINE_setChorusFeedback(u16 feedback);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_I2S_Start(u32 *buffer, u16 len, void *callback) { return 0; }
+s32 MIOS32_I2S_Stop(void) { return 0; }
+s32 MIOS32_IRQ_Disable(void) { return 0; }
+s32 MIOS32_IRQ_Enable(void) { return 0; }
+s32 MIOS32_MIDI_SendDebugMessage(const char *format, ...) { return 0; }
+s32 MIOS32_STOPWATCH_Reset(void) { return 0; }
+u32 MIOS32_STOPWATCH_ValueGet(void) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Random patches
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 rnd_seed;
+static u32 rnd(void)
+{
+  rnd_seed = rnd_seed * 1103515245 + 12345;
+  return rnd_seed >> 8;
+}
+
+static void random_patch(int patch)
+{
+  int i, k;
+
+  rnd_seed = patch * 7919 + 1;
+
+  ENGINE_setEngine(ENGINE_SYNTH);
+
+  for(i=0; i<2; ++i) {
+    ENGINE_setOscWaveform(i, rnd() & 0xff);
+    ENGINE_setOscVolume(i, rnd());
+    ENGINE_setOscFinetune(i, rnd() % 10);
+    ENGINE_setOscTranspose(i, rnd() % 12);
+    ENGINE_setSubOscVolume(i, rnd());
+    ENGINE_setOscPW(i, rnd());
+    ENGINE_setPortamentoMode(i, rnd() % 3);
+    ENGINE_setPortamentoRate(i, rnd());
+  }
+  ENGINE_setMasterVolume(rnd() | 0x8000);
+  ENGINE_setEngineFlags(rnd() & 0xfcff);
+
+  for(i=0; i<ROUTES; ++i) {
+    routes[i].outputid = rnd() % 19;
+    for(k=0; k<ROUTE_INPUTS_PER_PATH; ++k) {
+      routes[i].inputid[k] = rnd() % ROUTE_SOURCES;
+      routes[i].depth[k] = rnd();
+      routes[i].offset[k] = rnd() % 4096;
+    }
+  }
+
+  for(i=0; i<2; ++i) {
+    ENV_setAttack(i, rnd());
+    ENV_setDecay(i, rnd());
+    ENV_setSustain(i, rnd());
+    ENV_setRelease(i, rnd());
+    LFO_setFreq(i, rnd());
+    LFO_setWaveform(i, rnd() % 8);
+  }
+
+  FILTER_setFilter(rnd() % FILTER_TYPES);
+  FILTER_setCutoff(rnd());
+  FILTER_setResonance(rnd());
+
+  ENGINE_setOverdrive(rnd());
+  if( rnd() & 1 )
+    ENGINE_setXOR(rnd() & 0x3f);
+  ENGINE_setBitcrush(rnd() % 16);
+  ENGINE_setDelayTime(rnd() & 0xfff);
+  ENGINE_setDelayFeedback(rnd());
+  ENGINE_setChorusTime(rnd());
+  ENGINE_setChorusFeedback(rnd());
+  ENGINE_setDownsampling(rnd() & 7);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Renders all patches
+/////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+  unsigned long long hash = 1469598103934665603ULL; // FNV-1a
+  double render_ns = 0.0;
+  long num_samples = 0;
+  FILE *raw = NULL;
+  int patch, block, i;
+
+  if( argc > 1 && !(raw = fopen(argv[1], "wb")) ) {
+    printf("ERROR: can't create %s\n", argv[1]);
+    return 1;
+  }
+
+  ENGINE_init();
+
+  for(patch=0; patch<NUM_PATCHES; ++patch) {
+    random_patch(patch);
+    u8 note = 0;
+
+    for(block=0; block<NUM_BLOCKS; ++block) {
+      if( (block % 500) == 0 ) {
+	note = 30 + rnd() % 50;
+	ENGINE_noteOn(note, 1 + rnd() % 127, STEAL);
+      }
+      if( (block % 500) == 300 )
+	ENGINE_noteOff(note);
+      if( (block % 97) == 0 )
+	ENGINE_setModWheel(rnd());
+
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      ENGINE_ReloadSampleBuffer(block & 1);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      render_ns += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+      num_samples += BLOCK_SIZE;
+
+      u32 *buffer = &sample_buffer[(block & 1) ? BLOCK_SIZE : 0];
+      for(i=0; i<BLOCK_SIZE; ++i) {
+	u32 w = buffer[i];
+	int b;
+	for(b=0; b<4; ++b) {
+	  hash ^= (w >> (8*b)) & 0xff;
+	  hash *= 1099511628211ULL;
+	}
+	if( raw )
+	  fwrite(&w, 4, 1, raw);
+      }
+    }
+
+    ENGINE_noteOff(note);
+  }
+
+  if( raw )
+    fclose(raw);
+
+  printf("Rendered %ld samples: hash %016llx, %.1f nS per sample\n", num_samples, hash, render_ns / num_samples);
+
+  if( hash != RENDER_REFERENCE_HASH ) {
+    printf("FAILED: output differs from the per-sample engine (hash %016llx)\n", RENDER_REFERENCE_HASH);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1 @@
+// the engine includes FreeRTOS.h, but doesn't use it
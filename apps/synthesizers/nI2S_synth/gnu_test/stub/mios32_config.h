@@ -0,0 +1,9 @@
+// configuration for the host tests: the synth configuration without USB
+#ifndef _HOST_MIOS32_CONFIG_H
+#define _HOST_MIOS32_CONFIG_H
+
+#include "../../mios32_config.h"
+
+#define DEBUG_MSG(...) do {} while(0)
+
+#endif /* _HOST_MIOS32_CONFIG_H */
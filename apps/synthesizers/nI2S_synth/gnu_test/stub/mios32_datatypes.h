@@ -0,0 +1,36 @@
+// Host replacement of <mios32_datatypes.h>:
+// 32bit u32/s32 like on the Cortex-M target, so that the phase
+// accumulators and the fixed point arithmetic of the engine wrap
+// the same way
+#ifndef _MIOS32_DATATYPES_H
+#define _MIOS32_DATATYPES_H
+
+#include <stdint.h>
+
+typedef int32_t  s32;
+typedef int16_t  s16;
+typedef int8_t   s8;
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+
+typedef volatile int32_t  vs32;
+typedef volatile int16_t  vs16;
+typedef volatile int8_t   vs8;
+
+typedef volatile uint32_t vu32;
+typedef volatile uint16_t vu16;
+typedef volatile uint8_t  vu8;
+
+#define U8_MAX     ((u8)255)
+#define S8_MAX     ((s8)127)
+#define S8_MIN     ((s8)-128)
+#define U16_MAX    ((u16)65535u)
+#define S16_MAX    ((s16)32767)
+#define S16_MIN    ((s16)-32768)
+#define U32_MAX    ((u32)4294967295uL)
+#define S32_MAX    ((s32)2147483647)
+#define S32_MIN    ((s32)-2147483648)
+
+#endif /* _MIOS32_DATATYPES_H */
@@ -0,0 +1 @@
+// the engine includes portmacro.h, but doesn't use it
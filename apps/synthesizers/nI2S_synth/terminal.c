@@ -0,0 +1,112 @@
+// $Id$
+/*
+ * The command Terminal of the nI2S Toy Synth
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2009 nILS Podewski (nils@podewski.de)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <string.h>
+
+#include <profile.h>
+
+#include "terminal.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local defines
+/////////////////////////////////////////////////////////////////////////////
+
+#define STRING_MAX 80
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local variables
+/////////////////////////////////////////////////////////////////////////////
+
+static char line_buffer[STRING_MAX];
+static u16 line_ix;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Initialisation
+/////////////////////////////////////////////////////////////////////////////
+s32 TERMINAL_Init(u32 mode)
+{
+  // install the callback function which is called on incoming characters from MIOS Terminal
+  MIOS32_MIDI_DebugCommandCallback_Init(TERMINAL_Parse);
+
+  // clear line buffer
+  line_buffer[0] = 0;
+  line_ix = 0;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Parser
+/////////////////////////////////////////////////////////////////////////////
+s32 TERMINAL_Parse(mios32_midi_port_t port, char byte)
+{
+  // temporary change debug port (will be restored at the end of this function)
+  mios32_midi_port_t prev_debug_port = MIOS32_MIDI_DebugPortGet();
+  MIOS32_MIDI_DebugPortSet(port);
+
+  if( byte == '\r' ) {
+    // ignore
+  } else if( byte == '\n' ) {
+    TERMINAL_ParseLine(line_buffer, MIOS32_MIDI_SendDebugMessage);
+    line_ix = 0;
+    line_buffer[line_ix] = 0;
+  } else if( line_ix < (STRING_MAX-1) ) {
+    line_buffer[line_ix++] = byte;
+    line_buffer[line_ix] = 0;
+  }
+
+  // restore debug port
+  MIOS32_MIDI_DebugPortSet(prev_debug_port);
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Parser for a complete line
+/////////////////////////////////////////////////////////////////////////////
+s32 TERMINAL_ParseLine(char *input, void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+  char *separators = " \t";
+  char *brkt;
+  char *parameter;
+
+  if( PROFILE_TerminalParseLine(input, _output_function) > 0 )
+    return 0; // command parsed
+
+  if( (parameter = strtok_r(input, separators, &brkt)) ) {
+    if( strcmp(parameter, "help") == 0 ) {
+      out("Welcome to the nI2S Toy Synth!");
+      out("Following commands are available:");
+      PROFILE_TerminalHelp(_output_function);
+      out("  reset:                            resets the synth (!)");
+      out("  help:                             this page");
+    } else if( strcmp(parameter, "reset") == 0 ) {
+      MIOS32_SYS_Reset();
+    } else {
+      out("Unknown command - type 'help' to list available commands!");
+    }
+  }
+
+  return 0; // no error
+}
@@ -0,0 +1,42 @@
+// $Id$
+/*
+ * Header file of the command Terminal
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2009 nILS Podewski (nils@podewski.de)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _TERMINAL_H
+#define _TERMINAL_H
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 TERMINAL_Init(u32 mode);
+extern s32 TERMINAL_Parse(mios32_midi_port_t port, char byte);
+extern s32 TERMINAL_ParseLine(char *input, void *_output_function);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Export global variables
+/////////////////////////////////////////////////////////////////////////////
+
+
+#endif /* _TERMINAL_H */
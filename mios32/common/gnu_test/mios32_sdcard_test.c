@@ -0,0 +1,523 @@
+// Host test of the SD Card multi block transfers
+//
+// MIOS32_SDCARD_SectorsRead() and MIOS32_SDCARD_SectorsWrite() run against
+// a byte level emulation of an SD Card in SPI mode (the MIOS32_SPI_*
+// functions below). The emulated card checks the protocol: ACMD23 before
+// CMD25 (SD Cards only), byte/block addressing, the stuff byte and busy
+// phase after CMD12, no data or stop token and no chip select release
+// while the card is busy, and no chip select release during an unfinished
+// multi block transfer.
+//
+// Random transfers of SDHC, SD1 and MMC cards are compared with a
+// reference image, afterwards the error paths are injected: R1 error
+// flags, missing start token, data error token, rejected data block,
+// busy timeout and a missing card.
+// Finally the SPI bytes per sector of single and multi block reads are
+// printed.
+
+#include <mios32.h>
+
+#include "../mios32_sdcard.c"
+
+#define NUM_BLOCKS 256
+
+static u32 num_errors;
+
+#define CHECK(cond, msg) do { if( !(cond) ) { ++num_errors; printf("FAILED at line %d: %s\n", __LINE__, msg); } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SD Card emulation
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  CARD_IDLE,
+  CARD_READ_MULTI,
+  CARD_WRITE_SINGLE,    // waiting for the 0xfe start token
+  CARD_WRITE_MULTI,     // waiting for the 0xfc data or 0xfd stop token
+  CARD_WRITE_REJECTED,  // a block has been rejected, only the stop token is allowed
+  CARD_WRITE_DATA,
+} card_state_t;
+
+static u8 disk[NUM_BLOCKS][512];
+static u8 card_block_addressing;
+static card_state_t card_state;
+static u8 card_cs_active;
+static u8 card_app_cmd;
+static u8 card_multi_write;
+static u8 card_read_stalled;
+
+// output FIFO of the card, 0x00 bytes at the end are the busy phase
+static u8 card_out[2048];
+static u32 card_out_head, card_out_tail;
+
+static u8 card_cmd[6];
+static u8 card_cmd_len;
+static u32 card_block;
+static u8 card_data[514];
+static u32 card_data_len;
+
+// fault injection
+static u8 fault_r1;               // R1 response of data commands
+static s32 fault_no_start_block;  // card stops sending at this block
+static s32 fault_error_block;     // data error token at this block
+static s32 fault_reject_block;    // data response "CRC error" at this block
+static s32 fault_busy_block;      // card stays busy after this block
+static u8 fault_no_card;
+static u8 card_busy_forever;
+static u8 card_abort_expected;
+
+// statistics
+static u32 num_cmds[64];
+static u32 last_erase_count;
+static u32 num_stop_tokens;
+static u32 num_spi_bytes;
+
+static u32 rnd_seed = 1;
+static u32 rnd(u32 n)
+{
+  rnd_seed = rnd_seed * 1103515245u + 12345u;
+  return (rnd_seed >> 8) % n;
+}
+
+static void card_push(u8 b)
+{
+  card_out[card_out_tail++ % sizeof(card_out)] = b;
+}
+
+static void card_push_busy(void)
+{
+  int i, n = rnd(40);
+  for(i=0; i<n; ++i)
+    card_push(0x00);
+}
+
+static u32 card_out_pending(void)
+{
+  return card_out_tail - card_out_head;
+}
+
+static void card_reset(void)
+{
+  card_state = CARD_IDLE;
+  card_out_head = card_out_tail = 0;
+  card_cmd_len = 0;
+  card_app_cmd = 0;
+  card_busy_forever = 0;
+  card_abort_expected = 0;
+  fault_r1 = 0;
+  fault_no_start_block = fault_error_block = fault_reject_block = fault_busy_block = -1;
+  fault_no_card = 0;
+  memset(num_cmds, 0, sizeof(num_cmds));
+  last_erase_count = 0;
+  num_stop_tokens = 0;
+}
+
+// gap (at least the clocking byte after R1), start token, data and CRC
+static void card_push_block(void)
+{
+  int i, gap = 1 + rnd(4);
+
+  for(i=0; i<gap; ++i)
+    card_push(0xff);
+
+  if( card_block >= NUM_BLOCKS || (s32)card_block == fault_error_block ) {
+    card_push(0x08); // data error token: out of range
+    card_read_stalled = 1; // a multi block read still has to be stopped
+    return;
+  }
+
+  card_push(0xfe);
+  for(i=0; i<512; ++i)
+    card_push(disk[card_block][i]);
+  card_push(0x12);
+  card_push(0x34);
+  ++card_block;
+}
+
+static s32 card_address(u32 arg)
+{
+  if( card_block_addressing )
+    return arg;
+
+  CHECK((arg % 512) == 0, "byte address isn't sector aligned");
+  return arg / 512;
+}
+
+static void card_execute(void)
+{
+  u8 cmd = card_cmd[0] & 0x3f;
+  u32 arg = (card_cmd[1] << 24) | (card_cmd[2] << 16) | (card_cmd[3] << 8) | card_cmd[4];
+
+  ++num_cmds[cmd];
+
+  if( card_state == CARD_READ_MULTI ) {
+    CHECK(cmd == 12, "command other than CMD12 during a multi block read");
+    card_out_head = card_out_tail = 0;
+    card_push(0x3c); // stuff byte (bit 7 cleared)
+    card_push(0xff);
+    card_push(0x00); // R1
+    card_push_busy();
+    card_state = CARD_IDLE;
+    return;
+  }
+
+  card_push(0xff); // NCR
+
+  if( card_app_cmd && cmd == 23 ) {
+    card_app_cmd = 0;
+    last_erase_count = arg;
+    card_push(0x00);
+    return;
+  }
+  card_app_cmd = 0;
+
+  switch( cmd ) {
+  case 55:
+    card_app_cmd = 1;
+    card_push(0x00);
+    break;
+
+  case 17:
+  case 18:
+  case 24:
+  case 25:
+    if( fault_r1 ) {
+      card_push(fault_r1);
+      break;
+    }
+    card_push(0x00);
+    card_block = card_address(arg);
+
+    if( cmd == 17 )
+      card_push_block();
+    else if( cmd == 18 ) {
+      card_state = CARD_READ_MULTI;
+      card_read_stalled = 0;
+    }
+    else {
+      card_multi_write = cmd == 25;
+      card_state = card_multi_write ? CARD_WRITE_MULTI : CARD_WRITE_SINGLE;
+    }
+    break;
+
+  case 12:
+    CHECK(0, "CMD12 without multi block read");
+    card_push(0x04);
+    break;
+
+  default:
+    card_push(0x04); // illegal command
+  }
+}
+
+static void card_receive_block(void)
+{
+  if( (s32)card_block == fault_reject_block || card_block >= NUM_BLOCKS ) {
+    card_push(0xeb); // data rejected due to CRC error
+    card_push_busy();
+    card_state = card_multi_write ? CARD_WRITE_REJECTED : CARD_IDLE;
+    return;
+  }
+
+  memcpy(disk[card_block], card_data, 512);
+  card_push(0xe5); // data accepted
+  card_push_busy();
+  if( (s32)card_block == fault_busy_block )
+    card_busy_forever = 1;
+  ++card_block;
+  card_state = card_multi_write ? CARD_WRITE_MULTI : CARD_IDLE;
+}
+
+static void card_input(u8 b)
+{
+  switch( card_state ) {
+  case CARD_WRITE_DATA:
+    card_data[card_data_len++] = b;
+    if( card_data_len == 514 )
+      card_receive_block();
+    return;
+
+  case CARD_WRITE_SINGLE:
+    if( b == 0xfe ) {
+      card_state = CARD_WRITE_DATA;
+      card_data_len = 0;
+    } else
+      CHECK(b == 0xff, "unexpected byte before the start token");
+    return;
+
+  case CARD_WRITE_MULTI:
+  case CARD_WRITE_REJECTED:
+    if( b == 0xfc ) {
+      CHECK(card_out_pending() == 0 && !card_busy_forever, "data token while the card is busy");
+      CHECK(card_state != CARD_WRITE_REJECTED, "data token after a rejected block");
+      card_state = CARD_WRITE_DATA;
+      card_data_len = 0;
+    } else if( b == 0xfd ) {
+      CHECK(card_out_pending() == 0 && !card_busy_forever, "stop token while the card is busy");
+      ++num_stop_tokens;
+      card_push(0xff);
+      card_push_busy();
+      card_state = CARD_IDLE;
+    } else
+      CHECK(b == 0xff, "unexpected byte during a multi block write");
+    return;
+
+  default:
+    if( card_cmd_len == 0 ) {
+      if( (b & 0xc0) != 0x40 )
+	return;
+      CHECK(card_state == CARD_READ_MULTI || card_out_pending() == 0, "command while the card is busy");
+    }
+    card_cmd[card_cmd_len++] = b;
+    if( card_cmd_len == 6 ) {
+      card_cmd_len = 0;
+      card_execute();
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs: the SPI port is connected to the emulated card
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_DELAY_Wait_uS(u16 uS) { return 0; }
+s32 MIOS32_SPI_IO_Init(u8 spi, mios32_spi_pin_driver_t spi_pin_driver) { return 0; }
+s32 MIOS32_SPI_TransferModeInit(u8 spi, mios32_spi_mode_t spi_mode, mios32_spi_prescaler_t spi_prescaler) { return 0; }
+
+s32 MIOS32_SPI_RC_PinSet(u8 spi, u8 rc_pin, u8 pin_value)
+{
+  if( pin_value && card_cs_active ) {
+    if( !card_abort_expected ) {
+      CHECK(card_state == CARD_IDLE, "chip select released during a multi block transfer");
+      CHECK(card_out_pending() == 0 && !card_busy_forever, "chip select released while the card is busy");
+    }
+    card_state = CARD_IDLE;
+    card_out_head = card_out_tail = 0;
+    card_cmd_len = 0;
+    card_busy_forever = 0;
+  }
+  card_cs_active = !pin_value;
+  return 0;
+}
+
+s32 MIOS32_SPI_TransferByte(u8 spi, u8 b)
+{
+  u8 ret = 0xff;
+
+  ++num_spi_bytes;
+  if( !card_cs_active || fault_no_card )
+    return 0xff;
+
+  if( card_state == CARD_READ_MULTI && !card_out_pending() && !card_read_stalled && (s32)card_block != fault_no_start_block )
+    card_push_block();
+
+  if( card_out_pending() )
+    ret = card_out[card_out_head++ % sizeof(card_out)];
+  else if( card_busy_forever )
+    ret = 0x00;
+
+  card_input(b);
+  return ret;
+}
+
+s32 MIOS32_SPI_TransferBlock(u8 spi, u8 *send_buffer, u8 *receive_buffer, u16 len, void *callback)
+{
+  int i;
+  for(i=0; i<len; ++i) {
+    u8 b = MIOS32_SPI_TransferByte(spi, send_buffer ? send_buffer[i] : 0xff);
+    if( receive_buffer )
+      receive_buffer[i] = b;
+  }
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Helpers
+/////////////////////////////////////////////////////////////////////////////
+
+static u8 image[NUM_BLOCKS][512];
+static u8 buffer[32*512];
+
+static void fill_random(u8 *data, u32 len)
+{
+  u32 i;
+  for(i=0; i<len; ++i)
+    data[i] = rnd(256);
+}
+
+static void card_select(u8 type)
+{
+  card_reset();
+  CardType = type;
+  card_block_addressing = (type & CT_BLOCK) ? 1 : 0;
+  fill_random(&disk[0][0], sizeof(disk));
+  memcpy(image, disk, sizeof(disk));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Random transfers compared with the reference image
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_random_transfers(u8 type, const char *name)
+{
+  int round;
+
+  card_select(type);
+
+  for(round=0; round<300; ++round) {
+    u32 count = 1 + rnd(32);
+    u32 sector = rnd(NUM_BLOCKS - count + 1);
+    s32 status;
+
+    num_cmds[23] = num_cmds[18] = num_cmds[25] = 0;
+    last_erase_count = 0;
+
+    if( rnd(2) ) {
+      memset(buffer, 0xaa, sizeof(buffer));
+      status = MIOS32_SDCARD_SectorsRead(sector, buffer, count);
+      CHECK(status == 0, name);
+      CHECK(memcmp(buffer, image[sector], count*512) == 0, "read data differs");
+      CHECK(num_cmds[18] == (count > 1), "CMD18 only used for multiple sectors");
+      CHECK(num_cmds[12] == num_cmds[18], "CMD12 missing");
+    } else {
+      fill_random(buffer, count*512);
+      status = MIOS32_SDCARD_SectorsWrite(sector, buffer, count);
+      CHECK(status == 0, name);
+      memcpy(image[sector], buffer, count*512);
+      CHECK(memcmp(disk, image, sizeof(disk)) == 0, "written data differs");
+      CHECK(num_cmds[25] == (count > 1), "CMD25 only used for multiple sectors");
+      if( count > 1 && (type & CT_SDC) )
+	CHECK(num_cmds[23] == 1 && last_erase_count == count, "ACMD23 with block count missing");
+      else
+	CHECK(num_cmds[23] == 0, "ACMD23 sent to MMC or for a single sector");
+    }
+    num_cmds[12] = 0;
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Error paths
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_errors(void)
+{
+  s32 status;
+
+  // R1 error flags are returned as negative values
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_r1 = 0x20;
+  CHECK(MIOS32_SDCARD_SectorsRead(10, buffer, 4) == -0x20, "CMD18 address error not returned");
+  CHECK(MIOS32_SDCARD_SectorsWrite(10, buffer, 4) == -0x20, "CMD25 address error not returned");
+  CHECK(MIOS32_SDCARD_SectorRead(10, buffer) == -0x20, "CMD17 address error not returned");
+  CHECK(MIOS32_SDCARD_SectorWrite(10, buffer) == -0x20, "CMD24 address error not returned");
+  CHECK(memcmp(disk, image, sizeof(disk)) == 0, "data written despite R1 error");
+
+  // start token doesn't arrive: the transfer still has to be stopped with CMD12
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_no_start_block = 13;
+  memset(buffer, 0, sizeof(buffer));
+  status = MIOS32_SDCARD_SectorsRead(10, buffer, 8);
+  CHECK(status == -257, "start token timeout not returned");
+  CHECK(num_cmds[12] == 1, "CMD12 not sent after start token timeout");
+  CHECK(memcmp(buffer, image[10], 3*512) == 0, "blocks before the timeout differ");
+
+  // data error token instead of the start token
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_error_block = 20;
+  status = MIOS32_SDCARD_SectorsRead(16, buffer, 8);
+  CHECK(status == -257, "data error token not returned");
+  CHECK(num_cmds[12] == 1, "CMD12 not sent after data error token");
+  CHECK(memcmp(buffer, image[16], 4*512) == 0, "blocks before the error token differ");
+
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_error_block = 5;
+  CHECK(MIOS32_SDCARD_SectorRead(5, buffer) == -257, "single block data error token not returned");
+
+  // beyond the card: CMD18 is accepted, but the first block fails
+  card_select(CT_SD2 | CT_BLOCK);
+  CHECK(MIOS32_SDCARD_SectorsRead(NUM_BLOCKS-2, buffer, 4) == -257, "out of range read not detected");
+
+  // rejected block: the card is busy before the stop token is allowed,
+  // the following blocks mustn't be written
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_reject_block = 33;
+  fill_random(buffer, 8*512);
+  status = MIOS32_SDCARD_SectorsWrite(30, buffer, 8);
+  CHECK(status == -257, "rejected block not returned");
+  CHECK(num_stop_tokens == 1, "stop token not sent after the rejected block");
+  CHECK(memcmp(disk[30], buffer, 3*512) == 0, "blocks before the rejected block not written");
+  CHECK(memcmp(disk[33], image[33], 5*512) == 0, "blocks after the rejected block written");
+
+  card_select(CT_SD1);
+  fault_reject_block = 7;
+  CHECK(MIOS32_SDCARD_SectorWrite(7, buffer) == -257, "single block rejection not returned");
+
+  // card stays busy
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_busy_block = 41;
+  card_abort_expected = 1;
+  CHECK(MIOS32_SDCARD_SectorsWrite(40, buffer, 4) == -258, "busy timeout not returned");
+
+  // no card
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_no_card = 1;
+  CHECK(MIOS32_SDCARD_SectorsRead(0, buffer, 4) == -256, "missing card not detected on read");
+  CHECK(MIOS32_SDCARD_SectorsWrite(0, buffer, 4) == -256, "missing card not detected on write");
+
+  // the card is usable again after all errors
+  card_select(CT_SD2 | CT_BLOCK);
+  fault_error_block = 3;
+  MIOS32_SDCARD_SectorsRead(0, buffer, 8);
+  fault_error_block = -1;
+  CHECK(MIOS32_SDCARD_SectorsRead(0, buffer, 8) == 0, "read failed after an error");
+  CHECK(memcmp(buffer, image[0], 8*512) == 0, "read data differs after an error");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SPI bytes per sector of single and multi block reads
+/////////////////////////////////////////////////////////////////////////////
+
+static void measure_overhead(void)
+{
+  int i;
+
+  card_select(CT_SD2 | CT_BLOCK);
+
+  num_spi_bytes = 0;
+  for(i=0; i<32; ++i)
+    MIOS32_SDCARD_SectorRead(i, buffer + i*512);
+  u32 single_bytes = num_spi_bytes;
+
+  num_spi_bytes = 0;
+  MIOS32_SDCARD_SectorsRead(0, buffer, 32);
+  u32 multi_bytes = num_spi_bytes;
+
+  printf("SPI bytes per sector: %.1f single block, %.1f multi block (32 sectors)\n",
+	 single_bytes / 32.0, multi_bytes / 32.0);
+  CHECK(multi_bytes < single_bytes, "multi block read isn't cheaper");
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_random_transfers(CT_SD2 | CT_BLOCK, "SDHC transfer failed");
+  test_random_transfers(CT_SD2, "SD2 transfer failed");
+  test_random_transfers(CT_SD1, "SD1 transfer failed");
+  test_random_transfers(CT_MMC, "MMC transfer failed");
+  test_errors();
+  measure_overhead();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
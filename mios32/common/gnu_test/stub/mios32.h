@@ -0,0 +1,26 @@
+// Minimal host replacement of <mios32.h> for the SD Card driver test:
+// the SPI functions are implemented by the SD Card emulator of the test
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+#define MIOS32_SYS_CPU_FREQUENCY 72000000
+
+#include <mios32_spi.h>
+#include <mios32_sdcard.h>
+
+extern s32 MIOS32_DELAY_Wait_uS(u16 uS);
+
+#endif /* _MIOS32_H */
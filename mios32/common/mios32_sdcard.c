@@ -108,6 +108,18 @@
 #define SDCMD_WRITE_SINGLE_BLOCK (0x40+24)
 #define SDCMD_WRITE_SINGLE_BLOCK_CRC 0xff
 
+#define SDCMD_STOP_TRANSMISSION	(0x40+12)
+#define SDCMD_STOP_TRANSMISSION_CRC 0xff
+
+#define SDCMD_READ_MULTIPLE_BLOCK (0x40+18)
+#define SDCMD_READ_MULTIPLE_BLOCK_CRC 0xff
+
+#define SDCMD_WRITE_MULTIPLE_BLOCK (0x40+25)
+#define SDCMD_WRITE_MULTIPLE_BLOCK_CRC 0xff
+
+#define SDCMD_SET_WR_BLK_ERASE_COUNT (0xC0+23)
+#define SDCMD_SET_WR_BLK_ERASE_COUNT_CRC 0xff
+
 
 /* Card type flags (CardType) */
 #define CT_MMC				0x01
@@ -450,17 +462,18 @@ s32 MIOS32_SDCARD_SectorRead(u32 sector, u8 *buffer)
   MIOS32_SPI_TransferModeInit(MIOS32_SDCARD_SPI, MIOS32_SPI_MODE_CLK1_PHASE1, MIOS32_SDCARD_SPI_PRESCALER);
 
   if( (status=MIOS32_SDCARD_SendSDCCmd(SDCMD_READ_SINGLE_BLOCK, sector, SDCMD_READ_SINGLE_BLOCK_CRC)) ) {
-    status=(status < 0) ? -256 : status; // return timeout indicator or error flags
+    status=(status < 0) ? -256 : -status; // return timeout indicator or error flags
     goto error;
   }
   
   // wait for start token of the data block
+  u8 ret = 0xff;
   for(i=0; i<65536; ++i) { // TODO: check if sufficient
-    u8 ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+    ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
     if( ret != 0xff )
       break;
   }
-  if( i == 65536 ) {
+  if( ret != 0xfe ) { // timeout or data error token
     status= -257;
     goto error;
   }
@@ -526,7 +539,7 @@ s32 MIOS32_SDCARD_SectorWrite(u32 sector, u8 *buffer)
   MIOS32_SPI_TransferModeInit(MIOS32_SDCARD_SPI, MIOS32_SPI_MODE_CLK1_PHASE1, MIOS32_SDCARD_SPI_PRESCALER);
 
   if( (status=MIOS32_SDCARD_SendSDCCmd(SDCMD_WRITE_SINGLE_BLOCK, sector, SDCMD_WRITE_SINGLE_BLOCK_CRC)) ) {
-    status=(status < 0) ? -256 : status; // return timeout indicator or error flags
+    status=(status < 0) ? -256 : -status; // return timeout indicator or error flags
     goto error;
   }  
 
@@ -547,19 +560,257 @@ s32 MIOS32_SDCARD_SectorWrite(u32 sector, u8 *buffer)
 
   // read response
   u8 response = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+  // wait for write completion (the card can also be busy after a rejected block)
+  for(i=0; i<32*65536; ++i) { // TODO: check if sufficient
+    u8 ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+    if( ret != 0x00 )
+      break;
+  }
+  if( i == 32*65536 ) {
+
+    status= -258;
+    goto error;
+  }
+
   if( (response & 0x0f) != 0x5 ) {
     status= -257;
     goto error;
   }
 
+  // required for clocking (see spec)
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+error:
+  // deactivate chip select
+  MIOS32_SPI_RC_PinSet(MIOS32_SDCARD_SPI, MIOS32_SDCARD_SPI_RC_PIN, 1); // spi, rc_pin, pin_value
+  // Send dummy byte once deactivated to drop cards DO
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+  MIOS32_SDCARD_MUTEX_GIVE;
+
+  return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local function: terminates a CMD18 multi block read
+// The card is still streaming data when CMD12 is sent, therefore the byte
+// which follows the command is a stuff byte and has to be skipped before
+// the R1 response is polled. Afterwards the card can be busy for a while.
+// returns 0 on success, -259 on timeout
+/////////////////////////////////////////////////////////////////////////////
+static s32 MIOS32_SDCARD_StopTransmission(void)
+{
+  int i;
+  u32 addr = 0;
+
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, SDCMD_STOP_TRANSMISSION);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, (addr >> 24) & 0xff);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, (addr >> 16) & 0xff);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, (addr >>  8) & 0xff);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, (addr >>  0) & 0xff);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, SDCMD_STOP_TRANSMISSION_CRC);
+
+  // skip stuff byte
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+  // wait for R1 response (bit 7 cleared)
+  for(i=0; i<8; ++i) {
+    if( !(MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff) & 0x80) )
+      break;
+  }
+  if( i == 8 )
+    return -259;
+
+  // wait until card is not busy anymore
+  for(i=0; i<32*65536; ++i) { // TODO: check if sufficient
+    if( MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff) != 0x00 )
+      break;
+  }
+  if( i == 32*65536 )
+    return -259;
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Reads multiple consecutive sectors with a single CMD18 transfer.<BR>
+//! Compared to MIOS32_SDCARD_SectorRead() the command/response and access
+//! latency is only paid once for the whole sequence, each 512 byte data
+//! phase is transfered via DMA.
+//! \param[in] sector 32bit sector of the first block
+//! \param[in] *buffer pointer to buffer which can store count*512 bytes
+//! \param[in] count number of sectors which should be read
+//! \return 0 if all sectors have been successfully read
+//! \return -error if error occured during read operation (see MIOS32_SDCARD_SectorRead)
+//! \return -256 if timeout during command has been sent
+//! \return -257 if timeout while waiting for start token
+//! \return -259 if transmission couldn't be stopped
+/////////////////////////////////////////////////////////////////////////////
+s32 MIOS32_SDCARD_SectorsRead(u32 sector, u8 *buffer, u32 count)
+{
+  s32 status = 0;
+  int i;
+
+  if( count == 0 )
+    return 0;
+  if( count == 1 )
+    return MIOS32_SDCARD_SectorRead(sector, buffer);
+
+  if (!(CardType & CT_BLOCK))
+	sector *= 512;
+
+  MIOS32_SDCARD_MUTEX_TAKE;
+
+  // init SPI port for fast frequency access (ca. 18 MBit/s)
+  // this is required for the case that the SPI port is shared with other devices
+  MIOS32_SPI_TransferModeInit(MIOS32_SDCARD_SPI, MIOS32_SPI_MODE_CLK1_PHASE1, MIOS32_SDCARD_SPI_PRESCALER);
+
+  if( (status=MIOS32_SDCARD_SendSDCCmd(SDCMD_READ_MULTIPLE_BLOCK, sector, SDCMD_READ_MULTIPLE_BLOCK_CRC)) ) {
+    status=(status < 0) ? -256 : -status; // return timeout indicator or error flags
+    goto error;
+  }
+
+  while( count ) {
+    // wait for start token of the data block
+    u8 ret = 0xff;
+    for(i=0; i<65536; ++i) { // TODO: check if sufficient
+      ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+      if( ret != 0xff )
+	break;
+    }
+    if( ret != 0xfe ) { // timeout or data error token
+      status= -257;
+      break;
+    }
+
+    // read 512 bytes via DMA
+#ifdef MIOS32_SDCARD_TASK_SUSPEND_HOOK
+    MIOS32_SPI_TransferBlock(MIOS32_SDCARD_SPI, NULL, buffer, 512, MIOS32_SDCARD_TASK_RESUME_HOOK);
+    MIOS32_SDCARD_TASK_SUSPEND_HOOK();
+#else
+    MIOS32_SPI_TransferBlock(MIOS32_SDCARD_SPI, NULL, buffer, 512, NULL);
+#endif
+
+    // read (and ignore) CRC
+    MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+    MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+    buffer += 512;
+    --count;
+  }
+
+  // stop the transfer - also required if a data block timed out
+  if( MIOS32_SDCARD_StopTransmission() < 0 && status == 0 )
+    status = -259;
+
+error:
+  // deactivate chip select
+  MIOS32_SPI_RC_PinSet(MIOS32_SDCARD_SPI, MIOS32_SDCARD_SPI_RC_PIN, 1); // spi, rc_pin, pin_value
+
+  // Send dummy byte once deactivated to drop cards DO
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+  MIOS32_SDCARD_MUTEX_GIVE;
+  return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Writes multiple consecutive sectors with a single CMD25 transfer.<BR>
+//! SD Cards are notified about the number of blocks with ACMD23 before,
+//! so that they can pre-erase the area. Each 512 byte data phase is
+//! transfered via DMA.
+//! \param[in] sector 32bit sector of the first block
+//! \param[in] *buffer pointer to buffer which contains count*512 bytes
+//! \param[in] count number of sectors which should be written
+//! \return 0 if all sectors have been successfully written
+//! \return -error if error occured during write operation (see MIOS32_SDCARD_SectorWrite)
+//! \return -256 if timeout during command has been sent
+//! \return -257 if write operation not accepted
+//! \return -258 if timeout during write operation
+/////////////////////////////////////////////////////////////////////////////
+s32 MIOS32_SDCARD_SectorsWrite(u32 sector, u8 *buffer, u32 count)
+{
+  s32 status = 0;
+  int i;
+
+  if( count == 0 )
+    return 0;
+  if( count == 1 )
+    return MIOS32_SDCARD_SectorWrite(sector, buffer);
+
+  MIOS32_SDCARD_MUTEX_TAKE;
+
+  if (!(CardType & CT_BLOCK))
+	sector *= 512;
+
+  // init SPI port for fast frequency access (ca. 18 MBit/s)
+  // this is required for the case that the SPI port is shared with other devices
+  MIOS32_SPI_TransferModeInit(MIOS32_SDCARD_SPI, MIOS32_SPI_MODE_CLK1_PHASE1, MIOS32_SDCARD_SPI_PRESCALER);
+
+  // pre-erase (only a hint for the card, therefore the response is ignored)
+  if( CardType & CT_SDC ) {
+    MIOS32_SDCARD_SendSDCCmd(SDCMD_SET_WR_BLK_ERASE_COUNT, count, SDCMD_SET_WR_BLK_ERASE_COUNT_CRC);
+  }
+
+  if( (status=MIOS32_SDCARD_SendSDCCmd(SDCMD_WRITE_MULTIPLE_BLOCK, sector, SDCMD_WRITE_MULTIPLE_BLOCK_CRC)) ) {
+    status=(status < 0) ? -256 : -status; // return timeout indicator or error flags
+    goto error;
+  }
+
+  while( count ) {
+    // send start token (multi block write)
+    MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xfc);
+
+    // send 512 bytes of data via DMA
+#ifdef MIOS32_SDCARD_TASK_SUSPEND_HOOK
+    MIOS32_SPI_TransferBlock(MIOS32_SDCARD_SPI, buffer, NULL, 512, MIOS32_SDCARD_TASK_RESUME_HOOK);
+    MIOS32_SDCARD_TASK_SUSPEND_HOOK();
+#else
+    MIOS32_SPI_TransferBlock(MIOS32_SDCARD_SPI, buffer, NULL, 512, NULL);
+#endif
+
+    // send CRC
+    MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+    MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+    // read response
+    u8 response = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
+    // wait for block programming completion - also after a rejected block,
+    // the stop token mustn't be sent while the card is busy
+    for(i=0; i<32*65536; ++i) { // TODO: check if sufficient
+      u8 ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+      if( ret != 0x00 )
+	break;
+    }
+    if( i == 32*65536 ) {
+      status= -258;
+      goto error;
+    }
+
+    if( (response & 0x0f) != 0x5 ) {
+      status= -257;
+      break;
+    }
+
+    buffer += 512;
+    --count;
+  }
+
+  // send stop token
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xfd);
+  MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
+
   // wait for write completion
   for(i=0; i<32*65536; ++i) { // TODO: check if sufficient
     u8 ret = MIOS32_SPI_TransferByte(MIOS32_SDCARD_SPI, 0xff);
     if( ret != 0x00 )
       break;
   }
-  if( i == 32*65536 ) {
-
+  if( i == 32*65536 && status == 0 ) {
     status= -258;
     goto error;
   }
@@ -0,0 +1,201 @@
+// $Id$
+//! \defgroup BLM_SCALAR_FRAME
+//!
+//! Bulk frame encoder/decoder for the BLM_SCALAR protocol
+//!
+//! A frame transfers the 16 LEDs of consecutive rows of a colour plane
+//! with a single SysEx message:
+//! <PRE>
+//!   F0 00 00 7E 4E <device> 02 <mode/plane> <first row> <num rows> <data> F7
+//! </PRE>
+//! The LED bits are serialized row by row, starting with bit 0 of the first row.
+//! In RLE mode, each data byte contains the length of a run (0..127) of equal bits,
+//! the first run contains cleared bits, and the bit value toggles after each run.
+//! Runs which are longer than 127 bits are split by an empty run.
+//! In raw mode (BLM_SCALAR_FRAME_MODE_RAW), each row is sent with 3 bytes
+//! (bit 6..0, bit 13..7, bit 15..14). The encoder selects the shorter variant.
+//!
+//! This unit has no hardware dependencies, so that it can also be compiled
+//! and tested on a host.
+//!
+//! \{
+/* ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+//! Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+
+#include "blm_scalar_frame.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Encodes the rows first_row..first_row+num_rows-1 of a colour plane
+//! \param[out] buffer will contain <mode/plane> <first row> <num rows> <data>,
+//!             it has to provide at least 3+BLM_SCALAR_FRAME_MAX_DATA bytes
+//! \param[in] plane the colour plane (0: green, 1: red)
+//! \param[in] rows the LED patterns of all rows
+//! \return number of bytes written into the buffer, < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 BLM_SCALAR_FRAME_Encode(u8 *buffer, u8 plane, u16 *rows, u8 first_row, u8 num_rows)
+{
+  if( num_rows == 0 || num_rows > BLM_SCALAR_FRAME_MAX_ROWS || first_row > 0x7f )
+    return -1; // invalid parameters
+
+  u8 *data = &buffer[3];
+  u32 len = 0;
+
+  // try RLE first
+  {
+    u32 num_bits = 16*num_rows;
+    u32 bit;
+    u8 value = 0;
+    u8 run = 0;
+    for(bit=0; bit<num_bits && len < BLM_SCALAR_FRAME_MAX_DATA; ++bit) {
+      u8 b = (rows[first_row + bit/16] >> (bit % 16)) & 1;
+      if( b != value ) {
+	data[len++] = run;
+	run = 0;
+	value = b;
+      } else if( run == 0x7f ) {
+	data[len++] = run;
+	if( len < BLM_SCALAR_FRAME_MAX_DATA )
+	  data[len++] = 0; // empty run of the other value
+	run = 0;
+      }
+      ++run;
+    }
+
+    if( len < BLM_SCALAR_FRAME_MAX_DATA ) {
+      // the last run of cleared bits doesn't need to be sent
+      if( value )
+	data[len++] = run;
+    } else {
+      len = BLM_SCALAR_FRAME_MAX_DATA + 1; // too long
+    }
+  }
+
+  if( len <= 3*num_rows ) {
+    buffer[0] = plane;
+  } else {
+    int row;
+    len = 0;
+    for(row=0; row<num_rows; ++row) {
+      u16 pattern = rows[first_row + row];
+      data[len++] = pattern & 0x7f;
+      data[len++] = (pattern >> 7) & 0x7f;
+      data[len++] = (pattern >> 14) & 0x03;
+    }
+    buffer[0] = plane | BLM_SCALAR_FRAME_MODE_RAW;
+  }
+
+  buffer[1] = first_row;
+  buffer[2] = num_rows;
+
+  return 3 + len;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Initializes the decoder, should be called when the frame command is received
+/////////////////////////////////////////////////////////////////////////////
+s32 BLM_SCALAR_FRAME_DecoderInit(blm_scalar_frame_decoder_t *decoder)
+{
+  int row;
+
+  decoder->ctr = 0;
+  decoder->mode = 0;
+  decoder->first_row = 0;
+  decoder->num_rows = 0;
+  decoder->bit_pos = 0;
+  decoder->bit_value = 0;
+  decoder->error = 0;
+  for(row=0; row<BLM_SCALAR_FRAME_MAX_ROWS; ++row)
+    decoder->row[row] = 0;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Decodes the next byte of the frame (following to the command byte)
+//! \return < 0 if the frame is invalid
+/////////////////////////////////////////////////////////////////////////////
+s32 BLM_SCALAR_FRAME_DecoderPut(blm_scalar_frame_decoder_t *decoder, u8 midi_in)
+{
+  if( decoder->error )
+    return -1;
+
+  switch( decoder->ctr ) {
+  case 0: decoder->mode = midi_in; break;
+  case 1: decoder->first_row = midi_in; break;
+  case 2: {
+    decoder->num_rows = midi_in;
+    if( midi_in == 0 || midi_in > BLM_SCALAR_FRAME_MAX_ROWS )
+      decoder->error = 1;
+  } break;
+
+  default: {
+    u16 num_bits = 16*decoder->num_rows;
+
+    if( decoder->mode & BLM_SCALAR_FRAME_MODE_RAW ) {
+      u8 row = decoder->bit_pos / 3;
+      u8 pos = decoder->bit_pos % 3;
+      if( row >= decoder->num_rows ) {
+	decoder->error = 1;
+      } else {
+	decoder->row[row] |= (u16)midi_in << (7*pos);
+	++decoder->bit_pos;
+      }
+    } else {
+      u16 end_pos = decoder->bit_pos + midi_in;
+      if( end_pos > num_bits ) {
+	decoder->error = 1;
+      } else {
+	if( decoder->bit_value ) {
+	  u16 bit;
+	  for(bit=decoder->bit_pos; bit<end_pos; ++bit)
+	    decoder->row[bit / 16] |= (1 << (bit % 16));
+	}
+	decoder->bit_pos = end_pos;
+	decoder->bit_value ^= 1;
+      }
+    }
+  }
+  }
+
+  if( decoder->ctr < 0xff )
+    ++decoder->ctr;
+
+  return decoder->error ? -1 : 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Checks the frame after F7 has been received.\n
+//! On success, decoder->row[0..num_rows-1] contain the patterns of the rows
+//! starting at decoder->first_row for the plane decoder->mode & 0x0f
+//! \return number of decoded rows, < 0 if the frame is invalid
+/////////////////////////////////////////////////////////////////////////////
+s32 BLM_SCALAR_FRAME_DecoderFinish(blm_scalar_frame_decoder_t *decoder)
+{
+  if( decoder->error || decoder->ctr < 3 )
+    return -1;
+
+  // raw mode: all rows have to be received
+  // RLE mode: the remaining bits are cleared
+  if( (decoder->mode & BLM_SCALAR_FRAME_MODE_RAW) && decoder->bit_pos != 3*decoder->num_rows )
+    return -1;
+
+  return decoder->num_rows;
+}
+
+//! \}
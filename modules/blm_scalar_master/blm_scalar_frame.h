@@ -0,0 +1,65 @@
+// $Id$
+/*
+ * Header file for BLM_SCALAR bulk frame encoder/decoder
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _BLM_SCALAR_FRAME_H
+#define _BLM_SCALAR_FRAME_H
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// SysEx command of a bulk frame:
+// F0 00 00 7E 4E <device> 02 <mode/plane> <first row> <num rows> <data> F7
+#define BLM_SCALAR_FRAME_SYSEX_CMD 0x02
+
+// capability flag which is sent by the BLM as 7th byte of the layout info
+#define BLM_SCALAR_FRAME_CAP_BULK 0x01
+
+// max. number of rows which can be transfered with a single frame
+#define BLM_SCALAR_FRAME_MAX_ROWS 16
+
+// <mode/plane> byte: bit 3..0 colour plane (0: green, 1: red), bit 4: raw data instead of RLE
+#define BLM_SCALAR_FRAME_MODE_RAW 0x10
+
+// max. data bytes: raw mode takes 3 bytes per row
+#define BLM_SCALAR_FRAME_MAX_DATA (3*BLM_SCALAR_FRAME_MAX_ROWS)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  u8  ctr;       // number of received bytes
+  u8  mode;      // mode/plane byte
+  u8  first_row;
+  u8  num_rows;
+  u16 bit_pos;   // RLE: next bit which will be written; raw: row*3 + byte
+  u8  bit_value; // RLE: value of the next run
+  u8  error;
+  u16 row[BLM_SCALAR_FRAME_MAX_ROWS];
+} blm_scalar_frame_decoder_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 BLM_SCALAR_FRAME_Encode(u8 *buffer, u8 plane, u16 *rows, u8 first_row, u8 num_rows);
+
+extern s32 BLM_SCALAR_FRAME_DecoderInit(blm_scalar_frame_decoder_t *decoder);
+extern s32 BLM_SCALAR_FRAME_DecoderPut(blm_scalar_frame_decoder_t *decoder, u8 midi_in);
+extern s32 BLM_SCALAR_FRAME_DecoderFinish(blm_scalar_frame_decoder_t *decoder);
+
+
+#endif /* _BLM_SCALAR_FRAME_H */
@@ -24,6 +24,7 @@
 #endif
 
 #include "blm_scalar_master.h"
+#include "blm_scalar_frame.h"
 
 /////////////////////////////////////////////////////////////////////////////
 //! Local definitions
@@ -85,6 +86,8 @@ typedef union {
     unsigned COLUMNS_RECEIVED:1;
     unsigned ROWS_RECEIVED:1;
     unsigned COLOURS_RECEIVED:1;
+    unsigned EXTRA_CTR:2;
+    unsigned CAPS_RECEIVED:1;
   } blm;
 
 } sysex_state_t;
@@ -124,6 +127,7 @@ static u8 blm_led_row_offset;
 static u8 blm_num_columns;
 static u8 blm_num_rows;
 static u8 blm_num_colours;
+static u8 blm_caps;
 static u8 blm_force_update;
 
 static s32 (*blm_button_callback_func)(u8 blm, blm_scalar_master_element_t element_id, u8 button_x, u8 button_y, u8 button_depressed);
@@ -159,6 +163,9 @@ static s32 BLM_SCALAR_MASTER_SYSEX_Cmd_Ping(mios32_midi_port_t port, sysex_cmd_s
 static s32 BLM_SCALAR_MASTER_SYSEX_SendAck(mios32_midi_port_t port, u8 ack_code, u8 ack_arg);
 
 static s32 BLM_SendPackets(mios32_midi_package_t *packets, u8 num_packets);
+#if BLM_SCALAR_MASTER_BULK_FRAMES
+static s32 BLM_SendFrame(u8 plane, u16 *leds, u16 *leds_sent, u8 force_update, int num_rows);
+#endif
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -178,6 +185,7 @@ s32 BLM_SCALAR_MASTER_Init(u32 mode)
   blm_num_columns = 16;
   blm_num_rows = 16;
   blm_num_colours = 2;
+  blm_caps = 0;
   blm_force_update = 0;
   blm_leds_rotate_view = 0;
   blm_led_row_offset = 0;
@@ -648,6 +656,7 @@ static s32 BLM_SCALAR_MASTER_SYSEX_Cmd_Layout(mios32_midi_port_t port, sysex_cmd
   switch( cmd_state ) {
 
     case SYSEX_CMD_STATE_BEGIN:
+      blm_caps = 0; // only sent by newer BLMs
       break;
 
     case SYSEX_CMD_STATE_CONT:
@@ -664,6 +673,11 @@ static s32 BLM_SCALAR_MASTER_SYSEX_Cmd_Layout(mios32_midi_port_t port, sysex_cmd
       } else if( !sysex_state.blm.COLOURS_RECEIVED ) {
 	sysex_state.blm.COLOURS_RECEIVED = 1;
 	blm_num_colours = midi_in;
+      } else if( sysex_state.blm.EXTRA_CTR < 3 ) {
+	++sysex_state.blm.EXTRA_CTR; // number of extra rows, columns and buttons
+      } else if( !sysex_state.blm.CAPS_RECEIVED ) {
+	sysex_state.blm.CAPS_RECEIVED = 1;
+	blm_caps = midi_in;
       }
       // ignore all other bytes
       // don't sent error message to allow future extensions
@@ -834,8 +848,24 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
   {
     int i;
     int num_rows = blm_leds_rotate_view ? BLM_SCALAR_MASTER_NUM_ROWS : blm_num_rows;
+
+    // bulk frames for the colour planes (not for the rotated view, which is transfered column-wise)
+    u8 bulk_planes = 0;
+#if BLM_SCALAR_MASTER_BULK_FRAMES
+    if( (blm_caps & BLM_SCALAR_FRAME_CAP_BULK) && !blm_leds_rotate_view &&
+	blm_connection_state == BLM_SCALAR_MASTER_CONNECTION_STATE_SYSEX ) {
+      if( BLM_SendFrame(0, blm_scalar_master_leds_green, blm_scalar_master_leds_green_sent, force_update, num_rows) > 0 )
+	bulk_planes |= 1;
+      if( blm_num_colours >= 2 &&
+	  BLM_SendFrame(1, blm_scalar_master_leds_red, blm_scalar_master_leds_red_sent, force_update, num_rows) > 0 )
+	bulk_planes |= 2;
+    }
+#endif
+
     for(i=0; i<num_rows; ++i) {
       u8 led_row = i + blm_led_row_offset;
+      u8 send_green = !(bulk_planes & 1);
+      u8 send_red = !(bulk_planes & 2);
 
       u16 pattern_green = blm_scalar_master_leds_green[led_row];
       u16 prev_pattern_green = blm_scalar_master_leds_green_sent[led_row];
@@ -845,7 +875,7 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
       if( force_update || pattern_green != prev_pattern_green || pattern_red != prev_pattern_red ) {
 
         // Note: the MIOS32 MIDI driver will take care about running status to optimize the stream
-        if( force_update || ((pattern_green ^ prev_pattern_green) & 0x00ff) ) {
+        if( send_green && (force_update || ((pattern_green ^ prev_pattern_green) & 0x00ff)) ) {
           u8 pattern8 = pattern_green;
           p.chn = i;
           p.cc_number = 8*blm_leds_rotate_view + ((pattern8 & 0x80) ? 17 : 16); // CC number + MSB LED
@@ -854,7 +884,7 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
           SEND_PACKET(p);
         }
 
-        if( force_update || ((pattern_green ^ prev_pattern_green) & 0xff00) ) {
+        if( send_green && (force_update || ((pattern_green ^ prev_pattern_green) & 0xff00)) ) {
           u8 pattern8 = pattern_green >> 8;
           p.chn = i;
           p.cc_number = 8*blm_leds_rotate_view + ((pattern8 & 0x80) ? 19 : 18); // CC number + MSB LED
@@ -863,7 +893,7 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
           SEND_PACKET(p);
         }       
 
-        if( force_update || ((pattern_red ^ prev_pattern_red) & 0x00ff) ) {
+        if( send_red && (force_update || ((pattern_red ^ prev_pattern_red) & 0x00ff)) ) {
           u8 pattern8 = pattern_red;
           p.chn = i;
           p.cc_number = 8*blm_leds_rotate_view + ((pattern8 & 0x80) ? 33 : 32); // CC number + MSB LED
@@ -872,7 +902,7 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
           SEND_PACKET(p);
         }
 
-        if( force_update || ((pattern_red ^ prev_pattern_red) & 0xff00) ) {
+        if( send_red && (force_update || ((pattern_red ^ prev_pattern_red) & 0xff00)) ) {
           u8 pattern8 = pattern_red >> 8;
           p.chn = i;
           p.cc_number = 8*blm_leds_rotate_view + ((pattern8 & 0x80) ? 35 : 34); // CC number + MSB LED
@@ -881,8 +911,11 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
           SEND_PACKET(p);
         }       
 
-        blm_scalar_master_leds_green_sent[led_row] = pattern_green;
-        blm_scalar_master_leds_red_sent[led_row] = pattern_red;
+        // (bulk frames have already updated the sent patterns)
+        if( send_green )
+          blm_scalar_master_leds_green_sent[led_row] = pattern_green;
+        if( send_red )
+          blm_scalar_master_leds_red_sent[led_row] = pattern_red;
       }
     }
   }
@@ -994,6 +1027,75 @@ s32 BLM_SCALAR_MASTER_Periodic_mS(void)
   return 0; // no error
 }
 
+#if BLM_SCALAR_MASTER_BULK_FRAMES
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which sends the changed rows of a colour plane with a single
+//! bulk frame (see blm_scalar_frame.c) if this takes less bytes than the CCs
+//! \return 1 if the frame has been sent, 0 if CCs should be sent instead
+/////////////////////////////////////////////////////////////////////////////
+static s32 BLM_SendFrame(u8 plane, u16 *leds, u16 *leds_sent, u8 force_update, int num_rows)
+{
+  u16 rows[BLM_SCALAR_MASTER_NUM_ROWS];
+  int first_row = -1;
+  int last_row = -1;
+  int cc_bytes = 0;
+  int i;
+
+  for(i=0; i<num_rows; ++i) {
+    u8 led_row = i + blm_led_row_offset;
+    rows[i] = leds[led_row]; // take a copy, the patterns could be changed by another task
+
+    u16 changed = force_update ? 0xffff : (rows[i] ^ leds_sent[led_row]);
+    if( changed ) {
+      if( first_row < 0 )
+	first_row = i;
+      last_row = i;
+
+      // each 8 LED half row is sent with a 3 byte CC
+      if( changed & 0x00ff )
+	cc_bytes += 3;
+      if( changed & 0xff00 )
+	cc_bytes += 3;
+    }
+  }
+
+  if( first_row < 0 || (last_row - first_row) >= BLM_SCALAR_FRAME_MAX_ROWS )
+    return 0; // nothing to send, or too many rows for a frame
+
+  u8 sysex_buffer[sizeof(blm_sysex_header) + 2 + 3 + BLM_SCALAR_FRAME_MAX_DATA + 1];
+  u8 *sysex_buffer_ptr = &sysex_buffer[0];
+
+  for(i=0; i<sizeof(blm_sysex_header); ++i)
+    *sysex_buffer_ptr++ = blm_sysex_header[i];
+
+  // device ID
+  *sysex_buffer_ptr++ = sysex_device_id;
+
+  // frame
+  *sysex_buffer_ptr++ = BLM_SCALAR_FRAME_SYSEX_CMD;
+  s32 len = BLM_SCALAR_FRAME_Encode(sysex_buffer_ptr, plane, rows, first_row, last_row - first_row + 1);
+  if( len < 0 )
+    return 0;
+  sysex_buffer_ptr += len;
+
+  // send footer
+  *sysex_buffer_ptr++ = 0xf7;
+
+  u32 sysex_len = (u32)sysex_buffer_ptr - ((u32)&sysex_buffer[0]);
+  if( sysex_len >= cc_bytes )
+    return 0; // CCs are more efficient
+
+  BLM_SCALAR_MASTER_MUTEX_MIDIOUT_TAKE;
+  MIOS32_MIDI_SendSysEx(blm_midi_port, (u8 *)sysex_buffer, sysex_len);
+  BLM_SCALAR_MASTER_MUTEX_MIDIOUT_GIVE;
+
+  for(i=first_row; i<=last_row; ++i)
+    leds_sent[i + blm_led_row_offset] = rows[i];
+
+  return 1;
+}
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 //! Help function to send MIDI packets for LED layout changes
 /////////////////////////////////////////////////////////////////////////////
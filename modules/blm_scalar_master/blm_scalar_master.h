@@ -43,6 +43,13 @@
 #endif
 
 
+// send changed rows with a single SysEx bulk frame per colour plane if the BLM
+// supports this (notified with the layout info), and if it takes less bytes than CCs
+#ifndef BLM_SCALAR_MASTER_BULK_FRAMES
+#define BLM_SCALAR_MASTER_BULK_FRAMES 1
+#endif
+
+
 // it's recommended to assign the MIDIOUT mutex used by the application in mios32_config.h
 #ifndef BLM_SCALAR_MASTER_MUTEX_MIDIOUT_TAKE
 #define BLM_SCALAR_MASTER_MUTEX_MIDIOUT_TAKE { }
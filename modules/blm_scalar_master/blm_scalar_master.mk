@@ -7,7 +7,8 @@ C_INCLUDE += -I $(MIOS32_PATH)/modules/blm_scalar_master
 
 # add modules to thumb sources (TODO: provide makefile option to add code to ARM sources)
 THUMB_SOURCE += \
-	$(MIOS32_PATH)/modules/blm_scalar_master/blm_scalar_master.c
+	$(MIOS32_PATH)/modules/blm_scalar_master/blm_scalar_master.c \
+	$(MIOS32_PATH)/modules/blm_scalar_master/blm_scalar_frame.c
 
 
 # directories and files that should be part of the distribution (release) package
@@ -0,0 +1,330 @@
+// Recorded-sequence test of the BLM_SCALAR LED transfer
+//
+// BLM_SCALAR_MASTER_Periodic_mS() runs against a small BLM emulator which
+// decodes the CCs and the SysEx bulk frames (blm_scalar_frame.c) into its
+// own LED state. A recorded sequence (playhead sweep, pattern changes,
+// sparse edits, full redraws) is played with 1 mS periods, after each
+// period the LEDs of the emulator have to match with the master.
+//
+// The number of transfered bytes and the periods which are required to
+// transfer the bursts over a 31250 baud MIDI link are printed.
+// blm_frame_test_cc is built with BLM_SCALAR_MASTER_BULK_FRAMES=0 and
+// serves as the reference ("before").
+//
+// In addition, the frame codec is checked for round-trips.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mios32.h>
+
+#include "blm_scalar_master.h"
+#include "blm_scalar_frame.h"
+
+
+#define BLM_PORT USB1
+
+// bytes per mS on a 31250 baud link
+#define LINK_BYTES_PER_MS (31250.0 / 10.0 / 1000.0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// BLM emulator
+/////////////////////////////////////////////////////////////////////////////
+
+static u16 blm_green[16];
+static u16 blm_red[16];
+
+static u32 bytes_period;   // bytes sent in the current period
+static u32 bytes_total;
+static u32 num_ccs;
+static u32 num_frames;
+static u32 num_errors;
+
+static void blm_cc(u8 chn, u8 cc_number, u8 value)
+{
+  if( cc_number < 16 || cc_number > 35 )
+    return; // extra rows/columns are not emulated
+
+  u8 cc = cc_number & 0x0f;
+  if( cc > 3 )
+    return;
+
+  u16 *plane = (cc_number >= 32) ? blm_red : blm_green;
+  u8 pattern8 = value | ((cc & 1) ? 0x80 : 0x00);
+
+  if( cc & 2 )
+    plane[chn] = (plane[chn] & 0x00ff) | ((u16)pattern8 << 8);
+  else
+    plane[chn] = (plane[chn] & 0xff00) | pattern8;
+}
+
+static void blm_sysex(u8 *stream, u32 count)
+{
+  static const u8 header[5] = { 0xf0, 0x00, 0x00, 0x7e, 0x4e };
+
+  if( count < 8 || memcmp(stream, header, sizeof(header)) != 0 || stream[count-1] != 0xf7 ) {
+    printf("ERROR: invalid SysEx stream\n");
+    ++num_errors;
+    return;
+  }
+
+  if( stream[6] != BLM_SCALAR_FRAME_SYSEX_CMD )
+    return; // e.g. acknowledge
+
+  blm_scalar_frame_decoder_t decoder;
+  BLM_SCALAR_FRAME_DecoderInit(&decoder);
+
+  u32 i;
+  for(i=7; i<(count-1); ++i)
+    BLM_SCALAR_FRAME_DecoderPut(&decoder, stream[i]);
+
+  s32 num_rows = BLM_SCALAR_FRAME_DecoderFinish(&decoder);
+  if( num_rows < 0 ) {
+    printf("ERROR: invalid frame\n");
+    ++num_errors;
+    return;
+  }
+
+  u16 *plane = (decoder.mode & 0x0f) ? blm_red : blm_green;
+  for(i=0; i<num_rows; ++i)
+    plane[decoder.first_row + i] = decoder.row[i];
+
+  ++num_frames;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_IRQ_Disable(void) { return 0; }
+s32 MIOS32_IRQ_Enable(void) { return 0; }
+
+s32 MIOS32_MIDI_SendPackage(mios32_midi_port_t port, mios32_midi_package_t package)
+{
+  if( package.event == CC )
+    blm_cc(package.chn, package.cc_number, package.value);
+
+  bytes_period += 3;
+  ++num_ccs;
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendCC(mios32_midi_port_t port, mios32_midi_chn_t chn, u8 cc_number, u8 val)
+{
+  blm_cc(chn, cc_number, val);
+  bytes_period += 3;
+  ++num_ccs;
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendSysEx(mios32_midi_port_t port, u8 *stream, u32 count)
+{
+  blm_sysex(stream, count);
+  bytes_period += count;
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Master side
+/////////////////////////////////////////////////////////////////////////////
+
+// layout info of a BLM16x16+X with bulk frame support
+static void master_receive_layout(void)
+{
+  static const u8 layout[] = { 0xf0, 0x00, 0x00, 0x7e, 0x4e, 0x00, 0x01,
+			       16, 16, 2, 1, 1, 1, BLM_SCALAR_FRAME_CAP_BULK, 0xf7 };
+  int i;
+  for(i=0; i<sizeof(layout); ++i)
+    BLM_SCALAR_MASTER_SYSEX_Parser(BLM_PORT, layout[i]);
+}
+
+static void master_set_row(u8 plane, u8 row, u16 pattern)
+{
+  if( plane )
+    blm_scalar_master_leds_red[row] = pattern;
+  else
+    blm_scalar_master_leds_green[row] = pattern;
+}
+
+static u32 rnd_seed = 1;
+static u16 rnd16(void)
+{
+  rnd_seed = rnd_seed * 1103515245 + 12345;
+  return (rnd_seed >> 8) & 0xffff;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Recorded sequence: returns 0 when the sequence has finished
+/////////////////////////////////////////////////////////////////////////////
+
+#define STEP_MS 125 // 16th notes at 120 BPM
+
+static int sequence_tick(u32 ms)
+{
+  int row;
+
+  if( ms >= 8000 )
+    return 0;
+
+  // new layout info (e.g. BLM reconnected): full redraw
+  if( ms == 4000 )
+    master_receive_layout();
+
+  // pattern change each bar: new dense green patterns
+  if( (ms % (16*STEP_MS)) == 0 ) {
+    for(row=0; row<16; ++row)
+      master_set_row(0, row, rnd16());
+  }
+
+  // playhead in the red plane
+  if( (ms % STEP_MS) == 0 ) {
+    u8 step = (ms / STEP_MS) % 16;
+    for(row=0; row<16; ++row)
+      master_set_row(1, row, 1 << step);
+  }
+
+  // sparse edits: a single LED is toggled
+  if( (ms % 300) == 150 ) {
+    u8 r = rnd16() % 16;
+    blm_scalar_master_leds_green[r] ^= 1 << (rnd16() % 16);
+  }
+
+  return 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Plays the sequence and checks the BLM LEDs after each period
+/////////////////////////////////////////////////////////////////////////////
+static void test_sequence(void)
+{
+  u32 ms;
+  u32 num_periods = 0;
+  u32 max_burst = 0;
+  double link_ms = 0.0;
+
+  BLM_SCALAR_MASTER_Init(0);
+  BLM_SCALAR_MASTER_MIDI_PortSet(0, BLM_PORT);
+  master_receive_layout();
+
+  for(ms=0; sequence_tick(ms); ++ms) {
+    bytes_period = 0;
+    BLM_SCALAR_MASTER_Periodic_mS();
+
+    if( bytes_period ) {
+      ++num_periods;
+      bytes_total += bytes_period;
+      link_ms += bytes_period / LINK_BYTES_PER_MS;
+      if( bytes_period > max_burst )
+	max_burst = bytes_period;
+    }
+
+    if( memcmp(blm_green, blm_scalar_master_leds_green, sizeof(blm_green)) != 0 ||
+	memcmp(blm_red, blm_scalar_master_leds_red, sizeof(blm_red)) != 0 ) {
+      printf("ERROR: LEDs out of sync at %u mS\n", (unsigned)ms);
+      ++num_errors;
+      break;
+    }
+  }
+
+  printf("Sequence (%s): %u bytes in %u periods, %u CCs, %u frames\n",
+	 BLM_SCALAR_MASTER_BULK_FRAMES ? "bulk frames" : "CCs only",
+	 (unsigned)bytes_total, (unsigned)num_periods, (unsigned)num_ccs, (unsigned)num_frames);
+  printf("  max. burst %u bytes (%.1f mS at 31250 baud), link busy for %.0f mS\n",
+	 (unsigned)max_burst, max_burst / LINK_BYTES_PER_MS, link_ms);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Codec round-trips
+/////////////////////////////////////////////////////////////////////////////
+static int roundtrip(u16 *rows, u8 first_row, u8 num_rows)
+{
+  u8 buffer[3 + BLM_SCALAR_FRAME_MAX_DATA];
+  s32 len = BLM_SCALAR_FRAME_Encode(buffer, 0, rows, first_row, num_rows);
+  if( len < 3 || len > sizeof(buffer) || len > (3 + 3*num_rows) )
+    return -1;
+
+  blm_scalar_frame_decoder_t decoder;
+  BLM_SCALAR_FRAME_DecoderInit(&decoder);
+
+  int i;
+  for(i=0; i<len; ++i) {
+    if( buffer[i] & 0x80 )
+      return -2; // not a valid SysEx data byte
+    if( BLM_SCALAR_FRAME_DecoderPut(&decoder, buffer[i]) < 0 )
+      return -3;
+  }
+
+  if( BLM_SCALAR_FRAME_DecoderFinish(&decoder) != num_rows || decoder.first_row != first_row )
+    return -4;
+
+  for(i=0; i<num_rows; ++i)
+    if( decoder.row[i] != rows[first_row + i] )
+      return -5;
+
+  return 0;
+}
+
+static void test_codec(void)
+{
+  u16 rows[16];
+  int run, i;
+  int num_runs = 0;
+
+  for(run=0; run<20000; ++run) {
+    u8 density = run % 4;
+    for(i=0; i<16; ++i) {
+      switch( density ) {
+      case 0: rows[i] = rnd16(); break;                          // dense
+      case 1: rows[i] = (rnd16() % 8) ? 0 : (1 << (rnd16() % 16)); break; // sparse
+      case 2: rows[i] = (rnd16() % 2) ? 0xffff : 0x0000; break;  // long runs
+      default: rows[i] = rnd16() & rnd16() & rnd16(); break;
+      }
+    }
+
+    u8 first_row = rnd16() % 16;
+    u8 num_rows = 1 + (rnd16() % (16 - first_row));
+    s32 status = roundtrip(rows, first_row, num_rows);
+    if( status < 0 ) {
+      printf("ERROR: codec round-trip failed with %d (run %d)\n", (int)status, run);
+      ++num_errors;
+      return;
+    }
+    ++num_runs;
+  }
+
+  // empty and full planes
+  memset(rows, 0x00, sizeof(rows));
+  if( roundtrip(rows, 0, 16) < 0 ) {
+    printf("ERROR: empty plane\n");
+    ++num_errors;
+  }
+  memset(rows, 0xff, sizeof(rows));
+  if( roundtrip(rows, 0, 16) < 0 ) {
+    printf("ERROR: full plane\n");
+    ++num_errors;
+  }
+
+  printf("Codec: %d round-trips passed\n", num_runs + 2);
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_codec();
+  test_sequence();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,7 @@
+// minimal configuration for the host tests
+#ifndef _MIOS32_CONFIG_H
+#define _MIOS32_CONFIG_H
+
+#define DEBUG_MSG(...) do {} while(0)
+
+#endif /* _MIOS32_CONFIG_H */
@@ -0,0 +1,316 @@
+// $Id$
+//! \defgroup DEBUG_LOG
+//!
+//! Deferred Debug Logging
+//!
+//! MIOS32_MIDI_SendDebugMessage() formats the message with vsprintf and
+//! sends it as SysEx stream immediately, which blocks the calling task.
+//! DEBUG_LOG() only stores the format pointer, a timestamp and the raw
+//! arguments into a ring buffer; the messages are formatted and sent by
+//! DEBUG_LOG_Handler(), which should be called from APP_Background()
+//! (idle task).
+//!
+//! Usage:
+//! \code
+//!   // optional: compile only errors and warnings in this file
+//!   #define DEBUG_LOG_MODULE_LEVEL DEBUG_LOG_LEVEL_WARNING
+//!   #include <debug_log.h>
+//!
+//!   DEBUG_LOG_INFO("Button %d %s\n", pin, pin_value ? "depressed" : "pressed");
+//! \endcode
+//!
+//! Restrictions: up to DEBUG_LOG_MAX_ARGS integer or pointer arguments,
+//! no floating point values, and strings passed with %s must still be
+//! valid when the message is formatted (no buffers on the stack!).
+//!
+//! Records which don't fit into the buffer are counted, and the number of
+//! lost records is reported with the next message.
+//!
+//! \{
+/* ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <string.h>
+
+#include "debug_log.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local definitions
+/////////////////////////////////////////////////////////////////////////////
+
+#if (DEBUG_LOG_BUFFER_SIZE & (DEBUG_LOG_BUFFER_SIZE-1))
+# error "DEBUG_LOG_BUFFER_SIZE must be a power of two!"
+#endif
+
+#define LOG_IX_MASK (DEBUG_LOG_BUFFER_SIZE-1)
+
+// max. number of records which are sent with each DEBUG_LOG_Handler() call
+#ifndef DEBUG_LOG_HANDLER_MAX_RECORDS
+#define DEBUG_LOG_HANDLER_MAX_RECORDS 4
+#endif
+
+// ensures that the record has been copied before the tail index is incremented
+// (sufficient for a single core, e.g. Cortex-M3/M4)
+#if defined(__GNUC__)
+# define LOG_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+# define LOG_BARRIER()
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  const char *format;
+  u32 timestamp;
+  debug_log_arg_t arg[DEBUG_LOG_MAX_ARGS];
+  u8 level;
+} debug_log_record_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local variables
+/////////////////////////////////////////////////////////////////////////////
+
+static debug_log_record_t log_buffer[DEBUG_LOG_BUFFER_SIZE];
+
+// free running indices: head written by DEBUG_LOG_Record() with disabled IRQs,
+// tail only written by the handler
+static volatile u32 log_head;
+static volatile u32 log_tail;
+
+static volatile u32 num_lost;
+static u32 num_lost_reported;
+
+static u8 log_level = DEBUG_LOG_COMPILE_LEVEL;
+static u8 log_timestamp = 1;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Initializes the logger
+//! \param[in] mode currently only mode 0 supported
+//! \return < 0 if initialisation failed
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_Init(u32 mode)
+{
+  if( mode != 0 )
+    return -1; // only mode 0 supported
+
+  log_head = 0;
+  log_tail = 0;
+  num_lost = 0;
+  num_lost_reported = 0;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Stores a message into the ring buffer.<BR>
+//! Should be called via the DEBUG_LOG() macro, which expands the arguments.
+//! Can be called from any task and from interrupts.
+//! \param[in] level the log level of the message
+//! \param[in] format the constant format string
+//! \param[in] arg0..arg5 the raw arguments
+//! \return 0 if stored or filtered, -1 if the record has been lost
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_Record(u8 level, const char *format,
+		     debug_log_arg_t arg0, debug_log_arg_t arg1, debug_log_arg_t arg2,
+		     debug_log_arg_t arg3, debug_log_arg_t arg4, debug_log_arg_t arg5)
+{
+  if( level > log_level )
+    return 0; // filtered
+
+  u32 timestamp = MIOS32_TIMESTAMP_Get();
+
+  MIOS32_IRQ_Disable();
+  u32 head = log_head;
+  if( (head - log_tail) >= DEBUG_LOG_BUFFER_SIZE ) {
+    ++num_lost;
+    MIOS32_IRQ_Enable();
+    return -1; // buffer full
+  }
+
+  debug_log_record_t *r = &log_buffer[head & LOG_IX_MASK];
+  r->format = format;
+  r->timestamp = timestamp;
+  r->arg[0] = arg0;
+  r->arg[1] = arg1;
+  r->arg[2] = arg2;
+  r->arg[3] = arg3;
+  r->arg[4] = arg4;
+  r->arg[5] = arg5;
+  r->level = level;
+  log_head = head + 1;
+  MIOS32_IRQ_Enable();
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Formats a message with the recorded arguments.<BR>
+//! The resulting string is limited to 7bit characters like for
+//! MIOS32_MIDI_SendDebugMessage(), longer strings are truncated
+//! \param[out] str the string buffer
+//! \param[in] max_len size of the buffer, at least 128 characters
+//! \param[in] format the format string (100 characters maximum)
+//! \param[in] args DEBUG_LOG_MAX_ARGS arguments
+//! \return the string length, < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_Format(char *str, u32 max_len, const char *format, const debug_log_arg_t *args)
+{
+  // same weak protection like in MIOS32_MIDI_SendDebugMessage()
+  if( max_len < 128 || strlen(format) > 100 )
+    return -1;
+
+  snprintf(str, max_len, format, args[0], args[1], args[2], args[3], args[4], args[5]);
+
+  u32 len = strlen(str);
+  u8 *str_ptr = (u8 *)str;
+  u32 i;
+  for(i=0; i<len; ++i) {
+    *str_ptr++ &= 0x7f; // ensure that MIDI protocol won't be violated
+  }
+
+  return len;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Formats and sends the oldest record
+// Returns 0 if no record available, 1 if a record has been sent
+/////////////////////////////////////////////////////////////////////////////
+static s32 DEBUG_LOG_SendNext(void)
+{
+  u32 tail = log_tail;
+
+  if( tail == log_head )
+    return 0; // no record
+
+  debug_log_record_t r = log_buffer[tail & LOG_IX_MASK];
+  LOG_BARRIER();
+  log_tail = tail + 1;
+
+  u32 lost = num_lost;
+  if( lost != num_lost_reported ) {
+    char str[64];
+    sprintf(str, "[DEBUG_LOG] %u messages lost!\n", lost - num_lost_reported);
+    num_lost_reported = lost;
+    MIOS32_MIDI_SendDebugString(str);
+  }
+
+  char str[16+128];
+  u32 pos = 0;
+  if( log_timestamp ) {
+    sprintf(str, "[%u.%03u] ", r.timestamp / 1000, r.timestamp % 1000);
+    pos = strlen(str);
+  }
+
+  if( DEBUG_LOG_Format(&str[pos], sizeof(str)-pos, r.format, r.arg) < 0 )
+    MIOS32_MIDI_SendDebugString("(ERROR: format string passed to DEBUG_LOG() is longer than 100 chars!\n");
+  else
+    MIOS32_MIDI_SendDebugString(str);
+
+  return 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Formats and sends recorded messages.<BR>
+//! Should be called periodically from APP_Background() (idle task).
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_Handler(void)
+{
+  int i;
+  for(i=0; i<DEBUG_LOG_HANDLER_MAX_RECORDS && DEBUG_LOG_SendNext() > 0; ++i);
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sends all recorded messages, e.g. before a reset
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_Flush(void)
+{
+  while( DEBUG_LOG_SendNext() > 0 );
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets/Gets the runtime log level, messages above this level won't be recorded.<BR>
+//! Note that messages above DEBUG_LOG_MODULE_LEVEL aren't compiled at all.
+//! \param[in] level DEBUG_LOG_LEVEL_OFF..DEBUG_LOG_LEVEL_DEBUG
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_LevelSet(u8 level)
+{
+  if( level > DEBUG_LOG_LEVEL_DEBUG )
+    return -1; // invalid level
+
+  log_level = level;
+
+  return 0; // no error
+}
+
+s32 DEBUG_LOG_LevelGet(void)
+{
+  return log_level;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Enables/disables the timestamp (seconds.milliseconds) in front of messages
+//! \param[in] enable 0 or 1
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 DEBUG_LOG_TimestampSet(u8 enable)
+{
+  log_timestamp = enable ? 1 : 0;
+
+  return 0; // no error
+}
+
+s32 DEBUG_LOG_TimestampGet(void)
+{
+  return log_timestamp;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the number of records which haven't been sent yet
+/////////////////////////////////////////////////////////////////////////////
+u32 DEBUG_LOG_NumPendingGet(void)
+{
+  return log_head - log_tail;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the number of records which have been lost since initialisation
+/////////////////////////////////////////////////////////////////////////////
+u32 DEBUG_LOG_NumLostGet(void)
+{
+  return num_lost;
+}
+
+//! \}
@@ -0,0 +1,125 @@
+// $Id$
+/*
+ * Header file for Deferred Debug Logging
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _DEBUG_LOG_H
+#define _DEBUG_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of records which can be buffered
+// must be a power of two, can be overruled in mios32_config.h
+#ifndef DEBUG_LOG_BUFFER_SIZE
+#define DEBUG_LOG_BUFFER_SIZE 64
+#endif
+
+// max. number of arguments which can be passed with a message
+#define DEBUG_LOG_MAX_ARGS 6
+
+// log levels
+#define DEBUG_LOG_LEVEL_OFF     0
+#define DEBUG_LOG_LEVEL_ERROR   1
+#define DEBUG_LOG_LEVEL_WARNING 2
+#define DEBUG_LOG_LEVEL_INFO    3
+#define DEBUG_LOG_LEVEL_DEBUG   4
+
+// messages above this level won't be compiled
+// can be overruled in mios32_config.h (global) or before debug_log.h
+// is included (per module) with DEBUG_LOG_MODULE_LEVEL
+#ifndef DEBUG_LOG_COMPILE_LEVEL
+#define DEBUG_LOG_COMPILE_LEVEL DEBUG_LOG_LEVEL_DEBUG
+#endif
+
+#ifndef DEBUG_LOG_MODULE_LEVEL
+#define DEBUG_LOG_MODULE_LEVEL DEBUG_LOG_COMPILE_LEVEL
+#endif
+
+
+// Usage: DEBUG_LOG(DEBUG_LOG_LEVEL_INFO, "Button %d %s\n", button, value ? "depressed" : "pressed");
+//
+// Only the format pointer, the timestamp and the raw arguments are stored,
+// the message is formatted later by DEBUG_LOG_Handler(). Therefore the
+// format string and strings passed with %s must be constant (no buffers
+// on the stack!), and floating point values can't be passed.
+#define DEBUG_LOG(level, ...) \
+  do { \
+    if( (level) <= DEBUG_LOG_MODULE_LEVEL ) \
+      DEBUG_LOG_Record(level, DEBUG_LOG_ARGS(__VA_ARGS__)); \
+  } while( 0 )
+
+#define DEBUG_LOG_ERROR(...)   DEBUG_LOG(DEBUG_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define DEBUG_LOG_WARNING(...) DEBUG_LOG(DEBUG_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define DEBUG_LOG_INFO(...)    DEBUG_LOG(DEBUG_LOG_LEVEL_INFO, __VA_ARGS__)
+#define DEBUG_LOG_DEBUG(...)   DEBUG_LOG(DEBUG_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// expands the format and up to DEBUG_LOG_MAX_ARGS arguments to the parameters of DEBUG_LOG_Record()
+#define DEBUG_LOG_A(x) ((debug_log_arg_t)(x))
+#define DEBUG_LOG_ARGS0(f)                   f, 0, 0, 0, 0, 0, 0
+#define DEBUG_LOG_ARGS1(f, a)                f, DEBUG_LOG_A(a), 0, 0, 0, 0, 0
+#define DEBUG_LOG_ARGS2(f, a, b)             f, DEBUG_LOG_A(a), DEBUG_LOG_A(b), 0, 0, 0, 0
+#define DEBUG_LOG_ARGS3(f, a, b, c)          f, DEBUG_LOG_A(a), DEBUG_LOG_A(b), DEBUG_LOG_A(c), 0, 0, 0
+#define DEBUG_LOG_ARGS4(f, a, b, c, d)       f, DEBUG_LOG_A(a), DEBUG_LOG_A(b), DEBUG_LOG_A(c), DEBUG_LOG_A(d), 0, 0
+#define DEBUG_LOG_ARGS5(f, a, b, c, d, e)    f, DEBUG_LOG_A(a), DEBUG_LOG_A(b), DEBUG_LOG_A(c), DEBUG_LOG_A(d), DEBUG_LOG_A(e), 0
+#define DEBUG_LOG_ARGS6(f, a, b, c, d, e, g) f, DEBUG_LOG_A(a), DEBUG_LOG_A(b), DEBUG_LOG_A(c), DEBUG_LOG_A(d), DEBUG_LOG_A(e), DEBUG_LOG_A(g)
+#define DEBUG_LOG_SELECT(_0, _1, _2, _3, _4, _5, _6, name, ...) name
+#define DEBUG_LOG_ARGS(...) \
+  DEBUG_LOG_SELECT(__VA_ARGS__, DEBUG_LOG_ARGS6, DEBUG_LOG_ARGS5, DEBUG_LOG_ARGS4, DEBUG_LOG_ARGS3, \
+		   DEBUG_LOG_ARGS2, DEBUG_LOG_ARGS1, DEBUG_LOG_ARGS0, dummy)(__VA_ARGS__)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+// large enough for integers and pointers
+typedef size_t debug_log_arg_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 DEBUG_LOG_Init(u32 mode);
+
+extern s32 DEBUG_LOG_Record(u8 level, const char *format,
+			    debug_log_arg_t arg0, debug_log_arg_t arg1, debug_log_arg_t arg2,
+			    debug_log_arg_t arg3, debug_log_arg_t arg4, debug_log_arg_t arg5);
+
+extern s32 DEBUG_LOG_Handler(void);
+extern s32 DEBUG_LOG_Flush(void);
+
+extern s32 DEBUG_LOG_LevelSet(u8 level);
+extern s32 DEBUG_LOG_LevelGet(void);
+extern s32 DEBUG_LOG_TimestampSet(u8 enable);
+extern s32 DEBUG_LOG_TimestampGet(void);
+
+extern u32 DEBUG_LOG_NumPendingGet(void);
+extern u32 DEBUG_LOG_NumLostGet(void);
+
+extern s32 DEBUG_LOG_Format(char *str, u32 max_len, const char *format, const debug_log_arg_t *args);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Export global variables
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DEBUG_LOG_H */
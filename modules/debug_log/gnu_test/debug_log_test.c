@@ -0,0 +1,270 @@
+// Host test and throughput benchmark of the deferred debug logging
+//
+// The formatted messages are compared with the output of the direct
+// vsprintf path of MIOS32_MIDI_SendDebugMessage(). In addition the
+// truncation of long messages, the lost record counter and the log
+// level filters are checked.
+//
+// The benchmark measures the time which is spent in the calling task:
+// direct vsprintf+send vs. recording only, and the total time of
+// recording and deferred formatting.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <mios32.h>
+
+// DEBUG_LOG_DEBUG() messages are not compiled
+#define DEBUG_LOG_MODULE_LEVEL DEBUG_LOG_LEVEL_INFO
+#include "debug_log.h"
+
+
+#define CHECK(cond) do { if( !(cond) ) { printf("ERROR: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond); ++num_errors; return; } } while(0)
+
+static unsigned num_errors;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 timestamp;
+static char last_str[1024];
+static u32 num_sent;
+static volatile u8 sink[512];
+
+s32 MIOS32_IRQ_Disable(void) { return 0; }
+s32 MIOS32_IRQ_Enable(void) { return 0; }
+s32 MIOS32_TIMESTAMP_Get(void) { return timestamp; }
+
+s32 MIOS32_MIDI_SendDebugString(const char *str)
+{
+  u32 len = strlen(str);
+  if( len >= sizeof(last_str) )
+    len = sizeof(last_str) - 1;
+  memcpy(last_str, str, len);
+  last_str[len] = 0;
+  ++num_sent;
+
+  // emulates the copy into the SysEx stream
+  u32 i;
+  for(i=0; i<len+8; ++i)
+    sink[i & 511] = str[i % (len+1)];
+
+  return 0;
+}
+
+// direct path of MIOS32_MIDI_SendDebugMessage()
+static s32 direct_message(char *str, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vsprintf(str, format, args);
+  va_end(args);
+
+  u32 len = strlen(str);
+  u32 i;
+  for(i=0; i<len; ++i)
+    str[i] &= 0x7f;
+
+  return MIOS32_MIDI_SendDebugString(str);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_format(void)
+{
+  char expected[128];
+
+  DEBUG_LOG_Init(0);
+  DEBUG_LOG_TimestampSet(1);
+  DEBUG_LOG_LevelSet(DEBUG_LOG_LEVEL_DEBUG);
+
+  timestamp = 12345;
+  DEBUG_LOG_INFO("Button %d %s %x\n", 5, "pressed", 0xab);
+  timestamp = 7;
+  DEBUG_LOG_ERROR("no args\n");
+  DEBUG_LOG(DEBUG_LOG_LEVEL_WARNING, "%d %d %d %d %d %u\n", 1, 2, 3, 4, 5, -1);
+  DEBUG_LOG_INFO("7bit: \xc3\xa4\n");
+  DEBUG_LOG_DEBUG("not compiled %d\n", 1);
+  CHECK(DEBUG_LOG_NumPendingGet() == 4);
+
+  num_sent = 0;
+  CHECK(DEBUG_LOG_Handler() == 0);
+  CHECK(num_sent == 4 && DEBUG_LOG_NumPendingGet() == 0);
+
+  // compare the messages without timestamp with the direct path
+  DEBUG_LOG_TimestampSet(0);
+  DEBUG_LOG_INFO("Button %d %s %x\n", 5, "pressed", 0xab);
+  DEBUG_LOG_Flush();
+  direct_message(expected, "Button %d %s %x\n", 5, "pressed", 0xab);
+  CHECK(strcmp(last_str, expected) == 0);
+
+  DEBUG_LOG(DEBUG_LOG_LEVEL_WARNING, "%d %d %d %d %d %u\n", 1, 2, 3, 4, 5, -1);
+  DEBUG_LOG_Flush();
+  direct_message(expected, "%d %d %d %d %d %u\n", 1, 2, 3, 4, 5, -1);
+  CHECK(strcmp(last_str, expected) == 0);
+
+  DEBUG_LOG_INFO("7bit: \xc3\xa4\n");
+  DEBUG_LOG_Flush();
+  CHECK(strcmp(last_str, "7bit: \x43\x24\n") == 0);
+
+  // timestamp prefix
+  DEBUG_LOG_TimestampSet(1);
+  timestamp = 12345;
+  DEBUG_LOG_ERROR("no args\n");
+  DEBUG_LOG_Flush();
+  CHECK(strcmp(last_str, "[12.345] no args\n") == 0);
+}
+
+
+static void test_truncate(void)
+{
+  char str[128 + 16];
+  static char long_str[101];
+  debug_log_arg_t args[DEBUG_LOG_MAX_ARGS];
+  int i;
+
+  memset(long_str, 'x', 100);
+  long_str[100] = 0;
+  for(i=0; i<DEBUG_LOG_MAX_ARGS; ++i)
+    args[i] = (debug_log_arg_t)long_str;
+
+  // six strings with 100 characters: truncated to the buffer size
+  memset(str, 0x55, sizeof(str));
+  CHECK(DEBUG_LOG_Format(str, 128, "%s%s%s%s%s%s\n", args) == 127);
+  CHECK(str[127] == 0);
+  for(i=128; i<sizeof(str); ++i)
+    CHECK(str[i] == 0x55);
+
+  CHECK(DEBUG_LOG_Format(str, 127, "%s\n", args) < 0); // buffer too small
+
+  // through the handler with timestamp
+  DEBUG_LOG_Init(0);
+  DEBUG_LOG_TimestampSet(1);
+  timestamp = 4294967295U;
+  DEBUG_LOG_INFO("%s%s%s%s%s%s\n", long_str, long_str, long_str, long_str, long_str, long_str);
+  DEBUG_LOG_Flush();
+  CHECK(strncmp(last_str, "[4294967.295] xxx", 17) == 0);
+  CHECK(strlen(last_str) == 14 + 129);
+}
+
+
+static void test_lost(void)
+{
+  int i;
+
+  DEBUG_LOG_Init(0);
+  DEBUG_LOG_TimestampSet(0);
+
+  for(i=0; i<DEBUG_LOG_BUFFER_SIZE + 6; ++i)
+    DEBUG_LOG_INFO("msg %d\n", i);
+  CHECK(DEBUG_LOG_NumLostGet() == 6);
+  CHECK(DEBUG_LOG_NumPendingGet() == DEBUG_LOG_BUFFER_SIZE);
+
+  // the first handler call reports the lost records before the first message
+  num_sent = 0;
+  DEBUG_LOG_Handler();
+  CHECK(num_sent == 1 + 4);
+
+  DEBUG_LOG_Flush();
+  CHECK(num_sent == 1 + DEBUG_LOG_BUFFER_SIZE);
+  CHECK(strcmp(last_str, "msg 63\n") == 0);
+
+  // reported only once
+  DEBUG_LOG_INFO("after %d\n", 1);
+  DEBUG_LOG_Flush();
+  CHECK(num_sent == 2 + DEBUG_LOG_BUFFER_SIZE);
+  CHECK(strcmp(last_str, "after 1\n") == 0);
+}
+
+
+static void test_level(void)
+{
+  DEBUG_LOG_Init(0);
+
+  CHECK(DEBUG_LOG_LevelSet(DEBUG_LOG_LEVEL_DEBUG + 1) < 0);
+  CHECK(DEBUG_LOG_LevelSet(DEBUG_LOG_LEVEL_ERROR) == 0);
+  DEBUG_LOG_INFO("filtered\n");
+  DEBUG_LOG_WARNING("filtered\n");
+  DEBUG_LOG_ERROR("error\n");
+  CHECK(DEBUG_LOG_NumPendingGet() == 1);
+
+  CHECK(DEBUG_LOG_LevelSet(DEBUG_LOG_LEVEL_OFF) == 0);
+  DEBUG_LOG_ERROR("filtered\n");
+  CHECK(DEBUG_LOG_NumPendingGet() == 1);
+
+  DEBUG_LOG_LevelSet(DEBUG_LOG_LEVEL_INFO);
+  DEBUG_LOG_Flush();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Benchmark
+/////////////////////////////////////////////////////////////////////////////
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void benchmark(void)
+{
+  const int n = 2000000;
+  char str[128];
+  int i;
+  double t0;
+
+  DEBUG_LOG_Init(0);
+  DEBUG_LOG_TimestampSet(0);
+
+  t0 = now();
+  for(i=0; i<n; ++i)
+    direct_message(str, "[SEQ] Track %d step %d note %s vel %d\n", i & 15, i & 63, "C-3", 100);
+  double t_direct = now() - t0;
+
+  t0 = now();
+  for(i=0; i<n; ++i) {
+    DEBUG_LOG_INFO("[SEQ] Track %d step %d note %s vel %d\n", i & 15, i & 63, "C-3", 100);
+    if( (i % DEBUG_LOG_BUFFER_SIZE) == (DEBUG_LOG_BUFFER_SIZE-1) )
+      DEBUG_LOG_Init(0); // drop the records without formatting
+  }
+  double t_record = now() - t0;
+
+  t0 = now();
+  for(i=0; i<n; ++i) {
+    DEBUG_LOG_INFO("[SEQ] Track %d step %d note %s vel %d\n", i & 15, i & 63, "C-3", 100);
+    DEBUG_LOG_Handler();
+  }
+  double t_total = now() - t0;
+
+  printf("Benchmark: direct %.1f ns/msg, record only %.1f ns/msg, record + deferred format %.1f ns/msg\n",
+	 t_direct / n * 1e9, t_record / n * 1e9, t_total / n * 1e9);
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_format();
+  test_truncate();
+  test_lost();
+  test_level();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", num_errors);
+    return 1;
+  }
+
+  benchmark();
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -80,6 +80,15 @@ u8 file_copy_percentage;
 // Local types
 /////////////////////////////////////////////////////////////////////////////
 
+// a file opened via FILE_HandleOpen*()
+typedef struct {
+  FIL fil;       // FatFs file object incl. sector buffer
+  u8  is_open;
+  u8  is_write;
+  u8  is_stale;  // file system has been remounted, only FILE_HandleClose() is possible
+  u32 *clmap;    // optional cluster link map for fast seeks (NULL: use f_lseek)
+} file_handle_t;
+
 // from https://www.gnu.org/software/tar/manual/html_node/Standard.html
 typedef struct
 {                              /* byte offset */
@@ -109,6 +118,13 @@ typedef struct
 /////////////////////////////////////////////////////////////////////////////
 
 static s32 FILE_MountFS(void);
+#if FILE_HANDLE_NUM > 0
+static file_handle_t *FILE_HandleGet(s32 handle);
+#endif
+static s32 FILE_HandleNumOpen(void);
+static s32 FILE_ClusterMapCreate(FIL *fp, u32 *map, u32 map_len);
+static u32 FILE_ClusterMapLookup(u32 *map, u32 cl_ix);
+static s32 FILE_ClusterMapSeek(FIL *fp, u32 *map, u32 offset);
 
 static s32 FILE_CreateTarRecursive(char *filename, char *src_path, u8 exclude_tar_files, u8 depth, u8 max_depth, u32 *num_dirs, u32 *num_files);
 static s32 FILE_CreateTarHeader(char *filename, char *src_path, u8 is_dir, u32 filesize);
@@ -130,9 +146,15 @@ static char disk_label[12];
 // complete file structure for read/write accesses
 static FIL file_read;
 static u8 file_read_is_open; // only for safety purposes
+static u32 *file_read_clmap; // cluster link map of the file opened with FILE_ReadOpenIndexed()
 static FIL file_write;
 static u8 file_write_is_open; // only for safety purposes
 
+#if FILE_HANDLE_NUM > 0
+// files opened via FILE_HandleOpen*()
+static file_handle_t file_handle[FILE_HANDLE_NUM];
+#endif
+
 // SD Card status
 static u8 sdcard_available;
 static u8 volume_available;
@@ -147,6 +169,9 @@ static u8 tmp_buffer[TMP_BUFFER_SIZE];
 // for FILE_BrowserHandler
 static u32 browser_write_file_size;
 static u32 browser_write_file_pos;
+static u8  browser_write_windowed;
+static u16 browser_write_block_size;
+static u32 browser_write_block_map; // bit n: block at browser_write_file_pos + n*browser_write_block_size received
 
 static s32 (*browser_upload_callback_func)(char *filename);
 
@@ -244,6 +269,17 @@ static s32 FILE_MountFS(void)
   file_read_is_open = 0;
   file_write_is_open = 0;
 
+#if FILE_HANDLE_NUM > 0
+  // the file objects of open handles are not valid anymore, but the handles
+  // stay allocated until their owner closes them
+  {
+    int handle;
+    for(handle=0; handle<FILE_HANDLE_NUM; ++handle)
+      if( file_handle[handle].is_open )
+	file_handle[handle].is_stale = 1;
+  }
+#endif
+
   if( (res=f_mount(0, &fs)) != FR_OK ) {
     DEBUG_MSG("[FILE] Failed to mount SD Card - error status: %d\n", res);
     return -1; // error
@@ -380,7 +416,17 @@ s32 FILE_ReadOpen(file_t* file, char *filepath)
     return FILE_ERR_OPEN_READ_WITHOUT_CLOSE;
   }
 
+  file_read_clmap = NULL;
+
   if( (file_dfs_errno=f_open(&file_read, filepath, FA_OPEN_EXISTING | FA_READ)) != FR_OK ) {
+    // a remount would invalidate the files opened via FILE_HandleOpen*()
+    if( FILE_HandleNumOpen() ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+      DEBUG_MSG("[FILE] error opening file '%s' for reading!\n", filepath);
+#endif
+      return FILE_ERR_OPEN_READ;
+    }
+
 #if DEBUG_VERBOSE_LEVEL >= 2
     DEBUG_MSG("[FILE] Error opening file - try mounting the partition again\n");
 #endif
@@ -423,6 +469,48 @@ s32 FILE_ReadOpen(file_t* file, char *filepath)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//! Opens a file for reading like FILE_ReadOpen(), and stores the cluster
+//! chain of the file in a link map (same format as the CLMT of FatFs'
+//! _USE_FASTSEEK option):
+//! <UL>
+//!   <LI>map[0]: number of words used by the map
+//!   <LI>map[1..]: pairs of (number of clusters, first cluster) for each
+//!       contiguous fragment of the file
+//!   <LI>terminated by 0
+//! </UL>
+//! A contiguous file needs only 4 words, each additional fragment 2 more.\n
+//! As long as the file is open, FILE_ReadSeek() takes the cluster from the
+//! map instead of following the FAT. The map stays valid after the file has
+//! been closed (until it is modified), so that FILE_IndexedSectorGet() can
+//! be used to locate data sectors of the file without any FAT access.\n
+//! The map is provided by the caller and has to stay valid as long as the
+//! file is opened.
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return FILE_ERR_CLUSTER_MAP if map_len is too small, map[0] contains
+//! the number of required words in this case (file is closed again)
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_ReadOpenIndexed(file_t* file, char *filepath, u32 *map, u32 map_len)
+{
+  s32 status;
+
+  if( (status=FILE_ReadOpen(file, filepath)) < 0 )
+    return status;
+
+  if( (status=FILE_ClusterMapCreate(&file_read, map, map_len)) < 0 ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+    DEBUG_MSG("[FILE] cluster map of '%s' needs %u words\n", filepath, map[0]);
+#endif
+    FILE_ReadClose(file);
+    return status;
+  }
+
+  file_read_clmap = map;
+
+  return 0; // no error
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! reopens a file for reading
 //! \return < 0 on errors (error codes are documented in file.h)
@@ -443,6 +531,9 @@ s32 FILE_ReadReOpen(file_t* file)
   // for later check if we need to reload the sector
   u32 prev_dsect = file_read.dsect;
 
+  // the cluster map belonged to the previous file
+  file_read_clmap = NULL;
+
   // restore file variables from file_t
   file_read.fs = &fs;
   file_read.id = fs.id;
@@ -487,6 +578,7 @@ s32 FILE_ReadClose(file_t *file)
 
   // file has been closed
   file_read_is_open = 0;
+  file_read_clmap = NULL;
 
 
   // don't close file via f_close()! We allow to open the file again
@@ -500,6 +592,9 @@ s32 FILE_ReadClose(file_t *file)
 /////////////////////////////////////////////////////////////////////////////
 s32 FILE_ReadSeek(u32 offset)
 {
+  if( file_read_clmap != NULL )
+    return FILE_ClusterMapSeek(&file_read, file_read_clmap, offset);
+
   if( (file_dfs_errno=f_lseek(&file_read, offset)) != FR_OK ) {
 #if DEBUG_VERBOSE_LEVEL >= 2
     DEBUG_MSG("[FILE_ReadSeek] ERROR: seek to offset %u failed (FatFs status: %d)\n", offset, file_dfs_errno);
@@ -583,6 +678,11 @@ s32 FILE_ReadBufferUnknownLen(u8 *buffer, u32 len)
 
 /////////////////////////////////////////////////////////////////////////////
 //! Read a string (terminated with CR) from file
+//! Only the first byte of each sector is read via f_read(), which follows
+//! the cluster chain and loads the sector into the buffer of file_read.
+//! The remaining bytes are taken from this buffer directly, so that the
+//! file pointer always stays exact and FILE_ReadLine() can be mixed with
+//! the other read functions without seeking.
 //! \return < 0 on errors (error codes are documented in file.h)
 /////////////////////////////////////////////////////////////////////////////
 s32 FILE_ReadLine(u8 *buffer, u32 max_len)
@@ -591,9 +691,14 @@ s32 FILE_ReadLine(u8 *buffer, u32 max_len)
   u32 num_read = 0;
 
   while( file_read.fptr < file_read.fsize ) {
-    status = FILE_ReadBuffer(buffer, 1);
-
-    if( status < 0 )
+#if !_FS_TINY
+    // f_read() and f_lseek() keep the sector of an unaligned file pointer in the buffer
+    if( file_read.fptr % SECTOR_SIZE ) {
+      *buffer = file_read.buf[file_read.fptr % SECTOR_SIZE];
+      ++file_read.fptr;
+    } else
+#endif
+    if( (status=FILE_ReadBuffer(buffer, 1)) < 0 )
       return status;
 
     ++num_read;
@@ -797,6 +902,463 @@ s32 FILE_WriteWord(u32 word)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Handle based file access
+//
+// In distance to FILE_ReadOpen()/FILE_WriteOpen(), which share a single read
+// and write file object, up to FILE_HANDLE_NUM files can be kept open at the
+// same time, each with its own FatFs file object and sector buffer. Streaming
+// clients can keep a file open across reads instead of reopening and seeking
+// it on each access. FILE_ReadOpen()/FILE_WriteOpen() and friends are still
+// available and don't occupy a handle.
+//
+// The caller is responsible for MUTEX_SDCARD_TAKE/GIVE as usual.
+//
+// The file system isn't remounted while handles are open. If it has been
+// remounted anyhow (SD Card change), the handle functions return
+// FILE_ERR_HANDLE_STALE, and the handle has to be closed and opened again.
+//
+// Only available if FILE_HANDLE_NUM > 0 (e.g. in mios32_config.h), since each
+// handle allocates a FatFs file object.
+/////////////////////////////////////////////////////////////////////////////
+
+// internal FatFs functions (from ff.c)
+extern DWORD get_fat(FATFS *fs, DWORD clst);
+extern DWORD clust2sect(FATFS *fs, DWORD clst);
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return pointer to the handle structure or NULL if handle not open
+/////////////////////////////////////////////////////////////////////////////
+#if FILE_HANDLE_NUM > 0
+static file_handle_t *FILE_HandleGet(s32 handle)
+{
+  if( handle < 0 || handle >= FILE_HANDLE_NUM || !file_handle[handle].is_open )
+    return NULL;
+  return &file_handle[handle];
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return number of open (or stale) handles
+/////////////////////////////////////////////////////////////////////////////
+static s32 FILE_HandleNumOpen(void)
+{
+  s32 handle, num = 0;
+  for(handle=0; handle<FILE_HANDLE_NUM; ++handle)
+    if( file_handle[handle].is_open )
+      ++num;
+  return num;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Opens a file for reading in a free handle
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return >= 0: the handle number
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleOpenRead(char *filepath)
+{
+  s32 handle;
+  for(handle=0; handle<FILE_HANDLE_NUM; ++handle)
+    if( !file_handle[handle].is_open )
+      break;
+
+  if( handle >= FILE_HANDLE_NUM ) {
+#if DEBUG_VERBOSE_LEVEL >= 1
+    DEBUG_MSG("[FILE] FAILURE: no free handle to open '%s'\n", filepath);
+#endif
+    return FILE_ERR_NO_HANDLE;
+  }
+
+  file_handle_t *fh = &file_handle[handle];
+  if( (file_dfs_errno=f_open(&fh->fil, filepath, FA_OPEN_EXISTING | FA_READ)) != FR_OK ) {
+    // remount only on disk errors, and only if no other handle would be invalidated
+    if( file_dfs_errno == FR_NO_FILE || file_dfs_errno == FR_NO_PATH || file_dfs_errno == FR_INVALID_NAME ||
+	FILE_HandleNumOpen() ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+      DEBUG_MSG("[FILE] error opening file '%s' for reading!\n", filepath);
+#endif
+      return FILE_ERR_OPEN_READ;
+    }
+
+    s32 error;
+    if( (error = FILE_MountFS()) < 0 )
+      return FILE_ERR_SD_CARD;
+
+    if( (file_dfs_errno=f_open(&fh->fil, filepath, FA_OPEN_EXISTING | FA_READ)) != FR_OK ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+      DEBUG_MSG("[FILE] error opening file '%s' for reading!\n", filepath);
+#endif
+      return FILE_ERR_OPEN_READ;
+    }
+  }
+
+  fh->is_open = 1;
+  fh->is_write = 0;
+  fh->is_stale = 0;
+  fh->clmap = NULL;
+
+  return handle;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Opens a file for writing in a free handle
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return >= 0: the handle number
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleOpenWrite(char *filepath, u8 create)
+{
+  s32 handle;
+  for(handle=0; handle<FILE_HANDLE_NUM; ++handle)
+    if( !file_handle[handle].is_open )
+      break;
+
+  if( handle >= FILE_HANDLE_NUM ) {
+#if DEBUG_VERBOSE_LEVEL >= 1
+    DEBUG_MSG("[FILE] FAILURE: no free handle to open '%s'\n", filepath);
+#endif
+    return FILE_ERR_NO_HANDLE;
+  }
+
+  file_handle_t *fh = &file_handle[handle];
+  if( (file_dfs_errno=f_open(&fh->fil, filepath, (create ? FA_CREATE_ALWAYS : FA_OPEN_EXISTING) | FA_WRITE)) != FR_OK ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+    DEBUG_MSG("[FILE] error opening file '%s' for writing!\n", filepath);
+#endif
+    return FILE_ERR_OPEN_WRITE;
+  }
+
+  fh->is_open = 1;
+  fh->is_write = 1;
+  fh->is_stale = 0;
+  fh->clmap = NULL;
+
+  return handle;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Closes a handle, for write handles the remaining bytes are written
+//! \return < 0 on errors (error codes are documented in file.h)
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleClose(s32 handle)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  if( fh == NULL )
+    return FILE_ERR_INVALID_HANDLE;
+
+  s32 status = 0;
+  if( fh->is_write && !fh->is_stale ) {
+    if( (file_dfs_errno=f_close(&fh->fil)) != FR_OK )
+      status = FILE_ERR_WRITECLOSE;
+  }
+  // read files are not closed via f_close() (see FILE_ReadClose())
+
+  fh->is_open = 0;
+  fh->is_stale = 0;
+  fh->clmap = NULL;
+
+  return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Installs a cluster link map for a read handle, so that FILE_HandleSeek()
+//! can jump to any position without following the FAT cluster chain.\n
+//! The map format is described at FILE_ReadOpenIndexed(). It is provided by
+//! the caller and has to stay valid until the handle is closed.
+//! Pass NULL to remove the map.
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return FILE_ERR_CLUSTER_MAP if map_len is too small, map[0] contains
+//! the number of required words in this case
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleClusterMapSet(s32 handle, u32 *map, u32 map_len)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  if( fh == NULL )
+    return FILE_ERR_INVALID_HANDLE;
+
+  fh->clmap = NULL;
+
+  if( fh->is_stale )
+    return FILE_ERR_HANDLE_STALE;
+
+  if( map == NULL )
+    return 0; // no error
+
+  if( fh->is_write )
+    return FILE_ERR_CLUSTER_MAP; // file could grow
+
+  s32 status;
+  if( (status=FILE_ClusterMapCreate(&fh->fil, map, map_len)) < 0 ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+    DEBUG_MSG("[FILE] cluster map too small: %u words needed\n", map[0]);
+#endif
+    return status;
+  }
+
+  fh->clmap = map;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Changes to a new file position
+//! With a cluster map this doesn't access the FAT, and only reads the new
+//! sector if the position is not at a sector boundary
+//! \return < 0 on errors (error codes are documented in file.h)
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleSeek(s32 handle, u32 offset)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  if( fh == NULL )
+    return FILE_ERR_INVALID_HANDLE;
+
+  if( fh->is_stale )
+    return FILE_ERR_HANDLE_STALE;
+
+  if( fh->clmap == NULL ) {
+    if( (file_dfs_errno=f_lseek(&fh->fil, offset)) != FR_OK ) {
+#if DEBUG_VERBOSE_LEVEL >= 2
+      DEBUG_MSG("[FILE_HandleSeek] ERROR: seek to offset %u failed (FatFs status: %d)\n", offset, file_dfs_errno);
+#endif
+      return FILE_ERR_SEEK;
+    }
+    return 0; // no error
+  }
+
+  return FILE_ClusterMapSeek(&fh->fil, fh->clmap, offset);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return size of the file opened in handle (0 if handle not open)
+/////////////////////////////////////////////////////////////////////////////
+u32 FILE_HandleGetSize(s32 handle)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  return fh ? fh->fil.fsize : 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return current file pointer of the handle (0 if handle not open)
+/////////////////////////////////////////////////////////////////////////////
+u32 FILE_HandleGetPosition(s32 handle)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  return fh ? fh->fil.fptr : 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Reads from the file opened in handle
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return >= 0: number of bytes read (less than len at the end of file)
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleRead(s32 handle, u8 *buffer, u32 len)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  if( fh == NULL )
+    return FILE_ERR_INVALID_HANDLE;
+
+  if( fh->is_stale )
+    return FILE_ERR_HANDLE_STALE;
+
+  // exit if volume not available
+  if( !volume_available )
+    return FILE_ERR_NO_VOLUME;
+
+  UINT successcount;
+  if( (file_dfs_errno=f_read(&fh->fil, buffer, len, &successcount)) != FR_OK ) {
+#if DEBUG_VERBOSE_LEVEL >= 3
+    DEBUG_MSG("[FILE] Failed to read sector at position 0x%08x, status: %u\n", fh->fil.fptr, file_dfs_errno);
+#endif
+    return FILE_ERR_READ;
+  }
+
+  return successcount;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Writes into the file opened in handle
+//! \return < 0 on errors (error codes are documented in file.h)
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_HandleWrite(s32 handle, u8 *buffer, u32 len)
+{
+  file_handle_t *fh = FILE_HandleGet(handle);
+  if( fh == NULL || !fh->is_write )
+    return FILE_ERR_INVALID_HANDLE;
+
+  if( fh->is_stale )
+    return FILE_ERR_HANDLE_STALE;
+
+  // exit if volume not available
+  if( !volume_available )
+    return FILE_ERR_NO_VOLUME;
+
+  UINT successcount;
+  if( (file_dfs_errno=f_write(&fh->fil, buffer, len, &successcount)) != FR_OK ) {
+#if DEBUG_VERBOSE_LEVEL >= 3
+    DEBUG_MSG("[FILE] Failed to write buffer, status: %u\n", file_dfs_errno);
+#endif
+    return FILE_ERR_WRITE;
+  }
+  if( successcount != len ) {
+#if DEBUG_VERBOSE_LEVEL >= 3
+    DEBUG_MSG("[FILE] Wrong successcount while writing buffer (count: %d)\n", successcount);
+#endif
+    return FILE_ERR_WRITECOUNT;
+  }
+
+  return 0; // no error
+}
+
+#else
+
+static s32 FILE_HandleNumOpen(void)
+{
+  return 0; // handles not available
+}
+
+#endif /* FILE_HANDLE_NUM > 0 */
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Returns the physical sector which contains the given byte offset of a
+//! file indexed with FILE_ReadOpenIndexed() or FILE_HandleClusterMapSet().\n
+//! The lookup only walks the fragments of the map and never reads the FAT,
+//! so that streaming applications can read the file with
+//! MIOS32_SDCARD_SectorRead() directly.
+//! \return < 0 on errors (error codes are documented in file.h)
+//! \return >= 0: the physical sector
+/////////////////////////////////////////////////////////////////////////////
+s32 FILE_IndexedSectorGet(u32 *map, u32 offset)
+{
+  u32 sector_ix = offset / SECTOR_SIZE;
+  u32 clst = FILE_ClusterMapLookup(map, sector_ix / fs.csize);
+  if( !clst )
+    return FILE_ERR_CLUSTER_MAP; // offset outside of file
+
+  u32 sector = FILE_VolumeCluster2Sector(clst);
+  if( !sector )
+    return FILE_ERR_CLUSTER_MAP;
+
+  return sector + (sector_ix % fs.csize);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Creates the cluster link map of a (read) file, see FILE_ReadOpenIndexed()
+// map[0] always returns the required number of words
+/////////////////////////////////////////////////////////////////////////////
+static s32 FILE_ClusterMapCreate(FIL *fp, u32 *map, u32 map_len)
+{
+  u32 bcs = (u32)fs.csize * SECTOR_SIZE;
+  u32 num_clusters = (fp->fsize + bcs - 1) / bcs;
+  u32 clst = fp->org_clust;
+  u32 *tbl = &map[1];
+  u32 words = 2; // size word and terminator
+  u32 i;
+
+  if( map_len < 2 ) {
+    if( map_len )
+      map[0] = 0;
+    return FILE_ERR_CLUSTER_MAP;
+  }
+
+  for(i=0; i<num_clusters; ) {
+    u32 first = clst;
+    u32 ncl = 0;
+
+    // follow contiguous clusters
+    do {
+      if( clst < 2 || clst >= fs.max_clust )
+        return FILE_ERR_CLUSTER_MAP; // broken chain or disk error
+      ++ncl;
+      ++i;
+      if( i >= num_clusters )
+        break;
+      clst = get_fat(&fs, clst);
+    } while( clst == (first + ncl) );
+
+    words += 2;
+    if( words <= map_len ) {
+      *tbl++ = ncl;
+      *tbl++ = first;
+    }
+  }
+
+  map[0] = words;
+  if( words > map_len )
+    return FILE_ERR_CLUSTER_MAP;
+
+  *tbl = 0; // terminator
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the cluster of the given cluster index from a link map (0: beyond map)
+/////////////////////////////////////////////////////////////////////////////
+static u32 FILE_ClusterMapLookup(u32 *map, u32 cl_ix)
+{
+  u32 *tbl = &map[1];
+  u32 ncl;
+
+  while( (ncl=*tbl++) ) {
+    if( cl_ix < ncl )
+      return *tbl + cl_ix;
+    cl_ix -= ncl;
+    ++tbl;
+  }
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Same result as f_lseek() for read-only files, but cluster taken from a map
+/////////////////////////////////////////////////////////////////////////////
+static s32 FILE_ClusterMapSeek(FIL *fp, u32 *map, u32 offset)
+{
+  if( offset > fp->fsize )
+    offset = fp->fsize;
+
+  fp->fptr = offset;
+  fp->csect = 255;
+  if( offset == 0 )
+    return 0; // first f_read() starts from org_clust
+
+  u32 bcs = (u32)fs.csize * SECTOR_SIZE;
+  u32 cl_ix = (offset - 1) / bcs; // cluster which contains the last byte before the new position
+  u32 cl_ofs = offset - cl_ix * bcs;
+  if( !(fp->curr_clust = FILE_ClusterMapLookup(map, cl_ix)) ) {
+    fp->flag |= FA__ERROR;
+    return FILE_ERR_SEEK;
+  }
+  fp->csect = (BYTE)(cl_ofs / SECTOR_SIZE);
+
+  if( cl_ofs % SECTOR_SIZE ) {
+    u32 nsect = clust2sect(&fs, fp->curr_clust) + fp->csect;
+    fp->csect++;
+    if( nsect != fp->dsect ) {
+      if( disk_read(fs.drive, fp->buf, nsect, 1) != RES_OK ) {
+        file_dfs_errno = FR_DISK_ERR;
+        return FILE_ERR_SEEK;
+      }
+      fp->dsect = nsect;
+    }
+  }
+
+  return 0; // no error
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! This function copies a file
 //! \param[in] src_file the source file which should be copied
@@ -1851,6 +2413,10 @@ s32 FILE_SendErrorMessage(s32 error_status)
   case FILE_ERR_MKDIR: DEBUG_MSG("[SDCARD_ERROR:%d] FILE_MakeDir() failed\n", error_status); break;
   case FILE_ERR_INVALID_SESSION_NAME: DEBUG_MSG("[SDCARD_ERROR:%d] FILE_LoadSessionName()\n", error_status); break;
   case FILE_ERR_UPDATE_FREE: DEBUG_MSG("[SDCARD_ERROR:%d] FILE_UpdateFreeBytes()\n", error_status); break;
+  case FILE_ERR_REMOVE: DEBUG_MSG("[SDCARD_ERROR:%d] FILE_Remove() failed\n", error_status); break;
+  case FILE_ERR_NO_HANDLE: DEBUG_MSG("[SDCARD_ERROR:%d] no free file handle\n", error_status); break;
+  case FILE_ERR_INVALID_HANDLE: DEBUG_MSG("[SDCARD_ERROR:%d] invalid file handle\n", error_status); break;
+  case FILE_ERR_CLUSTER_MAP: DEBUG_MSG("[SDCARD_ERROR:%d] cluster map couldn't be created or is too small\n", error_status); break;
 
   default:
     // remaining errors just print the number
@@ -1862,9 +2428,96 @@ s32 FILE_SendErrorMessage(s32 error_status)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which converts a string of hex digits into bytes
+//! \return number of converted bytes, or -1 if buffer too small
+/////////////////////////////////////////////////////////////////////////////
+static s32 FILE_BrowserHexDecode(char *str_ptr, u8 *buffer, u32 max_len)
+{
+  u32 num_bytes;
+  for(num_bytes=0; *str_ptr; ++num_bytes) {
+    u8 b;
+    if( *str_ptr >= '0' && *str_ptr <= '9' )
+      b = (*str_ptr - '0') << 4;
+    else if( *str_ptr >= 'A' && *str_ptr <= 'F' )
+      b = (*str_ptr - 'A' + 10) << 4;
+    else
+      break;
+    ++str_ptr;
+
+    if( *str_ptr >= '0' && *str_ptr <= '9' )
+      b |= (*str_ptr - '0');
+    else if( *str_ptr >= 'A' && *str_ptr <= 'F' )
+      b |= (*str_ptr - 'A' + 10);
+    else
+      break;
+    ++str_ptr;
+
+    if( num_bytes >= max_len )
+      return -1; // buffer too small
+    buffer[num_bytes] = b;
+  }
+
+  return num_bytes;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which decompresses a "writedataz" block.\n
+//! The format is a byte oriented LZ77 variant:
+//! <UL>
+//!   <LI>0x00..0x7f: literal run, (c+1) bytes are following
+//!   <LI>0x80..0xff: match of ((c & 0x7f) + 3) bytes, the next byte contains
+//!       the distance-1 to already decoded bytes of the same block.
+//!       Overlapping copies are allowed (e.g. distance 1 repeats the last byte).
+//! </UL>
+//! \return number of decoded bytes, or -1 if stream is invalid
+/////////////////////////////////////////////////////////////////////////////
+static s32 FILE_BrowserLzDecode(u8 *src, u32 src_len, u8 *dst, u32 max_len)
+{
+  u32 src_pos = 0;
+  u32 dst_pos = 0;
+
+  while( src_pos < src_len ) {
+    u8 c = src[src_pos++];
+
+    if( c < 0x80 ) {
+      u32 len = c + 1;
+      if( (src_pos + len) > src_len || (dst_pos + len) > max_len )
+	return -1; // invalid stream
+      memcpy(&dst[dst_pos], &src[src_pos], len);
+      src_pos += len;
+      dst_pos += len;
+    } else {
+      u32 len = (c & 0x7f) + 3;
+      if( src_pos >= src_len )
+	return -1; // invalid stream
+      u32 distance = src[src_pos++] + 1;
+      if( distance > dst_pos || (dst_pos + len) > max_len )
+	return -1; // invalid stream
+
+      // byte-wise since source and destination may overlap
+      u8 *copy_ptr = &dst[dst_pos - distance];
+      for(; len; --len)
+	dst[dst_pos++] = *copy_ptr++;
+    }
+  }
+
+  return dst_pos;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 //! Handler for MIOS Studio Filebrowser accesses.\n
-//! See $MIOS32_PATH/apps/controllers/midio128/src/terminal.c for usage example.
+//! See $MIOS32_PATH/apps/controllers/midio128/src/terminal.c for usage example.\n
+//! Uploads are either started with "write <file> <size>", which expects the
+//! "writedata" blocks in order and acknowledges each of them with the next
+//! file position, or with "writew <file> <size> <block size>".\n
+//! In the windowed mode, the filebrowser can send multiple blocks (raw with
+//! "writedata" or compressed with "writedataz") without waiting for the
+//! acknowledge. Each block is answered with W<pos>:<map>, <pos> is the offset
+//! up to which the file has been completely received, <map> is a 32bit
+//! bitmap of the blocks received after this position (bit n: block at
+//! <pos> + n*<block size>), so that only missing blocks have to be re-sent.
 /////////////////////////////////////////////////////////////////////////////
 s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 {
@@ -1991,11 +2644,17 @@ s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 
 	FILE_ReadClose(&file);
       }
-    } else if( strcmp(parameter, "write") == 0 ) {
+    } else if( strcmp(parameter, "write") == 0 || strcmp(parameter, "writew") == 0 ) {
       command_taken = 1;
       status |= MIOS32_MIDI_SendDebugStringHeader(port, 0x41, (u8)'W');
       u8 parameters_valid = 1;
+      u8 windowed = parameter[5] == 'w';
+      u16 block_size = 0;
 
+      // the windowed state is only taken over with valid parameters
+      browser_write_windowed = 0;
+      browser_write_block_size = 0;
+      browser_write_block_map = 0;
 
       char *filename = NULL;
       if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
@@ -2013,11 +2672,27 @@ s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 	    browser_write_file_size = l;
 	  }
 	}
+
+	if( parameters_valid && windowed ) {
+	  if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
+	    parameters_valid = 0;
+	  } else {
+	    char *next;
+	    long l = strtol(parameter, &next, 0);
+	    if( parameter == next || l < 1 || l > FILE_BROWSER_BLOCK_SIZE_MAX ) {
+	      parameters_valid = 0;
+	    } else {
+	      block_size = l;
+	    }
+	  }
+	}
       }
 
       if( !parameters_valid ) {
 	status |= MIOS32_MIDI_SendDebugStringBody(port, "~", 1); // missing or invalid parameter
       } else {
+	browser_write_windowed = windowed;
+	browser_write_block_size = block_size;
 	browser_write_file_pos = 0;
 
 	// try to open file
@@ -2027,6 +2702,19 @@ s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 	  FILE_WriteClose(); // just to ensure...
 	  if( FILE_WriteOpen(filename, 1) < 0 ) {
 	    status |= MIOS32_MIDI_SendDebugStringBody(port, "-", 1); // failed to open file
+	  } else if( browser_write_file_size == 0 ) {
+	    // empty file: no data block will follow, the upload is already complete
+	    FILE_WriteClose();
+	    status |= MIOS32_MIDI_SendDebugStringBody(port, "#", 1); // done
+	    status |= MIOS32_MIDI_SendDebugStringFooter(port);
+	    send_footer = 0;
+
+	    DEBUG_MSG("[FILE] Uploaded %s with 0 bytes\n", filename);
+
+	    if( browser_upload_callback_func ) {
+	      browser_upload_callback_func(filename);
+	      browser_upload_callback_func(NULL);
+	    }
 	  } else {
 	    // initial request
 	    status |= MIOS32_MIDI_SendDebugStringBody(port, "00000000", 8);
@@ -2040,10 +2728,11 @@ s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 	  }
 	}
       }
-    } else if( strcmp(parameter, "writedata") == 0 ) {
+    } else if( strcmp(parameter, "writedata") == 0 || strcmp(parameter, "writedataz") == 0 ) {
       command_taken = 1;
       status |= MIOS32_MIDI_SendDebugStringHeader(port, 0x41, (u8)'W');
       u8 parameters_valid = 1;
+      u8 compressed = parameter[9] == 'z';
 
       u32 address_offset = 0;
       if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
@@ -2058,35 +2747,83 @@ s32 FILE_BrowserHandler(mios32_midi_port_t port, char *command)
 	}
       }
 
-      if( !parameters_valid || address_offset != browser_write_file_pos ) {
+      if( !parameters_valid ||
+	  (!browser_write_windowed && (compressed || address_offset != browser_write_file_pos)) ||
+	  (browser_write_windowed && (address_offset >= browser_write_file_size || (address_offset % browser_write_block_size))) ) {
 	status |= MIOS32_MIDI_SendDebugStringBody(port, "~", 1); // missing or invalid parameter
       } else {
 	if( !volume_available ) {
 	  status |= MIOS32_MIDI_SendDebugStringBody(port, "!", 1); // SD Card not mounted
-	} else {
+	} else if( browser_write_windowed ) {
+	  u8 block[FILE_BROWSER_BLOCK_SIZE_MAX];
+	  s32 num_bytes;
+
+	  if( compressed ) {
+	    // the compressed stream is never larger than the block (otherwise filebrowser sends it raw)
+	    u8 compressed_block[FILE_BROWSER_BLOCK_SIZE_MAX];
+	    num_bytes = FILE_BrowserHexDecode(brkt, compressed_block, browser_write_block_size);
+	    if( num_bytes >= 0 )
+	      num_bytes = FILE_BrowserLzDecode(compressed_block, num_bytes, block, browser_write_block_size);
+	  } else {
+	    num_bytes = FILE_BrowserHexDecode(brkt, block, browser_write_block_size);
+	  }
+
+	  u32 expected_bytes = browser_write_file_size - address_offset;
+	  if( expected_bytes > browser_write_block_size )
+	    expected_bytes = browser_write_block_size;
+
+	  u32 block_ix = (address_offset - browser_write_file_pos) / browser_write_block_size;
+	  u8 write_failed = 0;
+	  if( num_bytes != (s32)expected_bytes ) {
+	    // corrupted block: don't acknowledge it, it will be re-sent
+	  } else if( address_offset < browser_write_file_pos || block_ix >= 32 ||
+		     (browser_write_block_map & (1u << block_ix)) ) {
+	    // block already received, or outside the window
+	  } else {
+	    if( FILE_WriteGetCurrentPosition() != address_offset && FILE_WriteSeek(address_offset) < 0 ) {
+	      write_failed = 1;
+	    } else if( FILE_WriteBuffer(block, num_bytes) < 0 ) {
+	      write_failed = 1;
+	    } else {
+	      browser_write_block_map |= (1u << block_ix);
+	      while( browser_write_block_map & 1 ) {
+		browser_write_block_map >>= 1;
+		browser_write_file_pos += browser_write_block_size;
+	      }
+	      if( browser_write_file_pos > browser_write_file_size )
+		browser_write_file_pos = browser_write_file_size;
+	    }
+	  }
+
+	  if( write_failed ) {
+	    FILE_WriteClose();
+	    status |= MIOS32_MIDI_SendDebugStringBody(port, "-", 1); // failed to write file
+	  } else if( browser_write_file_pos >= browser_write_file_size ) {
+	    // blocks could be re-sent after the last acknowledge got lost: close & notify only once
+	    if( file_write_is_open ) {
+	      FILE_WriteClose();
+
+	      DEBUG_MSG("[FILE] Upload of %d bytes finished.", browser_write_file_size);
 
-	  char *str_ptr = brkt;
-	  int num_bytes;
-	  for(num_bytes=0; *str_ptr; ++num_bytes) { // we can receive any number of bytes
-	    u8 b;
-	    if( *str_ptr >= '0' && *str_ptr <= '9' )
-	      b = (*str_ptr - '0') << 4;
-	    else if( *str_ptr >= 'A' && *str_ptr <= 'F' )
-	      b = (*str_ptr - 'A' + 10) << 4;
-	    else
-	      break;
-	    ++str_ptr;
-
-	    if( *str_ptr >= '0' && *str_ptr <= '9' )
-	      b |= (*str_ptr - '0');
-	    else if( *str_ptr >= 'A' && *str_ptr <= 'F' )
-	      b |= (*str_ptr - 'A' + 10);
-	    else
-	      break;
-	    ++str_ptr;
-
-	    FILE_WriteByte(b);
+	      if( browser_upload_callback_func )
+		browser_upload_callback_func(NULL);
+	    }
+	    status |= MIOS32_MIDI_SendDebugStringBody(port, "#", 1); // done
+	    status |= MIOS32_MIDI_SendDebugStringFooter(port);
+	    send_footer = 0;
+	  } else {
+	    // acknowledge with selective map
+	    char str[20];
+	    sprintf(str, "%08X:%08X", (unsigned)browser_write_file_pos, (unsigned)browser_write_block_map);
+	    status |= MIOS32_MIDI_SendDebugStringBody(port, str, strlen(str));
+	    status |= MIOS32_MIDI_SendDebugStringFooter(port);
+	    send_footer = 0;
 	  }
+	} else {
+	  // we can receive any number of bytes: decode them in place, the binary data
+	  // is never longer than its hex string
+	  s32 num_bytes = FILE_BrowserHexDecode(brkt, (u8 *)brkt, strlen(brkt) / 2);
+	  FILE_WriteBuffer((u8 *)brkt, num_bytes);
 
 	  browser_write_file_pos += num_bytes;
 	  if( browser_write_file_pos >= browser_write_file_size ) {
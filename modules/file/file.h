@@ -51,6 +51,23 @@ extern "C" {
 #define FILE_ERR_INVALID_SESSION_NAME -24 // FILE_LoadSessionName()
 #define FILE_ERR_UPDATE_FREE      -25 // FILE_UpdateFreeBytes()
 #define FILE_ERR_REMOVE           -26 // FILE_Remove() failed
+#define FILE_ERR_NO_HANDLE        -27 // FILE_HandleOpen*() failed, all handles are in use
+#define FILE_ERR_INVALID_HANDLE   -28 // handle number out of range or not open
+#define FILE_ERR_CLUSTER_MAP      -29 // cluster map couldn't be created, e.g. map too small
+#define FILE_ERR_HANDLE_STALE     -30 // file system has been remounted, the handle has to be closed
+
+// number of files which can be opened concurrently with FILE_HandleOpen*()
+// Each one allocates a FatFs FIL with its own sector buffer (~550 bytes), therefore
+// the handle functions are only available if enabled in mios32_config.h
+#ifndef FILE_HANDLE_NUM
+#define FILE_HANDLE_NUM 0
+#endif
+
+// max. block size of windowed filebrowser uploads ("writew" command)
+// the block is decoded into a stack buffer of this size
+#ifndef FILE_BROWSER_BLOCK_SIZE_MAX
+#define FILE_BROWSER_BLOCK_SIZE_MAX 64
+#endif
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -90,6 +107,7 @@ extern u32 FILE_VolumeSectorsPerCluster(void);
 extern u32 FILE_VolumeCluster2Sector(u32 cluster);
 
 extern s32 FILE_ReadOpen(file_t* file, char *filepath);
+extern s32 FILE_ReadOpenIndexed(file_t* file, char *filepath, u32 *map, u32 map_len);
 extern s32 FILE_ReadReOpen(file_t* file);
 extern s32 FILE_ReadClose(file_t* file);
 extern s32 FILE_ReadSeek(u32 offset);
@@ -112,6 +130,20 @@ extern s32 FILE_WriteByte(u8 byte);
 extern s32 FILE_WriteHWord(u16 hword);
 extern s32 FILE_WriteWord(u32 word);
 
+#if FILE_HANDLE_NUM > 0
+extern s32 FILE_HandleOpenRead(char *filepath);
+extern s32 FILE_HandleOpenWrite(char *filepath, u8 create);
+extern s32 FILE_HandleClose(s32 handle);
+extern s32 FILE_HandleClusterMapSet(s32 handle, u32 *map, u32 map_len);
+extern s32 FILE_HandleSeek(s32 handle, u32 offset);
+extern u32 FILE_HandleGetSize(s32 handle);
+extern u32 FILE_HandleGetPosition(s32 handle);
+extern s32 FILE_HandleRead(s32 handle, u8 *buffer, u32 len);
+extern s32 FILE_HandleWrite(s32 handle, u8 *buffer, u32 len);
+#endif
+
+extern s32 FILE_IndexedSectorGet(u32 *map, u32 offset);
+
 extern s32 FILE_Copy(char *src_file, char *dst_file);
 
 extern s32 FILE_MakeDir(char *path);
@@ -0,0 +1,665 @@
+// Loopback test of the MIOS Studio filebrowser uploads
+//
+// FILE_BrowserHandler() runs on top of the real FatFs with a RAM disk.
+// A small client which follows the upload logic of MiosFileBrowser.cpp
+// (old "write" protocol, and "writew" with selective acknowledges and
+// "writedataz" blocks) sends files over a lossy/reordering link, the
+// uploaded files are read back and compared.
+//
+// The LZ codec (compressBlock() of MiosFileBrowser.cpp, FILE_BrowserLzDecode()
+// of file.c) is checked for round-trips, and its speed is measured in KB/s.
+//
+// Files kept open with FILE_HandleOpen*() have to survive failed opens of
+// other files, and have to report FILE_ERR_HANDLE_STALE after a remount.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// static functions of the filebrowser are tested directly
+#include "../file.c"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// RAM disk
+/////////////////////////////////////////////////////////////////////////////
+
+#define RAMDISK_SECTORS 8192 // 4 MB
+
+static u8 ramdisk[RAMDISK_SECTORS][512];
+
+DSTATUS disk_initialize(BYTE drv) { return 0; }
+DSTATUS disk_status(BYTE drv) { return 0; }
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count)
+{
+  if( (sector + count) > RAMDISK_SECTORS )
+    return RES_PARERR;
+  memcpy(buff, ramdisk[sector], count * 512);
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count)
+{
+  if( (sector + count) > RAMDISK_SECTORS )
+    return RES_PARERR;
+  memcpy(ramdisk[sector], buff, count * 512);
+  return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+  switch( ctrl ) {
+  case CTRL_SYNC: return RES_OK;
+  case GET_SECTOR_COUNT: *(DWORD *)buff = RAMDISK_SECTORS; return RES_OK;
+  case GET_SECTOR_SIZE: *(WORD *)buff = 512; return RES_OK;
+  case GET_BLOCK_SIZE: *(DWORD *)buff = 1; return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+DWORD get_fattime(void) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs, the debug string of the last response is captured
+/////////////////////////////////////////////////////////////////////////////
+
+static char response[256];
+static u32 response_len;
+static u32 num_responses;
+
+s32 MIOS32_SDCARD_Init(u32 mode) { return 0; }
+s32 MIOS32_SDCARD_CheckAvailable(u8 was_available) { return 1; }
+s32 MIOS32_SDCARD_CIDRead(mios32_sdcard_cid_t *cid) { return -1; }
+s32 MIOS32_SDCARD_CSDRead(mios32_sdcard_csd_t *csd) { return -1; }
+s32 MIOS32_MIDI_SendSysEx(mios32_midi_port_t port, u8 *stream, u32 count) { return 0; }
+
+s32 MIOS32_MIDI_SendDebugStringHeader(mios32_midi_port_t port, char command, char first_byte)
+{
+  response[0] = first_byte;
+  response_len = 1;
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendDebugStringBody(mios32_midi_port_t port, char *str_from_second_byte, u32 len)
+{
+  if( (response_len + len) >= sizeof(response) )
+    len = sizeof(response) - 1 - response_len;
+  memcpy(&response[response_len], str_from_second_byte, len);
+  response_len += len;
+  return 0;
+}
+
+s32 MIOS32_MIDI_SendDebugStringFooter(mios32_midi_port_t port)
+{
+  response[response_len] = 0;
+  ++num_responses;
+  return 0;
+}
+
+static u32 upload_callbacks_started;
+static u32 upload_callbacks_finished;
+
+static s32 upload_callback(char *filename)
+{
+  if( filename )
+    ++upload_callbacks_started;
+  else
+    ++upload_callbacks_finished;
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Compressor, same as compressBlock() in MiosFileBrowser.cpp
+/////////////////////////////////////////////////////////////////////////////
+static int compressBlock(const u8 *src, int len, u8 *dst, int maxLen)
+{
+  int dstPos = 0;
+  int literalStart = 0;
+  int pos = 0;
+
+  while( pos <= len ) {
+    int bestLen = 0;
+    int bestDistance = 0;
+
+    if( pos < len ) {
+      int distance;
+      for(distance=1; distance<=pos && distance<=256; ++distance) {
+        int matchLen = 0;
+        while( (pos+matchLen) < len && matchLen < (0x7f+3) &&
+               src[pos+matchLen-distance] == src[pos+matchLen] )
+          ++matchLen;
+
+        if( matchLen > bestLen ) {
+          bestLen = matchLen;
+          bestDistance = distance;
+        }
+      }
+    }
+
+    // flush literals before a match, at the end, or if the literal run is full
+    int literalLen = pos - literalStart;
+    if( literalLen && (bestLen >= 3 || pos == len || literalLen == 0x80) ) {
+      if( (dstPos + 1 + literalLen) > maxLen )
+        return -1;
+      dst[dstPos++] = literalLen - 1;
+      int i;
+      for(i=0; i<literalLen; ++i)
+        dst[dstPos++] = src[literalStart + i];
+      literalStart = pos;
+    }
+
+    if( pos == len )
+      break;
+
+    if( bestLen >= 3 ) {
+      if( (dstPos + 2) > maxLen )
+        return -1;
+      dst[dstPos++] = 0x80 | (bestLen - 3);
+      dst[dstPos++] = bestDistance - 1;
+      pos += bestLen;
+      literalStart = pos;
+    } else {
+      ++pos;
+    }
+  }
+
+  return (dstPos < len) ? dstPos : -1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Test data
+/////////////////////////////////////////////////////////////////////////////
+
+#define MAX_FILE_SIZE 70000
+
+static u8 file_data[MAX_FILE_SIZE];
+static u8 read_data[MAX_FILE_SIZE];
+
+static u32 rnd_state;
+static u32 rnd(void)
+{
+  rnd_state = rnd_state * 1103515245 + 12345;
+  return (rnd_state >> 16) & 0x7fff;
+}
+
+typedef enum {
+  DATA_RANDOM,
+  DATA_TEXT,
+  DATA_ZERO,
+} data_type_t;
+
+static const char *data_type_name[] = { "random", "text", "zero" };
+
+static void fill_data(data_type_t type, u32 size)
+{
+  static const char *words[] = { "NOTE ", "C-3 ", "CC#", "7 ", "127\n", "Track ", "Pattern ", "0x40 ", "# comment\n" };
+  u32 i;
+
+  switch( type ) {
+  case DATA_RANDOM:
+    for(i=0; i<size; ++i)
+      file_data[i] = rnd();
+    break;
+  case DATA_TEXT:
+    for(i=0; i<size; ) {
+      const char *w = words[rnd() % 9];
+      while( *w && i<size )
+        file_data[i++] = *w++;
+    }
+    break;
+  case DATA_ZERO:
+    memset(file_data, 0, size);
+    break;
+  }
+}
+
+static int errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { ++errors; printf("FAIL: " __VA_ARGS__); printf("\n"); } } while(0)
+
+static s32 send(char *command)
+{
+  static char buffer[512];
+  strcpy(buffer, command); // the handler modifies the string
+  response[0] = 0;
+  response_len = 0;
+  return FILE_BrowserHandler(DEFAULT, buffer);
+}
+
+static void check_file(const char *name, u32 size)
+{
+  file_t file;
+  CHECK(FILE_ReadOpen(&file, (char *)name) >= 0, "%s: can't open uploaded file", name);
+  u32 len = FILE_ReadGetCurrentSize();
+  CHECK(len == size, "%s: uploaded %u bytes, file has %u bytes", name, (unsigned)size, (unsigned)len);
+  if( len == size && size ) {
+    FILE_ReadBuffer(read_data, size);
+    CHECK(memcmp(file_data, read_data, size) == 0, "%s: content mismatch", name);
+  }
+  FILE_ReadClose(&file);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Old protocol: 32 blocks per burst, each block acknowledged with the next position
+/////////////////////////////////////////////////////////////////////////////
+static void test_old_protocol(const char *name, u32 size)
+{
+  char command[512];
+  u32 started = upload_callbacks_started;
+  u32 finished = upload_callbacks_finished;
+
+  sprintf(command, "write %s %u", name, (unsigned)size);
+  send(command);
+  u32 pos = 0;
+  while( response[0] == 'W' && response[1] != '#' ) {
+    pos = strtol(&response[1], NULL, 16);
+    int len = size - pos;
+    if( len > 32 )
+      len = 32;
+    char *ptr = command + sprintf(command, "writedata %08X ", (unsigned)pos);
+    int i;
+    for(i=0; i<len; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[pos + i]);
+    send(command);
+  }
+
+  CHECK(strcmp(response, "W#") == 0, "%s: old protocol upload ended with '%s'", name, response);
+  CHECK(upload_callbacks_started == started + 1 && upload_callbacks_finished == finished + 1, "%s: callbacks not executed", name);
+  check_file(name, size);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Windowed protocol over a lossy link
+/////////////////////////////////////////////////////////////////////////////
+
+#define BLOCK_SIZE 32
+#define WINDOW_SIZE 32
+#define MAX_RETRIES 5
+
+// link: commands in flight, may be dropped or swapped
+#define LINK_SIZE 256
+static char link_queue[LINK_SIZE][2*BLOCK_SIZE + 32];
+static u32 link_num;
+static u32 link_loss_percent;
+static u32 link_bytes;
+
+static u8 compression;
+static u32 payload_bytes;
+
+static void link_send(const char *command)
+{
+  link_bytes += strlen(command);
+  if( (rnd() % 100) < link_loss_percent )
+    return; // lost
+  if( link_num < LINK_SIZE )
+    strcpy(link_queue[link_num++], command);
+}
+
+static void send_block(u32 offset, u32 size)
+{
+  char command[2*BLOCK_SIZE + 32];
+  int len = size - offset;
+  if( len > BLOCK_SIZE )
+    len = BLOCK_SIZE;
+
+  u8 compressed[BLOCK_SIZE];
+  int compressed_len = compression ? compressBlock(&file_data[offset], len, compressed, len-1) : -1;
+
+  char *ptr;
+  int i;
+  if( compressed_len > 0 ) {
+    ptr = command + sprintf(command, "writedataz %08X ", (unsigned)offset);
+    for(i=0; i<compressed_len; ++i)
+      ptr += sprintf(ptr, "%02X", compressed[i]);
+    payload_bytes += compressed_len;
+  } else {
+    ptr = command + sprintf(command, "writedata %08X ", (unsigned)offset);
+    for(i=0; i<len; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[offset + i]);
+    payload_bytes += len;
+  }
+  link_send(command);
+}
+
+static void test_windowed(const char *name, u32 size, u32 loss_percent, u8 compress)
+{
+  char command[64];
+  u32 started = upload_callbacks_started;
+  u32 finished = upload_callbacks_finished;
+
+  link_num = 0;
+  link_loss_percent = loss_percent;
+  compression = compress;
+
+  sprintf(command, "writew %s %u %u", name, (unsigned)size, BLOCK_SIZE);
+  send(command);
+
+  u32 acked_offset = 0;
+  u32 next_offset = 0;
+  u32 ack_map = 0;
+  u32 fast_retransmit_offset = (u32)-1;
+  u32 retries = 0;
+  u8 done = strcmp(response, "W#") == 0;
+  u8 failed = !done && strcmp(response, "W00000000") != 0;
+
+  while( !done && !failed ) {
+    // fill the window
+    while( next_offset < size && next_offset < (acked_offset + WINDOW_SIZE*BLOCK_SIZE) ) {
+      send_block(next_offset, size);
+      next_offset += BLOCK_SIZE;
+    }
+
+    if( !link_num ) {
+      // timeout: re-send all blocks which haven't been acknowledged yet
+      if( ++retries > MAX_RETRIES ) {
+        failed = 1;
+        break;
+      }
+      u32 offset = acked_offset;
+      u32 block;
+      for(block=0; offset < next_offset; ++block, offset += BLOCK_SIZE) {
+        if( block >= 32 || !(ack_map & (1u << block)) )
+          send_block(offset, size);
+      }
+      continue;
+    }
+
+    // deliver the next command, sometimes swapped with the following one
+    u32 ix = (link_num > 1 && (rnd() % 100) < loss_percent) ? 1 : 0;
+    char delivered[sizeof(link_queue[0])];
+    strcpy(delivered, link_queue[ix]);
+    memmove(link_queue[ix], link_queue[ix+1], (link_num - ix - 1) * sizeof(link_queue[0]));
+    --link_num;
+
+    send(delivered);
+    if( (rnd() % 100) < loss_percent )
+      continue; // response lost
+
+    if( strcmp(response, "W#") == 0 ) {
+      done = 1;
+    } else if( response[0] != 'W' || response_len != 18 || response[9] != ':' ) {
+      failed = 1;
+    } else {
+      u32 address_offset = strtoul(&response[1], NULL, 16);
+      u32 map = strtoul(&response[10], NULL, 16);
+
+      if( address_offset > acked_offset ) {
+        acked_offset = address_offset;
+        retries = 0;
+      }
+      if( address_offset == acked_offset ) {
+        ack_map = map;
+
+        // blocks after a missing one have been received: re-send the missing block immediately (only once)
+        if( ack_map && fast_retransmit_offset != address_offset ) {
+          fast_retransmit_offset = address_offset;
+          send_block(address_offset, size);
+        }
+      }
+    }
+  }
+
+  // blocks which are still in flight after completion must not confuse the core
+  while( link_num ) {
+    send(link_queue[--link_num]);
+    CHECK(strcmp(response, "W#") == 0, "%s: late block answered with '%s'", name, response);
+  }
+
+  CHECK(done, "%s: windowed upload failed (last response '%s')", name, response);
+  CHECK(upload_callbacks_started == started + 1 && upload_callbacks_finished == finished + 1, "%s: callbacks not executed once", name);
+  check_file(name, size);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// the bitmap of the last block in the window (bit 31) must be handled
+/////////////////////////////////////////////////////////////////////////////
+static void test_window_end(void)
+{
+  char command[2*BLOCK_SIZE + 32];
+  u32 size = 40*BLOCK_SIZE;
+  fill_data(DATA_RANDOM, size);
+
+  sprintf(command, "writew WEND.BIN %u %u", (unsigned)size, BLOCK_SIZE);
+  send(command);
+
+  // send blocks 31..1, block 0 is missing
+  int block;
+  for(block=31; block>=1; --block) {
+    char *ptr = command + sprintf(command, "writedata %08X ", block*BLOCK_SIZE);
+    int i;
+    for(i=0; i<BLOCK_SIZE; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[block*BLOCK_SIZE + i]);
+    send(command);
+  }
+  CHECK(strcmp(response, "W00000000:FFFFFFFE") == 0, "window end: got '%s'", response);
+
+  // block 32 is outside of the window
+  {
+    char *ptr = command + sprintf(command, "writedata %08X ", 32*BLOCK_SIZE);
+    int i;
+    for(i=0; i<BLOCK_SIZE; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[32*BLOCK_SIZE + i]);
+    send(command);
+  }
+  CHECK(strcmp(response, "W00000000:FFFFFFFE") == 0, "window end: block outside of window acknowledged '%s'", response);
+
+  // block 0 completes the window
+  {
+    char *ptr = command + sprintf(command, "writedata %08X ", 0);
+    int i;
+    for(i=0; i<BLOCK_SIZE; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[i]);
+    send(command);
+  }
+  CHECK(strcmp(response, "W00000400:00000000") == 0, "window end: got '%s' after window has been completed", response);
+
+  // remaining blocks
+  for(block=32; block<40; ++block) {
+    char *ptr = command + sprintf(command, "writedata %08X ", block*BLOCK_SIZE);
+    int i;
+    for(i=0; i<BLOCK_SIZE; ++i)
+      ptr += sprintf(ptr, "%02X", file_data[block*BLOCK_SIZE + i]);
+    send(command);
+  }
+  CHECK(strcmp(response, "W#") == 0, "window end: upload not finished '%s'", response);
+  check_file("WEND.BIN", size);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// a rejected "writew" must not leave the windowed state with block size 0
+/////////////////////////////////////////////////////////////////////////////
+static void test_invalid_window(void)
+{
+  send("writew BAD.BIN 100 0");
+  CHECK(strcmp(response, "W~") == 0, "invalid window: block size 0 accepted '%s'", response);
+  send("writew BAD.BIN 100");
+  CHECK(strcmp(response, "W~") == 0, "invalid window: missing block size accepted '%s'", response);
+
+  // no division by zero, the data is rejected
+  send("writedata 00000000 55");
+  CHECK(strcmp(response, "W~") == 0, "invalid window: data accepted '%s'", response);
+  send("writedataz 00000000 0055");
+  CHECK(strcmp(response, "W~") == 0, "invalid window: compressed data accepted '%s'", response);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// open handles must not be invalidated by failed opens of other files
+/////////////////////////////////////////////////////////////////////////////
+static void test_handles(void)
+{
+  u8 buffer[100];
+  s32 h;
+
+  fill_data(DATA_RANDOM, 2000);
+  h = FILE_HandleOpenWrite("HANDLE.BIN", 1);
+  CHECK(h >= 0, "handles: open for writing failed (%d)", (int)h);
+  CHECK(FILE_HandleWrite(h, file_data, 2000) == 0, "handles: write failed");
+  CHECK(FILE_HandleClose(h) == 0, "handles: close after writing failed");
+
+  h = FILE_HandleOpenRead("HANDLE.BIN");
+  CHECK(h >= 0, "handles: open for reading failed (%d)", (int)h);
+  CHECK(FILE_HandleRead(h, buffer, 100) == 100 && memcmp(buffer, file_data, 100) == 0, "handles: first read failed");
+
+  // missing files are no reason to remount the volume
+  CHECK(FILE_HandleOpenRead("MISSING.BIN") == FILE_ERR_OPEN_READ, "handles: missing file opened");
+  file_t file;
+  CHECK(FILE_ReadOpen(&file, "MISSING.BIN") < 0, "handles: missing file opened for reading");
+  CHECK(FILE_HandleRead(h, buffer, 100) == 100 && memcmp(buffer, &file_data[100], 100) == 0, "handles: read after failed opens failed");
+  CHECK(FILE_HandleSeek(h, 1900) == 0 && FILE_HandleRead(h, buffer, 100) == 100 && memcmp(buffer, &file_data[1900], 100) == 0,
+        "handles: seek after failed opens failed");
+
+  // after a remount (e.g. SD Card change) the handle has to be reopened
+  CHECK(FILE_MountFS() == 0, "handles: remount failed");
+  CHECK(FILE_HandleSeek(h, 0) == FILE_ERR_HANDLE_STALE, "handles: seek on stale handle");
+  CHECK(FILE_HandleRead(h, buffer, 100) == FILE_ERR_HANDLE_STALE, "handles: read from stale handle");
+  CHECK(FILE_HandleClose(h) == 0, "handles: close of stale handle failed");
+
+  h = FILE_HandleOpenRead("HANDLE.BIN");
+  CHECK(h >= 0 && FILE_HandleRead(h, buffer, 100) == 100 && memcmp(buffer, file_data, 100) == 0, "handles: reopen failed");
+  FILE_HandleClose(h);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// LZ codec
+/////////////////////////////////////////////////////////////////////////////
+static void test_codec(data_type_t type)
+{
+  u32 size = 64*1024;
+  u32 rounds = 16;
+  fill_data(type, size);
+
+  u8 compressed[MAX_FILE_SIZE];
+  u32 compressed_len[MAX_FILE_SIZE / BLOCK_SIZE];
+  u32 num_blocks = size / BLOCK_SIZE;
+  u32 total_compressed = 0;
+  u32 round, block;
+
+  clock_t t0 = clock();
+  for(round=0; round<rounds; ++round) {
+    total_compressed = 0;
+    for(block=0; block<num_blocks; ++block) {
+      int len = compressBlock(&file_data[block*BLOCK_SIZE], BLOCK_SIZE, &compressed[block*BLOCK_SIZE], BLOCK_SIZE-1);
+      compressed_len[block] = (len > 0) ? len : 0;
+      total_compressed += (len > 0) ? len : BLOCK_SIZE;
+    }
+  }
+  clock_t t1 = clock();
+  for(round=0; round<rounds; ++round) {
+    for(block=0; block<num_blocks; ++block) {
+      if( !compressed_len[block] )
+        memcpy(&read_data[block*BLOCK_SIZE], &file_data[block*BLOCK_SIZE], BLOCK_SIZE);
+      else {
+        s32 len = FILE_BrowserLzDecode(&compressed[block*BLOCK_SIZE], compressed_len[block], &read_data[block*BLOCK_SIZE], BLOCK_SIZE);
+        if( len != BLOCK_SIZE ) {
+          CHECK(0, "codec %s: block %u decoded to %d bytes", data_type_name[type], (unsigned)block, (int)len);
+          return;
+        }
+      }
+    }
+  }
+  clock_t t2 = clock();
+
+  CHECK(memcmp(file_data, read_data, size) == 0, "codec %s: round-trip mismatch", data_type_name[type]);
+
+  double kb = (double)size * rounds / 1024.0;
+  double t_compress = (double)(t1 - t0) / CLOCKS_PER_SEC;
+  double t_decode = (double)(t2 - t1) / CLOCKS_PER_SEC;
+  printf("codec %-6s: %5.1f%% payload, compress %8.0f KB/s, decode %8.0f KB/s\n",
+         data_type_name[type], 100.0 * total_compressed / size,
+         t_compress > 0 ? kb / t_compress : 0.0,
+         t_decode > 0 ? kb / t_decode : 0.0);
+
+  // invalid streams must be rejected
+  u8 dst[BLOCK_SIZE];
+  u8 bad_distance[] = { 0x00, 0x11, 0x80, 0x01 }; // match before the first byte
+  CHECK(FILE_BrowserLzDecode(bad_distance, sizeof(bad_distance), dst, BLOCK_SIZE) < 0, "codec: invalid distance accepted");
+  u8 bad_literal[] = { 0x05, 0x11, 0x22 }; // truncated literal run
+  CHECK(FILE_BrowserLzDecode(bad_literal, sizeof(bad_literal), dst, BLOCK_SIZE) < 0, "codec: truncated literal accepted");
+  u8 too_long[] = { 0x00, 0x11, 0xff, 0x00 }; // 130 bytes
+  CHECK(FILE_BrowserLzDecode(too_long, sizeof(too_long), dst, BLOCK_SIZE) < 0, "codec: overlong block accepted");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  BYTE work_drive = 0;
+  FATFS mkfs_fs;
+  f_mount(work_drive, &mkfs_fs);
+  if( f_mkfs(work_drive, 0, 0) != FR_OK ) {
+    printf("FAIL: f_mkfs\n");
+    return 1;
+  }
+
+  FILE_Init(0);
+  FILE_CheckSDCard();
+  CHECK(FILE_VolumeAvailable(), "RAM disk not mounted");
+  FILE_BrowserUploadCallback_Init(upload_callback);
+
+  rnd_state = 1;
+
+  // codec
+  test_codec(DATA_RANDOM);
+  test_codec(DATA_TEXT);
+  test_codec(DATA_ZERO);
+
+  // old protocol (also with empty file and a partial last block)
+  fill_data(DATA_TEXT, 5000);
+  test_old_protocol("OLD.TXT", 5000);
+  test_old_protocol("OLD0.TXT", 0);
+
+  // empty file with the windowed protocol
+  test_windowed("EMPTY.TXT", 0, 0, 1);
+
+  test_window_end();
+  test_invalid_window();
+  test_handles();
+
+  // loopback throughput
+  static const u32 sizes[] = { 1, 31, 32, 33, 1000, 1024, 65000 };
+  static const u32 losses[] = { 0, 1, 5, 10 };
+  data_type_t type;
+  for(type=DATA_RANDOM; type<=DATA_ZERO; ++type) {
+    u8 compress;
+    for(compress=0; compress<=1; ++compress) {
+      u32 s, l;
+      for(l=0; l<sizeof(losses)/sizeof(u32); ++l) {
+        clock_t t0 = clock();
+        u32 total_size = 0;
+        link_bytes = 0;
+        payload_bytes = 0;
+        for(s=0; s<sizeof(sizes)/sizeof(u32); ++s) {
+          char name[16];
+          sprintf(name, "W%u%u%u%u.BIN", type, compress, (unsigned)l, (unsigned)s);
+          fill_data(type, sizes[s]);
+          test_windowed(name, sizes[s], losses[l], compress);
+          total_size += sizes[s];
+        }
+        double t = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        printf("loopback %-6s %s loss %2u%%: %6.1f%% payload, %5.2f wire bytes/byte, %8.0f KB/s\n",
+               data_type_name[type], compress ? "writedataz" : "writedata ", (unsigned)losses[l],
+               100.0 * payload_bytes / total_size, (double)link_bytes / total_size,
+               t > 0 ? total_size / 1024.0 / t : 0.0);
+      }
+    }
+  }
+
+  if( errors ) {
+    printf("%d errors\n", errors);
+    return 1;
+  }
+
+  printf("all tests passed\n");
+  return 0;
+}
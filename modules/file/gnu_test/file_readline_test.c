@@ -0,0 +1,403 @@
+// Host test and benchmark of FILE_ReadLine()
+//
+// FILE_ReadLine() runs on top of the real FatFs with a RAM disk. A text file
+// with LF, CR/LF and CR line endings, empty and overlong lines is written
+// fragmented (interleaved with a second file), so that lines cross sector
+// and cluster boundaries.
+//
+// - The lines are compared with a reference splitter for several max_len
+//   values, together with FILE_ReadGetCurrentPosition().
+// - FILE_ReadLine() is mixed randomly with FILE_ReadBuffer(),
+//   FILE_ReadByte(), FILE_ReadSeek() and FILE_ReadClose()/FILE_ReadReOpen()
+//   (with another file read in between), also on a file opened with
+//   FILE_ReadOpenIndexed().
+// - FILE_ReadClose() and FILE_ReadBuffer() mustn't access the disk when the
+//   data is already in the sector buffer.
+//
+// Finally the time and the number of sector reads per line are printed,
+// compared to a loop which reads each character with FILE_ReadBuffer().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../file.c"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// RAM disk with access counter
+/////////////////////////////////////////////////////////////////////////////
+
+#define RAMDISK_SECTORS 8192 // 4 MB
+
+static u8 ramdisk[RAMDISK_SECTORS][512];
+static u32 num_sector_reads;
+
+DSTATUS disk_initialize(BYTE drv) { return 0; }
+DSTATUS disk_status(BYTE drv) { return 0; }
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count)
+{
+  if( (sector + count) > RAMDISK_SECTORS )
+    return RES_PARERR;
+  memcpy(buff, ramdisk[sector], count * 512);
+  num_sector_reads += count;
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count)
+{
+  if( (sector + count) > RAMDISK_SECTORS )
+    return RES_PARERR;
+  memcpy(ramdisk[sector], buff, count * 512);
+  return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+  switch( ctrl ) {
+  case CTRL_SYNC: return RES_OK;
+  case GET_SECTOR_COUNT: *(DWORD *)buff = RAMDISK_SECTORS; return RES_OK;
+  case GET_SECTOR_SIZE: *(WORD *)buff = 512; return RES_OK;
+  case GET_BLOCK_SIZE: *(DWORD *)buff = 1; return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+DWORD get_fattime(void) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_SDCARD_Init(u32 mode) { return 0; }
+s32 MIOS32_SDCARD_CheckAvailable(u8 was_available) { return 1; }
+s32 MIOS32_SDCARD_CIDRead(mios32_sdcard_cid_t *cid) { return -1; }
+s32 MIOS32_SDCARD_CSDRead(mios32_sdcard_csd_t *csd) { return -1; }
+s32 MIOS32_MIDI_SendSysEx(mios32_midi_port_t port, u8 *stream, u32 count) { return 0; }
+s32 MIOS32_MIDI_SendDebugStringHeader(mios32_midi_port_t port, char command, char first_byte) { return 0; }
+s32 MIOS32_MIDI_SendDebugStringBody(mios32_midi_port_t port, char *str_from_second_byte, u32 len) { return 0; }
+s32 MIOS32_MIDI_SendDebugStringFooter(mios32_midi_port_t port) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Test data
+/////////////////////////////////////////////////////////////////////////////
+
+#define TEXT_SIZE  300000
+#define OTHER_SIZE 100000
+
+static u8 text[TEXT_SIZE];
+static u8 other[OTHER_SIZE];
+
+static u32 rnd_state;
+static u32 rnd(void)
+{
+  rnd_state = rnd_state * 1103515245 + 12345;
+  return (rnd_state >> 16) & 0x7fff;
+}
+
+static void fill_text(void)
+{
+  static const char *words[] = { "NOTE ", "C-3 ", "CC#", "7 ", "127", "Track ", "Pattern ", "0x40 ", "# comment" };
+  static const char *endings[] = { "\n", "\r\n", "\r", "\n\n" };
+  u32 i = 0;
+
+  while( i < TEXT_SIZE ) {
+    // mostly short lines, sometimes lines which exceed the buffers of the test
+    int num_words = (rnd() % 16) ? (rnd() % 12) : (50 + rnd() % 100);
+    int w;
+    for(w=0; w<num_words && i<TEXT_SIZE; ++w) {
+      const char *s = words[rnd() % 9];
+      while( *s && i<TEXT_SIZE )
+	text[i++] = *s++;
+    }
+    const char *e = endings[rnd() % 4];
+    while( *e && i<TEXT_SIZE )
+      text[i++] = *e++;
+  }
+}
+
+// writes both files in small chunks, so that their clusters are interleaved
+static void write_files(void)
+{
+  FIL a, b;
+  UINT bw;
+  u32 pos_a = 0, pos_b = 0;
+
+  f_open(&a, "TEXT.TXT", FA_CREATE_ALWAYS | FA_WRITE);
+  f_open(&b, "OTHER.BIN", FA_CREATE_ALWAYS | FA_WRITE);
+  while( pos_a < TEXT_SIZE || pos_b < OTHER_SIZE ) {
+    u32 len = 1 + rnd() % 3000;
+    if( pos_a < TEXT_SIZE ) {
+      if( len > (TEXT_SIZE - pos_a) )
+	len = TEXT_SIZE - pos_a;
+      f_write(&a, &text[pos_a], len, &bw);
+      pos_a += len;
+    }
+    if( pos_b < OTHER_SIZE ) {
+      len = 1 + rnd() % 3000;
+      if( len > (OTHER_SIZE - pos_b) )
+	len = OTHER_SIZE - pos_b;
+      f_write(&b, &other[pos_b], len, &bw);
+      pos_b += len;
+    }
+  }
+  f_close(&a);
+  f_close(&b);
+}
+
+static int errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { ++errors; printf("FAIL: " __VA_ARGS__); printf("\n"); } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Reference: the line which starts at *pos, terminated by a single CR or LF,
+// cut to max_len-1 characters; returns the number of consumed bytes
+/////////////////////////////////////////////////////////////////////////////
+static u32 reference_line(u32 pos, u32 max_len, char *line)
+{
+  u32 num_read = 0;
+  u32 len = 0;
+
+  while( pos < TEXT_SIZE ) {
+    u8 c = text[pos++];
+    ++num_read;
+    if( c == '\n' || c == '\r' )
+      break;
+    if( len < (max_len - 1) )
+      line[len++] = c;
+  }
+  line[len] = 0;
+
+  return num_read;
+}
+
+// checks the next line at the given position
+static void check_line(const char *name, u32 *pos, u32 max_len)
+{
+  char line[1024];
+  char expected[1024];
+  u32 num_expected = reference_line(*pos, max_len, expected);
+
+  s32 num_read = FILE_ReadLine((u8 *)line, max_len);
+  CHECK(num_read == num_expected, "%s: line at %u: read %d bytes, expected %u", name, (unsigned)*pos, (int)num_read, (unsigned)num_expected);
+  CHECK(strcmp(line, expected) == 0, "%s: line at %u: '%s', expected '%s'", name, (unsigned)*pos, line, expected);
+  *pos += num_expected;
+  CHECK(FILE_ReadGetCurrentPosition() == *pos, "%s: position %u after line, expected %u", name, (unsigned)FILE_ReadGetCurrentPosition(), (unsigned)*pos);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Line splitting with LF, CR/LF and CR
+/////////////////////////////////////////////////////////////////////////////
+static void test_lines(u32 max_len)
+{
+  file_t file;
+  char name[32];
+  u32 pos = 0;
+
+  sprintf(name, "lines (max_len %u)", (unsigned)max_len);
+  CHECK(FILE_ReadOpen(&file, "TEXT.TXT") >= 0, "%s: can't open file", name);
+  while( pos < TEXT_SIZE && !errors )
+    check_line(name, &pos, max_len);
+  CHECK(FILE_ReadLine((u8 *)name, max_len) == 0, "lines: data returned at the end of file");
+  FILE_ReadClose(&file);
+}
+
+static void test_line_endings(void)
+{
+  static const char content[] = "one\r\ntwo\rthree\n\nfour";
+  static const char *lines[] = { "one", "", "two", "three", "", "four" };
+  file_t file;
+  char line[16];
+  int i;
+
+  FILE_WriteOpen("ENDINGS.TXT", 1);
+  FILE_WriteBuffer((u8 *)content, strlen(content));
+  FILE_WriteClose();
+
+  // every CR and LF terminates a line, a CR/LF therefore results into an additional empty line
+  CHECK(FILE_ReadOpen(&file, "ENDINGS.TXT") >= 0, "endings: can't open file");
+  for(i=0; i<6; ++i) {
+    FILE_ReadLine((u8 *)line, sizeof(line));
+    CHECK(strcmp(line, lines[i]) == 0, "endings: line %d is '%s', expected '%s'", i, line, lines[i]);
+  }
+  CHECK(FILE_ReadLine((u8 *)line, sizeof(line)) == 0 && line[0] == 0, "endings: data returned at the end of file");
+  FILE_ReadClose(&file);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// FILE_ReadLine() mixed with the other read functions
+/////////////////////////////////////////////////////////////////////////////
+static void test_mixed(u8 indexed)
+{
+  static u8 buffer[2000];
+  static u32 map[1024];
+  const char *name = indexed ? "mixed (indexed)" : "mixed";
+  file_t file, file_other;
+  u32 pos = 0;
+  int i;
+
+  if( indexed )
+    CHECK(FILE_ReadOpenIndexed(&file, "TEXT.TXT", map, 1024) >= 0, "%s: can't open file", name);
+  else
+    CHECK(FILE_ReadOpen(&file, "TEXT.TXT") >= 0, "%s: can't open file", name);
+
+  // the other file is read in between
+  FILE_ReadClose(&file);
+  CHECK(FILE_ReadOpen(&file_other, "OTHER.BIN") >= 0, "%s: can't open other file", name);
+  FILE_ReadClose(&file_other);
+  FILE_ReadReOpen(&file);
+
+  for(i=0; i<20000 && !errors; ++i) {
+    switch( rnd() % 8 ) {
+    case 0: { // read buffer
+      u32 len = 1 + rnd() % sizeof(buffer);
+      if( len > (TEXT_SIZE - pos) )
+	break;
+      u32 reads = num_sector_reads;
+      CHECK(FILE_ReadBuffer(buffer, len) == 0, "%s: read of %u bytes at %u failed", name, (unsigned)len, (unsigned)pos);
+      CHECK(memcmp(buffer, &text[pos], len) == 0, "%s: read of %u bytes at %u differs", name, (unsigned)len, (unsigned)pos);
+      if( (pos % 512) && (pos % 512) + len <= 512 )
+	CHECK(num_sector_reads == reads, "%s: read inside of the current sector accessed the disk", name);
+      pos += len;
+    } break;
+
+    case 1: { // read byte
+      u8 b;
+      if( pos >= TEXT_SIZE )
+	break;
+      CHECK(FILE_ReadByte(&b) == 0 && b == text[pos], "%s: byte at %u differs", name, (unsigned)pos);
+      ++pos;
+    } break;
+
+    case 2: // seek
+      pos = (rnd() % 4) ? (rnd() * 13) % TEXT_SIZE : (rnd() % (TEXT_SIZE / 512)) * 512;
+      CHECK(FILE_ReadSeek(pos) == 0, "%s: seek to %u failed", name, (unsigned)pos);
+      break;
+
+    case 3: { // close, read the other file, and reopen
+      u32 reads = num_sector_reads;
+      FILE_ReadClose(&file);
+      CHECK(num_sector_reads == reads, "%s: close accessed the disk", name);
+      if( rnd() % 2 ) {
+	u32 ofs = rnd() % (OTHER_SIZE - 100);
+	CHECK(FILE_ReadOpen(&file_other, "OTHER.BIN") >= 0, "%s: can't open other file", name);
+	FILE_ReadSeek(ofs);
+	FILE_ReadBuffer(buffer, 100);
+	CHECK(memcmp(buffer, &other[ofs], 100) == 0, "%s: other file differs", name);
+	FILE_ReadLine(buffer, 100);
+	FILE_ReadClose(&file_other);
+      }
+      CHECK(FILE_ReadReOpen(&file) == 0, "%s: reopen failed", name);
+      CHECK(FILE_ReadGetCurrentPosition() == pos, "%s: position %u after reopen, expected %u", name, (unsigned)FILE_ReadGetCurrentPosition(), (unsigned)pos);
+    } break;
+
+    default: // lines
+      check_line(name, &pos, (rnd() % 2) ? 80 : (1 + rnd() % 1000));
+    }
+  }
+
+  FILE_ReadClose(&file);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Benchmark
+/////////////////////////////////////////////////////////////////////////////
+
+// FILE_ReadLine() before the sector buffer was used
+static s32 read_line_bytewise(u8 *buffer, u32 max_len)
+{
+  s32 status;
+  u32 num_read = 0;
+
+  while( file_read.fptr < file_read.fsize ) {
+    status = FILE_ReadBuffer(buffer, 1);
+
+    if( status < 0 )
+      return status;
+
+    ++num_read;
+
+    if( *buffer == '\n' || *buffer == '\r' )
+      break;
+
+    if( num_read < max_len )
+      ++buffer;
+  }
+
+  // replace newline by terminator
+  *buffer = 0;
+
+  return num_read;
+}
+
+static void benchmark(const char *name, s32 (*read_line)(u8 *buffer, u32 max_len))
+{
+  const int rounds = 20;
+  file_t file;
+  u8 line[256];
+  u32 num_lines = 0;
+  int round;
+
+  num_sector_reads = 0;
+  clock_t t0 = clock();
+  for(round=0; round<rounds; ++round) {
+    FILE_ReadOpen(&file, "TEXT.TXT");
+    while( read_line(line, sizeof(line)) > 0 )
+      ++num_lines;
+    FILE_ReadClose(&file);
+  }
+  double t = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+  printf("%-28s %7.1f nS per line, %5.2f sector reads per KB\n", name,
+	 1e9 * t / num_lines, num_sector_reads / (rounds * TEXT_SIZE / 1024.0));
+}
+
+
+int main(int argc, char **argv)
+{
+  BYTE work_drive = 0;
+  FATFS mkfs_fs;
+  f_mount(work_drive, &mkfs_fs);
+  if( f_mkfs(work_drive, 0, 0) != FR_OK ) {
+    printf("FAIL: f_mkfs\n");
+    return 1;
+  }
+
+  FILE_Init(0);
+  FILE_CheckSDCard();
+  CHECK(FILE_VolumeAvailable(), "RAM disk not mounted");
+
+  rnd_state = 1;
+  fill_text();
+  u32 i;
+  for(i=0; i<OTHER_SIZE; ++i)
+    other[i] = rnd();
+  write_files();
+
+  test_line_endings();
+  test_lines(1);
+  test_lines(8);
+  test_lines(80);
+  test_lines(1000);
+  test_mixed(0);
+  test_mixed(1);
+
+  benchmark("FILE_ReadLine", FILE_ReadLine);
+  benchmark("FILE_ReadBuffer per byte", read_line_bytewise);
+
+  if( errors ) {
+    printf("%d errors\n", errors);
+    return 1;
+  }
+
+  printf("all tests passed\n");
+  return 0;
+}
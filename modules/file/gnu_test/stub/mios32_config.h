@@ -0,0 +1,10 @@
+// minimal configuration for the host tests
+#ifndef _MIOS32_CONFIG_H
+#define _MIOS32_CONFIG_H
+
+#define DEBUG_MSG(...) do {} while(0)
+
+// the handle functions are tested as well
+#define FILE_HANDLE_NUM 2
+
+#endif /* _MIOS32_CONFIG_H */
@@ -47,6 +47,40 @@ u32 genesis_clock_psg;
 // Local variables
 /////////////////////////////////////////////////////////////////////////////
 
+#ifdef GENESIS_USE_WRITEQUEUE
+typedef union {
+    u32 all;
+    struct {
+        u8 type; //0x00 PSG write; 0x02, 0x03 OPN2 write port 0, 1
+        u8 addr;
+        u8 data;
+        u8 dummy;
+    };
+} genesis_wq_entry_t;
+
+typedef struct {
+    genesis_wq_entry_t q[GENESIS_WRITEQUEUE_LENGTH];
+    u8 start;
+    volatile u8 depth;
+    u8 busy; //Chips are still busy from the last write, until readytime
+    u16 readytime; //TIM4 time
+} genesis_wq_t;
+
+static genesis_wq_t wq[GENESIS_COUNT];
+static volatile u8 wq_phase; //0: bus idle; 1, 2: OPN2 address, data strobe active
+static u8 wq_board; //Board on the bus, or last served
+
+static void Genesis_WQ_Init();
+static void Genesis_WQ_TakeBus(u8 board);
+
+//Take the bus for a synchronous access: finishes any write the queue has in
+//progress, then leaves interrupts disabled
+#define GENESIS_BUS_TAKE Genesis_WQ_TakeBus(0xFF)
+#else
+#define GENESIS_BUS_TAKE MIOS32_IRQ_Disable()
+#endif
+#define GENESIS_BUS_GIVE MIOS32_IRQ_Enable()
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Lookup tables
@@ -105,6 +139,9 @@ void Genesis_Init(){
     GPIOC->OTYPER &= 0xFFFF1FFF;    //Set all to push-pull
     GPIOC->OSPEEDR |= 0xFC000000;   //GOTTA GO FAST
     GPIOC->PUPDR &= 0x03FFFFFF;     //Turn off all pull-ups
+#ifdef GENESIS_USE_WRITEQUEUE
+    Genesis_WQ_Init();
+#endif
     //Reset all (also resets internal chip state)
     u8 i;
     for(i=0; i<GENESIS_COUNT; ++i){
@@ -115,10 +152,22 @@ void Genesis_Init(){
     genesis_clock_psg = 3579545;
 }
 
-void Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data){
-    board &= 0x03;
-    addrhi &= 0x01;
-    //Save chip state
+/////////////////////////////////////////////////////////////////////////////
+// Bus access
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef MIOS32_FAMILY_EMULATION
+//The host tests (gnu_test/) emulate the bus by implementing the functions which
+//drive the GPIOs; TIM4 is simulated by the test as well
+extern void Genesis_OPN2BusWrite(u8 board, u8 addrhi, u8 address, u8 data);
+extern void Genesis_PSGBusWriteNoLock(u8 board, u8 data);
+extern void Genesis_OPN2BusAddress(u8 board, u8 addrhi, u8 address);
+extern void Genesis_OPN2BusData(u8 data);
+extern void Genesis_OPN2BusRelease();
+#endif
+
+//Update genesis[board] for a write to the OPN2
+static void Genesis_OPN2Shadow(u8 board, u8 addrhi, u8 address, u8 data){
     u8 chan, op, reg;
     if(address <= 0x2F){
         if(address >= 0x20 && !addrhi){
@@ -163,8 +212,12 @@ void Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data){
             genesis[board].opn2.chan[chan].ALL[reg] = data;
         }
     }//else { not a register; }
-    //Perform chip write
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+}
+
+#ifndef MIOS32_FAMILY_EMULATION
+//Perform an OPN2 write on the bus, waiting for the strobe timing
+static void Genesis_OPN2BusWrite(u8 board, u8 addrhi, u8 address, u8 data){
+    GENESIS_BUS_TAKE; //Turn off interrupts
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -190,12 +243,12 @@ void Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data){
     GENESIS_OPN2_WRITEWAIT; //Wait for 1 OPN2 internal cycle
     GPIOC->ODR |= 0x0000A000; //Write /CS and /WR high
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs
-    MIOS32_IRQ_Enable(); //Turn on interrupts
+    GENESIS_BUS_GIVE; //Turn on interrupts
 }
+#endif
 
-void Genesis_PSGWrite(u8 board, u8 data){
-    board &= 0x03;
-    //Save chip state
+//Update genesis[board] for a write to the PSG
+static void Genesis_PSGShadow(u8 board, u8 data){
     u8 addr, voice;
     if(data & 0x80){
         addr = (data & 0x70) >> 4;
@@ -223,8 +276,11 @@ void Genesis_PSGWrite(u8 board, u8 data){
             genesis[board].psg.square[voice].freq = (genesis[board].psg.square[voice].freq & 0x000F) | ((u16)(data & 0x3F) << 4);
         }
     }
-    //Perform chip write
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+}
+
+#ifndef MIOS32_FAMILY_EMULATION
+//Perform a PSG write on the bus; interrupts must already be disabled
+static void Genesis_PSGBusWriteNoLock(u8 board, u8 data){
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -245,12 +301,252 @@ void Genesis_PSGWrite(u8 board, u8 data){
     GENESIS_SHORTWAIT;
     GPIOC->ODR |= 0x00002000; //Now write /CS high to turn off bus drivers
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs
+}
+
+//The phases of an OPN2 write performed by the write queue, without waiting for
+//the strobe timing; interrupts must already be disabled
+//Phase 1: address strobe
+static inline void Genesis_OPN2BusAddress(u8 board, u8 addrhi, u8 address){
+    GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
+    u32 porte = GPIOE->ODR;
+    porte &= 0xFFFF000B; //Mask out the things we will set
+    u32 a = address;
+    a <<= 2; //Make room for board number
+    a |= board;
+    a <<= 2; //A2 = 0 for OPN2 write, A1 = addrhi
+    a |= addrhi;
+    a <<= 4; //Move over into place, A0 = 0 for address write
+    porte |= a; //Write to our temp copy
+    GPIOE->ODR = porte; //Write address bits and data
+    GPIOE->MODER |= 0x55550000; //Set data pins to outputs
+    GENESIS_SHORTWAIT;
+    GPIOC->ODR &= 0xFFFF5FFF; //Write /CS and /WR low
+}
+
+//Phase 2: data strobe
+static inline void Genesis_OPN2BusData(u8 data){
+    GPIOC->ODR |= 0x0000A000; //Write /CS and /WR high
+    u32 porte = GPIOE->ODR;
+    porte &= 0xFFFF00FF; //Get rid of address value
+    porte |= ((u32)data << 8); //Put in data value
+    porte |= 4; //A0 = 1 for data write
+    GPIOE->ODR = porte; //Write address bits and data
+    GENESIS_SHORTWAIT;
+    GPIOC->ODR &= 0xFFFF5FFF; //Write /CS and /WR low
+}
+
+//End of the write
+static inline void Genesis_OPN2BusRelease(){
+    GPIOC->ODR |= 0x0000A000; //Write /CS and /WR high
+    GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs
+}
+#endif
+
+#ifdef GENESIS_USE_WRITEQUEUE
+/////////////////////////////////////////////////////////////////////////////
+// Write queue
+/////////////////////////////////////////////////////////////////////////////
+
+//Have the TIM4 compare interrupt fire in the given number of ticks
+static inline void Genesis_WQ_Arm(u16 ticks){
+    if(ticks < 16) ticks = 16; //Don't set the compare value to a time that's already passed
+    TIM4->CCR1 = (u16)(TIM4->CNT + ticks);
+    TIM4->SR = (u16)~TIM_IT_CC1;
+    TIM4->DIER |= TIM_IT_CC1;
+}
+
+//The head write of a board's queue has been completed
+static inline void Genesis_WQ_Done(genesis_wq_t* w, u16 busyticks){
+    w->start = (w->start + 1) & (GENESIS_WRITEQUEUE_LENGTH-1);
+    --w->depth;
+    w->busy = 1;
+    w->readytime = (u16)(TIM4->CNT + busyticks);
+}
+
+//Advance the queue: finish the bus phase in progress, start the next write
+//on any board which is ready, and set up the next interrupt
+static void Genesis_WQ_Service(){
+    genesis_wq_t* w;
+    genesis_wq_entry_t e;
+    u16 now;
+    s16 wait, minwait;
+    u8 i, b;
+    if(wq_phase == 1){
+        //OPN2 address strobe has been held long enough, now strobe the data
+        w = &wq[wq_board];
+        e = w->q[w->start];
+        Genesis_OPN2BusData(e.data);
+        wq_phase = 2;
+        Genesis_WQ_Arm(GENESIS_WQ_OPN2_HOLDTICKS);
+        return;
+    }else if(wq_phase == 2){
+        //OPN2 data strobe has been held long enough, write is done
+        w = &wq[wq_board];
+        e = w->q[w->start];
+        Genesis_OPN2BusRelease();
+        Genesis_WQ_Done(w, Genesis_OPN2BusyTicks(e.addr));
+        wq_phase = 0;
+    }
+    //Bus is idle, find the next board to write to, round-robin
+    while(1){
+        now = TIM4->CNT;
+        minwait = 0x7FFF;
+        for(i=1; i<=GENESIS_COUNT; ++i){
+            b = (wq_board + i) % GENESIS_COUNT;
+            w = &wq[b];
+            if(w->busy){
+                wait = (s16)(w->readytime - now);
+                if(wait > 0){
+                    if(wait < minwait) minwait = wait;
+                    continue;
+                }
+                w->busy = 0;
+            }
+            if(w->depth) break;
+        }
+        if(i > GENESIS_COUNT){
+            //Nothing ready; wake up when the next chip stops being busy
+            if(minwait != 0x7FFF){
+                Genesis_WQ_Arm(minwait);
+            }else{
+                TIM4->DIER &= ~TIM_IT_CC1; //Nothing to do
+            }
+            return;
+        }
+        wq_board = b;
+        e = w->q[w->start];
+        if(e.type == 0){
+            //PSG writes only take a few hundred ns on the bus, just do it
+            Genesis_PSGBusWriteNoLock(b, e.data);
+            Genesis_WQ_Done(w, GENESIS_WQ_PSG_BUSYTICKS);
+            continue;
+        }
+        //Start OPN2 write: address strobe
+        Genesis_OPN2BusAddress(b, (e.type & 0x01), e.addr);
+        wq_phase = 1;
+        Genesis_WQ_Arm(GENESIS_WQ_OPN2_HOLDTICKS);
+        return;
+    }
+}
+
+void TIM4_IRQHandler(void){
+    if(TIM4->SR & TIM_IT_CC1){
+        TIM4->SR = (u16)~TIM_IT_CC1;
+        Genesis_WQ_Service();
+    }
+}
+
+//Take the bus (see GENESIS_BUS_TAKE). If board is a valid board number, also
+//performs the writes queued for it and waits out its busy time, so that the
+//chip can be accessed directly. The queue is advanced from here instead of
+//waiting for the interrupt, so this works at any interrupt priority.
+static void Genesis_WQ_TakeBus(u8 board){
+    genesis_wq_t* w = (board < GENESIS_COUNT) ? &wq[board] : NULL;
+    MIOS32_IRQ_Disable();
+    while(wq_phase || (w != NULL && (w->depth || w->busy))){
+        if(!(TIM4->DIER & TIM_IT_CC1)) break; //Nothing scheduled (shouldn't happen)
+        if((s16)(TIM4->CCR1 - (u16)TIM4->CNT) <= 0){
+            Genesis_WQ_Service();
+        }else{
+            //Let other interrupts in while waiting
+            MIOS32_IRQ_Enable();
+            MIOS32_IRQ_Disable();
+        }
+    }
+}
+
+static s32 Genesis_WQ_Push(u8 board, u8 type, u8 addr, u8 data){
+    genesis_wq_t* w = &wq[board];
+    genesis_wq_entry_t e;
+    e.type = type;
+    e.addr = addr;
+    e.data = data;
+    e.dummy = 0;
+    MIOS32_IRQ_Disable();
+    if(w->depth == GENESIS_WRITEQUEUE_LENGTH){
+        //Don't wait for the interrupt to make room: it can't preempt callers
+        //of its own priority (e.g. the VGM player)
+        MIOS32_IRQ_Enable();
+        return -1;
+    }
+    w->q[(w->start + w->depth) & (GENESIS_WRITEQUEUE_LENGTH-1)] = e;
+    ++w->depth;
+    if(!(TIM4->DIER & TIM_IT_CC1)){
+        //Queue interrupt is idle, wake it up
+        Genesis_WQ_Arm(0);
+    }
+    MIOS32_IRQ_Enable();
+    return 0;
+}
+
+static void Genesis_WQ_Init(){
+    u8 i;
+    for(i=0; i<GENESIS_COUNT; ++i){
+        wq[i].start = 0;
+        wq[i].depth = 0;
+        wq[i].busy = 0;
+    }
+    wq_phase = 0;
+    wq_board = 0;
+    //TIM4 free-running at 84 MHz; compare channel 1 schedules the queue
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+    TIM_TimeBaseStructure.TIM_Prescaler = 0;
+    TIM_TimeBaseStructure.TIM_ClockDivision = 0;
+    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM4, &TIM_TimeBaseStructure);
+    TIM_ITConfig(TIM4, TIM_IT_CC1, DISABLE);
+    MIOS32_IRQ_Install(TIM4_IRQn, MIOS32_IRQ_PRIO_INSANE);
+    TIM_Cmd(TIM4, ENABLE);
+}
+
+u8 Genesis_WriteQueue_Free(u8 board){
+    board &= 0x03;
+    return GENESIS_WRITEQUEUE_LENGTH - wq[board].depth;
+}
+
+void Genesis_WriteQueue_Flush(u8 board){
+    board &= 0x03;
+    Genesis_WQ_TakeBus(board);
+    GENESIS_BUS_GIVE;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Functions
+/////////////////////////////////////////////////////////////////////////////
+
+s32 Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data){
+    board &= 0x03;
+    addrhi &= 0x01;
+#ifdef GENESIS_USE_WRITEQUEUE
+    if(Genesis_WQ_Push(board, 0x02 | addrhi, address, data) < 0) return -1;
+    Genesis_OPN2Shadow(board, addrhi, address, data);
+#else
+    Genesis_OPN2Shadow(board, addrhi, address, data);
+    Genesis_OPN2BusWrite(board, addrhi, address, data);
+#endif
+    return 0;
+}
+
+s32 Genesis_PSGWrite(u8 board, u8 data){
+    board &= 0x03;
+#ifdef GENESIS_USE_WRITEQUEUE
+    if(Genesis_WQ_Push(board, 0x00, 0, data) < 0) return -1;
+    Genesis_PSGShadow(board, data);
+#else
+    Genesis_PSGShadow(board, data);
+    MIOS32_IRQ_Disable(); //Turn off interrupts
+    Genesis_PSGBusWriteNoLock(board, data);
     MIOS32_IRQ_Enable(); //Turn on interrupts
+#endif
+    return 0;
 }
 
 u8 Genesis_GetOPN2Status(u8 board){
     board &= 0x03;
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+    GENESIS_BUS_TAKE; //Turn off interrupts
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -263,24 +559,33 @@ u8 Genesis_GetOPN2Status(u8 board){
     GENESIS_OPN2_WRITEWAIT; //Wait for 1 OPN2 internal cycle
     u8 res = ((GPIOE->IDR >> 8) & 0xFF); //Read OPN2 data
     GPIOC->ODR |= 0x00006000; //Write /CS and /RD high
-    MIOS32_IRQ_Enable(); //Turn on interrupts
+    GENESIS_BUS_GIVE; //Turn on interrupts
     return res;
 }
 
 u8 Genesis_CheckOPN2Busy(u8 board){
     board &= 0x03;
+#ifdef GENESIS_USE_WRITEQUEUE
+    //The status only means something after the queued writes
+    Genesis_WQ_TakeBus(board);
+#else
+    GENESIS_BUS_TAKE;
+#endif
     if(genesis[board].opn2.test_readdat){
         //Switch back to read status mode
         genesis[board].opn2.test_readdat = 0;
-        Genesis_OPN2Write(board, 0, 0x21, genesis[board].opn2.testreg21);
+        Genesis_OPN2Shadow(board, 0, 0x21, genesis[board].opn2.testreg21);
+        Genesis_OPN2BusWrite(board, 0, 0x21, genesis[board].opn2.testreg21); //Not through the queue
         //Don't wait for busy
     }
-    return ((Genesis_GetOPN2Status(board) & 0x80) > 0);
+    u8 res = ((Genesis_GetOPN2Status(board) & 0x80) > 0);
+    GENESIS_BUS_GIVE;
+    return res;
 }
 
 u8 Genesis_CheckPSGBusy(u8 board){
     board &= 0x03;
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+    GENESIS_BUS_TAKE; //Turn off interrupts
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -294,13 +599,13 @@ u8 Genesis_CheckPSGBusy(u8 board){
     GENESIS_PSG_WRITEWAIT; //Wait for the glue logic to catch up
     genesis[board].board.readbits = ((GPIOE->IDR >> 8) & 0xFF); //Read board bits data
     GPIOC->ODR |= 0x00006000; //Write /CS and /RD high
-    MIOS32_IRQ_Enable(); //Turn on interrupts
+    GENESIS_BUS_GIVE; //Turn on interrupts
     return !(genesis[board].board.psg_ready);
 }
 
 void Genesis_WriteBoardBits(u8 board){
     board &= 0x03;
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+    GENESIS_BUS_TAKE; //Turn off interrupts
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -321,11 +626,17 @@ void Genesis_WriteBoardBits(u8 board){
     GENESIS_SHORTWAIT;
     GPIOC->ODR |= 0x00002000; //Now write /CS high to turn off bus drivers
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs
-    MIOS32_IRQ_Enable(); //Turn on interrupts
+    GENESIS_BUS_GIVE; //Turn on interrupts
 }
 
 void Genesis_Reset(u8 board){
     board &= 0x03;
+#ifdef GENESIS_USE_WRITEQUEUE
+    //Drop anything still queued for the old chip state
+    GENESIS_BUS_TAKE;
+    wq[board].depth = 0;
+    GENESIS_BUS_GIVE;
+#endif
     //Clear internal state
     u8 i;
     for(i=0; i<sizeof(genesis_t); i++){
@@ -362,12 +673,23 @@ void Genesis_Reset(u8 board){
 
 void Genesis_CaptureOPN2OpStates(u8 board){
     board &= 3;
+#ifdef GENESIS_USE_WRITEQUEUE
+    //Perform the queued writes first, and keep the bus for the whole capture,
+    //so that no write queued meanwhile reaches the chip while the test
+    //registers are changed
+    Genesis_WQ_TakeBus(board);
+#else
+    GENESIS_BUS_TAKE;
+#endif
     u8 last_21 = genesis[board].opn2.testreg21;
     u8 last_2C = genesis[board].opn2.testreg2C;
-    Genesis_OPN2Write(board, 0, 0x21, (last_21 & 0b00111110) | 0b01000000);
-    Genesis_OPN2Write(board, 0, 0x2C, (last_2C & 0b00101111) | 0b10000000);
+    //These have to happen right now, not through the queue
+    Genesis_OPN2Shadow(board, 0, 0x21, (last_21 & 0b00111110) | 0b01000000);
+    Genesis_OPN2BusWrite(board, 0, 0x21, (last_21 & 0b00111110) | 0b01000000);
+    Genesis_OPN2Shadow(board, 0, 0x2C, (last_2C & 0b00101111) | 0b10000000);
+    Genesis_OPN2BusWrite(board, 0, 0x2C, (last_2C & 0b00101111) | 0b10000000);
     //Set up read
-    MIOS32_IRQ_Disable(); //Turn off interrupts
+    GENESIS_BUS_TAKE; //Turn off interrupts
     GPIOE->MODER &= 0x0000FFFF; //Set data pins to inputs (in case not already)
     u32 porte = GPIOE->ODR;
     porte &= 0xFFFF000B; //Mask out the things we will set
@@ -412,8 +734,11 @@ void Genesis_CaptureOPN2OpStates(u8 board){
     }
     done:
     GPIOC->ODR |= 0x00006000; //Write /CS and /RD high
-    MIOS32_IRQ_Enable(); //Turn on interrupts
-    Genesis_OPN2Write(board, 0, 0x21, last_21);
-    Genesis_OPN2Write(board, 0, 0x2C, last_2C);
+    GENESIS_BUS_GIVE; //Turn on interrupts
+    Genesis_OPN2Shadow(board, 0, 0x21, last_21);
+    Genesis_OPN2BusWrite(board, 0, 0x21, last_21);
+    Genesis_OPN2Shadow(board, 0, 0x2C, last_2C);
+    Genesis_OPN2BusWrite(board, 0, 0x2C, last_2C);
+    GENESIS_BUS_GIVE;
 }
 
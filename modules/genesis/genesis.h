@@ -54,6 +54,40 @@ OPN2 Timeout Test Results
 #define GENESIS_RESETTIMEOUTUS 1000
 #endif
 
+/*
+Write queue: if GENESIS_USE_WRITEQUEUE is defined (e.g. in mios32_config.h),
+Genesis_OPN2Write() and Genesis_PSGWrite() update the chip state structures
+immediately, but only queue the bus write. The queues are drained by the TIM4
+compare interrupt, which performs each bus write in phases instead of waiting
+for the strobe timing, and keeps each chip idle for its busy time after each
+write (see Genesis_OPN2BusyTicks()). Writes to different boards interleave on
+the bus. If a board's queue is full, the write is dropped and the write
+functions return -1 without waiting, since the queue interrupt can't make room
+while the caller runs at its priority; check Genesis_WriteQueue_Free() first.
+The synchronous bus functions below (status reads, board bits, capture) finish
+the write in progress on the bus themselves; Genesis_CheckOPN2Busy() and
+Genesis_WriteQueue_Flush() also perform the writes queued for the board, so
+they can be called at any interrupt priority (but not with interrupts
+disabled).
+*/
+#ifndef GENESIS_WRITEQUEUE_LENGTH
+#define GENESIS_WRITEQUEUE_LENGTH 64 //Per board, must be a power of two
+#endif
+
+//Timing of the write queue, in TIM4 ticks (84 MHz)
+#ifndef GENESIS_WQ_OPN2_HOLDTICKS
+#define GENESIS_WQ_OPN2_HOLDTICKS (GENESIS_OPN2_WRITETIMEOUT / 2) //1 OPN2 internal cycle
+#endif
+#ifndef GENESIS_WQ_OPN2_BUSYTICKS
+#define GENESIS_WQ_OPN2_BUSYTICKS 2100 //After a normal register write
+#endif
+#ifndef GENESIS_WQ_OPN2_FASTTICKS
+#define GENESIS_WQ_OPN2_FASTTICKS 0 //After a 0x2x register write, except key on
+#endif
+#ifndef GENESIS_WQ_PSG_BUSYTICKS
+#define GENESIS_WQ_PSG_BUSYTICKS 672
+#endif
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Global Types
@@ -432,11 +466,13 @@ extern u32 genesis_clock_psg;
 // resets all boards.
 extern void Genesis_Init(void);
 
-// Write a value to an OPN2.
-extern void Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data);
+// Write a value to an OPN2. Returns -1 if the write queue of the board is full
+// (the write is dropped), otherwise 0.
+extern s32 Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data);
 
-// Write a value to a PSG.
-extern void Genesis_PSGWrite(u8 board, u8 data);
+// Write a value to a PSG. Returns -1 if the write queue of the board is full
+// (the write is dropped), otherwise 0.
+extern s32 Genesis_PSGWrite(u8 board, u8 data);
 
 // Read data back from the OPN2 (usually the status, unless you've been playing
 // with the test registers).
@@ -458,8 +494,26 @@ extern void Genesis_Reset(u8 board);
 extern void Genesis_WriteBoardBits(u8 board);
 
 // Experimental features, TIM2 must be running at 84 MHz or this will hang
+// With the write queue, the writes queued for the board are performed first.
 extern void Genesis_CaptureOPN2OpStates(u8 board);
 
+// Busy time model for the write queue: TIM4 ticks the OPN2 needs after a write
+// to the given register before it can accept the next write.
+static inline u16 Genesis_OPN2BusyTicks(u8 address){
+    return (address >= 0x20 && address <= 0x2F && address != 0x28)
+            ? GENESIS_WQ_OPN2_FASTTICKS : GENESIS_WQ_OPN2_BUSYTICKS;
+}
+
+#ifdef GENESIS_USE_WRITEQUEUE
+// Number of writes which can be queued for a board without blocking.
+extern u8 Genesis_WriteQueue_Free(u8 board);
+
+// Wait until all queued writes to a board have been performed and the chips
+// are idle. The writes are performed by the caller if the queue interrupt
+// can't run. Don't call with interrupts disabled.
+extern void Genesis_WriteQueue_Flush(u8 board);
+#endif
+
 
 #ifdef __cplusplus
 }
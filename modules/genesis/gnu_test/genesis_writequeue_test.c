@@ -0,0 +1,464 @@
+// Host test of the write queue of the Genesis driver
+//
+// The bus functions of genesis.c are replaced by a mock which logs every
+// OPN2/PSG write per board, and TIM4 is simulated tick by tick. The mock
+// checks that the writes of each board arrive in the order in which they
+// have been queued, that the address and data strobes are held for
+// GENESIS_WQ_OPN2_HOLDTICKS, that no write starts before the chip's busy
+// time of the previous write has passed, and that only one write is on the
+// bus at a time.
+//
+// With the queue interrupt blocked (caller at the priority of the queue),
+// a full queue has to be reported instead of waiting, and
+// Genesis_WriteQueue_Flush(), Genesis_CheckOPN2Busy() and
+// Genesis_CaptureOPN2OpStates() have to perform the queued writes before
+// they access the chip directly (also with the interrupt running).
+
+// static variables of the queue are checked directly
+#include "../genesis.c"
+
+#define NUM_RANDOM_WRITES 20000
+#define MAX_LOG 100000
+
+GPIO_TypeDef gpioc, gpioe;
+TIM_TypeDef tim2, tim4;
+
+static u32 errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++errors; } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Time and interrupts
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 now;
+static u32 irq_nested;
+static u8 irq_blocked; // the caller runs at the priority of the queue interrupt
+static u8 in_isr;
+static u32 num_isr;
+
+static void run_isr(void)
+{
+  if( irq_nested || irq_blocked || in_isr || !(tim4.SR & TIM_IT_CC1) )
+    return;
+  in_isr = 1;
+  ++irq_nested;
+  ++num_isr;
+  TIM4_IRQHandler();
+  --irq_nested;
+  in_isr = 0;
+}
+
+static void tick(void)
+{
+  ++now;
+  tim4.CNT = now & 0xffff;
+  if( (tim4.DIER & TIM_IT_CC1) && tim4.CNT == tim4.CCR1 )
+    tim4.SR |= TIM_IT_CC1;
+  run_isr();
+}
+
+static void run(u32 ticks)
+{
+  while( ticks-- )
+    tick();
+}
+
+s32 MIOS32_IRQ_Disable(void)
+{
+  ++irq_nested;
+  return 0;
+}
+
+s32 MIOS32_IRQ_Enable(void)
+{
+  if( !irq_nested ) {
+    CHECK(0, "interrupts enabled without having been disabled");
+    return -1;
+  }
+  if( --irq_nested == 0 && !in_isr )
+    tick(); // code between the accesses takes time, and interrupts can fire
+  return 0;
+}
+
+s32 MIOS32_DELAY_Wait_uS(u16 uS)
+{
+  run(uS * 84);
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Mock bus
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  u32 time;
+  u8 board;
+  u8 type; // 0x00 PSG, 0x02/0x03 OPN2 port 0/1
+  u8 addr;
+  u8 data;
+  u8 direct; // not through the queue
+} bus_write_t;
+
+static bus_write_t log_writes[MAX_LOG];
+static u32 num_log;
+
+static genesis_wq_entry_t expected[GENESIS_COUNT][MAX_LOG];
+static u32 num_expected[GENESIS_COUNT];
+static u32 num_written[GENESIS_COUNT];
+static u8 checking;
+
+static u32 readytime[GENESIS_COUNT];
+static u8 opn2_phase; // 1: address strobe, 2: data strobe
+static u8 opn2_board, opn2_addrhi, opn2_addr, opn2_data;
+static u32 opn2_time;
+
+static void log_write(u8 board, u8 type, u8 addr, u8 data, u8 direct, u16 busyticks)
+{
+  CHECK(board < GENESIS_COUNT, "write to board %d", board);
+  CHECK(irq_nested > 0, "bus access with interrupts enabled");
+  CHECK((s32)(now - readytime[board]) >= 0, "board %d: write %02x:%02x while busy for %u more ticks",
+        board, addr, data, (unsigned)(readytime[board] - now));
+  readytime[board] = now + busyticks;
+
+  if( num_log < MAX_LOG ) {
+    bus_write_t *w = &log_writes[num_log++];
+    w->time = now;
+    w->board = board;
+    w->type = type;
+    w->addr = addr;
+    w->data = data;
+    w->direct = direct;
+  }
+
+  if( !checking || direct )
+    return;
+
+  if( num_written[board] >= num_expected[board] ) {
+    CHECK(0, "board %d: unexpected write %02x:%02x:%02x", board, type, addr, data);
+    return;
+  }
+  genesis_wq_entry_t e = expected[board][num_written[board]++];
+  if( type == 0 )
+    CHECK(e.type == 0 && e.data == data, "board %d: PSG write %02x, expected %02x:%02x:%02x", board, data, e.type, e.addr, e.data);
+  else
+    CHECK(e.type == type && e.addr == addr && e.data == data, "board %d: OPN2 write %02x:%02x:%02x, expected %02x:%02x:%02x",
+          board, type, addr, data, e.type, e.addr, e.data);
+}
+
+void Genesis_OPN2BusAddress(u8 board, u8 addrhi, u8 address)
+{
+  CHECK(opn2_phase == 0, "address strobe while another OPN2 write is on the bus");
+  CHECK((s32)(now - readytime[board]) >= 0, "board %d: address strobe while busy", board);
+  opn2_phase = 1;
+  opn2_board = board;
+  opn2_addrhi = addrhi;
+  opn2_addr = address;
+  opn2_time = now;
+}
+
+void Genesis_OPN2BusData(u8 data)
+{
+  CHECK(opn2_phase == 1, "data strobe without address strobe");
+  CHECK(now - opn2_time >= GENESIS_WQ_OPN2_HOLDTICKS, "address strobe held for %u ticks only", (unsigned)(now - opn2_time));
+  opn2_phase = 2;
+  opn2_data = data;
+  opn2_time = now;
+}
+
+void Genesis_OPN2BusRelease()
+{
+  CHECK(opn2_phase == 2, "release without data strobe");
+  CHECK(now - opn2_time >= GENESIS_WQ_OPN2_HOLDTICKS, "data strobe held for %u ticks only", (unsigned)(now - opn2_time));
+  opn2_phase = 0;
+  log_write(opn2_board, 0x02 | opn2_addrhi, opn2_addr, opn2_data, 0, Genesis_OPN2BusyTicks(opn2_addr));
+}
+
+void Genesis_PSGBusWriteNoLock(u8 board, u8 data)
+{
+  CHECK(opn2_phase == 0, "PSG write while an OPN2 write is on the bus");
+  log_write(board, 0x00, 0, data, 0, GENESIS_WQ_PSG_BUSYTICKS);
+}
+
+void Genesis_OPN2BusWrite(u8 board, u8 addrhi, u8 address, u8 data)
+{
+  MIOS32_IRQ_Disable();
+  CHECK(opn2_phase == 0 && !wq_phase, "direct OPN2 write while a queued write is on the bus");
+  CHECK(wq[board].depth == 0, "board %d: direct OPN2 write with %d writes queued", board, wq[board].depth);
+  log_write(board, 0x02 | addrhi, address, data, 1, Genesis_OPN2BusyTicks(address));
+  MIOS32_IRQ_Enable();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Test helpers
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 rnd_state = 1;
+static u32 rnd(u32 n)
+{
+  rnd_state = rnd_state * 1103515245u + 12345u;
+  return (rnd_state >> 8) % n;
+}
+
+static s32 push_opn2(u8 board, u8 addrhi, u8 addr, u8 data)
+{
+  s32 status = Genesis_OPN2Write(board, addrhi, addr, data);
+  if( status >= 0 ) {
+    genesis_wq_entry_t *e = &expected[board][num_expected[board]++];
+    e->type = 0x02 | addrhi;
+    e->addr = addr;
+    e->data = data;
+  }
+  return status;
+}
+
+static s32 push_psg(u8 board, u8 data)
+{
+  s32 status = Genesis_PSGWrite(board, data);
+  if( status >= 0 ) {
+    genesis_wq_entry_t *e = &expected[board][num_expected[board]++];
+    e->type = 0x00;
+    e->addr = 0;
+    e->data = data;
+  }
+  return status;
+}
+
+static u8 random_opn2_addr(void)
+{
+  switch( rnd(4) ) {
+  case 0: return 0x22 + rnd(6); // fast global registers
+  case 1: return 0x28; // key on
+  case 2: return 0xa0 + rnd(0x17);
+  }
+  return 0x30 + rnd(0x70);
+}
+
+static u8 queue_idle(void)
+{
+  u8 board;
+  if( wq_phase )
+    return 0;
+  for(board=0; board<GENESIS_COUNT; ++board)
+    if( wq[board].depth || wq[board].busy )
+      return 0;
+  return 1;
+}
+
+static void run_until_idle(void)
+{
+  u32 limit = 10000000;
+  while( !queue_idle() ) {
+    if( !limit-- ) {
+      CHECK(0, "queue doesn't become idle");
+      return;
+    }
+    tick();
+  }
+}
+
+static void check_all_written(const char *test)
+{
+  u8 board;
+  for(board=0; board<GENESIS_COUNT; ++board)
+    CHECK(num_written[board] == num_expected[board], "%s: board %d: %u of %u writes performed",
+          test, board, (unsigned)num_written[board], (unsigned)num_expected[board]);
+}
+
+static void reset_log(void)
+{
+  num_log = 0;
+  memset(num_expected, 0, sizeof(num_expected));
+  memset(num_written, 0, sizeof(num_written));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Random writes to all boards: order and busy timing
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_random(void)
+{
+  u32 i;
+  reset_log();
+  for(i=0; i<NUM_RANDOM_WRITES; ) {
+    u8 board = rnd(GENESIS_COUNT);
+    if( !Genesis_WriteQueue_Free(board) ) {
+      run(rnd(500));
+      continue;
+    }
+    if( rnd(4) == 0 )
+      CHECK(push_psg(board, rnd(256)) == 0, "random: PSG write refused with free queue");
+    else
+      CHECK(push_opn2(board, rnd(2), random_opn2_addr(), rnd(256)) == 0, "random: OPN2 write refused with free queue");
+    ++i;
+    if( rnd(8) == 0 )
+      run(rnd(3000));
+  }
+  run_until_idle();
+  check_all_written("random");
+  printf("random writes: %u writes to %d boards: %s\n", NUM_RANDOM_WRITES, GENESIS_COUNT, errors ? "FAILED" : "OK");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Throughput: the queue mustn't add much to the busy times, and writes to
+// different boards have to overlap with each other's busy times
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 measure(u8 num_boards, u32 writes_per_board)
+{
+  u32 pushed[GENESIS_COUNT] = { 0 };
+  u32 start = now;
+  u8 board, done;
+  reset_log();
+  do {
+    done = 1;
+    for(board=0; board<num_boards; ++board) {
+      if( pushed[board] >= writes_per_board )
+        continue;
+      done = 0;
+      if( Genesis_WriteQueue_Free(board) ) {
+        push_opn2(board, 0, 0x30 + (pushed[board] & 0x3f), pushed[board]);
+        ++pushed[board];
+      }
+    }
+    if( !done )
+      tick();
+  } while( !done );
+  run_until_idle();
+  check_all_written("throughput");
+  return now - start;
+}
+
+static void test_throughput(void)
+{
+  const u32 writes = 500;
+  const u32 ideal = 2*GENESIS_WQ_OPN2_HOLDTICKS + GENESIS_WQ_OPN2_BUSYTICKS;
+
+  u32 t1 = measure(1, writes);
+  u32 t4 = measure(GENESIS_COUNT, writes);
+  printf("throughput: 1 board %.1f, %d boards %.1f ticks per write and board (busy time %u)\n",
+         (double)t1 / writes, GENESIS_COUNT, (double)t4 / writes, (unsigned)ideal);
+
+  CHECK(t1 <= writes * (ideal + 50), "throughput: %u ticks for %u writes to one board", (unsigned)t1, (unsigned)writes);
+  CHECK(t4 <= writes * (ideal + 50 + 2*GENESIS_WQ_OPN2_HOLDTICKS * GENESIS_COUNT),
+        "throughput: %u ticks for %u writes to %d boards", (unsigned)t4, (unsigned)writes, GENESIS_COUNT);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Full queue at the priority of the queue interrupt: no waiting, no change
+// of the chip state, the flush performs the writes itself
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_full(void)
+{
+  u32 i;
+  genesis_t before;
+  reset_log();
+  irq_blocked = 1;
+  u32 isr_before = num_isr;
+
+  for(i=0; i<GENESIS_WRITEQUEUE_LENGTH; ++i)
+    CHECK(push_opn2(0, 0, 0x30 + (i & 0x3f), i) == 0, "full: write %u refused", (unsigned)i);
+  CHECK(Genesis_WriteQueue_Free(0) == 0, "full: %d entries free", Genesis_WriteQueue_Free(0));
+
+  memcpy(&before, &genesis[0], sizeof(genesis_t));
+  CHECK(push_opn2(0, 0, 0x40, 0x55) < 0, "full: OPN2 write accepted");
+  CHECK(push_psg(0, 0x9a) < 0, "full: PSG write accepted");
+  CHECK(memcmp(&before, &genesis[0], sizeof(genesis_t)) == 0, "full: chip state changed by a refused write");
+
+  // other boards are not affected
+  CHECK(push_psg(1, 0x9a) == 0, "full: write to another board refused");
+
+  Genesis_WriteQueue_Flush(0);
+  CHECK(wq[0].depth == 0 && !wq[0].busy, "full: flush returned with %d writes queued", wq[0].depth);
+  CHECK(num_written[0] == GENESIS_WRITEQUEUE_LENGTH, "full: %u writes performed by the flush", (unsigned)num_written[0]);
+  CHECK(num_isr == isr_before, "full: interrupt ran while blocked");
+
+  irq_blocked = 0;
+  run_until_idle();
+  check_all_written("full");
+  printf("full queue: %s\n", errors ? "FAILED" : "OK");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Direct chip accesses perform the queued writes first
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_direct(u8 blocked)
+{
+  u32 i, num_direct, first_direct;
+  reset_log();
+  irq_blocked = blocked;
+
+  // status check with test register read mode active
+  for(i=0; i<10; ++i) {
+    push_opn2(1, 1, 0x30 + i, i);
+    push_psg(2, 0x80 | i);
+  }
+  genesis[1].opn2.test_readdat = 1;
+  Genesis_CheckOPN2Busy(1);
+  CHECK(wq[1].depth == 0, "check busy: %d writes still queued", wq[1].depth);
+  CHECK(num_written[1] == num_expected[1], "check busy: %u of %u writes performed before", (unsigned)num_written[1], (unsigned)num_expected[1]);
+  CHECK(num_log > 0 && log_writes[num_log-1].direct && log_writes[num_log-1].board == 1 && log_writes[num_log-1].addr == 0x21,
+        "check busy: test register not switched back after the queued writes");
+
+  // the queued writes, the write on the bus and the busy time are waited
+  // out, and the bus is kept for the whole capture
+  push_opn2(3, 0, 0x40, 0x7f);
+  push_opn2(3, 0, 0x48, 0x7f);
+  irq_blocked = 0;
+  while( wq_phase != 1 || wq_board != 3 )
+    tick();
+  irq_blocked = blocked;
+  push_opn2(0, 0, 0x50, 0x11); // another board, keeps the queue running
+  Genesis_CaptureOPN2OpStates(3);
+  first_direct = num_log;
+  num_direct = 0;
+  for(i=0; i<num_log; ++i) {
+    if( log_writes[i].direct && log_writes[i].board == 3 ) {
+      if( !num_direct++ )
+        first_direct = i;
+      CHECK(log_writes[i].time == log_writes[first_direct].time, "capture: bus released during the capture");
+    }
+  }
+  CHECK(num_direct == 4, "capture: %u direct writes", (unsigned)num_direct);
+  CHECK(num_written[3] == num_expected[3], "capture: queued write not performed before");
+  for(i=first_direct; i<num_log; ++i)
+    CHECK(log_writes[i].board != 3 || log_writes[i].direct, "capture: queued write after the capture");
+
+  irq_blocked = 0;
+  run_until_idle();
+  check_all_written("direct");
+  printf("direct access%s: %s\n", blocked ? " (interrupt blocked)" : "", errors ? "FAILED" : "OK");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+  checking = 0;
+  Genesis_Init();
+  run_until_idle();
+  checking = 1;
+
+  test_random();
+  test_throughput();
+  test_full();
+  test_direct(0);
+  test_direct(1);
+
+  if( errors ) {
+    printf("FAILED with %u errors\n", (unsigned)errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
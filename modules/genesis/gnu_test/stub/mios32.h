@@ -0,0 +1,68 @@
+// Minimal host replacement of <mios32.h> for the Genesis driver tests:
+// the GPIO and timer registers are plain memory, TIM4 is advanced by the test
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+typedef struct {
+  volatile u32 MODER;
+  volatile u32 OTYPER;
+  volatile u32 OSPEEDR;
+  volatile u32 PUPDR;
+  volatile u32 IDR;
+  volatile u32 ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+  volatile u32 CNT;
+  volatile u32 CCR1;
+  volatile u32 SR;
+  volatile u32 DIER;
+} TIM_TypeDef;
+
+typedef struct {
+  u32 TIM_Period;
+  u32 TIM_Prescaler;
+  u32 TIM_ClockDivision;
+  u32 TIM_CounterMode;
+} TIM_TimeBaseInitTypeDef;
+
+extern GPIO_TypeDef gpioc, gpioe;
+extern TIM_TypeDef tim2, tim4;
+#define GPIOC (&gpioc)
+#define GPIOE (&gpioe)
+#define TIM2 (&tim2)
+#define TIM4 (&tim4)
+
+#define DISABLE 0
+#define ENABLE 1
+#define TIM_IT_CC1 0x0002
+#define TIM_CounterMode_Up 0
+#define RCC_APB1Periph_TIM4 0
+#define TIM4_IRQn 0
+#define MIOS32_IRQ_PRIO_INSANE 3
+
+#define RCC_APB1PeriphClockCmd(p, s)
+#define TIM_TimeBaseInit(t, i) ((void)(i))
+#define TIM_ITConfig(t, i, s) do { if( !(s) ) (t)->DIER &= ~(i); } while(0)
+#define TIM_Cmd(t, s)
+#define MIOS32_IRQ_Install(irq, prio)
+
+// implemented by the test: interrupts and time
+extern s32 MIOS32_IRQ_Disable(void);
+extern s32 MIOS32_IRQ_Enable(void);
+extern s32 MIOS32_DELAY_Wait_uS(u16 uS);
+
+#endif /* _MIOS32_H */
@@ -0,0 +1,508 @@
+// Unit tests of the MIDI monitor capture ring and the SMF exporter
+//
+// Ring: event order, overrun/drop counters, trigger note, stop count,
+// restart and wrap-around of the free running indices. In addition a
+// producer and a consumer thread run concurrently on the ring.
+//
+// SMF export: the exported file is parsed again and compared with the
+// captured events (header, track length, tempo, delta times, port filter,
+// filtered system messages, only the last MIDIMON_CAPTURE_SIZE events
+// after an overrun, callback errors).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <mios32.h>
+
+// static variables are accessed by the wrap-around test
+#include "../midimon_capture.c"
+
+
+#define CHECK(cond) do { if( !(cond) ) { printf("ERROR: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond); ++num_errors; return; } } while(0)
+
+static unsigned num_errors;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Help functions
+/////////////////////////////////////////////////////////////////////////////
+
+static mios32_midi_package_t pkg(u8 type, u8 chn, u8 evnt1, u8 evnt2)
+{
+  mios32_midi_package_t p;
+  p.ALL = 0;
+  p.type = type;
+  p.evnt0 = (type << 4) | chn;
+  p.evnt1 = evnt1;
+  p.evnt2 = evnt2;
+  return p;
+}
+
+static mios32_midi_package_t sysex_pkg(void)
+{
+  mios32_midi_package_t p;
+  p.ALL = 0;
+  p.type = 0x7; // SysEx ends with three bytes
+  p.evnt0 = 0xf0;
+  p.evnt1 = 0x7e;
+  p.evnt2 = 0xf7;
+  return p;
+}
+
+static mios32_midi_package_t clock_pkg(void)
+{
+  mios32_midi_package_t p;
+  p.ALL = 0;
+  p.type = 0xf; // single byte
+  p.evnt0 = 0xf8;
+  return p;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Ring tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_order(void)
+{
+  midimon_capture_event_t e;
+  int i;
+
+  MIDIMON_CAPTURE_Init(0);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 60, 100), 1) == 0); // not running
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+
+  MIDIMON_CAPTURE_Start();
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_RUNNING);
+
+  for(i=0; i<100; ++i) {
+    CHECK(MIDIMON_CAPTURE_Put(UART0 + (i & 1), pkg(CC, i & 15, i, 127-i), 1000 + i) == 1);
+    if( (i % 3) == 2 ) {
+      // consumer catches up from time to time
+      int j;
+      for(j=i-2; j<=i; ++j) {
+	CHECK(MIDIMON_CAPTURE_Get(&e) == 1);
+	CHECK(e.timestamp == 1000 + j && e.port == UART0 + (j & 1));
+	CHECK(e.package.evnt1 == j && e.package.evnt2 == 127-j && e.package.chn == (j & 15));
+      }
+    }
+  }
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 1099);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+  CHECK(MIDIMON_CAPTURE_NumCapturedGet() == 100);
+  CHECK(MIDIMON_CAPTURE_NumDroppedGet() == 0);
+
+  MIDIMON_CAPTURE_Stop();
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 60, 100), 1) == 0);
+  CHECK(MIDIMON_CAPTURE_NumCapturedGet() == 100);
+}
+
+
+static void test_overrun(void)
+{
+  midimon_capture_event_t e;
+  int i;
+
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_Start();
+
+  for(i=0; i<MIDIMON_CAPTURE_SIZE; ++i)
+    CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, i & 0x7f, 1), i) == 1);
+  for(i=0; i<10; ++i)
+    CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 0, 1), 5000) == -1);
+
+  CHECK(MIDIMON_CAPTURE_NumCapturedGet() == MIDIMON_CAPTURE_SIZE);
+  CHECK(MIDIMON_CAPTURE_NumDroppedGet() == 10);
+  CHECK(MIDIMON_CAPTURE_NumDroppedTake() == 10);
+  CHECK(MIDIMON_CAPTURE_NumDroppedTake() == 0);
+
+  // one free entry
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 0);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 1, 1), 6000) == 1);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 1, 1), 6001) == -1);
+  CHECK(MIDIMON_CAPTURE_NumDroppedTake() == 1);
+
+  // the dropped events don't show up
+  for(i=1; i<MIDIMON_CAPTURE_SIZE; ++i)
+    CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == i);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 6000);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+}
+
+
+static void test_trigger_and_stop(void)
+{
+  midimon_capture_event_t e;
+  int i;
+
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_TriggerNoteSet(200); // invalid: no trigger
+  CHECK(MIDIMON_CAPTURE_TriggerNoteGet() == MIDIMON_CAPTURE_TRIGGER_NONE);
+
+  MIDIMON_CAPTURE_TriggerNoteSet(64);
+  MIDIMON_CAPTURE_StopCountSet(5);
+  MIDIMON_CAPTURE_Start();
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_ARMED);
+
+  // no trigger: other notes, Note On with velocity 0, Note Off, CC
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 63, 100), 1) == 0);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 0, 64, 0), 2) == 0);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOff, 0, 64, 64), 3) == 0);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 64, 127), 4) == 0);
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_ARMED);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+
+  // trigger note is the first captured event
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(NoteOn, 3, 64, 1), 10) == 1);
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_RUNNING);
+
+  for(i=1; i<5; ++i)
+    CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, i), 10 + i) == 1);
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_STOPPED);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 5), 15) == 0);
+  CHECK(MIDIMON_CAPTURE_NumCapturedGet() == 5);
+
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 10 && e.package.chn == 3);
+  for(i=1; i<5; ++i)
+    CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 10 + i);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+
+  // dropped events count for the stop condition
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_StopCountSet(MIDIMON_CAPTURE_SIZE + 3);
+  MIDIMON_CAPTURE_Start();
+  for(i=0; i<MIDIMON_CAPTURE_SIZE + 2; ++i)
+    MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 1), i);
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_RUNNING);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 1), i) == -1);
+  CHECK(MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_STOPPED);
+  CHECK(MIDIMON_CAPTURE_NumDroppedGet() == 3);
+}
+
+
+static void test_restart(void)
+{
+  midimon_capture_event_t e;
+
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_Start();
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 1), 1);
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 2), 2);
+  MIDIMON_CAPTURE_Stop();
+
+  // unconsumed events are kept, the counters are cleared
+  MIDIMON_CAPTURE_Start();
+  CHECK(MIDIMON_CAPTURE_NumCapturedGet() == 0);
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 3), 3);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 1);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 2);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == 3);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+}
+
+
+static void test_wrap(void)
+{
+  midimon_capture_event_t e;
+  u32 i;
+
+  // free running indices shortly before the wrap-around
+  MIDIMON_CAPTURE_Init(0);
+  capture_head = capture_tail = (u32)-8;
+  MIDIMON_CAPTURE_Start();
+
+  for(i=0; i<MIDIMON_CAPTURE_SIZE; ++i)
+    CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 1), i) == 1);
+  CHECK(MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, 1), i) == -1);
+
+  for(i=0; i<MIDIMON_CAPTURE_SIZE; ++i)
+    CHECK(MIDIMON_CAPTURE_Get(&e) == 1 && e.timestamp == i);
+  CHECK(MIDIMON_CAPTURE_Get(&e) == 0);
+  CHECK(capture_head == (u32)(MIDIMON_CAPTURE_SIZE - 8));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Producer and consumer threads
+/////////////////////////////////////////////////////////////////////////////
+
+#define THREAD_NUM_EVENTS 200000
+
+static volatile int producer_done;
+
+static void *producer_thread(void *arg)
+{
+  u32 i;
+  for(i=0; i<THREAD_NUM_EVENTS; ++i) {
+    // wait for the consumer, except for some bursts which overrun the ring
+    if( (i & 0xfff) >= 0x100 )
+      while( (capture_head - capture_tail) >= MIDIMON_CAPTURE_SIZE )
+	sched_yield();
+    MIDIMON_CAPTURE_Put(USB0, pkg(CC, i & 15, (i >> 4) & 0x7f, (i >> 11) & 0x7f), i);
+  }
+  producer_done = 1;
+  return NULL;
+}
+
+static void test_threads(void)
+{
+  pthread_t producer;
+  midimon_capture_event_t e;
+  u32 num_received = 0;
+  s32 prev = -1;
+
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_Start();
+  producer_done = 0;
+  pthread_create(&producer, NULL, producer_thread, NULL);
+
+  while( 1 ) {
+    int done = producer_done;
+    while( MIDIMON_CAPTURE_Get(&e) > 0 ) {
+      u32 i = e.timestamp;
+      // increasing order, the payload belongs to the timestamp
+      CHECK((s32)i > prev);
+      CHECK(e.package.chn == (i & 15) && e.package.evnt1 == ((i >> 4) & 0x7f) && e.package.evnt2 == ((i >> 11) & 0x7f));
+      prev = i;
+      ++num_received;
+    }
+    if( done )
+      break;
+    sched_yield();
+  }
+  pthread_join(producer, NULL);
+
+  CHECK(num_received == MIDIMON_CAPTURE_NumCapturedGet());
+  CHECK(num_received + MIDIMON_CAPTURE_NumDroppedGet() == THREAD_NUM_EVENTS);
+  CHECK(num_received > THREAD_NUM_EVENTS/2 && MIDIMON_CAPTURE_NumDroppedGet() > 0);
+
+  printf("Threads: %u events received, %u dropped\n",
+	 (unsigned)num_received, (unsigned)MIDIMON_CAPTURE_NumDroppedGet());
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// SMF export
+/////////////////////////////////////////////////////////////////////////////
+
+static u8 smf[65536];
+static u32 smf_len;
+static s32 smf_error_after; // callback fails after the given number of calls, -1: never
+
+static s32 smf_write(u8 *buffer, u32 len)
+{
+  if( smf_error_after == 0 )
+    return -1;
+  if( smf_error_after > 0 )
+    --smf_error_after;
+
+  if( smf_len + len > sizeof(smf) )
+    return -1;
+  memcpy(&smf[smf_len], buffer, len);
+  smf_len += len;
+  return 0;
+}
+
+static s32 smf_export(mios32_midi_port_t port_filter)
+{
+  smf_len = 0;
+  smf_error_after = -1;
+  return MIDIMON_CAPTURE_ExportSmf(port_filter, smf_write);
+}
+
+typedef struct {
+  u32 tick;
+  u8 len;
+  u8 event[3];
+} smf_event_t;
+
+static u32 be32(u8 *p) { return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3]; }
+
+// parses the exported file, returns the number of events or < 0 on errors
+static int smf_parse(smf_event_t *events, int max_events)
+{
+  if( smf_len < 22 || memcmp(smf, "MThd", 4) != 0 || be32(&smf[4]) != 6 )
+    return -1;
+  if( smf[8] != 0 || smf[9] != 0 || smf[10] != 0 || smf[11] != 1 )
+    return -2; // format 0, one track
+  if( ((smf[12] << 8) | smf[13]) != MIDIMON_CAPTURE_SMF_PPQN )
+    return -3;
+  if( memcmp(&smf[14], "MTrk", 4) != 0 || be32(&smf[18]) != (smf_len - 22) )
+    return -4;
+
+  u32 pos = 22;
+  u32 tick = 0;
+  int num_events = 0;
+  int tempo_found = 0;
+  while( pos < smf_len ) {
+    u32 delta = 0;
+    u8 b;
+    int n = 0;
+    do {
+      if( pos >= smf_len || ++n > 4 )
+	return -5;
+      b = smf[pos++];
+      delta = (delta << 7) | (b & 0x7f);
+    } while( b & 0x80 );
+    tick += delta;
+
+    if( pos >= smf_len )
+      return -6;
+    u8 status = smf[pos];
+
+    if( status == 0xff ) {
+      if( pos + 3 > smf_len )
+	return -7;
+      u8 type = smf[pos+1];
+      u8 len = smf[pos+2];
+      if( type == 0x51 ) {
+	if( len != 3 || ((smf[pos+3] << 16) | (smf[pos+4] << 8) | smf[pos+5]) != MIDIMON_CAPTURE_SMF_TEMPO )
+	  return -8;
+	tempo_found = 1;
+      } else if( type == 0x2f ) {
+	if( len != 0 || (pos + 3) != smf_len || !tempo_found )
+	  return -9; // end of track must be the last event
+	return num_events;
+      }
+      pos += 3 + len;
+    } else {
+      if( !(status & 0x80) || status >= 0xf0 )
+	return -10; // no running status, no system messages
+      u8 len = ((status & 0xf0) == 0xc0 || (status & 0xf0) == 0xd0) ? 2 : 3;
+      if( pos + len > smf_len || num_events >= max_events )
+	return -11;
+      events[num_events].tick = tick;
+      events[num_events].len = len;
+      memcpy(events[num_events].event, &smf[pos], len);
+      ++num_events;
+      pos += len;
+    }
+  }
+
+  return -12; // no end of track
+}
+
+
+static void test_smf(void)
+{
+  static smf_event_t events[MIDIMON_CAPTURE_SIZE];
+  int num;
+
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_Start();
+  CHECK(smf_export(0) == -1); // still running
+
+  MIDIMON_CAPTURE_Put(USB0,  pkg(NoteOn, 0, 60, 100), 1000);
+  MIDIMON_CAPTURE_Put(USB0,  clock_pkg(), 1010);                       // not exported
+  MIDIMON_CAPTURE_Put(UART0, pkg(CC, 1, 7, 0x7f), 1100);               // delta 100: one byte
+  MIDIMON_CAPTURE_Put(USB0,  sysex_pkg(), 1200);                       // not exported
+  MIDIMON_CAPTURE_Put(USB0,  pkg(ProgramChange, 2, 5, 0), 1300);      // delta 200: two bytes
+  MIDIMON_CAPTURE_Put(UART0, pkg(Aftertouch, 3, 64, 0), 1300);        // delta 0
+  MIDIMON_CAPTURE_Put(USB0,  pkg(PitchBend, 4, 0x00, 0x40), 21300);   // delta 20000: three bytes
+  MIDIMON_CAPTURE_Put(USB0,  pkg(NoteOff, 0, 60, 0), 21301);
+  MIDIMON_CAPTURE_Stop();
+
+  CHECK(smf_export(0) == 6);
+  num = smf_parse(events, MIDIMON_CAPTURE_SIZE);
+  CHECK(num == 6);
+
+  // the first event starts at tick 0, one tick per mS
+  CHECK(events[0].tick == 0 && events[0].len == 3 && events[0].event[0] == 0x90 && events[0].event[1] == 60 && events[0].event[2] == 100);
+  CHECK(events[1].tick == 100 && events[1].len == 3 && events[1].event[0] == 0xb1 && events[1].event[1] == 7 && events[1].event[2] == 0x7f);
+  CHECK(events[2].tick == 300 && events[2].len == 2 && events[2].event[0] == 0xc2 && events[2].event[1] == 5);
+  CHECK(events[3].tick == 300 && events[3].len == 2 && events[3].event[0] == 0xd3 && events[3].event[1] == 64);
+  CHECK(events[4].tick == 20300 && events[4].len == 3 && events[4].event[0] == 0xe4 && events[4].event[2] == 0x40);
+  CHECK(events[5].tick == 20301 && events[5].event[0] == 0x80);
+
+  // byte layout of the header and the first event
+  static const u8 head[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0x01, 0xf4,
+    'M', 'T', 'r', 'k'
+  };
+  CHECK(memcmp(smf, head, sizeof(head)) == 0);
+  static const u8 first[] = { 0x00, 0xff, 0x51, 0x03, 0x07, 0xa1, 0x20, 0x00, 0x90, 60, 100, 0x64, 0xb1 };
+  CHECK(memcmp(&smf[22], first, sizeof(first)) == 0);
+
+  // port filter: delta times refer to the previous exported event
+  CHECK(smf_export(UART0) == 2);
+  num = smf_parse(events, MIDIMON_CAPTURE_SIZE);
+  CHECK(num == 2);
+  CHECK(events[0].tick == 0 && events[0].event[0] == 0xb1);
+  CHECK(events[1].tick == 200 && events[1].event[0] == 0xd3);
+
+  // empty export
+  CHECK(smf_export(UART1) == 0);
+  CHECK(smf_parse(events, MIDIMON_CAPTURE_SIZE) == 0);
+
+  // callback errors
+  int calls;
+  for(calls=0; calls<5; ++calls) {
+    smf_len = 0;
+    smf_error_after = calls;
+    CHECK(MIDIMON_CAPTURE_ExportSmf(0, smf_write) == -2);
+  }
+}
+
+
+static void test_smf_overrun(void)
+{
+  static smf_event_t events[MIDIMON_CAPTURE_SIZE];
+  midimon_capture_event_t e;
+  int i;
+
+  // previous capture which must not be exported
+  MIDIMON_CAPTURE_Init(0);
+  MIDIMON_CAPTURE_Start();
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 0, 0), 0);
+  MIDIMON_CAPTURE_Get(&e);
+  MIDIMON_CAPTURE_Stop();
+
+  // consumer keeps up, the ring is filled three times
+  MIDIMON_CAPTURE_Start();
+  for(i=0; i<3*MIDIMON_CAPTURE_SIZE; ++i) {
+    MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 1, i & 0x7f), 1 + 2*i);
+    MIDIMON_CAPTURE_Get(&e);
+  }
+  MIDIMON_CAPTURE_Stop();
+
+  // only the last MIDIMON_CAPTURE_SIZE events are exported
+  CHECK(smf_export(0) == MIDIMON_CAPTURE_SIZE);
+  CHECK(smf_parse(events, MIDIMON_CAPTURE_SIZE) == MIDIMON_CAPTURE_SIZE);
+  for(i=0; i<MIDIMON_CAPTURE_SIZE; ++i) {
+    int ix = 2*MIDIMON_CAPTURE_SIZE + i;
+    CHECK(events[i].tick == 2*i && events[i].event[2] == (ix & 0x7f));
+  }
+
+  // short capture after a restart: only the new events
+  MIDIMON_CAPTURE_Start();
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 2, 0), 100);
+  MIDIMON_CAPTURE_Put(USB0, pkg(CC, 0, 2, 1), 150);
+  MIDIMON_CAPTURE_Stop();
+  CHECK(smf_export(0) == 2);
+  CHECK(smf_parse(events, MIDIMON_CAPTURE_SIZE) == 2);
+  CHECK(events[0].event[1] == 2 && events[1].tick == 50);
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_order();
+  test_overrun();
+  test_trigger_and_stop();
+  test_restart();
+  test_wrap();
+  test_threads();
+  test_smf();
+  test_smf_overrun();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+// minimal configuration for the host tests
+#ifndef _MIOS32_CONFIG_H
+#define _MIOS32_CONFIG_H
+
+#define DEBUG_MSG(...) do {} while(0)
+
+// the capture mode is only compiled if enabled
+#define MIDIMON_CAPTURE_SIZE 256
+
+#endif /* _MIOS32_CONFIG_H */
@@ -16,8 +16,10 @@
 /////////////////////////////////////////////////////////////////////////////
 #include <mios32.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "midimon.h"
+#include "midimon_capture.h"
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -33,6 +35,11 @@
 
 #define NUM_TEMPO_PORTS 4 // for USB0/1 and UART0/1 separately
 
+// max. number of captured events which are formatted with each MIDIMON_Handler() call
+#ifndef MIDIMON_HANDLER_MAX_EVENTS
+#define MIDIMON_HANDLER_MAX_EVENTS 8
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 // Local structures
 /////////////////////////////////////////////////////////////////////////////
@@ -82,6 +89,10 @@ static u8 midimon_active = 0;
 static u8 filter_active = 1;
 static u8 tempo_active = 0;
 
+#if MIDIMON_CAPTURE_SIZE > 0
+static midimon_capture_state_t handler_capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+#endif
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Initialize the monitor
@@ -105,6 +116,11 @@ s32 MIDIMON_Init(u32 mode)
     mtc_pos[tempo_port_ix].ALL = 0;
   }
 
+#if MIDIMON_CAPTURE_SIZE > 0
+  MIDIMON_CAPTURE_Init(0);
+  handler_capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+#endif
+
   return 0; // no error
 }
 
@@ -166,6 +182,19 @@ s32 MIDIMON_TempoActiveGet(void)
 /////////////////////////////////////////////////////////////////////////////
 s32 MIDIMON_Receive(mios32_midi_port_t port, mios32_midi_package_t package, u8 filter_sysex_message)
 {
+#if MIDIMON_CAPTURE_SIZE > 0
+  // while capturing, the package is only stored; it will be formatted by MIDIMON_Handler()
+  if( MIDIMON_CAPTURE_StateGet() != MIDIMON_CAPTURE_STATE_STOPPED ) {
+    u8 is_sysex =
+      (package.type >= 0x4 && package.type <= 0x7 && package.type != 0x5) ||
+      ((package.type == 0x5 || package.type == 0xf) && package.evnt0 == 0xf7);
+
+    if( !filter_sysex_message || !is_sysex )
+      MIDIMON_CAPTURE_Put(port, package, MIOS32_TIMESTAMP_Get());
+    return 0;
+  }
+#endif
+
   if( !midimon_active )
     return 0; // MIDImon mode not enabled
 
@@ -173,6 +202,45 @@ s32 MIDIMON_Receive(mios32_midi_port_t port, mios32_midi_package_t package, u8 f
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Formats the captured packages, should be called periodically from a
+// low-priority task (e.g. APP_Background)
+// Does nothing if the capture mode isn't enabled with MIDIMON_CAPTURE_SIZE
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_Handler(void)
+{
+#if MIDIMON_CAPTURE_SIZE > 0
+  midimon_capture_event_t event;
+  int num_events;
+
+  for(num_events=0; num_events<MIDIMON_HANDLER_MAX_EVENTS && MIDIMON_CAPTURE_Get(&event) > 0; ++num_events) {
+    if( midimon_active )
+      MIDIMON_Print("", event.port, event.package, event.timestamp, 0);
+  }
+
+  u32 num_dropped = MIDIMON_CAPTURE_NumDroppedTake();
+  if( num_dropped ) {
+    MSG("[MIDIMON] capture overrun: %u events dropped!\n", num_dropped);
+  }
+
+  midimon_capture_state_t state = MIDIMON_CAPTURE_StateGet();
+  if( state != handler_capture_state ) {
+    if( state == MIDIMON_CAPTURE_STATE_RUNNING && handler_capture_state == MIDIMON_CAPTURE_STATE_ARMED ) {
+      MSG("[MIDIMON] capture triggered.\n");
+    } else if( state == MIDIMON_CAPTURE_STATE_STOPPED && num_events == 0 ) {
+      MSG("[MIDIMON] capture stopped after %u events (%u dropped).\n",
+	  MIDIMON_CAPTURE_NumCapturedGet() + MIDIMON_CAPTURE_NumDroppedGet(), MIDIMON_CAPTURE_NumDroppedGet());
+    } else if( state == MIDIMON_CAPTURE_STATE_STOPPED ) {
+      return 0; // report once the ring has been formatted
+    }
+    handler_capture_state = state;
+  }
+#endif
+
+  return 0; // no error
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // Print the MIDI event independent from midimon_active with an optional prefix-string
 /////////////////////////////////////////////////////////////////////////////
@@ -456,6 +524,11 @@ s32 MIDIMON_TerminalHelp(void *_output_function)
   out("  set midimon <on|off>:             enables/disables the MIDI monitor");
   out("  set midimon_filter <on|off>:      enables/disables MIDI monitor filters");
   out("  set midimon_tempo <on|off>:       enables/disables the tempo display");
+#if MIDIMON_CAPTURE_SIZE > 0
+  out("  set midimon_capture <on|off>:     starts/stops capturing of timestamped events");
+  out("  set midimon_trigger <note|off>:   capture starts with the given Note On (0..127)");
+  out("  set midimon_stop <num>:           capture stops after <num> events (0: endless)");
+#endif
 
   return 0; // no error
 }
@@ -525,6 +598,77 @@ s32 MIDIMON_TerminalParseLine(char *input, void *_output_function)
 	out("MIDI Monitor Tempo Display %s!", MIDIMON_TempoActiveGet() ? "enabled" : "disabled");
 	return 1; // command taken
 
+#if MIDIMON_CAPTURE_SIZE > 0
+      } else if( strcmp(parameter, "midimon_capture") == 0 ) {
+	s32 on_off = -1;
+	if( (parameter = strtok_r(NULL, separators, &brkt)) )
+	  on_off = get_on_off(parameter);
+
+	if( on_off < 0 ) {
+	  out("Expecting 'on' or 'off'!");
+	  return 1; // command taken
+	}
+
+	if( on_off ) {
+	  MIDIMON_CAPTURE_Start();
+	  if( MIDIMON_CAPTURE_StateGet() == MIDIMON_CAPTURE_STATE_ARMED )
+	    out("MIDI Monitor Capture waiting for Note On #%d!", MIDIMON_CAPTURE_TriggerNoteGet());
+	  else
+	    out("MIDI Monitor Capture started!");
+	} else {
+	  MIDIMON_CAPTURE_Stop();
+	  out("MIDI Monitor Capture stopped after %u events (%u dropped)!",
+	      MIDIMON_CAPTURE_NumCapturedGet() + MIDIMON_CAPTURE_NumDroppedGet(), MIDIMON_CAPTURE_NumDroppedGet());
+	}
+	return 1; // command taken
+
+      } else if( strcmp(parameter, "midimon_trigger") == 0 ) {
+	s32 note = -1;
+	if( (parameter = strtok_r(NULL, separators, &brkt)) ) {
+	  if( get_on_off(parameter) == 0 )
+	    note = MIDIMON_CAPTURE_TRIGGER_NONE;
+	  else {
+	    char *next;
+	    note = strtol(parameter, &next, 0);
+	    if( parameter == next || note < 0 || note >= 128 )
+	      note = -1;
+	  }
+	}
+
+	if( note < 0 ) {
+	  out("Expecting note number (0..127) or 'off'!");
+	  return 1; // command taken
+	}
+
+	MIDIMON_CAPTURE_TriggerNoteSet(note);
+	if( MIDIMON_CAPTURE_TriggerNoteGet() == MIDIMON_CAPTURE_TRIGGER_NONE )
+	  out("MIDI Monitor Capture Trigger disabled!");
+	else
+	  out("MIDI Monitor Capture Trigger set to Note On #%d!", MIDIMON_CAPTURE_TriggerNoteGet());
+	return 1; // command taken
+
+      } else if( strcmp(parameter, "midimon_stop") == 0 ) {
+	s32 num = -1;
+	if( (parameter = strtok_r(NULL, separators, &brkt)) ) {
+	  char *next;
+	  num = strtol(parameter, &next, 0);
+	  if( parameter == next )
+	    num = -1;
+	}
+
+	if( num < 0 ) {
+	  out("Expecting number of events (0: endless)!");
+	  return 1; // command taken
+	}
+
+	MIDIMON_CAPTURE_StopCountSet(num);
+	if( num )
+	  out("MIDI Monitor Capture stops after %d events!", num);
+	else
+	  out("MIDI Monitor Capture runs endless!");
+	return 1; // command taken
+
+#endif
       } else {
 	// out("Unknown command - type 'help' to list available commands!");
       }
@@ -553,5 +697,20 @@ s32 MIDIMON_TerminalPrintConfig(void *_output_function)
   out("MIDI Monitor Filters: %s", MIDIMON_FilterActiveGet() ? "enabled" : "disabled");
   out("MIDI Monitor Tempo Display: %s", MIDIMON_TempoActiveGet() ? "enabled" : "disabled");
 
+#if MIDIMON_CAPTURE_SIZE > 0
+  midimon_capture_state_t state = MIDIMON_CAPTURE_StateGet();
+  out("MIDI Monitor Capture: %s (%u events, %u dropped)",
+      (state == MIDIMON_CAPTURE_STATE_RUNNING) ? "running" : ((state == MIDIMON_CAPTURE_STATE_ARMED) ? "armed" : "stopped"),
+      MIDIMON_CAPTURE_NumCapturedGet() + MIDIMON_CAPTURE_NumDroppedGet(), MIDIMON_CAPTURE_NumDroppedGet());
+  if( MIDIMON_CAPTURE_TriggerNoteGet() == MIDIMON_CAPTURE_TRIGGER_NONE )
+    out("MIDI Monitor Capture Trigger: off");
+  else
+    out("MIDI Monitor Capture Trigger: Note On #%d", MIDIMON_CAPTURE_TriggerNoteGet());
+  if( MIDIMON_CAPTURE_StopCountGet() )
+    out("MIDI Monitor Capture Stop: after %u events", MIDIMON_CAPTURE_StopCountGet());
+  else
+    out("MIDI Monitor Capture Stop: endless");
+#endif
+
   return 0; // no error
 }
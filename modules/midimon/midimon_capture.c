@@ -0,0 +1,401 @@
+// $Id$
+/*
+ * MIDI Monitor Capture Ring and SMF Export
+ *
+ * Only compiled if MIDIMON_CAPTURE_SIZE is set in mios32_config.h, since
+ * the ring takes 12 bytes of RAM per event.
+ *
+ * MIDIMON_CAPTURE_Put() stores raw timestamped packages into a lock-free
+ * ring buffer with a single producer (the MIDI receive task) and a single
+ * consumer (a low-priority task which calls MIDIMON_CAPTURE_Get()).
+ * Both sides only write their own index, therefore no IRQ or mutex locking
+ * is required. Events which don't fit into the ring are counted as dropped.
+ *
+ * The last MIDIMON_CAPTURE_SIZE events of a capture are kept in the buffer
+ * (also after they have been consumed) and can be exported as Standard
+ * MIDI File with MIDIMON_CAPTURE_ExportSmf().
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+#include <mios32.h>
+
+#include "midimon_capture.h"
+
+#if MIDIMON_CAPTURE_SIZE > 0
+
+/////////////////////////////////////////////////////////////////////////////
+// Local defines
+/////////////////////////////////////////////////////////////////////////////
+
+#if (MIDIMON_CAPTURE_SIZE & (MIDIMON_CAPTURE_SIZE-1))
+# error "MIDIMON_CAPTURE_SIZE must be a power of two!"
+#endif
+
+#define CAPTURE_IX_MASK (MIDIMON_CAPTURE_SIZE-1)
+
+// ensures that the event has been stored before the index is incremented
+// (sufficient for a single core, e.g. Cortex-M3/M4)
+#if defined(__GNUC__)
+# define CAPTURE_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+# define CAPTURE_BARRIER()
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local variables
+/////////////////////////////////////////////////////////////////////////////
+
+static midimon_capture_event_t capture_buffer[MIDIMON_CAPTURE_SIZE];
+
+// free running indices, head only written by producer, tail only by consumer
+static volatile u32 capture_head;
+static volatile u32 capture_tail;
+
+// head index at the begin of the capture (for the export)
+static volatile u32 capture_start;
+
+static volatile u8 capture_state;
+static u8 capture_trigger_note;
+static u32 capture_stop_count;
+
+// written by producer
+static volatile u32 num_captured;
+static volatile u32 num_dropped;
+
+// written by consumer
+static u32 num_dropped_taken;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Initialisation
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_Init(u32 mode)
+{
+  if( mode > 0 )
+    return -1; // only mode 0 supported yet
+
+  capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+  capture_head = 0;
+  capture_tail = 0;
+  capture_start = 0;
+  capture_trigger_note = MIDIMON_CAPTURE_TRIGGER_NONE;
+  capture_stop_count = 0;
+  num_captured = 0;
+  num_dropped = 0;
+  num_dropped_taken = 0;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Starts a new capture; if a trigger note has been set, the capture is armed
+// until a Note On with this note number has been received.
+// Events which haven't been consumed yet are kept in the ring.
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_Start(void)
+{
+  capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+  CAPTURE_BARRIER();
+
+  capture_start = capture_head;
+  num_captured = 0;
+  num_dropped = 0;
+  num_dropped_taken = 0;
+  CAPTURE_BARRIER();
+
+  capture_state = (capture_trigger_note < 128) ? MIDIMON_CAPTURE_STATE_ARMED : MIDIMON_CAPTURE_STATE_RUNNING;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Stops the capture, the stored events can be exported afterwards
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_Stop(void)
+{
+  capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Returns the capture state
+/////////////////////////////////////////////////////////////////////////////
+midimon_capture_state_t MIDIMON_CAPTURE_StateGet(void)
+{
+  return (midimon_capture_state_t)capture_state;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Trigger conditions
+// note: 0..127, MIDIMON_CAPTURE_TRIGGER_NONE (or >= 128) to start immediately
+// num_events: capture stops after the given number of events, 0: endless
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_TriggerNoteSet(u8 note)
+{
+  capture_trigger_note = (note < 128) ? note : MIDIMON_CAPTURE_TRIGGER_NONE;
+  return 0; // no error
+}
+
+s32 MIDIMON_CAPTURE_TriggerNoteGet(void)
+{
+  return capture_trigger_note;
+}
+
+s32 MIDIMON_CAPTURE_StopCountSet(u32 num_events)
+{
+  capture_stop_count = num_events;
+  return 0; // no error
+}
+
+u32 MIDIMON_CAPTURE_StopCountGet(void)
+{
+  return capture_stop_count;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Producer: stores an event into the ring
+// Returns 1 if the event has been stored, 0 if capture is not running,
+// -1 if the event has been dropped because the ring is full
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_Put(mios32_midi_port_t port, mios32_midi_package_t package, u32 timestamp)
+{
+  u8 state = capture_state;
+
+  if( state == MIDIMON_CAPTURE_STATE_STOPPED )
+    return 0; // not running
+
+  if( state == MIDIMON_CAPTURE_STATE_ARMED ) {
+    if( package.type != NoteOn || package.velocity == 0 || package.note != capture_trigger_note )
+      return 0; // waiting for trigger
+    capture_state = MIDIMON_CAPTURE_STATE_RUNNING;
+  }
+
+  s32 status;
+  u32 head = capture_head;
+  if( (head - capture_tail) >= MIDIMON_CAPTURE_SIZE ) {
+    ++num_dropped;
+    status = -1;
+  } else {
+    midimon_capture_event_t *e = &capture_buffer[head & CAPTURE_IX_MASK];
+    e->timestamp = timestamp;
+    e->package = package;
+    e->port = port;
+    CAPTURE_BARRIER();
+    capture_head = head + 1;
+    ++num_captured;
+    status = 1;
+  }
+
+  if( capture_stop_count && (num_captured + num_dropped) >= capture_stop_count )
+    capture_state = MIDIMON_CAPTURE_STATE_STOPPED;
+
+  return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Consumer: takes the next event from the ring
+// Returns 1 if an event has been copied into *event, 0 if the ring is empty
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_Get(midimon_capture_event_t *event)
+{
+  u32 tail = capture_tail;
+
+  if( tail == capture_head )
+    return 0; // empty
+
+  CAPTURE_BARRIER();
+  *event = capture_buffer[tail & CAPTURE_IX_MASK];
+  CAPTURE_BARRIER();
+  capture_tail = tail + 1;
+
+  return 1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Counters of the current capture
+// NumDroppedTake() returns the number of events dropped since the last call
+/////////////////////////////////////////////////////////////////////////////
+u32 MIDIMON_CAPTURE_NumCapturedGet(void)
+{
+  return num_captured;
+}
+
+u32 MIDIMON_CAPTURE_NumDroppedGet(void)
+{
+  return num_dropped;
+}
+
+u32 MIDIMON_CAPTURE_NumDroppedTake(void)
+{
+  u32 dropped = num_dropped;
+  u32 delta = dropped - num_dropped_taken;
+  num_dropped_taken = dropped;
+  return delta;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Help functions for the SMF export
+/////////////////////////////////////////////////////////////////////////////
+
+// writes a variable length quantity, returns the number of bytes
+static u8 SMF_VarLen(u8 *buffer, u32 value)
+{
+  u8 tmp[4];
+  u8 len = 0;
+
+  if( value > 0x0fffffff )
+    value = 0x0fffffff;
+
+  do {
+    tmp[len++] = value & 0x7f;
+    value >>= 7;
+  } while( value );
+
+  u8 i;
+  for(i=0; i<len; ++i)
+    buffer[i] = tmp[len-1-i] | ((i < (len-1)) ? 0x80 : 0x00);
+
+  return len;
+}
+
+// writes a 32bit big endian value
+static void SMF_Word(u8 *buffer, u32 value)
+{
+  buffer[0] = (u8)(value >> 24);
+  buffer[1] = (u8)(value >> 16);
+  buffer[2] = (u8)(value >> 8);
+  buffer[3] = (u8)value;
+}
+
+// writes the MIDI event of a captured package, returns the number of bytes
+// only channel voice messages are exported
+static u8 SMF_Event(u8 *buffer, midimon_capture_event_t *e, mios32_midi_port_t port_filter)
+{
+  if( port_filter && e->port != port_filter )
+    return 0;
+
+  switch( e->package.type ) {
+  case NoteOff:
+  case NoteOn:
+  case PolyPressure:
+  case CC:
+  case PitchBend:
+    buffer[0] = e->package.evnt0;
+    buffer[1] = e->package.evnt1 & 0x7f;
+    buffer[2] = e->package.evnt2 & 0x7f;
+    return 3;
+
+  case ProgramChange:
+  case Aftertouch:
+    buffer[0] = e->package.evnt0;
+    buffer[1] = e->package.evnt1 & 0x7f;
+    return 2;
+  }
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Exports the last (up to MIDIMON_CAPTURE_SIZE) events of the capture as
+// Standard MIDI File (format 0) via the given write callback, which should
+// return < 0 on errors (e.g. FILE_WriteBuffer)
+// port_filter: only export events of the given port, 0: all ports
+// Returns the number of exported events, -1 if capture is still running,
+// -2 if the callback returned an error
+/////////////////////////////////////////////////////////////////////////////
+s32 MIDIMON_CAPTURE_ExportSmf(mios32_midi_port_t port_filter, s32 (*write_callback)(u8 *buffer, u32 len))
+{
+  if( capture_state != MIDIMON_CAPTURE_STATE_STOPPED )
+    return -1; // capture still running
+
+  u32 head = capture_head;
+  u32 first = capture_start;
+  if( (head - first) > MIDIMON_CAPTURE_SIZE )
+    first = head - MIDIMON_CAPTURE_SIZE;
+
+  u8 buffer[16];
+  u8 len;
+  u32 ix;
+
+  // tempo meta event
+  const u8 tempo_event[7] = {
+    0x00, 0xff, 0x51, 0x03,
+    (u8)(MIDIMON_CAPTURE_SMF_TEMPO >> 16), (u8)(MIDIMON_CAPTURE_SMF_TEMPO >> 8), (u8)MIDIMON_CAPTURE_SMF_TEMPO
+  };
+  const u8 end_event[4] = { 0x00, 0xff, 0x2f, 0x00 };
+
+  // first pass: determine the track length
+  u32 track_len = sizeof(tempo_event) + sizeof(end_event);
+  u32 num_events = 0;
+  u32 prev_timestamp = 0;
+  for(ix=first; ix != head; ++ix) {
+    midimon_capture_event_t *e = &capture_buffer[ix & CAPTURE_IX_MASK];
+    if( (len=SMF_Event(buffer, e, port_filter)) ) {
+      u32 delta = num_events ? (e->timestamp - prev_timestamp) : 0;
+      prev_timestamp = e->timestamp;
+      track_len += SMF_VarLen(buffer, delta) + len;
+      ++num_events;
+    }
+  }
+
+  // header chunk
+  buffer[0] = 'M'; buffer[1] = 'T'; buffer[2] = 'h'; buffer[3] = 'd';
+  SMF_Word(&buffer[4], 6);
+  buffer[8] = 0x00; buffer[9] = 0x00; // format 0
+  buffer[10] = 0x00; buffer[11] = 0x01; // one track
+  buffer[12] = (u8)(MIDIMON_CAPTURE_SMF_PPQN >> 8); buffer[13] = (u8)MIDIMON_CAPTURE_SMF_PPQN;
+  if( write_callback(buffer, 14) < 0 )
+    return -2;
+
+  // track chunk
+  buffer[0] = 'M'; buffer[1] = 'T'; buffer[2] = 'r'; buffer[3] = 'k';
+  SMF_Word(&buffer[4], track_len);
+  if( write_callback(buffer, 8) < 0 ||
+      write_callback((u8 *)tempo_event, sizeof(tempo_event)) < 0 )
+    return -2;
+
+  // second pass: write the events
+  u32 num_written = 0;
+  for(ix=first; ix != head; ++ix) {
+    midimon_capture_event_t *e = &capture_buffer[ix & CAPTURE_IX_MASK];
+    u8 event[3];
+    if( (len=SMF_Event(event, e, port_filter)) ) {
+      u32 delta = num_written ? (e->timestamp - prev_timestamp) : 0;
+      prev_timestamp = e->timestamp;
+      u8 pos = SMF_VarLen(buffer, delta);
+      u8 i;
+      for(i=0; i<len; ++i)
+	buffer[pos++] = event[i];
+      if( write_callback(buffer, pos) < 0 )
+	return -2;
+      ++num_written;
+    }
+  }
+
+  if( write_callback((u8 *)end_event, sizeof(end_event)) < 0 )
+    return -2;
+
+  return num_written;
+}
+
+#endif /* MIDIMON_CAPTURE_SIZE > 0 */
@@ -0,0 +1,93 @@
+// $Id$
+/*
+ * Header file for MIDI monitor capture ring and SMF export
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _MIDIMON_CAPTURE_H
+#define _MIDIMON_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// number of captured events which can be stored (12 bytes RAM each)
+// must be a power of two, can be overruled in mios32_config.h
+// 0 disables the capture mode and the "set midimon_capture" commands
+#ifndef MIDIMON_CAPTURE_SIZE
+#define MIDIMON_CAPTURE_SIZE 0
+#endif
+
+// no trigger note: capturing starts immediately
+#define MIDIMON_CAPTURE_TRIGGER_NONE 0xff
+
+// the exported SMF runs at 120 BPM with 500 ticks per quarter note,
+// so that one tick matches with one timestamp (mS)
+#define MIDIMON_CAPTURE_SMF_PPQN  500
+#define MIDIMON_CAPTURE_SMF_TEMPO 500000
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  MIDIMON_CAPTURE_STATE_STOPPED = 0,
+  MIDIMON_CAPTURE_STATE_ARMED,    // waiting for the trigger note
+  MIDIMON_CAPTURE_STATE_RUNNING
+} midimon_capture_state_t;
+
+
+typedef struct {
+  u32 timestamp;
+  mios32_midi_package_t package;
+  mios32_midi_port_t port;
+} midimon_capture_event_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 MIDIMON_CAPTURE_Init(u32 mode);
+
+extern s32 MIDIMON_CAPTURE_Start(void);
+extern s32 MIDIMON_CAPTURE_Stop(void);
+extern midimon_capture_state_t MIDIMON_CAPTURE_StateGet(void);
+
+extern s32 MIDIMON_CAPTURE_TriggerNoteSet(u8 note);
+extern s32 MIDIMON_CAPTURE_TriggerNoteGet(void);
+extern s32 MIDIMON_CAPTURE_StopCountSet(u32 num_events);
+extern u32 MIDIMON_CAPTURE_StopCountGet(void);
+
+extern s32 MIDIMON_CAPTURE_Put(mios32_midi_port_t port, mios32_midi_package_t package, u32 timestamp);
+extern s32 MIDIMON_CAPTURE_Get(midimon_capture_event_t *event);
+
+extern u32 MIDIMON_CAPTURE_NumCapturedGet(void);
+extern u32 MIDIMON_CAPTURE_NumDroppedGet(void);
+extern u32 MIDIMON_CAPTURE_NumDroppedTake(void);
+
+extern s32 MIDIMON_CAPTURE_ExportSmf(mios32_midi_port_t port_filter, s32 (*write_callback)(u8 *buffer, u32 len));
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Export global variables
+/////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MIDIMON_CAPTURE_H */
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "../minfs.h"
+
+// storage device: 64 byte blocks
+#define DEV_BLOCK_SIZE_EXP 6
+#define DEV_BLOCK_SIZE (1 << DEV_BLOCK_SIZE_EXP)
+#define DEV_NUM_BLOCKS_MAX 320
+
+// workload
+#define NUM_FILES 6
+#define MAX_FILE_SIZE 900
+#define NUM_OPS 3000
+#define SYNC_EVERY 8
+
+// chain-index entries per file
+#define CHAIN_INDEX_SIZE 32
+
+// power loss test rounds
+#define POWER_LOSS_ROUNDS 400
+
+typedef uint8_t databuf_t[DEV_BLOCK_SIZE];
+
+// storage device
+static databuf_t storage_blocks[DEV_NUM_BLOCKS_MAX];
+static uint32_t dev_reads, dev_read_bytes;
+static uint32_t dev_writes, dev_write_bytes;
+
+// power loss simulation: all writes starting with write number power_loss_at get lost,
+// the write power_loss_at itself may be torn
+static uint32_t power_loss_at;
+static uint8_t power_lost;
+
+// without cache, the file-system reads the lost data again. Errors after a power loss
+// stop the workload instead of failing the test.
+static jmp_buf power_loss_jmp;
+static uint8_t power_loss_jmp_armed;
+
+// single buffer for the uncached mode
+static MINFS_block_buf_t block_buf;
+static databuf_t block_buf_buffer;
+
+// block-cache
+static MINFS_cache_t cache;
+static MINFS_block_buf_t cache_bufs[MINFS_CACHE_MAX_BLOCK_BUFS];
+static databuf_t cache_bufs_buffer[MINFS_CACHE_MAX_BLOCK_BUFS];
+
+static MINFS_fs_t fs;
+static MINFS_file_t f;
+static uint32_t chain_index[CHAIN_INDEX_SIZE];
+
+// reference model
+typedef struct{
+  uint8_t exists;
+  uint32_t size;
+  uint8_t data[MAX_FILE_SIZE];
+} model_file_t;
+
+static model_file_t model[NUM_FILES + 1];
+static model_file_t model_synced[NUM_FILES + 1];
+
+static uint32_t rand_state;
+
+
+// ------- local prototypes -------
+static uint32_t rnd(void);
+static void fail(const char *msg, int32_t status);
+static void dev_format(uint32_t num_blocks);
+static void fs_mount(uint8_t num_cache_bufs, uint8_t portion_write);
+static void fs_sync(void);
+static void workload(uint32_t seed, uint32_t num_ops, uint8_t use_chain_index, uint32_t *p_hashes);
+static int32_t fsck(model_file_t *p_model, uint32_t *p_leaked);
+static uint32_t image_hash(void);
+static void benchmark(void);
+static void equivalence_test(void);
+static void power_loss_test(uint8_t num_cache_bufs, uint8_t portion_write);
+
+
+// ------- main -------
+int main(void){
+  benchmark();
+  equivalence_test();
+  power_loss_test(0, 0);
+  power_loss_test(8, 0);
+  power_loss_test(8, 1);
+  printf("all tests passed\n");
+  exit(0);
+}
+
+
+// ------- tests -------
+
+// counts backend accesses for different cache sizes, with whole-block and portion-writes
+static void benchmark(void){
+  static const uint8_t num_cache_bufs[] = { 0, 2, 4, 8, 16 };
+  uint8_t i, use_chain_index, portion_write;
+  uint32_t block_write_bytes[2];
+  printf("benchmark: %d random operations on %d files, sync every %d operations\n", NUM_OPS, NUM_FILES, SYNC_EVERY);
+  printf("  buffers  writes  index     reads  read bytes    writes write bytes  hit rate\n");
+  for(i = 0; i < sizeof(num_cache_bufs); i++){
+    for(portion_write = 0; portion_write < (num_cache_bufs[i] ? 2 : 1); portion_write++){
+      for(use_chain_index = 0; use_chain_index < 2; use_chain_index++){
+        dev_format(128);
+        fs_mount(num_cache_bufs[i], portion_write);
+        dev_reads = dev_read_bytes = dev_writes = dev_write_bytes = 0;
+        workload(1234, NUM_OPS, use_chain_index, NULL);
+        fs_sync();
+        if( fsck(model, NULL) )
+          fail("benchmark: file-system check", 0);
+        printf("  %7d  %6s  %5s  %8u  %10u  %8u  %10u", num_cache_bufs[i], num_cache_bufs[i] ? (portion_write ? "range" : "block") : "-",
+          use_chain_index ? "yes" : "no", dev_reads, dev_read_bytes, dev_writes, dev_write_bytes);
+        if( num_cache_bufs[i] )
+          printf("  %7.1f%%\n", 100.0 * cache.hits / (cache.hits + cache.misses));
+        else
+          printf("         -\n");
+        // the changed byte ranges have to save bytes compared to whole-block writes
+        if( !portion_write )
+          block_write_bytes[use_chain_index] = dev_write_bytes;
+        else if( dev_write_bytes >= block_write_bytes[use_chain_index] )
+          fail("benchmark: portion-writes don't save bytes", dev_write_bytes);
+      }
+    }
+  }
+}
+
+
+// the storage image has to be identical with and without cache at each sync point
+static void equivalence_test(void){
+  static uint32_t hashes_uncached[NUM_OPS / SYNC_EVERY + 1];
+  static uint32_t hashes_cached[NUM_OPS / SYNC_EVERY + 1];
+  static const uint32_t num_blocks[] = { 128, 300 }; // 1 and 2 byte block pointers
+  uint8_t i;
+  uint32_t j;
+  for(i = 0; i < 4; i++){
+    dev_format(num_blocks[i & 1]);
+    databuf_t *p_image = malloc(sizeof(storage_blocks));
+    memcpy(p_image, storage_blocks, sizeof(storage_blocks));
+    fs_mount(0, 0);
+    workload(99 + (i & 1), NUM_OPS, 0, hashes_uncached);
+    memcpy(storage_blocks, p_image, sizeof(storage_blocks));
+    memset(model, 0, sizeof(model));
+    fs_mount(8, i >> 1);
+    workload(99 + (i & 1), NUM_OPS, 1, hashes_cached);
+    free(p_image);
+    for(j = 0; j <= NUM_OPS / SYNC_EVERY; j++){
+      if( hashes_uncached[j] != hashes_cached[j] ){
+        printf("sync point %u, %u blocks, %s writes: ", j, num_blocks[i & 1], (i >> 1) ? "portion" : "block");
+        fail("equivalence: storage image differs", 0);
+      }
+    }
+    printf("equivalence: %u blocks, %s writes, %u sync points identical\n", num_blocks[i & 1], (i >> 1) ? "portion" : "block", NUM_OPS / SYNC_EVERY + 1);
+  }
+}
+
+
+// interrupts the workload at random writes. If no write was lost after a sync, all synced data
+// must be there. Otherwise the number of consistent file-systems is reported.
+static void power_loss_test(uint8_t num_cache_bufs, uint8_t portion_write){
+  uint32_t round, total_writes, leaked;
+  uint32_t num_at_sync = 0, num_consistent = 0, num_synced_data = 0, num_leaks = 0;
+  for(round = 0; round < POWER_LOSS_ROUNDS; round++){
+    // count the writes of the whole workload
+    dev_format(128);
+    fs_mount(num_cache_bufs, portion_write);
+    dev_writes = 0;
+    workload(round, 200, num_cache_bufs ? 1 : 0, NULL);
+    fs_sync();
+    total_writes = dev_writes;
+    // run again with power loss, every 4th round just at the end of a sync
+    dev_format(128);
+    fs_mount(num_cache_bufs, portion_write);
+    dev_writes = 0;
+    power_loss_at = 1 + rand_state % total_writes;
+    uint8_t at_sync = (round % 4) == 0;
+    if( at_sync )
+      power_loss_at = 0xffffffff; // determined by workload()
+    power_loss_jmp_armed = 1;
+    if( !setjmp(power_loss_jmp) )
+      workload(round, 200, num_cache_bufs ? 1 : 0, at_sync ? &power_loss_at : NULL);
+    power_loss_jmp_armed = 0;
+    // remount (unsynced blocks in the cache are lost) and check
+    power_loss_at = 0xffffffff;
+    power_lost = 0;
+    fs_mount(num_cache_bufs, portion_write);
+    int32_t status = fsck(model_synced, &leaked);
+    if( at_sync ){
+      num_at_sync++;
+      if( status )
+        fail("power loss after sync: synced data lost", status);
+    } else {
+      if( status >= 0 )
+        num_consistent++;
+      if( status == 0 )
+        num_synced_data++;
+      if( leaked )
+        num_leaks++;
+    }
+  }
+  printf("power loss, %d cache buffers%s: %u losses after sync ok; %u random losses: %u consistent, %u with synced data, %u with leaked blocks\n",
+    num_cache_bufs, portion_write ? " (portion-writes)" : "", num_at_sync, POWER_LOSS_ROUNDS - num_at_sync, num_consistent, num_synced_data, num_leaks);
+}
+
+
+// ------- helper functions -------
+
+static uint32_t rnd(void){
+  rand_state = rand_state * 1103515245 + 12345;
+  return (rand_state >> 8) & 0xffffff;
+}
+
+static void fail(const char *msg, int32_t status){
+  if( power_lost && power_loss_jmp_armed )
+    longjmp(power_loss_jmp, 1);
+  printf("FAILED: %s (%d)\n", msg, status);
+  exit(1);
+}
+
+// formats the storage without cache
+static void dev_format(uint32_t num_blocks){
+  int32_t status;
+  memset(storage_blocks, 0xff, sizeof(storage_blocks));
+  power_loss_at = 0xffffffff;
+  power_lost = 0;
+  MINFS_CacheInit(&fs, NULL, NULL, 0, 0);
+  MINFS_InitBlockBuffer(&block_buf);
+  block_buf.p_buf = block_buf_buffer;
+  fs.info.block_size = DEV_BLOCK_SIZE_EXP;
+  fs.info.num_blocks = num_blocks;
+  fs.info.flags = MINFS_FLAGS_NOPEC;
+  fs.info.os_flags = 0;
+  fs.fs_id = 1;
+  if( status = MINFS_Format(&fs, NULL) )
+    fail("format", status);
+  memset(model, 0, sizeof(model));
+  memset(model_synced, 0, sizeof(model_synced));
+}
+
+// mounts the file-system with a block-cache of num_cache_bufs buffers (0: no cache)
+static void fs_mount(uint8_t num_cache_bufs, uint8_t portion_write){
+  int32_t status;
+  uint8_t i;
+  MINFS_InitBlockBuffer(&block_buf);
+  block_buf.p_buf = block_buf_buffer;
+  if( num_cache_bufs ){
+    for(i = 0; i < num_cache_bufs; i++)
+      cache_bufs[i].p_buf = cache_bufs_buffer[i];
+    if( status = MINFS_CacheInit(&fs, &cache, cache_bufs, num_cache_bufs, portion_write) )
+      fail("cache init", status);
+  } else
+    MINFS_CacheInit(&fs, NULL, NULL, 0, 0);
+  if( status = MINFS_FSOpen(&fs, NULL) )
+    fail("fs open", status);
+}
+
+static void fs_sync(void){
+  int32_t status;
+  if( status = MINFS_CacheSync(&fs) )
+    fail("sync", status);
+  memcpy(model_synced, model, sizeof(model));
+}
+
+// random file operations, verified against the model. If p_hashes is set, the storage image hashes
+// will be stored at each sync point. If p_hashes points to power_loss_at, the power will be lost
+// right after the last sync which is executed before the workload ends.
+static void workload(uint32_t seed, uint32_t num_ops, uint8_t use_chain_index, uint32_t *p_hashes){
+  static uint8_t buf[MAX_FILE_SIZE];
+  uint32_t op, i, id, pos, len;
+  int32_t status;
+  uint8_t loss_after_sync = (p_hashes == &power_loss_at);
+  uint32_t num_syncs = 0, loss_sync;
+  rand_state = seed;
+  loss_sync = 1 + rnd() % (num_ops / SYNC_EVERY);
+  for(op = 0; op < num_ops; op++){
+    uint32_t kind = rnd() % 10;
+    id = 1 + rnd() % NUM_FILES;
+    model_file_t *m = &model[id];
+    // unlink
+    if( kind == 8 ){
+      if( m->exists ){
+        if( status = MINFS_FileUnlink(&fs, id, 0, NULL) )
+          fail("unlink", status);
+        m->exists = 0;
+        m->size = 0;
+      }
+    } else {
+      // open (creates the file)
+      if( status = MINFS_FileOpen(&fs, id, &f, NULL) )
+        fail("open", status);
+      if( !m->exists ){
+        m->exists = 1;
+        m->size = 0;
+      }
+      if( f.info.size != m->size )
+        fail("open: file size", f.info.size);
+      if( use_chain_index )
+        MINFS_FileSetChainIndex(&f, chain_index, CHAIN_INDEX_SIZE);
+      if( kind <= 4 ){
+        // write
+        pos = rnd() % (m->size + 1);
+        len = 1 + rnd() % 120;
+        if( pos + len > MAX_FILE_SIZE )
+          len = MAX_FILE_SIZE - pos;
+        for(i = 0; i < len; i++)
+          buf[i] = rnd();
+        if( (status = MINFS_FileSeek(&f, pos, NULL)) && status != MINFS_STATUS_EOF )
+          fail("write: seek", status);
+        // if the file-system is full, nothing will be written
+        if( (status = MINFS_FileWrite(&f, buf, len, NULL)) != MINFS_STATUS_FULL ){
+          if( status && status != MINFS_STATUS_EOF )
+            fail("write", status);
+          memcpy(&m->data[pos], buf, len);
+          if( pos + len > m->size )
+            m->size = pos + len;
+        }
+      } else if( kind == 7 ){
+        // truncate
+        len = rnd() % (m->size + 1);
+        if( status = MINFS_FileSetSize(&f, len, NULL) )
+          fail("truncate", status);
+        m->size = len;
+      } else {
+        // read: one range, or a couple of small ranges (seeks)
+        uint32_t num_reads = (kind == 9) ? 8 : 1;
+        while( num_reads-- ){
+          pos = rnd() % (m->size + 1);
+          len = (kind == 9) ? 16 : rnd() % 200;
+          if( (status = MINFS_FileSeek(&f, pos, NULL)) && status != MINFS_STATUS_EOF )
+            fail("read: seek", status);
+          uint32_t read_len = len;
+          if( (status = MINFS_FileRead(&f, buf, &read_len, NULL)) && status != MINFS_STATUS_EOF )
+            fail("read", status);
+          if( read_len != ((pos + len > m->size) ? m->size - pos : len) )
+            fail("read: length", read_len);
+          if( memcmp(buf, &m->data[pos], read_len) )
+            fail("read: data", pos);
+        }
+      }
+    }
+    // sync
+    if( (op % SYNC_EVERY) == (SYNC_EVERY - 1) ){
+      fs_sync();
+      if( loss_after_sync ){
+        if( ++num_syncs == loss_sync ){
+          power_loss_at = dev_writes + 1;
+          return;
+        }
+      } else if( p_hashes != NULL )
+        p_hashes[op / SYNC_EVERY] = image_hash();
+    }
+    // stop after power loss
+    if( power_lost )
+      return;
+  }
+  if( p_hashes != NULL && !loss_after_sync ){
+    fs_sync();
+    p_hashes[num_ops / SYNC_EVERY] = image_hash();
+  }
+}
+
+static uint32_t chain_next(uint32_t block_n){
+  uint8_t bp_size = fs.calc.bp_size;
+  uint32_t offset = sizeof(MINFS_fs_header_t) + bp_size * (block_n - fs.calc.first_datablock_n);
+  uint8_t *p = (uint8_t *)storage_blocks + offset;
+  return (bp_size == 1) ? p[0] : (p[0] | (p[1] << 8));
+}
+
+// walks a block chain, marks the blocks and returns the chain length, -1 if the chain is broken
+static int32_t chain_walk(uint32_t block_n, uint8_t *p_used){
+  int32_t len = 0;
+  while( block_n != MINFS_BLOCK_EOC ){
+    if( block_n < fs.calc.first_datablock_n || block_n >= fs.info.num_blocks || p_used[block_n] )
+      return -1; // out of range, loop or cross-linked
+    p_used[block_n] = 1;
+    len++;
+    block_n = chain_next(block_n);
+  }
+  return len;
+}
+
+// reads a file's data directly from the storage, returns the size or -1
+static int32_t file_read_raw(uint32_t block_n, uint8_t *p_buf, uint32_t max_len){
+  uint8_t *p_block = storage_blocks[block_n];
+  if( memcmp(p_block, MINFS_FILE_SIG, 4) )
+    return -1;
+  uint32_t size = p_block[4] | (p_block[5] << 8) | (p_block[6] << 16) | (p_block[7] << 24);
+  uint32_t i, offset = sizeof(MINFS_file_header_t);
+  if( size > max_len )
+    return -1;
+  for(i = 0; i < size; i++){
+    if( offset == DEV_BLOCK_SIZE ){
+      block_n = chain_next(block_n);
+      if( block_n == MINFS_BLOCK_EOC || block_n >= fs.info.num_blocks )
+        return -1;
+      p_block = storage_blocks[block_n];
+      offset = 0;
+    }
+    p_buf[i] = p_block[offset++];
+  }
+  return size;
+}
+
+// checks the structure of the file-system on the storage device and compares it with the model
+// OUT: 0 if consistent and equal to the model, 1 if consistent but different, < 0 if broken
+static int32_t fsck(model_file_t *p_model, uint32_t *p_leaked){
+  static uint8_t used[DEV_NUM_BLOCKS_MAX];
+  static uint8_t index[MAX_FILE_SIZE], data[MAX_FILE_SIZE];
+  uint32_t id, block_n, i;
+  int32_t len, size, index_size;
+  int32_t ret = 0;
+  memset(used, 0, sizeof(used));
+  // free blocks chain starts at the virtual block num_blocks
+  if( chain_walk(chain_next(fs.info.num_blocks), used) < 0 )
+    return -1;
+  // file-index
+  if( (len = chain_walk(fs.calc.first_datablock_n, used)) < 0 )
+    return -2;
+  if( (index_size = file_read_raw(fs.calc.first_datablock_n, index, sizeof(index))) < 0 )
+    return -3;
+  for(id = 1; id <= NUM_FILES; id++){
+    block_n = MINFS_BLOCK_EOC;
+    if( (id - 1) * fs.calc.bp_size < index_size ){
+      block_n = index[(id - 1) * fs.calc.bp_size];
+      if( fs.calc.bp_size == 2 )
+        block_n |= index[(id - 1) * fs.calc.bp_size + 1] << 8;
+    }
+    if( block_n == MINFS_BLOCK_EOC ){
+      if( p_model[id].exists )
+        ret = 1;
+      continue;
+    }
+    if( (len = chain_walk(block_n, used)) < 0 )
+      return -4;
+    if( (size = file_read_raw(block_n, data, sizeof(data))) < 0 )
+      return -5;
+    if( len != (size + sizeof(MINFS_file_header_t) + DEV_BLOCK_SIZE - 1) / DEV_BLOCK_SIZE )
+      return -6;
+    if( !p_model[id].exists || size != p_model[id].size || memcmp(data, p_model[id].data, size) )
+      ret = 1;
+  }
+  // blocks which are neither free nor used by a file
+  if( p_leaked != NULL ){
+    *p_leaked = 0;
+    for(i = fs.calc.first_datablock_n; i < fs.info.num_blocks; i++)
+      if( !used[i] )
+        (*p_leaked)++;
+  }
+  return ret;
+}
+
+static uint32_t image_hash(void){
+  uint32_t i, h = 2166136261u;
+  for(i = 0; i < fs.info.num_blocks * DEV_BLOCK_SIZE; i++)
+    h = (h ^ ((uint8_t *)storage_blocks)[i]) * 16777619u;
+  return h;
+}
+
+
+// ------- MINFS OS hook functions -------
+int32_t MINFS_Read(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uint16_t data_offset, uint16_t data_len){
+  if(!data_len){
+    data_len = DEV_BLOCK_SIZE; // read entire block
+    p_block_buf->flags.populated = 1;
+  }
+  memcpy( (uint8_t*)(p_block_buf->p_buf) + data_offset, &(storage_blocks[p_block_buf->block_n][data_offset]), data_len);
+  dev_reads++;
+  dev_read_bytes += data_len;
+  return 0;
+}
+
+int32_t MINFS_Write(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uint16_t data_offset, uint16_t data_len){
+  if(!data_len)
+    data_len = DEV_BLOCK_SIZE; // write entire block
+  dev_writes++;
+  dev_write_bytes += data_len;
+  if( dev_writes == power_loss_at ){
+    data_len = rnd() % (data_len + 1); // torn write
+    power_lost = 1;
+  }
+  if( !power_lost || dev_writes == power_loss_at )
+    memcpy(&(storage_blocks[p_block_buf->block_n][data_offset]), (uint8_t*)(p_block_buf->p_buf) + data_offset, data_len);
+  p_block_buf->flags.changed = 0;
+  return 0;
+}
+
+int32_t MINFS_GetBlockBuffer(MINFS_fs_t *p_fs, MINFS_block_buf_t **pp_block_buf, uint32_t block_n, uint32_t file_id){
+  (*pp_block_buf) = &block_buf;
+  return 0;
+}
@@ -58,11 +58,11 @@ static const uint32_t BECV = 1; // dummy value to check endianes
 #define LE_SET(p_dst, src, len){ \
   *( (uint8_t*)p_dst ) = (uint8_t)src; \
   if( len > 1 ) \
-    *( (uint8_t*)(p_dst + 1) ) |= (uint8_t)( src >> 8 ); \
+    *( (uint8_t*)(p_dst + 1) ) = (uint8_t)( src >> 8 ); \
   if( len > 2 ) \
-    *( (uint8_t*)(p_dst + 2) ) |= (uint8_t)( src >> 16 ); \
+    *( (uint8_t*)(p_dst + 2) ) = (uint8_t)( src >> 16 ); \
   if( len > 3 ) \
-    *( (uint8_t*)(p_dst + 3) ) |= (uint8_t)( src >> 24 ); \
+    *( (uint8_t*)(p_dst + 3) ) = (uint8_t)( src >> 24 ); \
 }
 
 // copies 1-4 bytes type-casted
@@ -120,6 +120,8 @@ static const uint32_t BECV = 1; // dummy value to check endianes
 // you can't/don't want to read data portion-wise.
 // Once a block-buffer is completly populated, the function should set 
 // p_block_buf->flags.populated (ommits further MINFS_Read-calls for this block).
+// If a block-cache is used (see MINFS_CacheInit), only whole blocks will be
+// read (data_len == 0).
 //
 // IN:  <p_fs> Pointer to filesystem-info structure (fs_id may be used to select the source)
 //      <block_buf> Pointer to MINFS_block_buf_t structure
@@ -140,6 +142,8 @@ extern int32_t MINFS_Read(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uint
 // If PEC enabled file-systems should be used, flush-write *must* be implemented,
 // as only whole blocks will be written (data_len == 0). No data will be written
 // if PEC is enabled and flush-write is not implemented.
+// If a block-cache is used, only whole blocks will be written as well (data_len == 0),
+// unless the cache was initialized with portion_write (see MINFS_CacheInit).
 // If data was written like requested, the function should reset p_block_buf->flags.changed to
 // signal that there are no more unsaved changes in the block-buffer (ommits
 // further MINFS_Write-calls until changed will be set again).
@@ -159,6 +163,8 @@ extern int32_t MINFS_Write(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uin
 // the block_n of the buffer differs from the one needed to write/read.
 // If this function is not implemented, the buffers must be passed to the
 // MINFS_XXX functions directly.
+// The function will not be called for file-systems with a block-cache, the
+// buffers of the cache will be used instead.
 // If the returned (*pp_block_buf)->block_n != block_n passed to the function,
 // the flags of the buffer will be reset and block_n set. Be sure to initialize
 // buffer structures ( MINFS_InitBlockBuffer ) before using them. Also make sure
@@ -199,6 +205,7 @@ static int32_t File_Seek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *
 static int32_t File_SetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block_buf_t **pp_block_buf);
 static int32_t File_ReadWrite(MINFS_file_t *p_file, void *p_buf, uint32_t *p_len, uint8_t mode, MINFS_block_buf_t **pp_block_buf);
 static int32_t File_HeaderWrite(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t file_id, uint32_t file_size, MINFS_block_buf_t **pp_block_buf);
+static int32_t File_ChainBlock(MINFS_file_t *p_file, uint32_t block_i, MINFS_block_buf_t **pp_block_buf);
 
 // Block chain layer
 static int32_t BlockChain_Seek(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t offset, MINFS_block_buf_t **pp_block_buf);
@@ -212,6 +219,11 @@ static int32_t BlockBuffer_Write(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_bu
 static int32_t BlockBuffer_Read(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uint16_t data_offset, uint16_t data_len);
 static int32_t BlockBuffer_Flush(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf);
 
+// Block-cache layer
+static int32_t Cache_Get(MINFS_fs_t *p_fs, MINFS_block_buf_t **pp_block_buf, uint32_t block_n, uint8_t populate);
+static int32_t Cache_Sync(MINFS_fs_t *p_fs);
+static void Cache_Drop(MINFS_cache_t *p_cache);
+
 
 //------------------------------------------------------------------------------
 //--------------------------- High level functions -----------------------------
@@ -262,6 +274,72 @@ int32_t MINFS_FlushBlockBuffer(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf)
   return BlockBuffer_Flush(p_fs, p_block_buf);
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Attaches a write-back block-cache to a file-system. All block-buffers
+// will be taken from the cache, MINFS_GetBlockBuffer will not be called and
+// buffers passed to the MINFS_XXX functions will be ignored. Changed blocks
+// will be written when their buffer is replaced (least recently used first)
+// or by MINFS_CacheSync, which has to be called at the end of each 
+// MINFS-session instead of MINFS_FlushBlockBuffer.
+// The cache has to be attached before MINFS_Format / MINFS_FSOpen, the 
+// MINFS_Read hook has to support the population of whole blocks.
+// Without portion_write, whole blocks will be written. This saves write calls,
+// but small changes (e.g. a block-pointer) cost a whole block, so that more
+// bytes may be written than without the cache. With portion_write, the
+// changed byte range of each block will be written (not for PEC enabled 
+// file-systems).
+//
+// IN:  <p_fs> Pointer to a fs-structure.
+//      <p_cache> Pointer to a MINFS_cache_t struct, NULL detaches the cache
+//                (call MINFS_CacheSync before!)
+//      <p_block_bufs> Array of block-buffers, the buffer pointers (p_buf) have
+//                     to be set to buffers of at least 2^p_fs->info.block_size bytes.
+//      <num_block_bufs> Number of block-buffers (1 - MINFS_CACHE_MAX_BLOCK_BUFS)
+//      <portion_write> If > 0, the MINFS_Write hook supports portion-writes
+// OUT: 0 on success, else < 0 (MINFS_ERROR_XXXX)
+/////////////////////////////////////////////////////////////////////////////
+int32_t MINFS_CacheInit(MINFS_fs_t *p_fs, MINFS_cache_t *p_cache, MINFS_block_buf_t *p_block_bufs, uint8_t num_block_bufs, uint8_t portion_write){
+  // detach cache?
+  if( p_cache == NULL ){
+    p_fs->p_cache = NULL;
+    return 0;
+  }
+  // valid buffers?
+  if( p_block_bufs == NULL || num_block_bufs < 1 || num_block_bufs > MINFS_CACHE_MAX_BLOCK_BUFS )
+    return MINFS_ERROR_NO_BUFFER;
+  uint8_t i;
+  for(i = 0; i < num_block_bufs; i++){
+    if( p_block_bufs[i].p_buf == NULL )
+      return MINFS_ERROR_NO_BUFFER;
+  }
+  // initialize cache
+  p_cache->p_block_bufs = p_block_bufs;
+  p_cache->num_block_bufs = num_block_bufs;
+  p_cache->portion_write = portion_write;
+  for(i = 0; i < num_block_bufs; i++)
+    p_cache->lru[i] = i;
+  p_cache->hits = 0;
+  p_cache->misses = 0;
+  Cache_Drop(p_cache);
+  // attach cache
+  p_fs->p_cache = p_cache;
+  // success
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Writes all changed blocks of the block-cache.
+// 
+// IN:   <p_fs> Pointer to filesystem-info structure.
+// OUT: 0 on success, else < 0 (MINFS_ERROR_XXXX)
+/////////////////////////////////////////////////////////////////////////////
+int32_t MINFS_CacheSync(MINFS_fs_t *p_fs){
+  // no cache attached?
+  if( p_fs->p_cache == NULL )
+    return 0;
+  return Cache_Sync(p_fs);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Formats a file-system (fs_id): [FS-header : block-map : data-blocks]
 // The file starting with data-block 0 will contain the block-pointers to
@@ -348,6 +426,12 @@ int32_t MINFS_FSOpen(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf){
   // prepare fs-struct
   p_fs->info.block_size = 4; // minimal block size
   p_fs->info.flags = 0;
+  // write back changed blocks (e.g. from MINFS_Format) and empty the block-cache
+  if( p_fs->p_cache != NULL ){
+    if( status = Cache_Sync(p_fs) )
+      return status; // return error status
+    Cache_Drop(p_fs->p_cache);
+  }
   // get buffer
   if( status = BlockBuffer_Get(p_fs, &p_block_buf, 0, MINFS_FILE_NULL, 0) )
     return status; // return error status
@@ -364,6 +448,9 @@ int32_t MINFS_FSOpen(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf){
   // convert words from little-endian to platform's format
   BE_SWAP_32(p_fs->info.num_blocks);
   BE_SWAP_16(p_fs->info.os_flags);
+  // the header block was read with the minimal block size, drop it
+  if( p_fs->p_cache != NULL )
+    Cache_Drop(p_fs->p_cache);
   // calculate and validate fs-params
   if( status = CalcFSParams(p_fs) )
     return status;
@@ -481,6 +568,37 @@ int32_t MINFS_FileSetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block_b
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Assigns a block-chain index to an opened file. The block numbers of the 
+// file's blocks will be stored in the index while the block-chain is walked, 
+// so that seeking does not have to walk the chain again. Has to be called 
+// after each MINFS_FileOpen. The index is only valid as long as the file is
+// not resized by another MINFS_file_t struct.
+// 
+// IN:  <p_file> Pointer to a populated MINFS_file_t struct (use MINFS_FileOpen)
+//      <p_chain_index> Array for the block numbers, NULL removes the index
+//      <chain_index_size> Number of entries p_chain_index can hold, blocks
+//                         beyond will be found by walking the chain from the
+//                         last indexed block
+// OUT: 0 on success, on error MINFS_ERROR_XXXX
+/////////////////////////////////////////////////////////////////////////////
+int32_t MINFS_FileSetChainIndex(MINFS_file_t *p_file, uint32_t *p_chain_index, uint16_t chain_index_size){
+  if( p_chain_index == NULL || chain_index_size == 0 ){
+    p_file->p_chain_index = NULL;
+    p_file->chain_index_size = 0;
+    p_file->chain_index_len = 0;
+    return 0;
+  }
+  // the first block is known already
+  p_chain_index[0] = p_file->first_block_n;
+  p_file->p_chain_index = p_chain_index;
+  p_file->chain_index_size = chain_index_size;
+  p_file->chain_index_len = 1;
+  // success
+  return 0;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // Creates a non-existing file with size 0.
 // 
@@ -839,7 +957,7 @@ static int32_t File_SetFilePointer(MINFS_file_t *p_file_0, uint32_t file_id, uin
 /////////////////////////////////////////////////////////////////////////////
 static int32_t File_Unlink(MINFS_file_t *p_file_0, uint32_t file_id, MINFS_block_buf_t **pp_block_buf){
   // get pointer to file
-  uint32_t file_bp;
+  int32_t file_bp;
   if( (file_bp = File_GetFilePointer(p_file_0, file_id, pp_block_buf)) < 0)
     return file_bp; // return error status
   // set file pointer to MINFS_BLOCK_EOC
@@ -921,6 +1039,9 @@ static int32_t File_Open(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t file_id, M
   p_file->data_ptr_block_offset = sizeof(MINFS_file_header_t);
   p_file->first_block_n = block_n;
   p_file->p_fs = p_fs;
+  p_file->p_chain_index = NULL;
+  p_file->chain_index_size = 0;
+  p_file->chain_index_len = 0;
   // success
   return 0;
 }
@@ -940,7 +1061,7 @@ static int32_t File_Seek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *
   if( pos == p_file->data_ptr )
     return 0;
   int32_t ret_status = 0;
-  uint32_t seek_start_data_ptr;
+  uint32_t seek_start_block_i;
   uint32_t seek_start_block_n;
   // move forward ?
   if( pos > p_file->data_ptr ){
@@ -961,8 +1082,8 @@ static int32_t File_Seek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *
       p_file->data_ptr = pos;
       return ret_status;
     } 
-    // seek from current position
-    seek_start_data_ptr = p_file->data_ptr;
+    // seek from current block
+    seek_start_block_i = (p_file->data_ptr + sizeof(MINFS_file_header_t) - p_file->data_ptr_block_offset) / p_file->p_fs->calc.block_data_len;
     seek_start_block_n = p_file->current_block_n;
   } else {
     // still in current buffer ?
@@ -972,14 +1093,24 @@ static int32_t File_Seek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *
       return ret_status;
     }
     // seek from start
-    seek_start_data_ptr = 0;
+    seek_start_block_i = 0;
     seek_start_block_n = p_file->first_block_n;
   }
-  // calculate block offset and seek
-  uint32_t block_n_offset = (pos + sizeof(MINFS_file_header_t)) / p_file->p_fs->calc.block_data_len 
-      - ( seek_start_data_ptr + sizeof(MINFS_file_header_t)) /  p_file->p_fs->calc.block_data_len;
+  // calculate target block and offset. If the file ends at a block end, the
+  // end of the file is at the end of the last block (there's no next block).
+  uint32_t block_i = (pos + sizeof(MINFS_file_header_t)) / p_file->p_fs->calc.block_data_len;
+  uint32_t block_offset = (pos + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len;
+  if( block_offset == 0 && pos == p_file->info.size ){
+    block_i--;
+    block_offset = p_file->p_fs->calc.block_data_len;
+  }
+  // seek, with a chain-index the block may be known already
   int32_t status;
-  if( (status = BlockChain_Seek(p_file->p_fs, seek_start_block_n, block_n_offset, pp_block_buf)) < 0)
+  if( p_file->p_chain_index != NULL )
+    status = File_ChainBlock(p_file, block_i, pp_block_buf);
+  else
+    status = BlockChain_Seek(p_file->p_fs, seek_start_block_n, block_i - seek_start_block_i, pp_block_buf);
+  if( status < 0 )
     return status; // return error status
   // if EOC, the file's block chain is broken
   if( status == MINFS_BLOCK_EOC )
@@ -987,7 +1118,7 @@ static int32_t File_Seek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *
   // update *p_file fields
   p_file->current_block_n = status;
   p_file->data_ptr = pos;
-  p_file->data_ptr_block_offset = (pos + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len;
+  p_file->data_ptr_block_offset = block_offset;
   // success
   return ret_status; // return 0 or EOF
 }
@@ -1006,17 +1137,18 @@ static int32_t File_SetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block
   // already right size?
   if( p_file->info.size == new_size )
     return 0;
-  uint16_t current_size_block_offset = ( (p_file->info.size + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len ) + 1;
+  // number of blocks used by the file (header + data) before and after resizing
+  uint16_t block_data_len = p_file->p_fs->calc.block_data_len;
+  uint32_t num_blocks = (p_file->info.size + sizeof(MINFS_file_header_t) + block_data_len - 1) / block_data_len;
+  uint32_t new_num_blocks = (new_size + sizeof(MINFS_file_header_t) + block_data_len - 1) / block_data_len;
   // shrink file ?
   if( new_size < p_file->info.size ){
     // truncate blocks ?
-    if( (p_file->info.size - new_size) >= current_size_block_offset ){
+    if( new_num_blocks < num_blocks ){
       int32_t new_last_block_n;
       int32_t fbc_cont_block;
       // find new last block
-      uint32_t new_num_blocks = ( new_size + sizeof(MINFS_file_header_t)) / p_file->p_fs->calc.block_data_len
-        + ( ( new_size + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len ) ? 1 : 0;
-      if( (new_last_block_n = BlockChain_Seek(p_file->p_fs, p_file->first_block_n, new_num_blocks - 1, pp_block_buf)) < 0 )
+      if( (new_last_block_n = File_ChainBlock(p_file, new_num_blocks - 1, pp_block_buf)) < 0 )
         return new_last_block_n; // return error status
       // if EOC, the file's block chain is broken
       if( new_last_block_n == MINFS_BLOCK_EOC )
@@ -1026,7 +1158,7 @@ static int32_t File_SetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block
         return fbc_cont_block; // return error status
       // if EOC, the file's block chain is broken
       if( fbc_cont_block == MINFS_BLOCK_EOC )
-	return fbc_cont_block;
+	return MINFS_ERROR_FILE_CHAIN;
       // cut block chain
       int32_t status;
       if( status = BlockChain_Link(p_file->p_fs, new_last_block_n, MINFS_BLOCK_EOC, pp_block_buf) )
@@ -1034,6 +1166,9 @@ static int32_t File_SetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block
       // push cut-off free blocks
       if( status = BlockChain_PushFree(p_file->p_fs, fbc_cont_block, pp_block_buf) )
         return status; // return error status
+      // forget the cut-off blocks in the chain-index
+      if( p_file->chain_index_len > new_num_blocks )
+        p_file->chain_index_len = new_num_blocks;
       // set new current-block to new last block if data_ptr is beyond file size
       if( p_file->data_ptr > new_size )
 	p_file->current_block_n = new_last_block_n;
@@ -1041,33 +1176,29 @@ static int32_t File_SetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block
     // set new data_ptr and calc block offset if data_ptr is beyond file size
     if( p_file->data_ptr > new_size ){
       p_file->data_ptr = new_size;
-      p_file->data_ptr_block_offset = ( new_size + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len;
+      p_file->data_ptr_block_offset = ( new_size + sizeof(MINFS_file_header_t)) % block_data_len;
       // we are at the end of the file, if data_ptr_block_offset is 0, this means we'r at the end of the last block,
       // the correct offset is block_data_len
       if( p_file->data_ptr_block_offset == 0 )
-        p_file->data_ptr_block_offset = p_file->p_fs->calc.block_data_len;
+        p_file->data_ptr_block_offset = block_data_len;
     }
   }else{// extend file
     // add blocks ?
-    if( (new_size - p_file->info.size + current_size_block_offset) >  p_file->p_fs->calc.block_data_len ){
+    if( new_num_blocks > num_blocks ){
       // find last block of file
       int32_t file_last_block_n;
-      if( (file_last_block_n = BlockChain_Seek(p_file->p_fs, p_file->current_block_n, MINFS_SEEK_END, pp_block_buf)) < 0 )
+      if( p_file->p_chain_index != NULL )
+        file_last_block_n = File_ChainBlock(p_file, num_blocks - 1, pp_block_buf);
+      else
+        file_last_block_n = BlockChain_Seek(p_file->p_fs, p_file->current_block_n, MINFS_SEEK_END, pp_block_buf);
+      if( file_last_block_n < 0 )
         return file_last_block_n; // return error status
+      // if EOC, the file's block chain is broken
+      if( file_last_block_n == MINFS_BLOCK_EOC )
+	return MINFS_ERROR_FILE_CHAIN;
       // pop free blocks
-      /*
-      uint32_t add_blocks_count = ( new_size + sizeof(MINFS_file_header_t)) / p_file->p_fs->calc.block_data_len
-        + ( ( new_size + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len ) ? 1 : 0
-        - ( p_file->info.size + sizeof(MINFS_file_header_t)) / p_file->p_fs->calc.block_data_len
-        - ( ( p_file->info.size + sizeof(MINFS_file_header_t)) % p_file->p_fs->calc.block_data_len ) ? 1 : 0;
-      */
-      uint32_t add_bytes_count = (new_size - p_file->info.size);
-      uint32_t last_block_bytes_left = (p_file->p_fs->calc.block_data_len -(sizeof(MINFS_file_header_t) + p_file->info.size) % p_file->p_fs->calc.block_data_len);
-      uint32_t add_block_bytes_count = (add_bytes_count - last_block_bytes_left );
-      uint32_t add_blocks_count = add_block_bytes_count / p_file->p_fs->calc.block_data_len + 1;
-
       int32_t add_blocks_first_n;
-      if( (add_blocks_first_n = BlockChain_PopFree(p_file->p_fs, add_blocks_count, pp_block_buf)) < 0)
+      if( (add_blocks_first_n = BlockChain_PopFree(p_file->p_fs, new_num_blocks - num_blocks, pp_block_buf)) < 0)
         return add_blocks_first_n; // return error status
       // add free blocks to files block-chain
       int32_t status;
@@ -1141,7 +1272,12 @@ static int32_t File_ReadWrite(MINFS_file_t *p_file, void *p_buf, uint32_t *p_len
     // switch current block?
     if( ( (p_file->data_ptr_block_offset + delta) >=  p_file->p_fs->calc.block_data_len) && remain ){
       int32_t new_current_block_n;
-      if( (new_current_block_n = BlockChain_Seek(p_file->p_fs, p_file->current_block_n, 1, pp_block_buf)) < 0 )
+      if( p_file->p_chain_index != NULL ) // next block may be known by the chain-index
+        new_current_block_n = File_ChainBlock(p_file, (p_file->data_ptr + sizeof(MINFS_file_header_t) - p_file->data_ptr_block_offset) 
+          / p_file->p_fs->calc.block_data_len + 1, pp_block_buf);
+      else
+        new_current_block_n = BlockChain_Seek(p_file->p_fs, p_file->current_block_n, 1, pp_block_buf);
+      if( new_current_block_n < 0 )
         return new_current_block_n; // return error status
       if( new_current_block_n == MINFS_BLOCK_EOC )
         return MINFS_ERROR_FILE_CHAIN; // file chain is broken
@@ -1185,6 +1321,39 @@ static int32_t File_HeaderWrite(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t fil
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Returns the block number of the file's block <block_i>. If the file has 
+// a chain-index, known blocks will be taken from the index, else the chain
+// will be walked from the last known block and the index will be extended.
+// Without a chain-index, the chain will be walked from the first block.
+//
+// IN:  <p_file> Pointer to a populated MINFS_file_t struct
+//      <block_i> Index of the block in the file's block chain (0: first block)
+//      <pp_block_buf> Pointer to a Buffer-struct pointer
+// OUT: block number on success (may be MINFS_BLOCK_EOC), else < 0 (MINFS_ERROR_XXXX)
+/////////////////////////////////////////////////////////////////////////////
+static int32_t File_ChainBlock(MINFS_file_t *p_file, uint32_t block_i, MINFS_block_buf_t **pp_block_buf){
+  // no chain-index: walk the chain
+  if( p_file->p_chain_index == NULL )
+    return BlockChain_Seek(p_file->p_fs, p_file->first_block_n, block_i, pp_block_buf);
+  // block is known already?
+  if( block_i < p_file->chain_index_len )
+    return p_file->p_chain_index[block_i];
+  // walk the chain from the last known block, add the blocks to the index
+  uint32_t i = p_file->chain_index_len - 1;
+  int32_t block_n = p_file->p_chain_index[i];
+  while( i < block_i ){
+    if( (block_n = BlockChain_Seek(p_file->p_fs, block_n, 1, pp_block_buf)) <= 0 )
+      return block_n; // return error status or EOC
+    if( ++i < p_file->chain_index_size ){
+      p_file->p_chain_index[i] = block_n;
+      p_file->chain_index_len = i + 1;
+    }
+  }
+  return block_n;
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // Pops num_block from the free-block-chain and returns the first block number.
 //
@@ -1241,11 +1410,11 @@ static int32_t BlockChain_PushFree(MINFS_fs_t *p_fs, uint32_t start_block, MINFS
   if( start_block < p_fs->calc.first_datablock_n || start_block >= p_fs->info.num_blocks )
     return MINFS_ERROR_BLOCK_N;
   // find last block of the chain
-  uint32_t end_block;
+  int32_t end_block;
   if( (end_block = BlockChain_Seek(p_fs, start_block, MINFS_SEEK_END, pp_block_buf)) < 0 )
     return end_block; // return error status
   // find the second element in the free-blocks chain
-  uint32_t fbc_cont_block;
+  int32_t fbc_cont_block;
   if( (fbc_cont_block = BlockChain_Seek(p_fs, p_fs->info.num_blocks, 1, pp_block_buf)) < 0 )
     return fbc_cont_block; // return error status
   // link fbc first (virtual) block to start_block
@@ -1277,7 +1446,12 @@ static int32_t BlockChain_Seek(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t offs
   uint32_t block_chain_block_n, last_block_n;
   uint16_t block_chain_entry_offset;
   int32_t status;
+  uint8_t seek_end = (offset == MINFS_SEEK_END);
+  uint32_t steps = 0;
   while( offset > 0 ){
+    // a chain can't be longer than the number of blocks (+ the virtual block), else it's a loop
+    if( ++steps > p_fs->info.num_blocks + 1 )
+      return MINFS_ERROR_FILE_CHAIN;
     // calculate block and offset where the next block-pointer is stored
     block_chain_entry_offset = sizeof(MINFS_fs_header_t) + p_fs->calc.bp_size * (block_n - p_fs->calc.first_datablock_n); // chain-pointer offset from beginning of fs
     block_chain_block_n = block_chain_entry_offset / p_fs->calc.block_data_len; // block where the chain pointer resides
@@ -1294,7 +1468,7 @@ static int32_t BlockChain_Seek(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t offs
     // check if EOC
     if( block_n == MINFS_BLOCK_EOC ){
       // if seek-end requested, return the last block number
-      if( offset = MINFS_SEEK_END )
+      if( seek_end )
         return last_block_n;
       // offset was not reached, return EOC
       return MINFS_BLOCK_EOC;
@@ -1353,6 +1527,9 @@ static int32_t BlockChain_Link(MINFS_fs_t *p_fs, uint32_t block_n, uint32_t bloc
 /////////////////////////////////////////////////////////////////////////////
 static int32_t BlockBuffer_Get(MINFS_fs_t *p_fs, MINFS_block_buf_t **pp_block_buf, uint32_t block_n, uint32_t file_id, uint8_t populate){
   int32_t status;
+  // take the buffer from the block-cache if there is one
+  if( p_fs->p_cache != NULL )
+    return Cache_Get(p_fs, pp_block_buf, block_n, populate);
   // return if buffer is already valid (right block number, poplulated if this was requested)
   if(
     (*pp_block_buf != NULL) && 
@@ -1403,8 +1580,14 @@ static int32_t BlockBuffer_Flush(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_bu
   // NOTE: MINFS_Write has to reset the changed flag!
   if( p_block_buf->flags.changed ){
     int32_t status;
-    if( status = BlockBuffer_Write(p_fs, p_block_buf, 0, 0) )
-      return status; // return error status
+    // with a block-cache and portion-writes, write the changed byte range only
+    if( p_fs->p_cache != NULL && p_fs->p_cache->portion_write && !(p_fs->info.flags & MINFS_FLAGMASK_PEC) ){
+      if( status = MINFS_Write(p_fs, p_block_buf, p_block_buf->changed_offset, p_block_buf->changed_end - p_block_buf->changed_offset) )
+        return status; // return error status
+    } else {
+      if( status = BlockBuffer_Write(p_fs, p_block_buf, 0, 0) )
+        return status; // return error status
+    }
   }
   return 0;
 }
@@ -1426,9 +1609,24 @@ static int32_t BlockBuffer_Flush(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_bu
 // OUT: 0 on success, on error < 0 (MINFS_ERROR_XXXX)
 /////////////////////////////////////////////////////////////////////////////
 static int32_t BlockBuffer_Write(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf, uint16_t data_offset, uint16_t data_len){
+  // with a block-cache, extend the changed byte range of the buffer
+  if( p_fs->p_cache != NULL && data_len ){
+    if( !p_block_buf->flags.changed ){
+      p_block_buf->changed_offset = data_offset;
+      p_block_buf->changed_end = data_offset + data_len;
+    } else {
+      if( data_offset < p_block_buf->changed_offset )
+        p_block_buf->changed_offset = data_offset;
+      if( data_offset + data_len > p_block_buf->changed_end )
+        p_block_buf->changed_end = data_offset + data_len;
+    }
+  }
   // set the changed-flag
   // NOTE: MINFS_Write has to reset the changed flag!
   p_block_buf->flags.changed = 1;
+  // with a block-cache, changed blocks will be written when they are replaced or synced
+  if( p_fs->p_cache != NULL && data_len )
+    return 0;
   // if PEC is enabled, only whole-block-writes (flush) will be forwarded
   if( p_fs->info.flags & MINFS_FLAGMASK_PEC ){
     if( data_len )
@@ -1466,7 +1664,8 @@ static int32_t BlockBuffer_Read(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf
   if( p_block_buf->flags.populated )
     return 0;
   // If PEC is enabled, only reads of a whole block are valid (populate)
-  if( p_fs->info.flags & MINFS_FLAGMASK_PEC ){
+  // With a block-cache, whole blocks will be read to keep them in the cache
+  if( (p_fs->info.flags & MINFS_FLAGMASK_PEC) || p_fs->p_cache != NULL ){
     data_len = 0;
     data_offset = 0;
   }
@@ -1487,12 +1686,90 @@ static int32_t BlockBuffer_Read(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf
 }
 
 
+//-----------------------------------------------------------------------------
+//----------------------------- Block-cache layer -----------------------------
+//-----------------------------------------------------------------------------
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Returns the cached buffer for block_n. If the block is not in the cache,
+// the least recently used buffer will be replaced (written before if it was
+// changed).
+// 
+// IN:  <p_fs> Pointer to a populated fs-structure with a block-cache
+//      <block_buf> Pointer to a MINFS_block_buf_t pointer
+//      <block_n> Block number the buffer is used for
+//      <populate> If > 0, the returned buffer must be populated (for writes) 
+// OUT: 0 on success, on error < 0 (MINFS_ERROR_XXXX)
+/////////////////////////////////////////////////////////////////////////////
+static int32_t Cache_Get(MINFS_fs_t *p_fs, MINFS_block_buf_t **pp_block_buf, uint32_t block_n, uint8_t populate){
+  MINFS_cache_t *p_cache = p_fs->p_cache;
+  MINFS_block_buf_t *p_block_buf;
+  int32_t status;
+  uint8_t i, buf_i;
+  // search block, most recently used first
+  for(i = 0; i < p_cache->num_block_bufs; i++){
+    buf_i = p_cache->lru[i];
+    if( p_cache->p_block_bufs[buf_i].block_n == block_n )
+      break;
+  }
+  if( i < p_cache->num_block_bufs ){
+    p_block_buf = &(p_cache->p_block_bufs[buf_i]);
+    p_cache->hits++;
+  } else {
+    // not cached, replace the least recently used buffer
+    i = p_cache->num_block_bufs - 1;
+    buf_i = p_cache->lru[i];
+    p_block_buf = &(p_cache->p_block_bufs[buf_i]);
+    // write the old block if it was changed
+    if( status = BlockBuffer_Flush(p_fs, p_block_buf) )
+      return status; // return error status
+    p_block_buf->flags.ALL = 0;
+    p_block_buf->block_n = block_n;
+    p_cache->misses++;
+  }
+  // move buffer to the front of the LRU list
+  memmove(&(p_cache->lru[1]), &(p_cache->lru[0]), i);
+  p_cache->lru[0] = buf_i;
+  *pp_block_buf = p_block_buf;
+  // populate the buffer if requested and not already populated
+  if( populate && !p_block_buf->flags.populated ){
+    if( status = BlockBuffer_Read(p_fs, p_block_buf, 0, 0) )
+      return status; // return error status
+  }
+  // success
+  return 0;
+}
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Writes all changed buffers of the block-cache.
+// 
+// IN:  <p_fs> Pointer to a populated fs-structure with a block-cache
+// OUT: 0 on success, on error < 0 (MINFS_ERROR_XXXX)
+/////////////////////////////////////////////////////////////////////////////
+static int32_t Cache_Sync(MINFS_fs_t *p_fs){
+  MINFS_cache_t *p_cache = p_fs->p_cache;
+  int32_t status;
+  uint8_t i;
+  for(i = 0; i < p_cache->num_block_bufs; i++){
+    if( status = BlockBuffer_Flush(p_fs, &(p_cache->p_block_bufs[i])) )
+      return status; // return error status
+  }
+  // success
+  return 0;
+}
 
 
-
+/////////////////////////////////////////////////////////////////////////////
+// Empties the block-cache without writing changed buffers.
+// 
+// IN:  <p_cache> Pointer to a block-cache
+/////////////////////////////////////////////////////////////////////////////
+static void Cache_Drop(MINFS_cache_t *p_cache){
+  uint8_t i;
+  for(i = 0; i < p_cache->num_block_bufs; i++)
+    MINFS_InitBlockBuffer(&(p_cache->p_block_bufs[i]));
+}
 
 
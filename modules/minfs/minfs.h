@@ -80,6 +80,9 @@
 #define MINFS_MODE_FFID_NEXT 0
 #define MINFS_MODE_FFID_FIRST 0
 
+// maximum number of block-buffers of a block-cache
+#define MINFS_CACHE_MAX_BLOCK_BUFS 16
+
 
 
 
@@ -109,10 +112,14 @@ typedef struct{
  } MINFS_fs_calc_t;
 
 
+// optional write-back block-cache (see MINFS_CacheInit)
+typedef struct MINFS_cache_s MINFS_cache_t;
+
 typedef struct{
   MINFS_fs_info_t info;
   uint8_t fs_id; // remember fs_id value (identifies the fs on OS level)
   MINFS_fs_calc_t calc; // values calculated once at fs-info-get / format
+  MINFS_cache_t *p_cache; // block-cache, NULL if not used
 } MINFS_fs_t;
 
 typedef struct{
@@ -133,6 +140,9 @@ typedef struct{
   uint32_t current_block_n; // current block number
   uint32_t data_ptr_block_offset; // data pointer offset in the current block
   uint32_t first_block_n; // first block of the file
+  uint32_t *p_chain_index; // optional: block numbers of the file's blocks (see MINFS_FileSetChainIndex)
+  uint16_t chain_index_size; // number of entries p_chain_index can hold
+  uint16_t chain_index_len; // number of valid entries in p_chain_index
 } MINFS_file_t;
 
 // structure to hold information about a block-buffer
@@ -146,14 +156,30 @@ typedef struct{
       };
     uint8_t ALL;
   } flags;
+  uint16_t changed_offset; // block-cache: first changed byte (valid if flags.changed is set)
+  uint16_t changed_end; // block-cache: end of the changed byte range
 } MINFS_block_buf_t;
 
+// block-cache: block-buffers with LRU replacement, changed buffers will be
+// written when they are replaced or on MINFS_CacheSync
+struct MINFS_cache_s{
+  MINFS_block_buf_t *p_block_bufs; // block-buffers, p_buf has to be set by the caller
+  uint8_t num_block_bufs; // number of block-buffers (1 - MINFS_CACHE_MAX_BLOCK_BUFS)
+  uint8_t portion_write; // MINFS_Write supports portion-writes, only changed byte ranges will be written
+  uint8_t lru[MINFS_CACHE_MAX_BLOCK_BUFS]; // buffer indices, most recently used first
+  uint32_t hits; // statistics: number of requests served from the cache
+  uint32_t misses; // statistics: number of requests which needed a buffer replacement
+};
+
 /////////////////////////////////////////////////////////////////////////////
 // High level functions
 /////////////////////////////////////////////////////////////////////////////
 extern int32_t MINFS_InitBlockBuffer(MINFS_block_buf_t *p_block_buf);
 extern int32_t MINFS_FlushBlockBuffer(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf);
 
+extern int32_t MINFS_CacheInit(MINFS_fs_t *p_fs, MINFS_cache_t *p_cache, MINFS_block_buf_t *p_block_bufs, uint8_t num_block_bufs, uint8_t portion_write);
+extern int32_t MINFS_CacheSync(MINFS_fs_t *p_fs);
+
 extern int32_t MINFS_Format(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf);
 
 extern int32_t MINFS_FSOpen(MINFS_fs_t *p_fs, MINFS_block_buf_t *p_block_buf);
@@ -164,6 +190,7 @@ extern int32_t MINFS_FileRead(MINFS_file_t *p_file, void *p_buf, uint32_t *p_len
 extern int32_t MINFS_FileWrite(MINFS_file_t *p_file, void *p_buf, uint32_t len, MINFS_block_buf_t *p_block_buf);
 extern int32_t MINFS_FileSeek(MINFS_file_t *p_file, uint32_t pos, MINFS_block_buf_t *p_block_buf);
 extern int32_t MINFS_FileSetSize(MINFS_file_t *p_file, uint32_t new_size, MINFS_block_buf_t *p_block_buf);
+extern int32_t MINFS_FileSetChainIndex(MINFS_file_t *p_file, uint32_t *p_chain_index, uint16_t chain_index_size);
 
 extern int32_t MINFS_FileTouch(MINFS_fs_t *p_fs, uint32_t file_id, MINFS_block_buf_t *p_block_buf);
 extern int32_t MINFS_FileUnlink(MINFS_fs_t *p_fs, uint32_t file_id, uint8_t check_last_truncate, MINFS_block_buf_t *block_buf);
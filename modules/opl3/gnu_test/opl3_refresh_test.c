@@ -0,0 +1,381 @@
+// Host test of the register refresh of the OPL3 driver
+//
+// GPIOE is decoded like the chips see it: while the chip select of a chip
+// is low, A0=0 latches the address and A0=1 writes the data byte into that
+// register. A random session of OPL3_Set*() calls is replayed, with
+// OPL3_OnFrame() called after every few of them, without and with a frame
+// budget. The test marks every register whose copy in opl3_operators,
+// opl3_channels or opl3_chip has been changed as pending, and checks:
+// - a frame writes only pending registers, each once, and as many of them
+//   as the budget allows; OPL3_OnFrame() returns 1 if some are left
+// - a key-on (rising key-on bit of 0xB0, or a rising drum bit of 0xBD) is
+//   never written while a register with patch data of its channel which
+//   has been changed before the key-on is still pending, also if the
+//   budget spread them over several frames
+// - the total number of writes is the number of registers which became
+//   pending, and after the last frame the registers of the chips match
+//   the driver's copies
+
+// static variables of the driver are checked directly
+#include "../opl3.c"
+
+#define NUM_FRAMES 20000
+#define MAX_CHANGES_PER_FRAME 8
+
+// register of a chip: bank (0x000 or 0x100) + address
+#define REG(chip, bank, addr) (((chip)*2 + (bank))*256 + (addr))
+#define NUM_REGS (OPL3_COUNT*512)
+
+GPIO_TypeDef gpiob, gpioe;
+
+static u32 errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++errors; } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Chips
+/////////////////////////////////////////////////////////////////////////////
+
+static u8 chip_regs[NUM_REGS];
+static u16 chip_addr[OPL3_COUNT];
+static u32 last_odr;
+static u32 irq_nested;
+
+static u8 checking;
+static u8 pending[NUM_REGS];
+static u32 pending_since[NUM_REGS]; // session time when it became pending
+static u32 num_pending;
+static u32 num_marked;
+static u32 num_writes;
+
+static u32 session_time;
+static u32 keyon_time[18*OPL3_COUNT]; // of the last rising key-on bit
+static u32 drum_time[OPL3_COUNT];     // of the last rising drum bit
+
+// actual OPL3 channel of the channels of the driver (table in opl3.h)
+static const u8 actual_chan[18] = { 0, 3, 1, 4, 2, 5, 9, 12, 10, 13, 11, 14, 15, 16, 17, 6, 7, 8 };
+
+static u16 op_reg(u8 op, u8 reg)
+{
+  static const u8 base[5] = { 0x20, 0x40, 0x60, 0x80, 0xe0 };
+  u8 ac = actual_chan[(op % 36) / 2];
+  u8 c = ac % 9;
+  return REG(op / 36, ac / 9, base[reg] + (c / 3)*8 + (c % 3) + (op & 1)*3);
+}
+
+static u16 chan_reg(u8 chan, u8 reg)
+{
+  u8 ac = actual_chan[chan % 18];
+  return REG(chan / 18, ac / 9, 0xa0 + reg*0x10 + (ac % 9));
+}
+
+static u16 chip_reg(u8 chip, u8 reg)
+{
+  static const u16 addr[4] = { 0x105, 0x008, 0x0bd, 0x104 };
+  return REG(chip, 0, 0) + addr[reg];
+}
+
+// no register with patch data of the channel may be older than the key-on
+static void check_patch_written(u8 chan, u32 keyon, u8 with_b0, const char *what)
+{
+  u16 regs[32];
+  int num = 0, i, r;
+  u8 chip = chan / 18;
+
+  u8 last = (OPL3_IsChannel4Op(chan) == 1) ? chan+1 : chan;
+  u8 c;
+  for(c=chan; c<=last; ++c) {
+    for(r=0; r<5; ++r) {
+      regs[num++] = op_reg(2*c, r);
+      regs[num++] = op_reg(2*c+1, r);
+    }
+    regs[num++] = chan_reg(c, 0);
+    regs[num++] = chan_reg(c, 2);
+    if( with_b0 )
+      regs[num++] = chan_reg(c, 1);
+  }
+  regs[num++] = chip_reg(chip, 0);
+  regs[num++] = chip_reg(chip, 1);
+  regs[num++] = chip_reg(chip, 3);
+
+  for(i=0; i<num; ++i)
+    CHECK(!pending[regs[i]] || pending_since[regs[i]] > keyon,
+	  "%s of channel %d written before register %03x changed at %u (key-on at %u)",
+	  what, chan, regs[i], (unsigned)pending_since[regs[i]], (unsigned)keyon);
+}
+
+static void chip_write(u8 chip, u16 addr, u8 data)
+{
+  u16 r = REG(chip, 0, 0) + addr;
+
+  ++num_writes;
+  CHECK(irq_nested, "register %03x written with interrupts enabled", addr);
+
+  if( checking ) {
+    CHECK(pending[r], "chip %d register %03x written without a change", chip, addr);
+
+    if( addr >= 0xb0 && addr <= 0xb8 && (data & 0x20) && !(chip_regs[r] & 0x20) ) {
+      u8 chan;
+      for(chan=0; actual_chan[chan] != addr - 0xb0; ++chan);
+      chan += chip*18;
+      check_patch_written(chan, keyon_time[chan], 0, "key-on");
+    }
+
+    if( addr == 0x0bd && (data & ~chip_regs[r] & 0x1f) ) {
+      u8 chan;
+      for(chan=15; chan<18; ++chan)
+	check_patch_written(chip*18 + chan, drum_time[chip], 1, "drum key-on");
+    }
+
+    if( pending[r] ) {
+      pending[r] = 0;
+      --num_pending;
+    }
+  }
+
+  chip_regs[r] = data;
+}
+
+// decodes the chip selects, address and data lines
+static void bus_sample(void)
+{
+  u32 odr = gpioe.ODR;
+  if( odr == last_odr )
+    return;
+  last_odr = odr;
+
+  u8 chip;
+  for(chip=0; chip<OPL3_COUNT; ++chip) {
+    if( odr & OPL3CSMasks[chip] )
+      continue;
+    if( !(odr & (1 << 6)) )
+      chip_addr[chip] = (((odr >> 7) & 1) << 8) | ((odr >> 8) & 0xff);
+    else
+      chip_write(chip, chip_addr[chip], (odr >> 8) & 0xff);
+  }
+}
+
+GPIO_TypeDef *OPL3_TEST_BusAccess(void)
+{
+  bus_sample();
+  return &gpioe;
+}
+
+s32 MIOS32_DELAY_Wait_uS(u16 uS)
+{
+  bus_sample();
+  return 0;
+}
+
+void MIOS32_SYS_STM_PINSET(GPIO_TypeDef *port, u32 pin, u8 value)
+{
+  if( port == OPL3_RS_PORT && pin == OPL3_RS_PIN && !value )
+    memset(chip_regs, 0, sizeof(chip_regs));
+}
+
+s32 MIOS32_IRQ_Disable(void)
+{
+  ++irq_nested;
+  return 0;
+}
+
+s32 MIOS32_IRQ_Enable(void)
+{
+  CHECK(irq_nested, "interrupts enabled without having been disabled");
+  if( irq_nested )
+    --irq_nested;
+  return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Session
+/////////////////////////////////////////////////////////////////////////////
+
+static u32 rnd_seed = 1;
+static u32 rnd(u32 n)
+{
+  rnd_seed = rnd_seed * 1103515245 + 12345;
+  return (rnd_seed >> 8) % n;
+}
+
+static void mark(u16 r)
+{
+  if( !pending[r] ) {
+    pending[r] = 1;
+    pending_since[r] = session_time;
+    ++num_pending;
+    ++num_marked;
+  }
+}
+
+static void random_change(void)
+{
+  static opl3_operator_t operators[36*OPL3_COUNT];
+  static opl3_channel_t channels[18*OPL3_COUNT];
+  static opl3_chip_t chips[OPL3_COUNT];
+  u8 op = rnd(36*OPL3_COUNT);
+  u8 chan = rnd(18*OPL3_COUNT);
+  u8 chip = rnd(OPL3_COUNT);
+  u8 value = rnd(256);
+  int i, r;
+
+  ++session_time;
+  memcpy(operators, opl3_operators, sizeof(operators));
+  memcpy(channels, opl3_channels, sizeof(channels));
+  memcpy(chips, opl3_chip, sizeof(chips));
+
+  switch( rnd(32) ) {
+  case 0:  OPL3_SetFMult(op, value); break;
+  case 1:  OPL3_SetWaveform(op, value); break;
+  case 2:  OPL3_SetVibrato(op, value & 1); break;
+  case 3:  OPL3_SetVolume(op, value); break;
+  case 4:  OPL3_SetTremelo(op, value & 1); break;
+  case 5:  OPL3_SetKSL(op, value); break;
+  case 6:  OPL3_SetAttack(op, value); break;
+  case 7:  OPL3_SetDecay(op, value); break;
+  case 8:  OPL3_DoSustain(op, value & 1); break;
+  case 9:  OPL3_SetSustain(op, value); break;
+  case 10: OPL3_SetRelease(op, value); break;
+  case 11: OPL3_SetKSR(op, value & 1); break;
+  case 12: case 13: case 14: case 15: OPL3_Gate(chan, 1); break;
+  case 16: case 17: case 18: OPL3_Gate(chan, 0); break;
+  case 19: case 20:
+    // also marks the registers without a change
+    OPL3_SetFrequency(chan, rnd(1024), rnd(8));
+    mark(chan_reg(chan, 0));
+    mark(chan_reg(chan, 1));
+    break;
+  case 21: OPL3_SetFeedback(chan, value); break;
+  case 22: OPL3_SetAlgorithm(chan, value & 3); break;
+  case 23: OPL3_SetDest(chan, value); break;
+  case 24: OPL3_OutLeft(chan, value & 1); break;
+  case 25: OPL3_SetFourOp(chip*18 + 2*rnd(6), rnd(4) == 0); break;
+  case 26: OPL3_SetOpl3Mode(chip, rnd(8) != 0); break;
+  case 27: OPL3_SetNoteSel(chip, value & 1); break;
+  case 28: OPL3_SetVibratoDepth(chip, value & 1); break;
+  case 29: OPL3_SetPercussionMode(chip, rnd(4) != 0); break;
+  case 30: case 31: {
+    static s32 (*const trigger[5])(u8 chip, u8 value) = {
+      OPL3_TriggerBD, OPL3_TriggerSD, OPL3_TriggerTT, OPL3_TriggerHH, OPL3_TriggerCY
+    };
+    trigger[rnd(5)](chip, rnd(2));
+  } break;
+  }
+
+  for(i=0; i<36*OPL3_COUNT; ++i)
+    for(r=0; r<5; ++r)
+      if( operators[i].ALL[r] != opl3_operators[i].ALL[r] )
+	mark(op_reg(i, r));
+  for(i=0; i<18*OPL3_COUNT; ++i) {
+    for(r=0; r<3; ++r)
+      if( channels[i].ALL[r] != opl3_channels[i].ALL[r] )
+	mark(chan_reg(i, r));
+    if( !channels[i].keyon && opl3_channels[i].keyon )
+      keyon_time[i] = session_time;
+  }
+  for(i=0; i<OPL3_COUNT; ++i) {
+    for(r=0; r<4; ++r)
+      if( chips[i].ALL[r] != opl3_chip[i].ALL[r] )
+	mark(chip_reg(i, r));
+    if( opl3_chip[i].ALL[2] & ~chips[i].ALL[2] & 0x1f )
+      drum_time[i] = session_time;
+  }
+}
+
+static s32 frame(u16 max_writes)
+{
+  u32 pending_before = num_pending;
+  u32 writes_before = num_writes;
+  s32 status = OPL3_OnFrame();
+  u32 frame_writes = num_writes - writes_before;
+
+  CHECK(frame_writes == ((pending_before < max_writes) ? pending_before : max_writes),
+	"%u of %u pending registers written with a budget of %u", (unsigned)frame_writes, (unsigned)pending_before, max_writes);
+  CHECK(status == (num_pending > 0), "OnFrame returned %d with %u registers pending", (int)status, (unsigned)num_pending);
+  return status;
+}
+
+static void check_chip_state(const char *what)
+{
+  int i, r;
+  u32 differences = 0;
+
+  for(i=0; i<36*OPL3_COUNT; ++i)
+    for(r=0; r<5; ++r)
+      differences += chip_regs[op_reg(i, r)] != opl3_operators[i].ALL[r];
+  for(i=0; i<18*OPL3_COUNT; ++i)
+    for(r=0; r<3; ++r)
+      differences += chip_regs[chan_reg(i, r)] != opl3_channels[i].ALL[r];
+  for(i=0; i<OPL3_COUNT; ++i)
+    for(r=0; r<4; ++r)
+      differences += chip_regs[chip_reg(i, r)] != opl3_chip[i].ALL[r];
+
+  CHECK(differences == 0, "%s: %u registers of the chips differ from the driver", what, (unsigned)differences);
+}
+
+static void test_session(u16 budget_us)
+{
+  u16 max_writes = budget_us ? (budget_us / OPL3_WRITE_TIME_US) : 0xffff;
+  u32 marked_before = num_marked;
+  u32 writes_before = num_writes;
+  u32 frames = 0, late_frames = 0;
+  int i, n;
+
+  if( !max_writes )
+    max_writes = 1;
+  OPL3_SetFrameBudget(budget_us);
+
+  for(i=0; i<NUM_FRAMES; ++i) {
+    for(n=1+rnd(MAX_CHANGES_PER_FRAME); n; --n)
+      random_change();
+    late_frames += frame(max_writes);
+    ++frames;
+  }
+
+  // the rest has to go out without new changes
+  for(i=0; i<1000 && num_pending; ++i) {
+    frame(max_writes);
+    ++frames;
+  }
+  CHECK(num_pending == 0, "budget %u us: %u registers still pending", budget_us, (unsigned)num_pending);
+  CHECK(num_writes - writes_before == num_marked - marked_before,
+	"budget %u us: %u writes for %u changed registers", budget_us,
+	(unsigned)(num_writes - writes_before), (unsigned)(num_marked - marked_before));
+
+  char what[40];
+  sprintf(what, "budget %u us", budget_us);
+  check_chip_state(what);
+
+  printf("budget %u us: %u writes in %u frames, %u frames with registers left: %s\n",
+	 budget_us, (unsigned)(num_writes - writes_before), (unsigned)frames, (unsigned)late_frames, errors ? "FAILED" : "OK");
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+  // all registers and the demo patch; the chip selects are high at power-on
+  gpioe.ODR = last_odr = 0xffff;
+  OPL3_Init();
+  CHECK(num_writes == OPL3_COUNT*(4 + 36*5 + 18*3 + 3 + 2*3*3*11), "init: %u writes", (unsigned)num_writes);
+  CHECK(irq_nested == 0, "init: interrupts left disabled");
+
+  // the session starts with all registers 0 like the driver's copies
+  memset(chip_regs, 0, sizeof(chip_regs));
+  checking = 1;
+
+  test_session(0);
+  test_session(20 * OPL3_WRITE_TIME_US);
+  test_session(4 * OPL3_WRITE_TIME_US);
+  test_session(1);
+
+  if( errors ) {
+    printf("FAILED with %u errors\n", (unsigned)errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Minimal host replacement of <mios32.h> for the OPL3 driver test:
+// GPIOE is decoded by the test on every access, two chips are configured
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+#define OPL3_COUNT 2
+#define OPL3_CS_PINS  {12,13}
+#define OPL3_CS_MASKS {1<<4,1<<5}
+
+typedef struct {
+  volatile u32 ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+  u32 GPIO_Pin;
+  u32 GPIO_Mode;
+  u32 GPIO_Speed;
+  u32 GPIO_OType;
+} GPIO_InitTypeDef;
+
+// every access of GPIOE lets the test see the previously written value
+extern GPIO_TypeDef gpiob, gpioe;
+extern GPIO_TypeDef *OPL3_TEST_BusAccess(void);
+#define GPIOB (&gpiob)
+#define GPIOE (OPL3_TEST_BusAccess())
+
+#define GPIO_Pin_8 0x0100
+#define GPIO_Mode_OUT 1
+#define GPIO_Speed_50MHz 2
+#define GPIO_OType_PP 0
+#define MIOS32_BOARD_PIN_MODE_OUTPUT_PP 1
+
+#define GPIO_StructInit(i) memset((i), 0, sizeof(GPIO_InitTypeDef))
+#define GPIO_Init(port, i)
+#define MIOS32_BOARD_J10_PinInit(pin, mode)
+#define MIOS32_BOARD_J10_PinSet(pin, value)
+#define MIOS32_MIDI_SendDebugMessage(...)
+#define DEBUG_MSG(...)
+
+// implemented by the test: reset pin, interrupts and time
+extern void MIOS32_SYS_STM_PINSET(GPIO_TypeDef *port, u32 pin, u8 value);
+extern s32 MIOS32_IRQ_Disable(void);
+extern s32 MIOS32_IRQ_Enable(void);
+extern s32 MIOS32_DELAY_Wait_uS(u16 uS);
+
+#endif /* _MIOS32_H */
@@ -44,13 +44,19 @@ opl3_chip_t opl3_chip[OPL3_COUNT];
 // Local variables
 /////////////////////////////////////////////////////////////////////////////
 
-// Queues for what registers need to be updated
-static u16 opl3_op_queue[36*5*OPL3_COUNT];
-static u8 opl3_chan_queue[18*3*OPL3_COUNT];
-static u8 opl3_chip_queue[4*OPL3_COUNT];
-static u16 op_queue_idx;
-static u8 chan_queue_idx;
-static u8 chip_queue_idx;
+// Pending sets for what registers need to be updated: one bit per register,
+// laid out register-major (bit = reg*count + op/chan/chip) so that walking
+// the bits in order writes the registers in ascending address order
+#define OPL3_OP_PENDING_BITS   (5*36*OPL3_COUNT)
+#define OPL3_CHAN_PENDING_BITS (3*18*OPL3_COUNT)
+#define OPL3_CHIP_PENDING_BITS (4*OPL3_COUNT)
+static u32 opl3_op_pending[(OPL3_OP_PENDING_BITS+31)/32];
+static u32 opl3_chan_pending[(OPL3_CHAN_PENDING_BITS+31)/32];
+static u32 opl3_chip_pending[(OPL3_CHIP_PENDING_BITS+31)/32];
+
+// Time OPL3_OnFrame() may spend writing registers, in us (0: unlimited)
+static u16 opl3_frame_budget = OPL3_FRAME_BUDGET_US;
+static u16 opl3_frame_writes; //Writes left in the current frame
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -298,131 +304,101 @@ void OPL3_SendDemoPatch(){
   
 }
 
-u8 toggle;
-s32 OPL3_OnFrame(){
-  u8 op, chan, chip, reg;
-  u16 val, q=0;
-  while(q < op_queue_idx){
-    if(q >= 36*5*OPL3_COUNT){
-      DEBUG_MSG("PANIC!! [opl3.c] Op queue overflow q==%d!", q);
-    }
-    val = opl3_op_queue[q];
-    op = val / 5;
-    reg = val % 5;
-    OPL3_RefreshOperator(op, reg);
-    q++;
-  }
-  op_queue_idx = 0;
-  q = 0;
-  if(chan_queue_idx > 20){
-    DEBUG_MSG("chan_queue_idx=%d", chan_queue_idx);
-  }
-  while(q < chan_queue_idx){
-    if(q >= 18*3*OPL3_COUNT){
-      DEBUG_MSG("PANIC!! [opl3.c] Chan queue overflow q==%d!", q);
-    }
-    val = opl3_chan_queue[q];
-    chan = val / 3;
-    reg = val % 3;
-    OPL3_RefreshChannel(chan, reg);
-    q++;
-  }
-  chan_queue_idx = 0;
-  q = 0;
-  while(q < chip_queue_idx){
-    if(q >= 4*OPL3_COUNT){
-      DEBUG_MSG("PANIC!! [opl3.c] Chip queue overflow q==%d!", q);
+//Write the pending bits of one set with index in [first, last), clearing
+//them. Returns nonzero if the frame budget ran out before the range was done.
+typedef s32 (*opl3_refresh_fn)(u8 unit, u8 reg);
+static s32 OPL3_FlushPending(u32 *pending, u16 first, u16 last, u16 units, opl3_refresh_fn refresh){
+  u16 w, bit;
+  u32 word;
+  for(w = first >> 5; (w << 5) < last; w++){
+    word = pending[w];
+    if(w == (first >> 5)) word &= ~0UL << (first & 31);
+    while(word){
+      bit = (w << 5) + __builtin_ctz(word);
+      if(bit >= last) return 0;
+      if(!opl3_frame_writes) return 1;
+      --opl3_frame_writes;
+      pending[w] &= ~(1UL << (bit & 31));
+      word &= word - 1;
+      refresh(bit % units, bit / units);
     }
-    val = opl3_chip_queue[q];
-    chip = val / 4;
-    reg = val % 4;
-    OPL3_RefreshChip(chip, reg);
-    q++;
   }
-  chip_queue_idx = 0;
   return 0;
 }
 
+#define OPL3_OP_REGS(r0, r1)   ((r0)*36*OPL3_COUNT), ((r1)*36*OPL3_COUNT), 36*OPL3_COUNT, OPL3_RefreshOperator
+#define OPL3_CHAN_REGS(r0, r1) ((r0)*18*OPL3_COUNT), ((r1)*18*OPL3_COUNT), 18*OPL3_COUNT, OPL3_RefreshChannel
+#define OPL3_CHIP_REGS(r0, r1) ((r0)*OPL3_COUNT),    ((r1)*OPL3_COUNT),    OPL3_COUNT,    OPL3_RefreshChip
+
+s32 OPL3_OnFrame(){
+  if(opl3_frame_budget){
+    opl3_frame_writes = opl3_frame_budget / OPL3_WRITE_TIME_US;
+    if(!opl3_frame_writes) opl3_frame_writes = 1;
+  }else{
+    opl3_frame_writes = 0xFFFF;
+  }
+  //Order matters for the key-ons: chip mode (0x105, 0x104 4-op connections,
+  //0x08) and all operator settings go out first, then the channel algorithm
+  //and F-number low bits, then 0xB0 (block/F-num high + key-on), and last
+  //0xBD with the rhythm key-ons. If the budget runs out, the rest stays
+  //pending for the next frame, so a key-on never overtakes its patch data.
+  if(OPL3_FlushPending(opl3_chip_pending, OPL3_CHIP_REGS(0, 2))) return 1;
+  if(OPL3_FlushPending(opl3_chip_pending, OPL3_CHIP_REGS(3, 4))) return 1;
+  if(OPL3_FlushPending(opl3_op_pending,   OPL3_OP_REGS(0, 5)))   return 1;
+  if(OPL3_FlushPending(opl3_chan_pending, OPL3_CHAN_REGS(2, 3))) return 1;
+  if(OPL3_FlushPending(opl3_chan_pending, OPL3_CHAN_REGS(0, 1))) return 1;
+  if(OPL3_FlushPending(opl3_chan_pending, OPL3_CHAN_REGS(1, 2))) return 1;
+  if(OPL3_FlushPending(opl3_chip_pending, OPL3_CHIP_REGS(2, 3))) return 1;
+  return 0;
+}
+
+void OPL3_SetFrameBudget(u16 us){
+  opl3_frame_budget = us;
+}
+
 
 s32 OPL3_AddOperQueue(u8 op, u8 reg){
   if(op >= 36*OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid op %d passed to OPL3_AddOperQueue! op_queue_idx=%d", op, op_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid op %d passed to OPL3_AddOperQueue!", op);
     return -9001;
   }
   if(reg >= 5){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddOperQueue! op_queue_idx=%d", reg, op_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddOperQueue!", reg);
     return -9001;
   }
-  u16 val = (0x0005*((u16)op))+reg;
-  //See if it's on the queue
-  u16 q;
-  for(q=0; q<op_queue_idx; q++){
-    if(opl3_op_queue[q] == val){
-      return 0;
-    }
-  }
-  opl3_op_queue[op_queue_idx] = val;
-  op_queue_idx++;
-  if(op_queue_idx >= 36*5*OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Op queue overflow on write op_queue_idx==%d!", op_queue_idx);
-    op_queue_idx = (36*5*OPL3_COUNT)-1;
-  }
+  u16 bit = ((u16)reg*36*OPL3_COUNT) + op;
+  opl3_op_pending[bit >> 5] |= 1UL << (bit & 31);
   return 0;
 }
 
 s32 OPL3_AddChanQueue(u8 chan, u8 reg){
   if(chan >= 18*OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid chan %d passed to OPL3_AddChanQueue! chan_queue_idx=%d", chan, chan_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid chan %d passed to OPL3_AddChanQueue!", chan);
     return -9001;
   }
   if(reg >= 3){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddChanQueue! chan_queue_idx=%d", reg, chan_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddChanQueue!", reg);
     return -9001;
   }
-  u8 val = (3*chan)+reg;
-  //See if it's on the queue
-  u8 q;
-  for(q=0; q<chan_queue_idx; q++){
-    if(opl3_chan_queue[q] == val){
-      return 0;
-    }
-  }
-  opl3_chan_queue[chan_queue_idx] = val;
-  chan_queue_idx++;
-  if(chan_queue_idx >= 18*3*OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Chan queue overflow on write chan_queue_idx==%d!", chan_queue_idx);
-    chan_queue_idx = (18*3*OPL3_COUNT)-1;
-  }
+  u16 bit = ((u16)reg*18*OPL3_COUNT) + chan;
+  opl3_chan_pending[bit >> 5] |= 1UL << (bit & 31);
   return 0;
 }
 
 s32 OPL3_AddChipQueue(u8 chip, u8 reg){
   if(chip >= OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid chip %d passed to OPL3_AddChipQueue! chip_queue_idx=%d", chip, chip_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid chip %d passed to OPL3_AddChipQueue!", chip);
     return -9001;
   }
   if(reg >= 4){
-    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddChipQueue! chip_queue_idx=%d", reg, chip_queue_idx);
+    DEBUG_MSG("PANIC!! [opl3.c] Invalid reg %d passed to OPL3_AddChipQueue!", reg);
     return -9001;
   }
-  u8 val = (4*chip)+reg;
-  //See if it's on the queue
-  u8 q;
-  for(q=0; q<chip_queue_idx; q++){
-    if(opl3_chip_queue[q] == val){
-      return 0;
-    }
-  }
-  opl3_chip_queue[chip_queue_idx] = val;
-  chip_queue_idx++;
-  if(chip_queue_idx >= 4*OPL3_COUNT){
-    DEBUG_MSG("PANIC!! [opl3.c] Chip queue overflow on write chip_queue_idx==%d!", chip_queue_idx);
-    chip_queue_idx = 4*OPL3_COUNT;
-  }
+  u16 bit = ((u16)reg*OPL3_COUNT) + chip;
+  opl3_chip_pending[bit >> 5] |= 1UL << (bit & 31);
   return 0;
 }
 
-
 /////////////////////////////////////////////////////////////////////////////
 // OPL3-setting functions
 /////////////////////////////////////////////////////////////////////////////
@@ -97,6 +97,15 @@ Chan | 2-Op Mode |   4-Op Mode    |Chan | 2-Op Mode |   4-Op Mode    |
 #define OPL3_CS_MASKS {1<<5} //{1<<4,1<<5}
 #endif
 
+//Time one register write takes in OPL3_SendAddrData(), in us
+#ifndef OPL3_WRITE_TIME_US
+#define OPL3_WRITE_TIME_US 5
+#endif
+//Default time OPL3_OnFrame() may spend writing registers, in us (0: no limit)
+#ifndef OPL3_FRAME_BUDGET_US
+#define OPL3_FRAME_BUDGET_US 0
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 // Global Types
 /////////////////////////////////////////////////////////////////////////////
@@ -221,9 +230,15 @@ extern s32 OPL3_RefreshAll(void);
 extern void OPL3_SendDemoPatch(void);
 
 // Call this after every control refresh. Refreshes any OPL3 registers that have
-// changed since last time.
+// changed since last time. Returns 1 if the frame budget ran out and some
+// registers are still waiting for the next call, 0 otherwise.
 extern s32 OPL3_OnFrame(void);
 
+// Limits the time OPL3_OnFrame() spends writing registers (in us, 0 for no
+// limit). Registers which don't fit are written on the next frame(s), with
+// key-ons held back until the patch data before them has been sent.
+extern void OPL3_SetFrameBudget(u16 us);
+
 // Convenience functions for interacting with OPL3
 // You MUST use these functions to write data to OPL3 or the OPL3 will not be
 // refreshed with the data on the next frame!
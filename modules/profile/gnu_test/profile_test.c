@@ -0,0 +1,268 @@
+// Host test of the profiling zone accounting
+//
+// Runs with the clock_gettime() backend of MIOS32_FAMILY_EMULATION.
+// The statistics are checked with synthetic measurements passed to
+// PROFILE_ZoneAdd() (min/max/mean/last, histogram bins, reset), and
+// with nested PROFILE_BEGIN/END zones. The terminal commands are
+// checked with a capturing output function.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <mios32.h>
+
+#include "profile.h"
+
+
+#define CHECK(cond) do { if( !(cond) ) { printf("ERROR: %s:%d: %s\n", __FUNCTION__, __LINE__, #cond); ++num_errors; return; } } while(0)
+
+static unsigned num_errors;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_IRQ_Disable(void) { return 0; }
+s32 MIOS32_IRQ_Enable(void) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Captures the terminal output
+/////////////////////////////////////////////////////////////////////////////
+
+static char output[8192];
+static int output_lines;
+
+static void out(char *format, ...)
+{
+  u32 len = strlen(output);
+  va_list args;
+  va_start(args, format);
+  vsnprintf(&output[len], sizeof(output) - len - 1, format, args);
+  va_end(args);
+  strcat(output, "\n");
+  ++output_lines;
+}
+
+static void output_clear(void)
+{
+  output[0] = 0;
+  output_lines = 0;
+}
+
+static int parse(const char *line)
+{
+  char input[80];
+  strcpy(input, line);
+  output_clear();
+  return PROFILE_TerminalParseLine(input, out);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_register(void)
+{
+  CHECK(PROFILE_Init(1) < 0);
+  CHECK(PROFILE_Init(0) == 0);
+  CHECK(PROFILE_NumZonesGet() == 0);
+
+  s32 a = PROFILE_ZoneRegister("zone_a");
+  s32 b = PROFILE_ZoneRegister("zone_b");
+  CHECK(a == 0 && b == 1);
+
+  // the same name from a different location: same zone
+  static const char name_copy[] = "zone_a";
+  CHECK(PROFILE_ZoneRegister(name_copy) == a);
+  CHECK(PROFILE_ZoneFind("zone_b") == b);
+  CHECK(PROFILE_ZoneFind("zone_c") < 0);
+  CHECK(PROFILE_NumZonesGet() == 2);
+
+  profile_zone_t z;
+  CHECK(PROFILE_ZoneAdd(-1, 100) < 0);
+  CHECK(PROFILE_ZoneAdd(2, 100) < 0);
+  CHECK(PROFILE_ZoneGet(2, &z) < 0);
+  CHECK(PROFILE_ZoneReset(-1) < 0);
+}
+
+
+static void test_statistics(void)
+{
+  s32 zone = PROFILE_ZoneFind("zone_a");
+  profile_zone_t z;
+  int bin;
+
+  PROFILE_ZoneReset(zone);
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0);
+  CHECK(z.count == 0 && z.sum == 0 && strcmp(z.name, "zone_a") == 0);
+
+  // ticks are nS in emulation
+  static const u32 ticks[] = { 3000, 500, 999, 1000, 1999, 2000, 12345, 4000000, 7000 };
+  static const int expected_bin[] = { 2, 0, 0, 1, 1, 2, 4, PROFILE_HISTOGRAM_BINS-1, 3 };
+  u32 histogram[PROFILE_HISTOGRAM_BINS];
+  unsigned long long sum = 0;
+  int i;
+
+  memset(histogram, 0, sizeof(histogram));
+  for(i=0; i<sizeof(ticks)/sizeof(ticks[0]); ++i) {
+    CHECK(PROFILE_ZoneAdd(zone, ticks[i]) == 0);
+    ++histogram[expected_bin[i]];
+    sum += ticks[i];
+  }
+
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0);
+  CHECK(z.count == sizeof(ticks)/sizeof(ticks[0]));
+  CHECK(z.min == 500 && z.max == 4000000 && z.last == 7000);
+  CHECK(z.sum == sum);
+  for(bin=0; bin<PROFILE_HISTOGRAM_BINS; ++bin)
+    CHECK(z.histogram[bin] == histogram[bin]);
+
+  // the other zone isn't affected
+  CHECK(PROFILE_ZoneGet(PROFILE_ZoneFind("zone_b"), &z) == 0 && z.count == 0);
+
+  // reset keeps the name, the next value is the new minimum
+  CHECK(PROFILE_ZoneReset(zone) == 0);
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0);
+  CHECK(z.count == 0 && z.max == 0 && z.histogram[2] == 0 && strcmp(z.name, "zone_a") == 0);
+  PROFILE_ZoneAdd(zone, 80000);
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0 && z.min == 80000 && z.max == 80000);
+
+  // PROFILE_Reset() resets all zones
+  PROFILE_ZoneAdd(PROFILE_ZoneFind("zone_b"), 1);
+  CHECK(PROFILE_Reset() == 0);
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0 && z.count == 0);
+  CHECK(PROFILE_ZoneGet(PROFILE_ZoneFind("zone_b"), &z) == 0 && z.count == 0);
+}
+
+
+static volatile u32 work_sink;
+
+static void work(int n)
+{
+  int i;
+  for(i=0; i<n; ++i)
+    work_sink += i;
+}
+
+static void test_nested(void)
+{
+  int i;
+
+  for(i=0; i<100; ++i) {
+    PROFILE_BEGIN(outer);
+    work(1000);
+    {
+      PROFILE_BEGIN(inner);
+      work(10000);
+      PROFILE_END(inner);
+    }
+    work(1000);
+    PROFILE_END(outer);
+  }
+
+  profile_zone_t zo, zi;
+  CHECK(PROFILE_ZoneGet(PROFILE_ZoneFind("outer"), &zo) == 0);
+  CHECK(PROFILE_ZoneGet(PROFILE_ZoneFind("inner"), &zi) == 0);
+  CHECK(zo.count == 100 && zi.count == 100);
+
+  // the outer zone includes the inner zone
+  CHECK(zo.sum > zi.sum);
+  CHECK(zi.min > 0 && zi.min <= zi.max && zo.max >= zo.min);
+
+  // the zone number is available after PROFILE_BEGIN()
+  PROFILE_BEGIN(outer);
+  CHECK(profile_zone_outer == PROFILE_ZoneFind("outer"));
+  PROFILE_END(outer);
+
+  // run time counter: uS, monotonic
+  u32 rt0 = PROFILE_RunTimeCounterGet();
+  work(1000000);
+  u32 rt1 = PROFILE_RunTimeCounterGet();
+  CHECK(rt1 > rt0);
+}
+
+
+static void test_terminal(void)
+{
+  s32 zone = PROFILE_ZoneFind("zone_a");
+  PROFILE_Reset();
+  PROFILE_ZoneAdd(zone, 1000);
+  PROFILE_ZoneAdd(zone, 3500);
+
+  // table: count 2, min 1.0, mean 2.2 (2250 nS), max 3.5, last 3.5
+  CHECK(parse("profile") == 1);
+  CHECK(output_lines == 2 + PROFILE_NumZonesGet());
+  CHECK(strstr(output, "zone_a                    2         1.0         2.2         3.5         3.5\n") != NULL);
+
+  CHECK(parse("profile hist zone_a") == 1);
+  CHECK(output_lines == 1 + PROFILE_HISTOGRAM_BINS);
+  CHECK(strstr(output, "Histogram of 'zone_a' (2 measurements):") != NULL);
+  CHECK(strstr(output, "    1..    1 uS:        1  50% ####################\n") != NULL);
+  CHECK(strstr(output, "    2..    3 uS:        1  50% ####################\n") != NULL);
+
+  CHECK(parse("profile hist unknown") == 1);
+  CHECK(strstr(output, "Unknown profiling zone 'unknown'!") != NULL);
+
+  CHECK(parse("profile hist") == 1);
+  CHECK(strstr(output, "Please specify the zone name!") != NULL);
+
+  CHECK(parse("profile tasks") == 1);
+  CHECK(strstr(output, "not available in emulation") != NULL);
+
+  CHECK(parse("profile reset") == 1);
+  profile_zone_t z;
+  CHECK(PROFILE_ZoneGet(zone, &z) == 0 && z.count == 0);
+
+  // other commands are not taken, and the input line is restored
+  char input[80];
+  strcpy(input, "set midimon on");
+  CHECK(PROFILE_TerminalParseLine(input, out) == 0);
+  CHECK(strcmp(input, "set midimon on") == 0);
+
+  output_clear();
+  PROFILE_TerminalHelp(out);
+  CHECK(output_lines == 4);
+}
+
+
+static void test_max_zones(void)
+{
+  static char names[PROFILE_MAX_ZONES+1][16];
+  int i;
+
+  // zone numbers aren't recycled, the remaining zones can be registered
+  for(i=PROFILE_NumZonesGet(); i<PROFILE_MAX_ZONES; ++i) {
+    sprintf(names[i], "zone%d", i);
+    CHECK(PROFILE_ZoneRegister(names[i]) == i);
+  }
+
+  sprintf(names[PROFILE_MAX_ZONES], "overflow");
+  CHECK(PROFILE_ZoneRegister(names[PROFILE_MAX_ZONES]) < 0);
+  CHECK(PROFILE_NumZonesGet() == PROFILE_MAX_ZONES);
+
+  // PROFILE_END() of an unregistered zone is ignored
+  CHECK(PROFILE_ZoneAdd(-1, 1000) < 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_register();
+  test_statistics();
+  test_nested();
+  test_terminal();
+  test_max_zones();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
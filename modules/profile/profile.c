@@ -0,0 +1,484 @@
+// $Id$
+//! \defgroup PROFILE
+//!
+//! Profiling Zones and Task Statistics
+//!
+//! Measures the execution time of named code sections with the DWT cycle
+//! counter of the Cortex-M core (or with clock_gettime() in emulation).
+//! Min, max, mean values and a logarithmic histogram are kept for each zone.
+//!
+//! Usage:
+//! \code
+//!   #include <profile.h>
+//!
+//!   void MyFunction(void)
+//!   {
+//!     PROFILE_BEGIN(my_function);
+//!     ...
+//!     PROFILE_END(my_function);
+//!   }
+//! \endcode
+//!
+//! PROFILE_Init(0) has to be called once (e.g. in APP_Init()) to enable the
+//! cycle counter.
+//!
+//! The results can be requested from the MIOS Terminal with the "profile"
+//! command if PROFILE_TerminalParseLine() and PROFILE_TerminalHelp() are
+//! called from the terminal parser of the application.
+//!
+//! PROFILE_TasksPrint() lists the FreeRTOS tasks with their stack high-water
+//! marks. It requires following definitions in mios32_config.h:
+//! \code
+//! #define configUSE_TRACE_FACILITY                1
+//! // optional: run time of each task, based on the cycle counter
+//! #define configGENERATE_RUN_TIME_STATS           1
+//! #define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+//! #define portGET_RUN_TIME_COUNTER_VALUE          PROFILE_RunTimeCounterGet
+//! \endcode
+//! In distance to FREERTOS_UTILS_PerfCounterInit() no timer interrupt is
+//! required for the run time counter.
+//!
+//! \{
+/* ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include <string.h>
+
+#if defined(MIOS32_FAMILY_EMULATION)
+# include <time.h>
+#else
+# include <FreeRTOS.h>
+# include <task.h>
+#endif
+
+#include "profile.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// Cortex-M debug registers for the cycle counter
+#define DEMCR      (*(volatile u32 *)0xe000edfc)
+#define DEMCR_TRCENA (1 << 24)
+#define DWT_CTRL   (*(volatile u32 *)0xe0001000)
+#define DWT_CTRL_CYCCNTENA (1 << 0)
+#define DWT_CYCCNT (*(volatile u32 *)0xe0001004)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local variables
+/////////////////////////////////////////////////////////////////////////////
+
+static profile_zone_t profile_zone[PROFILE_MAX_ZONES];
+static u8 num_zones;
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Initializes the profiling module and enables the cycle counter
+//! \param[in] mode currently only mode 0 supported
+//! \return < 0 if initialisation failed
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_Init(u32 mode)
+{
+  if( mode != 0 )
+    return -1; // only mode 0 supported
+
+#if !defined(MIOS32_FAMILY_EMULATION)
+  DEMCR |= DEMCR_TRCENA;
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+
+  return PROFILE_Reset();
+}
+
+
+#if defined(MIOS32_FAMILY_EMULATION)
+/////////////////////////////////////////////////////////////////////////////
+//! Returns the clock for measurements in emulation (nS)
+/////////////////////////////////////////////////////////////////////////////
+u32 PROFILE_ClockGet(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u32)ts.tv_sec * 1000000000 + (u32)ts.tv_nsec;
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Registers a zone, usually called by PROFILE_BEGIN()
+//! \param[in] name the zone name (will be referenced, not copied!)
+//! \return the zone number, < 0 if no free zone available
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZoneRegister(const char *name)
+{
+  MIOS32_IRQ_Disable();
+
+  // a zone with the same name could be entered from a different task or location
+  s32 zone = PROFILE_ZoneFind(name);
+  if( zone < 0 && num_zones < PROFILE_MAX_ZONES ) {
+    zone = num_zones;
+    profile_zone[zone].name = name;
+    ++num_zones;
+  }
+
+  MIOS32_IRQ_Enable();
+
+  return zone;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the number of the zone with the given name, -1 if not found
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZoneFind(const char *name)
+{
+  int zone;
+  for(zone=0; zone<num_zones; ++zone) {
+    if( strcmp(profile_zone[zone].name, name) == 0 )
+      return zone;
+  }
+
+  return -1; // not found
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Adds a measurement to the statistics of a zone, usually called by PROFILE_END()
+//! \param[in] zone the zone number
+//! \param[in] ticks the measured time in clock ticks
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZoneAdd(s32 zone, u32 ticks)
+{
+  if( zone < 0 || zone >= num_zones )
+    return -1; // invalid zone
+
+  // logarithmic histogram bin
+  u32 us = ticks / PROFILE_TICKS_PER_US;
+  int bin = 0;
+#if defined(__GNUC__)
+  if( us )
+    bin = 32 - __builtin_clz(us);
+#else
+  while( us ) {
+    ++bin;
+    us >>= 1;
+  }
+#endif
+  if( bin >= PROFILE_HISTOGRAM_BINS )
+    bin = PROFILE_HISTOGRAM_BINS-1;
+
+  profile_zone_t *z = &profile_zone[zone];
+
+  MIOS32_IRQ_Disable();
+  if( !z->count || ticks < z->min )
+    z->min = ticks;
+  if( ticks > z->max )
+    z->max = ticks;
+  z->last = ticks;
+  z->sum += ticks;
+  ++z->count;
+  ++z->histogram[bin];
+  MIOS32_IRQ_Enable();
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Copies the statistics of a zone
+//! \param[in] zone the zone number
+//! \param[out] stats the zone statistics
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZoneGet(s32 zone, profile_zone_t *stats)
+{
+  if( zone < 0 || zone >= num_zones )
+    return -1; // invalid zone
+
+  MIOS32_IRQ_Disable();
+  *stats = profile_zone[zone];
+  MIOS32_IRQ_Enable();
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Resets the statistics of a zone, the zone stays registered
+//! \param[in] zone the zone number
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZoneReset(s32 zone)
+{
+  if( zone < 0 || zone >= num_zones )
+    return -1; // invalid zone
+
+  profile_zone_t *z = &profile_zone[zone];
+
+  MIOS32_IRQ_Disable();
+  const char *name = z->name;
+  memset(z, 0, sizeof(profile_zone_t));
+  z->name = name;
+  MIOS32_IRQ_Enable();
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the number of registered zones
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_NumZonesGet(void)
+{
+  return num_zones;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Resets the statistics of all zones
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_Reset(void)
+{
+  int zone;
+  for(zone=0; zone<num_zones; ++zone)
+    PROFILE_ZoneReset(zone);
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Run time counter for FreeRTOS in uS, derived from the cycle counter.<BR>
+//! Has to be called at least each 25 seconds (@168 MHz), which is given
+//! since FreeRTOS calls it on each context switch.
+//! \return the number of uS since startup
+/////////////////////////////////////////////////////////////////////////////
+u32 PROFILE_RunTimeCounterGet(void)
+{
+  static u32 last_ticks;
+  static u32 remaining_ticks;
+  static u32 run_time_us;
+
+  u32 ticks = PROFILE_ClockGet();
+  u32 delta = ticks - last_ticks + remaining_ticks;
+  last_ticks = ticks;
+
+  run_time_us += delta / PROFILE_TICKS_PER_US;
+  remaining_ticks = delta % PROFILE_TICKS_PER_US;
+
+  return run_time_us;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Help function: converts clock ticks to 1/10 uS
+/////////////////////////////////////////////////////////////////////////////
+static u32 ticks_to_100ns(unsigned long long ticks)
+{
+  return (u32)((ticks * 10) / PROFILE_TICKS_PER_US);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Prints the statistics of all zones
+//! \param[in] _output_function the output function (e.g. MIOS32_MIDI_SendDebugMessage)
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_ZonesPrint(void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+
+  if( !num_zones ) {
+    out("No profiling zones have been entered yet.");
+    return 0;
+  }
+
+  out("Zone                  Count        Min uS     Mean uS      Max uS     Last uS");
+  out("============================================================================");
+
+  int zone;
+  for(zone=0; zone<num_zones; ++zone) {
+    profile_zone_t z;
+    PROFILE_ZoneGet(zone, &z);
+
+    u32 min = ticks_to_100ns(z.min);
+    u32 mean = z.count ? ticks_to_100ns(z.sum / z.count) : 0;
+    u32 max = ticks_to_100ns(z.max);
+    u32 last = ticks_to_100ns(z.last);
+    out("%-20s %6u %9u.%u %9u.%u %9u.%u %9u.%u",
+	z.name, z.count, min/10, min%10, mean/10, mean%10, max/10, max%10, last/10, last%10);
+  }
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Prints the histogram of a zone
+//! \param[in] zone the zone number
+//! \param[in] _output_function the output function (e.g. MIOS32_MIDI_SendDebugMessage)
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_HistogramPrint(s32 zone, void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+  profile_zone_t z;
+
+  if( PROFILE_ZoneGet(zone, &z) < 0 ) {
+    out("Invalid profiling zone!");
+    return -1; // invalid zone
+  }
+
+  out("Histogram of '%s' (%u measurements):", z.name, z.count);
+
+  int bin;
+  for(bin=0; bin<PROFILE_HISTOGRAM_BINS; ++bin) {
+    u32 percent = z.count ? (u32)(((unsigned long long)z.histogram[bin] * 100) / z.count) : 0;
+    char bar[41];
+    int len = percent * 40 / 100;
+    memset(bar, '#', len);
+    bar[len] = 0;
+
+    if( bin == 0 )
+      out("       < 1 uS: %8u %3u%% %s", z.histogram[bin], percent, bar);
+    else if( bin == (PROFILE_HISTOGRAM_BINS-1) )
+      out("    >= %5u uS: %8u %3u%% %s", 1 << (bin-1), z.histogram[bin], percent, bar);
+    else
+      out("%5u..%5u uS: %8u %3u%% %s", 1 << (bin-1), (1 << bin) - 1, z.histogram[bin], percent, bar);
+  }
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Prints the FreeRTOS tasks with their stack high-water marks and run time
+//! \param[in] _output_function the output function (e.g. MIOS32_MIDI_SendDebugMessage)
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_TasksPrint(void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+
+#if defined(MIOS32_FAMILY_EMULATION)
+  out("Task statistics not available in emulation!");
+  return -1;
+#elif configUSE_TRACE_FACILITY == 0
+  out("configUSE_TRACE_FACILITY not activated in mios32_config.h!");
+  return -1;
+#else
+  TaskStatus_t task_status[PROFILE_MAX_TASKS];
+  uint32_t total_run_time = 0;
+  UBaseType_t num_tasks = uxTaskGetSystemState(task_status, PROFILE_MAX_TASKS, &total_run_time);
+
+  if( !num_tasks ) {
+    out("More than %d tasks - increase PROFILE_MAX_TASKS!", PROFILE_MAX_TASKS);
+    return -1;
+  }
+
+  out("Task              Prio  Stack Free     Run Time");
+  out("==============================================");
+
+  int i;
+  for(i=0; i<num_tasks; ++i) {
+    TaskStatus_t *t = &task_status[i];
+    u32 stack_free = t->usStackHighWaterMark * sizeof(StackType_t);
+#if configGENERATE_RUN_TIME_STATS
+    u32 permille = total_run_time ? (u32)(((unsigned long long)t->ulRunTimeCounter * 1000) / total_run_time) : 0;
+    out("%-16s %5d %7u bytes  %3u.%u%%", t->pcTaskName, (int)t->uxCurrentPriority, stack_free, permille/10, permille%10);
+#else
+    out("%-16s %5d %7u bytes      ---", t->pcTaskName, (int)t->uxCurrentPriority, stack_free);
+#endif
+  }
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Returns help page for implemented terminal commands of this module
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_TerminalHelp(void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+
+  out("  profile:                          prints the statistics of all profiling zones");
+  out("  profile hist <zone>:              prints the histogram of a profiling zone");
+  out("  profile tasks:                    prints run time and stack usage of all tasks");
+  out("  profile reset:                    resets the statistics of all profiling zones");
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Parser for a complete line
+//! \return > 0 if command line matches with profile terminal commands
+/////////////////////////////////////////////////////////////////////////////
+s32 PROFILE_TerminalParseLine(char *input, void *_output_function)
+{
+  void (*out)(char *format, ...) = _output_function;
+  char *separators = " \t";
+  char *brkt;
+  char *parameter;
+
+  // since strtok_r works destructive (separators in *input replaced by NUL), we have to restore them
+  // on an unsuccessful call (whenever this function returns < 1)
+  int input_len = strlen(input);
+
+  if( (parameter = strtok_r(input, separators, &brkt)) ) {
+    if( strcmp(parameter, "profile") == 0 ) {
+      if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
+	PROFILE_ZonesPrint(out);
+      } else if( strcmp(parameter, "hist") == 0 ) {
+	if( !(parameter = strtok_r(NULL, separators, &brkt)) ) {
+	  out("Please specify the zone name!");
+	} else {
+	  s32 zone = PROFILE_ZoneFind(parameter);
+	  if( zone < 0 ) {
+	    out("Unknown profiling zone '%s'!", parameter);
+	  } else {
+	    PROFILE_HistogramPrint(zone, out);
+	  }
+	}
+      } else if( strcmp(parameter, "tasks") == 0 ) {
+	PROFILE_TasksPrint(out);
+      } else if( strcmp(parameter, "reset") == 0 ) {
+	PROFILE_Reset();
+	out("Profiling statistics have been reset.");
+      } else {
+	out("Unknown profile command '%s' - type 'help' to list available commands!", parameter);
+      }
+
+      return 1; // command taken
+    }
+  }
+
+  // restore input line (replace NUL characters by spaces)
+  int i;
+  char *input_ptr = input;
+  for(i=0; i<input_len; ++i, ++input_ptr)
+    if( !*input_ptr )
+      *input_ptr = ' ';
+
+  return 0; // command not taken
+}
+
+//! \}
@@ -0,0 +1,131 @@
+// $Id$
+/*
+ * Header file for Profiling Zones
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ * 
+ * ==========================================================================
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// set to 0 in mios32_config.h to remove all PROFILE_BEGIN/END measurements
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+// max. number of zones
+#ifndef PROFILE_MAX_ZONES
+#define PROFILE_MAX_ZONES 16
+#endif
+
+// histogram bins: <1 uS, 1..2 uS, 2..4 uS, ... >= 2^(PROFILE_HISTOGRAM_BINS-2) uS
+#ifndef PROFILE_HISTOGRAM_BINS
+#define PROFILE_HISTOGRAM_BINS 12
+#endif
+
+// max. number of tasks which are listed by PROFILE_TasksPrint()
+#ifndef PROFILE_MAX_TASKS
+#define PROFILE_MAX_TASKS 16
+#endif
+
+
+// clock used for the measurements:
+// the DWT cycle counter of the Cortex-M core, or clock_gettime() (ns) in emulation
+#if defined(MIOS32_FAMILY_EMULATION)
+# define PROFILE_TICKS_PER_US 1000
+#else
+# define PROFILE_TICKS_PER_US (MIOS32_SYS_CPU_FREQUENCY/1000000)
+# define PROFILE_ClockGet() (*(volatile u32 *)0xe0001004) // DWT_CYCCNT
+#endif
+
+
+// Usage:
+//   PROFILE_BEGIN(my_zone);
+//   ...
+//   PROFILE_END(my_zone);
+// The zone is registered with the first call, begin and end have to be
+// located in the same scope. Zones can be nested, and they can be entered
+// by different tasks at the same time. After PROFILE_BEGIN(), the zone number
+// is available in profile_zone_<zone> (e.g. for PROFILE_ZoneGet()).
+#if PROFILE_ENABLED
+# define PROFILE_BEGIN(zone) \
+  static s32 profile_zone_##zone = -1; \
+  if( profile_zone_##zone < 0 ) \
+    profile_zone_##zone = PROFILE_ZoneRegister(#zone); \
+  u32 profile_start_##zone = PROFILE_ClockGet()
+
+# define PROFILE_END(zone) \
+  PROFILE_ZoneAdd(profile_zone_##zone, PROFILE_ClockGet() - profile_start_##zone)
+#else
+# define PROFILE_BEGIN(zone)
+# define PROFILE_END(zone)
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+// all times in clock ticks (see PROFILE_TICKS_PER_US)
+typedef struct {
+  const char *name;
+  u32 count;
+  u32 min;
+  u32 max;
+  u32 last;
+  unsigned long long sum;
+  u32 histogram[PROFILE_HISTOGRAM_BINS];
+} profile_zone_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 PROFILE_Init(u32 mode);
+
+#if defined(MIOS32_FAMILY_EMULATION)
+extern u32 PROFILE_ClockGet(void);
+#endif
+
+extern s32 PROFILE_ZoneRegister(const char *name);
+extern s32 PROFILE_ZoneFind(const char *name);
+extern s32 PROFILE_ZoneAdd(s32 zone, u32 ticks);
+extern s32 PROFILE_ZoneGet(s32 zone, profile_zone_t *stats);
+extern s32 PROFILE_ZoneReset(s32 zone);
+extern s32 PROFILE_NumZonesGet(void);
+extern s32 PROFILE_Reset(void);
+
+extern u32 PROFILE_RunTimeCounterGet(void);
+
+extern s32 PROFILE_ZonesPrint(void *_output_function);
+extern s32 PROFILE_HistogramPrint(s32 zone, void *_output_function);
+extern s32 PROFILE_TasksPrint(void *_output_function);
+
+extern s32 PROFILE_TerminalHelp(void *_output_function);
+extern s32 PROFILE_TerminalParseLine(char *input, void *_output_function);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Export global variables
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PROFILE_H */
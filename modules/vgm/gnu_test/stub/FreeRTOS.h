@@ -0,0 +1,6 @@
+// Minimal host replacement of FreeRTOS.h for the VGM heap test
+
+#ifndef _FREERTOS_H
+#define _FREERTOS_H
+
+#endif /* _FREERTOS_H */
@@ -0,0 +1,20 @@
+// Minimal host replacement of <genesis.h> for the VGM player tests:
+// the chip write functions are implemented by the test
+
+#ifndef _GENESIS_H
+#define _GENESIS_H
+
+#include <mios32.h>
+
+#define GENESIS_COUNT 2
+
+extern s32 Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data);
+extern s32 Genesis_PSGWrite(u8 board, u8 data);
+extern void Genesis_CaptureOPN2OpStates(u8 board);
+
+#ifdef GENESIS_USE_WRITEQUEUE
+#define GENESIS_WRITEQUEUE_LENGTH 64
+extern u8 Genesis_WriteQueue_Free(u8 board);
+#endif
+
+#endif /* _GENESIS_H */
@@ -0,0 +1,59 @@
+// Minimal host replacement of <mios32.h> for the VGM player tests:
+// only the types, timers and board functions used by vgmplayer.c
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+
+typedef struct {
+  volatile u32 CNT;
+  volatile u32 ARR;
+} TIM_TypeDef;
+
+typedef struct {
+  u32 TIM_Period;
+  u32 TIM_Prescaler;
+  u32 TIM_ClockDivision;
+  u32 TIM_CounterMode;
+} TIM_TimeBaseInitTypeDef;
+
+// TIM2: hr_time, TIM5: VGM sample clock, both advanced by the test
+extern TIM_TypeDef tim2, tim3, tim5;
+#define TIM2 (&tim2)
+#define TIM3 (&tim3)
+#define TIM5 (&tim5)
+
+#define RESET 0
+#define DISABLE 0
+#define ENABLE 1
+#define TIM_IT_Update 1
+#define TIM_CounterMode_Up 0
+#define RCC_APB1Periph_TIM2 0
+#define RCC_APB1Periph_TIM3 0
+#define RCC_APB1Periph_TIM5 0
+#define TIM3_IRQn 0
+#define MIOS32_IRQ_PRIO_INSANE 0
+
+#define RCC_APB1PeriphClockCmd(p, s)
+#define TIM_ITConfig(t, i, s)
+#define TIM_TimeBaseInit(t, i)
+#define TIM_Cmd(t, s)
+#define TIM_ARRPreloadConfig(t, s)
+#define TIM_GetITStatus(t, i) RESET
+#define TIM_ClearITPendingBit(t, i)
+#define MIOS32_IRQ_Install(irq, prio)
+#define MIOS32_BOARD_LED_Get() 0
+#define MIOS32_BOARD_LED_Set(mask, value)
+
+#endif /* _MIOS32_H */
@@ -0,0 +1,12 @@
+// Minimal host replacement of <stm32f4xx.h> for the VGM heap test:
+// the CCM RAM is an array of the test
+
+#ifndef _STM32F4XX_H
+#define _STM32F4XX_H
+
+#include <stdint.h>
+
+extern uint32_t ccm_ram[];
+#define CCMDATARAM_BASE ((uintptr_t)ccm_ram)
+
+#endif /* _STM32F4XX_H */
@@ -0,0 +1,12 @@
+// Minimal host replacement of task.h for the VGM heap test:
+// the scheduler suspension is counted to check that it's balanced
+
+#ifndef _TASK_H
+#define _TASK_H
+
+extern int task_suspended;
+
+#define vTaskSuspendAll() (++task_suspended)
+#define xTaskResumeAll() (--task_suspended)
+
+#endif /* _TASK_H */
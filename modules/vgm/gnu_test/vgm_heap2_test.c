@@ -0,0 +1,368 @@
+// Stress test and benchmark of the secondary heap in vgm_heap2.c
+//
+// Replays the allocation pattern of the tracker: RAM sources (VgmSource,
+// VgmSourceRAM) whose command lists grow and shrink one command at a time
+// with vgmh2_realloc(), while heads, queue heads and file paths are created
+// and deleted in between. The block list, the free lists and
+// vgmh2_numusedblocks are checked against each other, and all allocations
+// have to keep their contents.
+//
+// vgmh2_stats has to count every call once: as an alloc, a fallback, an in
+// place or a moved realloc. Every read of the hr_time counter advances it
+// by one tick, so alloctime_total has to be the number of counted calls.
+//
+// Finally the heap is filled until allocations go to the primary heap, a
+// command list which can't grow anymore has to move there, and after
+// deleting everything the heap has to be empty again.
+//
+// The time per call is printed.
+
+#include <time.h>
+
+#include <mios32.h>
+
+extern TIM_TypeDef tim2;
+static TIM_TypeDef *hr_time_read(void)
+{
+  ++tim2.CNT;
+  return &tim2;
+}
+#undef TIM2
+#define TIM2 (hr_time_read())
+
+#include "../vgm_heap2.c"
+#include "../vgmram.h"
+#include "../vgmqueue.h"
+
+#define NUM_SOURCES 32
+#define MAX_CMDS 400
+#define NUM_OBJECTS 48
+#define NUM_STEPS 400000
+#define CHECK_INTERVAL 64
+
+TIM_TypeDef tim2, tim3, tim5;
+uint32_t ccm_ram[VGMH2_HEAPSIZE / 4];
+int task_suspended;
+
+static u32 num_errors;
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); ++num_errors; } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Allocations of the test, filled with a pattern
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  u8 *ptr;
+  size_t size;
+  u8 seed;
+} allocation_t;
+
+typedef struct {
+  allocation_t source;
+  allocation_t ram;
+  allocation_t cmds;
+} source_t;
+
+static source_t sources[NUM_SOURCES];
+static allocation_t objects[NUM_OBJECTS];
+
+static vgmh2_stats_t expected;
+static u32 num_calls;
+static double call_ns;
+
+static u32 rnd_seed = 1;
+static u32 rnd(u32 n)
+{
+  rnd_seed = rnd_seed * 1103515245 + 12345;
+  return (rnd_seed >> 8) % n;
+}
+
+static double now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int in_heap(void *ptr)
+{
+  return (u8 *)ptr >= (u8 *)ccm_ram && (u8 *)ptr < (u8 *)ccm_ram + VGMH2_HEAPSIZE;
+}
+
+static void fill(allocation_t *a, size_t from)
+{
+  size_t i;
+  for(i=from; i<a->size; ++i)
+    a->ptr[i] = a->seed + i;
+}
+
+static int intact(allocation_t *a, size_t size)
+{
+  size_t i;
+  for(i=0; i<size; ++i)
+    if( a->ptr[i] != (u8)(a->seed + i) )
+      return 0;
+  return 1;
+}
+
+static void alloc(allocation_t *a, size_t size)
+{
+  double t0 = now_ns();
+  a->ptr = vgmh2_malloc(size);
+  call_ns += now_ns() - t0;
+  ++num_calls;
+  CHECK(task_suspended == 0);
+
+  if( in_heap(a->ptr) )
+    ++expected.allocs;
+  else
+    ++expected.fallbacks;
+  a->size = size;
+  a->seed = rnd(256);
+  fill(a, 0);
+}
+
+static void release(allocation_t *a)
+{
+  if( a->ptr ) {
+    CHECK(intact(a, a->size));
+    vgmh2_free(a->ptr);
+    CHECK(task_suspended == 0);
+  }
+  a->ptr = NULL;
+  a->size = 0;
+}
+
+// resizes like the tracker: realloc to 0 bytes frees the command list
+static void resize(allocation_t *a, size_t size)
+{
+  if( !a->ptr ) {
+    if( size )
+      alloc(a, size);
+    return;
+  }
+
+  u8 *old = a->ptr;
+  int was_in_heap = in_heap(old);
+  size_t kept = (size < a->size) ? size : a->size;
+  double t0 = now_ns();
+  a->ptr = vgmh2_realloc(old, size);
+  call_ns += now_ns() - t0;
+  ++num_calls;
+  CHECK(task_suspended == 0);
+
+  if( !size ) {
+    CHECK(a->ptr == NULL);
+    a->size = 0;
+    return;
+  }
+  CHECK(a->ptr != NULL);
+
+  if( was_in_heap && vgmh2_blocks(size) != vgmh2_blocks(a->size) ) {
+    if( a->ptr == old )
+      ++expected.reallocs_inplace;
+    else
+      ++expected.reallocs_moved;
+  }
+  CHECK(intact(a, kept));
+  a->size = size;
+  fill(a, kept);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Checks the heap structure against the allocations of the test
+/////////////////////////////////////////////////////////////////////////////
+
+static void check_allocation(allocation_t *a, u32 *num_in_heap, u32 *blocks_in_heap)
+{
+  if( !a->ptr )
+    return;
+  CHECK(intact(a, a->size));
+  if( in_heap(a->ptr) ) {
+    u16 c = ((u8 *)a->ptr - (u8 *)ccm_ram) / sizeof(vgmh2_block);
+    CHECK(!VGMH2_ISFREE(c));
+    CHECK(VGMH2_SIZE(c) == vgmh2_blocks(a->size));
+    ++*num_in_heap;
+    *blocks_in_heap += VGMH2_SIZE(c);
+  }
+}
+
+static void check_heap(void)
+{
+  u32 used_regions = 0, used_blocks = 0, free_regions = 0, free_blocks = 0;
+  u32 num_in_heap = 0, blocks_in_heap = 0;
+  u16 c, n, prev_free = 0;
+  u8 cls;
+  int i;
+
+  // block list
+  CHECK(VGMH2_PBLOCK(VGMH2_NBLOCK(0)) == 0);
+  for(c=VGMH2_NBLOCK(0); c!=vgmh2_end; c=n) {
+    n = VGMH2_NBLOCK(c) & VGMH2_BLOCKNO_MASK;
+    CHECK(n > c && n <= vgmh2_end);
+    if( n <= c || n > vgmh2_end )
+      return;
+    CHECK(VGMH2_PBLOCK(n) == c);
+    if( VGMH2_ISFREE(c) ) {
+      CHECK(!prev_free); // neighbours have been merged
+      ++free_regions;
+      free_blocks += n - c;
+    } else {
+      ++used_regions;
+      used_blocks += n - c;
+    }
+    prev_free = VGMH2_ISFREE(c);
+  }
+  CHECK(!prev_free); // the last block goes back to the space at the end
+  CHECK(VGMH2_NBLOCK(vgmh2_end) == 0);
+  CHECK(vgmh2_numusedblocks == used_blocks + 2);
+
+  // free lists
+  for(cls=0; cls<VGMH2_NUMCLASSES; ++cls) {
+    CHECK(!vgmh2_freelist[cls] == !(vgmh2_freemap & (1ul << cls)));
+    u16 p = 0;
+    for(c=vgmh2_freelist[cls]; c; c=VGMH2_NFREE(c)) {
+      CHECK(VGMH2_ISFREE(c));
+      CHECK(VGMH2_PFREE(c) == p);
+      CHECK(vgmh2_class(VGMH2_SIZE(c)) == cls);
+      p = c;
+    }
+  }
+  vgmh2_freeinfo_t info;
+  vgmh2_get_freeinfo(&info);
+  CHECK(info.regions == free_regions);
+  CHECK(info.blocks == free_blocks);
+  CHECK(info.top == VGMH2_NUMBLOCKS - 1 - vgmh2_end);
+
+  // allocations of the test
+  for(i=0; i<NUM_SOURCES; ++i) {
+    check_allocation(&sources[i].source, &num_in_heap, &blocks_in_heap);
+    check_allocation(&sources[i].ram, &num_in_heap, &blocks_in_heap);
+    check_allocation(&sources[i].cmds, &num_in_heap, &blocks_in_heap);
+  }
+  for(i=0; i<NUM_OBJECTS; ++i)
+    check_allocation(&objects[i], &num_in_heap, &blocks_in_heap);
+  CHECK(num_in_heap == used_regions);
+  CHECK(blocks_in_heap == used_blocks);
+
+  // every call counted and timed once
+  CHECK(vgmh2_stats.allocs == expected.allocs);
+  CHECK(vgmh2_stats.fallbacks == expected.fallbacks);
+  CHECK(vgmh2_stats.reallocs_inplace == expected.reallocs_inplace);
+  CHECK(vgmh2_stats.reallocs_moved == expected.reallocs_moved);
+  CHECK(vgmh2_stats.alloctime_total == expected.allocs + expected.reallocs_inplace + expected.reallocs_moved);
+  CHECK(vgmh2_stats.alloctime_max <= 1);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tracker session
+/////////////////////////////////////////////////////////////////////////////
+
+static void create_source(source_t *s)
+{
+  alloc(&s->source, sizeof(VgmSource));
+  alloc(&s->ram, sizeof(VgmSourceRAM));
+}
+
+static void delete_source(source_t *s)
+{
+  release(&s->cmds);
+  release(&s->ram);
+  release(&s->source);
+}
+
+static void step(void)
+{
+  source_t *s = &sources[rnd(NUM_SOURCES)];
+  size_t numcmds = s->cmds.size / sizeof(VgmChipWriteCmd);
+  u32 action = rnd(100);
+
+  if( action < 55 && numcmds < MAX_CMDS ) {
+    // VGM_SourceRAM_InsertCmd()
+    resize(&s->cmds, (numcmds + 1) * sizeof(VgmChipWriteCmd));
+  } else if( action < 80 && numcmds ) {
+    // VGM_SourceRAM_DeleteCmd()
+    resize(&s->cmds, (numcmds - 1) * sizeof(VgmChipWriteCmd));
+  } else if( action < 82 ) {
+    delete_source(s);
+    create_source(s);
+  } else {
+    // heads while playing, queue heads and file paths
+    allocation_t *a = &objects[rnd(NUM_OBJECTS)];
+    if( a->ptr )
+      release(a);
+    else {
+      static const size_t sizes[4] = { sizeof(VgmHead), sizeof(VgmHeadRAM), sizeof(VgmHeadQueue), 0 };
+      size_t size = sizes[rnd(4)];
+      alloc(a, size ? size : (8 + rnd(56)));
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  vgmh2_init();
+  for(i=0; i<NUM_SOURCES; ++i)
+    create_source(&sources[i]);
+
+  u32 peak = 0;
+  for(i=0; i<NUM_STEPS; ++i) {
+    step();
+    if( vgmh2_numusedblocks > peak )
+      peak = vgmh2_numusedblocks;
+    if( (i % CHECK_INTERVAL) == 0 )
+      check_heap();
+  }
+  check_heap();
+
+  printf("Replay: %u calls, %u allocs, %u fallbacks, %u in place and %u moved reallocs\n",
+         (unsigned)num_calls, (unsigned)vgmh2_stats.allocs, (unsigned)vgmh2_stats.fallbacks,
+         (unsigned)vgmh2_stats.reallocs_inplace, (unsigned)vgmh2_stats.reallocs_moved);
+  printf("Peak %u of %u blocks used, %.1f nS per call\n", (unsigned)peak, VGMH2_NUMBLOCKS, call_ns / num_calls);
+
+  // fill the heap until an allocation goes to the primary heap
+  for(i=0; i<NUM_OBJECTS; ++i) {
+    release(&objects[i]);
+    alloc(&objects[i], 2048);
+  }
+  CHECK(!in_heap(objects[NUM_OBJECTS-1].ptr));
+  check_heap();
+
+  // a command list which can't grow in this heap anymore moves to the primary heap
+  vgmh2_freeinfo_t info;
+  vgmh2_get_freeinfo(&info);
+  source_t *s = &sources[0];
+  for(i=1; i<NUM_SOURCES; ++i)
+    if( sources[i].cmds.size > s->cmds.size )
+      s = &sources[i];
+  CHECK(in_heap(s->cmds.ptr));
+  u32 moved = vgmh2_stats.reallocs_moved;
+  resize(&s->cmds, s->cmds.size + (info.largest + info.top + 2) * 8 + 8);
+  CHECK(!in_heap(s->cmds.ptr));
+  CHECK(vgmh2_stats.reallocs_moved == moved + 1);
+  check_heap();
+
+  // delete everything
+  for(i=0; i<NUM_SOURCES; ++i)
+    delete_source(&sources[i]);
+  for(i=0; i<NUM_OBJECTS; ++i)
+    release(&objects[i]);
+  check_heap();
+  CHECK(vgmh2_numusedblocks == 2);
+  CHECK(vgmh2_end == 1);
+  vgmh2_get_freeinfo(&info);
+  CHECK(info.regions == 0);
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,411 @@
+// Host test of the head scheduler in vgmplayer.c
+//
+// Heads play scripted command lists (waits and chip writes). The chip write
+// functions check that every head's writes arrive in script order and never
+// while the head is paused, VGM_Head_cmdNext() checks that no wait ends early
+// and that paused heads are not advanced.
+
+#include <mios32.h>
+#include <genesis.h>
+#include "../vgmhead.h"
+#include "../vgmplayer.h"
+
+#define NUM_HEADS 12
+#define MAX_CMDS 200
+#define STRESS_ROUNDS 200
+#define MAX_STEPS 200000
+
+// OPN2 writes carry the head number in the address, PSG writes in the upper nibble
+#define ADDR_BASE 0x30
+
+extern u16 VgmPlayer_WorkCallback();
+
+TIM_TypeDef tim2, tim3, tim5;
+
+VgmHead* vgm_heads[VGM_HEAD_MAXNUM];
+u32 vgm_numheads;
+
+typedef struct {
+  u8 iswait;
+  u16 wait;
+  VgmChipWriteCmd cmd;
+} script_cmd_t;
+
+typedef struct {
+  script_cmd_t cmds[MAX_CMDS];
+  u16 num_cmds;
+  s16 pos;
+  u32 cmdnext_calls;
+  VgmChipWriteCmd expected[MAX_CMDS]; // valid writes in script order
+  u16 num_expected;
+  u16 num_written;
+} script_t;
+
+static VgmHead heads[NUM_HEADS];
+static script_t scripts[NUM_HEADS];
+static u32 hr_time;
+static u8 in_callback;
+static u8 writequeue_full[GENESIS_COUNT];
+static u32 errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { printf("FAIL: " __VA_ARGS__); printf("\n"); ++errors; } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Time and random numbers
+/////////////////////////////////////////////////////////////////////////////
+
+static void set_time(u32 t)
+{
+  hr_time = t;
+  tim2.CNT = hr_time;
+  tim5.CNT = hr_time / VGMP_HRTICKSPERSAMPLE;
+}
+
+static u32 rnd_state = 1;
+static u32 rnd(u32 n)
+{
+  rnd_state = rnd_state * 1103515245u + 12345u;
+  return (rnd_state >> 8) % n;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Head and chip replacements
+/////////////////////////////////////////////////////////////////////////////
+
+static void load_cmd(VgmHead* head, u32 vgm_time)
+{
+  script_t* s = (script_t*)head->data;
+  if( s->pos >= s->num_cmds ){
+    head->isdone = 1;
+    head->iswait = 0;
+    head->iswrite = 0;
+    return;
+  }
+  script_cmd_t* c = &s->cmds[s->pos];
+  head->iswait = c->iswait;
+  head->iswrite = !c->iswait;
+  if( c->iswait ){
+    head->ticks = vgm_time + c->wait;
+  }else{
+    head->writecmd = c->cmd;
+  }
+}
+
+void VGM_Head_cmdNext(VgmHead* head, u32 vgm_time)
+{
+  script_t* s = (script_t*)head->data;
+  if( in_callback ){
+    CHECK(head->playing, "head %d advanced while paused", (int)(s - scripts));
+    if( head->iswait )
+      CHECK((s32)(vgm_time - head->ticks) >= 0, "head %d: wait ended %d samples early", (int)(s - scripts), (int)(head->ticks - vgm_time));
+  }
+  ++s->cmdnext_calls;
+  ++s->pos;
+  load_cmd(head, vgm_time);
+}
+
+static void check_write(int h, VgmChipWriteCmd cmd)
+{
+  if( h < 0 || h >= NUM_HEADS ){
+    CHECK(0, "write from unknown head %d", h);
+    return;
+  }
+  script_t* s = &scripts[h];
+  CHECK(heads[h].playing, "head %d wrote to the chip while paused", h);
+  if( s->num_written >= s->num_expected ){
+    CHECK(0, "head %d: unexpected write", h);
+    return;
+  }
+  VgmChipWriteCmd e = s->expected[s->num_written++];
+  if( (cmd.cmd & 0x0f) == 0 )
+    CHECK(cmd.cmd == e.cmd && cmd.data == e.data, "head %d: PSG write %02x:%02x, expected %02x:%02x", h, cmd.cmd, cmd.data, e.cmd, e.data);
+  else
+    CHECK(cmd.cmd == e.cmd && cmd.addr == e.addr && cmd.data == e.data, "head %d: OPN2 write %02x:%02x:%02x, expected %02x:%02x:%02x", h, cmd.cmd, cmd.addr, cmd.data, e.cmd, e.addr, e.data);
+}
+
+s32 Genesis_OPN2Write(u8 board, u8 addrhi, u8 address, u8 data)
+{
+  VgmChipWriteCmd cmd = { .cmd = (board << 4) | 2 | addrhi, .addr = address, .data = data };
+  check_write(address - ADDR_BASE, cmd);
+  set_time(hr_time + 50);
+  return 0;
+}
+
+s32 Genesis_PSGWrite(u8 board, u8 data)
+{
+  VgmChipWriteCmd cmd = { .cmd = (board << 4), .data = data };
+  check_write(data >> 4, cmd);
+  set_time(hr_time + 20);
+  return 0;
+}
+
+void Genesis_CaptureOPN2OpStates(u8 board)
+{
+}
+
+#ifdef GENESIS_USE_WRITEQUEUE
+u8 Genesis_WriteQueue_Free(u8 board)
+{
+  return !writequeue_full[board];
+}
+#endif
+
+void VGM_PerfMon_ClockIn(u8 task)
+{
+}
+
+void VGM_PerfMon_ClockOut(u8 task)
+{
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Test helpers
+/////////////////////////////////////////////////////////////////////////////
+
+static void reset_heads(int num_heads, u32 t)
+{
+  int h;
+  set_time(t);
+  memset(heads, 0, sizeof(heads));
+  memset(scripts, 0, sizeof(scripts));
+  memset(writequeue_full, 0, sizeof(writequeue_full));
+  for(h=0; h<num_heads; ++h){
+    heads[h].data = &scripts[h];
+    vgm_heads[h] = &heads[h];
+  }
+  vgm_numheads = num_heads;
+  VGM_Player_Init();
+}
+
+static void add_wait(int h, u16 wait)
+{
+  script_t* s = &scripts[h];
+  s->cmds[s->num_cmds].iswait = 1;
+  s->cmds[s->num_cmds].wait = wait;
+  ++s->num_cmds;
+}
+
+// port: 0 for PSG, 2 or 3 for OPN2 port 0/1; chip >= GENESIS_COUNT is an invalid write
+static void add_write(int h, u8 chip, u8 port)
+{
+  script_t* s = &scripts[h];
+  VgmChipWriteCmd cmd;
+  cmd.all = 0;
+  cmd.cmd = (chip << 4) | port;
+  if( port )
+    cmd.addr = ADDR_BASE + h;
+  cmd.data = port ? (s->num_cmds & 0xff) : ((h << 4) | (s->num_cmds & 0x0f));
+  s->cmds[s->num_cmds].iswait = 0;
+  s->cmds[s->num_cmds].cmd = cmd;
+  ++s->num_cmds;
+  if( chip < GENESIS_COUNT )
+    s->expected[s->num_expected++] = cmd;
+}
+
+static void start_head(int h)
+{
+  scripts[h].pos = 0;
+  load_cmd(&heads[h], tim5.CNT);
+  heads[h].playing = 1;
+  VGM_Player_Reschedule();
+}
+
+// like mode_vgm.c: pause, optionally without telling the scheduler
+static void pause_head(int h, u8 reschedule)
+{
+  heads[h].playing = 0;
+  if( reschedule )
+    VGM_Player_Reschedule();
+}
+
+// like mode_vgm.c: restart the current wait at the current time
+static void resume_head(int h)
+{
+  heads[h].ticks = tim5.CNT;
+  heads[h].playing = 1;
+  VGM_Player_Reschedule();
+}
+
+static u16 callback(void)
+{
+  in_callback = 1;
+  u16 delay = VgmPlayer_WorkCallback();
+  in_callback = 0;
+  return delay;
+}
+
+static int all_done(int num_heads)
+{
+  int h;
+  for(h=0; h<num_heads; ++h)
+    if( !heads[h].isdone )
+      return 0;
+  return 1;
+}
+
+static void run_until_done(int num_heads)
+{
+  u32 steps;
+  for(steps=0; steps<MAX_STEPS && !all_done(num_heads); ++steps)
+    set_time(hr_time + callback());
+  CHECK(all_done(num_heads), "heads not finished after %d steps", MAX_STEPS);
+}
+
+static void check_complete(int num_heads)
+{
+  int h;
+  for(h=0; h<num_heads; ++h){
+    script_t* s = &scripts[h];
+    CHECK(s->num_written == s->num_expected, "head %d: %d of %d writes", h, s->num_written, s->num_expected);
+    CHECK(s->cmdnext_calls == s->num_cmds, "head %d: %u advances for %d commands", h, s->cmdnext_calls, s->num_cmds);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+// a head which is paused during a wait must not continue when the wait expires
+static void test_pause_in_wait(u8 reschedule)
+{
+  reset_heads(1, 1000 * VGMP_HRTICKSPERSAMPLE);
+  add_wait(0, 10);
+  add_write(0, 0, 2);
+  add_write(0, 0, 0);
+  start_head(0);
+  callback();
+
+  set_time(hr_time + 5 * VGMP_HRTICKSPERSAMPLE);
+  callback();
+  pause_head(0, reschedule);
+
+  int i;
+  for(i=0; i<50; ++i){
+    set_time(hr_time + VGMP_HRTICKSPERSAMPLE);
+    callback();
+  }
+  CHECK(scripts[0].cmdnext_calls == 0, "paused head advanced %u times", scripts[0].cmdnext_calls);
+  CHECK(scripts[0].num_written == 0, "paused head wrote %d times", scripts[0].num_written);
+
+  resume_head(0);
+  callback();
+  CHECK(scripts[0].num_written >= 1, "resumed head didn't write");
+  run_until_done(1);
+  check_complete(1);
+}
+
+// queued writes of a paused head must not reach the chip
+static void test_pause_in_writeq(u8 reschedule)
+{
+  reset_heads(2, 1000 * VGMP_HRTICKSPERSAMPLE);
+  int i;
+  // both heads write to OPN2 chip 0, the chip is busy after each write
+  for(i=0; i<20; ++i){
+    add_write(0, 0, 2);
+    add_write(1, 0, 3);
+  }
+  start_head(0);
+  start_head(1);
+  callback();
+  pause_head(1, reschedule);
+  u16 written = scripts[1].num_written;
+  for(i=0; i<200; ++i)
+    set_time(hr_time + callback());
+  CHECK(scripts[1].num_written == written, "paused head wrote %d times", scripts[1].num_written - written);
+  CHECK(heads[0].isdone, "other head didn't finish");
+
+  resume_head(1);
+  run_until_done(2);
+  check_complete(2);
+}
+
+// a head whose next write goes to a lower queue is written in the same callback
+static void test_requeue_lower(void)
+{
+  reset_heads(1, 1000 * VGMP_HRTICKSPERSAMPLE);
+  add_write(0, 1, 2); // OPN2 chip 1
+  add_write(0, 0, 0); // PSG chip 0
+  add_write(0, 1, 0); // PSG chip 1
+  add_write(0, 0, 2); // OPN2 chip 0
+  start_head(0);
+  callback();
+  CHECK(scripts[0].num_written == 4, "%d of 4 writes in the first callback", scripts[0].num_written);
+  check_complete(1);
+}
+
+// random scripts with random pause/resume
+static void test_stress(void)
+{
+  u32 e = errors;
+  int round;
+  for(round=0; round<STRESS_ROUNDS; ++round){
+    reset_heads(NUM_HEADS, rnd(0x40000000));
+    int h, i;
+    for(h=0; h<NUM_HEADS; ++h){
+      int num_cmds = 1 + rnd(MAX_CMDS - 1);
+      for(i=0; i<num_cmds; ++i){
+        switch( rnd(6) ){
+        case 0: add_wait(h, rnd(4) ? rnd(20) : 0); break;
+        case 1: add_write(h, rnd(8) ? rnd(GENESIS_COUNT) : 7, 0); break;
+        default: add_write(h, rnd(8) ? rnd(GENESIS_COUNT) : 7, 2 + rnd(2)); break;
+        }
+      }
+      start_head(h);
+    }
+
+    u32 steps;
+    for(steps=0; steps<MAX_STEPS && !all_done(NUM_HEADS); ++steps){
+      if( rnd(8) == 0 ){
+        h = rnd(NUM_HEADS);
+        if( heads[h].playing )
+          pause_head(h, rnd(2));
+        else
+          resume_head(h);
+      }
+      for(i=0; i<GENESIS_COUNT; ++i)
+        writequeue_full[i] = rnd(4) == 0;
+      u32 delay = callback();
+      set_time(hr_time + (rnd(4) ? delay : rnd(3 * VGMP_HRTICKSPERSAMPLE)));
+
+      // paused heads are resumed after a while, so that everything finishes
+      if( (steps % 64) == 63 )
+        for(h=0; h<NUM_HEADS; ++h)
+          if( !heads[h].playing )
+            resume_head(h);
+    }
+    CHECK(all_done(NUM_HEADS), "round %d: heads not finished", round);
+    check_complete(NUM_HEADS);
+    if( errors != e ){
+      printf("stress round %d failed\n", round);
+      return;
+    }
+  }
+}
+
+int main(void)
+{
+#ifdef GENESIS_USE_WRITEQUEUE
+  printf("VGM scheduler test (GENESIS_USE_WRITEQUEUE)\n");
+#else
+  printf("VGM scheduler test\n");
+#endif
+  test_pause_in_wait(0);
+  test_pause_in_wait(1);
+  printf("pause during wait: %s\n", errors ? "FAILED" : "OK");
+  u32 e = errors;
+  test_pause_in_writeq(0);
+  test_pause_in_writeq(1);
+  printf("pause with queued writes: %s\n", errors != e ? "FAILED" : "OK");
+  e = errors;
+  test_requeue_lower();
+  printf("write to a lower queue: %s\n", errors != e ? "FAILED" : "OK");
+  e = errors;
+  test_stress();
+  printf("random pause/resume, %d rounds: %s\n", STRESS_ROUNDS, errors != e ? "FAILED" : "OK");
+
+  return errors ? 1 : 0;
+}
@@ -20,12 +20,25 @@
  * For clarity (this is the same in the original implementation): next and
  * previous blocks are the actual block numbers of the consecutive blocks.
  * I.e. sizeof(c) == NBLOCK(c) - c, and sizeof(previous) == c - PBLOCK(c).
- * However next and previous FREE blocks are in an arbitrary order; newly
- * freed blocks are added to the head of the free list.
+ *
+ * Unlike umm_malloc, free blocks are kept in segregated free lists by size
+ * class: one list per exact size for 1..VGMH2_NUMEXACTCLASSES blocks, then
+ * one list per power of two above that. A bitmap records which lists are
+ * non-empty, so a small allocation takes the head of the smallest non-empty
+ * list which is big enough, without walking anything. Within a list, next and
+ * previous free blocks are in arbitrary order (newly freed blocks go to the
+ * head); PFREE == 0 marks the head of a list.
+ *
+ * The space after the last block is not on any free list: vgmh2_end is the
+ * end-of-heap block, and freeing the last block moves the end back down.
+ * vgmh2_realloc() grows blocks in place whenever the following block is free
+ * or is the end of the heap, which is the common case for VGM RAM sources
+ * growing one command at a time.
  */
 
 
 #include "vgm_heap2.h"
+#include "vgmplayer.h"
 
 #include <string.h>
 #include "FreeRTOS.h"
@@ -52,11 +65,21 @@ typedef struct{
 #define VGMH2_FREELIST_MASK (0x8000)
 #define VGMH2_BLOCKNO_MASK  (0x7FFF)
 
+//Exact-size classes for 1..16 blocks, then power-of-two classes 16..31,
+//32..63, ... up to the maximum block number
+#define VGMH2_NUMEXACTCLASSES 16
+#define VGMH2_NUMCLASSES      (VGMH2_NUMEXACTCLASSES + 11)
+
 //--------------------------------The heap--------------------------------------
 
 vgmh2_block *const vgmh2_heap = (vgmh2_block *const)(VGMH2_HEAPSTART);
 
 volatile u16 vgmh2_numusedblocks;
+vgmh2_stats_t vgmh2_stats;
+
+static u16 vgmh2_freelist[VGMH2_NUMCLASSES]; //First free block of each class, 0 if none
+static u32 vgmh2_freemap; //Bit set for each non-empty class
+static u16 vgmh2_end; //End-of-heap block
 
 //---------------------Some macros for quick access-----------------------------
 
@@ -68,6 +91,9 @@ volatile u16 vgmh2_numusedblocks;
 #define VGMH2_PFREE(b)  (VGMH2_BLOCK(b).body.free.prev)
 #define VGMH2_DATA(b)   (VGMH2_BLOCK(b).body.data)
 
+#define VGMH2_SIZE(b)   ((VGMH2_NBLOCK(b) & VGMH2_BLOCKNO_MASK) - (b))
+#define VGMH2_ISFREE(b) (VGMH2_NBLOCK(b) & VGMH2_FREELIST_MASK)
+
 //----------------------------Helper functions----------------------------------
 
 //How many blocks will we need to fit size bytes of data?
@@ -76,36 +102,155 @@ u16 vgmh2_blocks(size_t size){
     return 2 + ((size-5)/8);
 }
 
-//Create a new block at c+blocks, link it into the list.
-void vgmh2_make_new_block(u16 c, u16 blocks, u16 c_freemask){
-     VGMH2_NBLOCK(c+blocks) = VGMH2_NBLOCK(c) & VGMH2_BLOCKNO_MASK; //New block's N is originally-next block
-     VGMH2_PBLOCK(c+blocks) = c; //New block's P is current block
+//Which free list does a block of this many blocks belong in?
+static inline u8 vgmh2_class(u16 blocks){
+    if(blocks <= VGMH2_NUMEXACTCLASSES) return blocks - 1;
+    //floor(log2(blocks)) is >= 4 here
+    return VGMH2_NUMEXACTCLASSES - 4 + (31 - __builtin_clz(blocks));
+}
+
+//Add a block to the free list of its class, and mark it as free.
+static void vgmh2_free_insert(u16 c){
+    u8 cls = vgmh2_class(VGMH2_SIZE(c));
+    u16 first = vgmh2_freelist[cls];
+    VGMH2_NFREE(c) = first;
+    VGMH2_PFREE(c) = 0;
+    if(first) VGMH2_PFREE(first) = c;
+    vgmh2_freelist[cls] = c;
+    vgmh2_freemap |= (1ul << cls);
+    VGMH2_NBLOCK(c) |= VGMH2_FREELIST_MASK;
+}
+
+//Disconnect this block from its free list, and mark it as not free.
+//Must be called before the size of the block changes.
+static void vgmh2_free_unlink(u16 c){
+    u8 cls = vgmh2_class(VGMH2_SIZE(c));
+    if(VGMH2_PFREE(c)){
+        VGMH2_NFREE(VGMH2_PFREE(c)) = VGMH2_NFREE(c); //Connect previous to next
+    }else{
+        vgmh2_freelist[cls] = VGMH2_NFREE(c); //Was the head of the list
+        if(!vgmh2_freelist[cls]) vgmh2_freemap &= ~(1ul << cls);
+    }
+    if(VGMH2_NFREE(c)){
+        VGMH2_PFREE(VGMH2_NFREE(c)) = VGMH2_PFREE(c); //Connect next to previous
+    }
+    VGMH2_NBLOCK(c) &= VGMH2_BLOCKNO_MASK; //Mark current block as not free
+}
+
+//Find a free block of at least the given size, remove it from its free list,
+//and return it; or return 0 if there is none.
+static u16 vgmh2_free_take(u16 blocks){
+    u8 cls = vgmh2_class(blocks);
+    u32 map;
+    u16 c;
+    if(cls < VGMH2_NUMEXACTCLASSES){
+        //Every block in this class or any higher one is big enough
+        map = vgmh2_freemap & ~((1ul << cls) - 1);
+    }else{
+        //Every block in a higher class is big enough
+        map = vgmh2_freemap & ~((2ul << cls) - 1);
+        if(!map){
+            //Only blocks in this class might fit, search them
+            for(c = vgmh2_freelist[cls]; c; c = VGMH2_NFREE(c)){
+                if(VGMH2_SIZE(c) >= blocks){
+                    vgmh2_free_unlink(c);
+                    return c;
+                }
+            }
+            return 0;
+        }
+    }
+    if(!map) return 0;
+    c = vgmh2_freelist[__builtin_ctz(map)];
+    vgmh2_free_unlink(c);
+    return c;
+}
+
+//Split block c (not free) at c+blocks; the new upper block is not free either.
+static void vgmh2_split(u16 c, u16 blocks){
+    u16 n = VGMH2_NBLOCK(c);
+    VGMH2_NBLOCK(c+blocks) = n; //New block's N is originally-next block
+    VGMH2_PBLOCK(c+blocks) = c; //New block's P is current block
+    VGMH2_PBLOCK(n)        = c+blocks; //Originally-next block's P is new block
+    VGMH2_NBLOCK(c)        = c+blocks; //Current block's N is new block
+}
+
+//Make block c (not free) end at block n, which must be a block boundary.
+static void vgmh2_join(u16 c, u16 n){
+    VGMH2_NBLOCK(c) = n;
+    VGMH2_PBLOCK(n) = c;
+}
 
-     VGMH2_PBLOCK(VGMH2_NBLOCK(c) & VGMH2_BLOCKNO_MASK) = (c+blocks); //Originally-next block's P is new block
-     VGMH2_NBLOCK(c)                                    = (c+blocks) | c_freemask; //Current block's N is new block, and mark the current block as free or not
+//Move the end of the heap to just after block c (not free), which is
+//then blocks long. Returns 0 if there isn't room.
+static u8 vgmh2_set_end(u16 c, u16 blocks){
+    u16 newEndOfHeap = c + blocks;
+    if(newEndOfHeap >= VGMH2_NUMBLOCKS) return 0;
+    VGMH2_NBLOCK(newEndOfHeap) = 0;
+    VGMH2_PBLOCK(newEndOfHeap) = c;
+    VGMH2_NBLOCK(c) = newEndOfHeap;
+    vgmh2_end = newEndOfHeap;
+    return 1;
 }
 
-//Disconnect this block from the free list.
-void vgmh2_disconnect_from_free_list(u16 c){
-    VGMH2_NFREE(VGMH2_PFREE(c)) = VGMH2_NFREE(c); //Connect previous to next
-    VGMH2_PFREE(VGMH2_NFREE(c)) = VGMH2_PFREE(c); //Connect next to previous
-    VGMH2_NBLOCK(c) &= (~VGMH2_FREELIST_MASK); //Mark current block as not free
+//Give block c (not free, not on any list) back to the free space, merging
+//it with its neighbours.
+static void vgmh2_release(u16 c){
+    u16 n = VGMH2_NBLOCK(c);
+    u16 p = VGMH2_PBLOCK(c);
+    //Combine this block with the next if possible
+    if(VGMH2_ISFREE(n)){
+        vgmh2_free_unlink(n);
+        vgmh2_join(c, VGMH2_NBLOCK(n));
+    }
+    //Combine this block with the previous if possible
+    if(VGMH2_ISFREE(p)){
+        vgmh2_free_unlink(p);
+        vgmh2_join(p, VGMH2_NBLOCK(c));
+        c = p;
+    }
+    if(VGMH2_NBLOCK(c) == vgmh2_end){
+        //Last block in the heap, give it back to the space at the end
+        VGMH2_NBLOCK(c) = 0;
+        vgmh2_end = c;
+    }else{
+        vgmh2_free_insert(c);
+    }
 }
 
-//If the next block is free, combine the current block with it.
-void vgmh2_assimilate_up(u16 c){
-    if(VGMH2_NBLOCK(VGMH2_NBLOCK(c)) & VGMH2_FREELIST_MASK){ //Next block is free
-        vgmh2_disconnect_from_free_list(VGMH2_NBLOCK(c)); //Disconnect next block
-        VGMH2_PBLOCK(VGMH2_NBLOCK(VGMH2_NBLOCK(c)) & VGMH2_BLOCKNO_MASK) = c; //Next-next-previous point to current
-        VGMH2_NBLOCK(c) = VGMH2_NBLOCK(VGMH2_NBLOCK(c)) & VGMH2_BLOCKNO_MASK; //Next point to next-next
-    } 
+//Take blocksNeeded blocks from the free lists, or from the end of the heap.
+//Returns the new block (not free), or 0 if there isn't room. Not counted in
+//vgmh2_stats, the callers do that.
+static u16 vgmh2_alloc(u16 blocksNeeded){
+    u16 blockSize, cf;
+    cf = vgmh2_free_take(blocksNeeded);
+    if(cf){
+        //cf is a free block, allocate within that
+        blockSize = VGMH2_SIZE(cf);
+        if(blockSize > blocksNeeded){
+            //Create our block in the later half of this block; put the
+            //original (lower/remaining) portion back on the right free list
+            vgmh2_split(cf, blockSize-blocksNeeded);
+            vgmh2_free_insert(cf);
+            //Going to return the later block
+            cf += blockSize-blocksNeeded;
+        }
+    }else{
+        //No free block big enough, allocate at the end of the heap
+        cf = vgmh2_end;
+        if(!vgmh2_set_end(cf, blocksNeeded)){
+            //The end of heap block would be outside the memory segment
+            return 0;
+        }
+    }
+    vgmh2_numusedblocks += blocksNeeded; //Count the number of blocks used
+    return cf;
 }
 
-//Combine the current block with the previous one.
-u16 vgmh2_assimilate_down(u16 c, u16 p_freemask){
-    VGMH2_NBLOCK(VGMH2_PBLOCK(c)) = VGMH2_NBLOCK(c) | p_freemask; //Previous-next point to next, and mark previous as free or not
-    VGMH2_PBLOCK(VGMH2_NBLOCK(c)) = VGMH2_PBLOCK(c); //Next-previous point to previous
-    return VGMH2_PBLOCK(c); //Return previous
+static inline void vgmh2_clock_out(u32 starttime){
+    u32 t = VGM_Player_GetHRTime() - starttime;
+    vgmh2_stats.alloctime_total += t;
+    if(t > vgmh2_stats.alloctime_max) vgmh2_stats.alloctime_max = t;
 }
 
 //------------------------------Main functions----------------------------------
@@ -117,69 +262,32 @@ void vgmh2_init(){
     while(head < end) *head++ = 0;
     //Initialize used blocks counter
     vgmh2_numusedblocks = 2; //The head and the tail
-    //Initialize head of heap
+    //Initialize head and end of heap
     VGMH2_NBLOCK(0) = 1;
-    VGMH2_NFREE(0)  = 1;
+    vgmh2_end = 1;
+    //Initialize free lists
+    u8 i;
+    for(i=0; i<VGMH2_NUMCLASSES; ++i) vgmh2_freelist[i] = 0;
+    vgmh2_freemap = 0;
+    memset(&vgmh2_stats, 0, sizeof(vgmh2_stats));
 }
 
 void *vgmh2_malloc(size_t size){
     if(size == 0) return NULL;
-    u16 blocksNeeded, blockSize, bestSize, bestBlock, cf;
-    blocksNeeded = vgmh2_blocks(size);
+    u16 cf;
+    u32 starttime;
     vTaskSuspendAll(); //Enter critical section
+    starttime = VGM_Player_GetHRTime();
 
-    //Scan free list to find first/best fit
-    cf = VGMH2_NFREE(0);
-    bestBlock = cf;
-    bestSize  = 0x7FFF;
-    blockSize = 0;
-    while(VGMH2_NFREE(cf)){
-        blockSize = (VGMH2_NBLOCK(cf) & VGMH2_BLOCKNO_MASK) - cf;
-        //#if defined VGMH2_FIRST_FIT
-        //if((blockSize >= blocksNeeded))
-        //    break;
-        //#elif defined VGMH2_BEST_FIT
-        if((blockSize >= blocksNeeded) && (blockSize < bestSize)){
-            bestBlock = cf;
-            bestSize  = blockSize;
-        }
-        //#endif
-        cf = VGMH2_NFREE(cf);
-    }
-    if(0x7FFF != bestSize){
-        cf        = bestBlock;
-        blockSize = bestSize;
-    }//else there are no free blocks, try at the end of the heap
-    //Now cf is the block we're going to use, and blockSize is its size
-
-    if(VGMH2_NBLOCK(cf) & VGMH2_BLOCKNO_MASK){
-        //cf is a free block, allocate within that
-        if(blockSize == blocksNeeded){
-            //Exact fit, just mark it as not free
-            vgmh2_disconnect_from_free_list(cf);
-        }else{
-            //Create our block in the later half of this block; mark the original
-            //(lower/remaining) portion as free
-            vgmh2_make_new_block(cf, blockSize-blocksNeeded, VGMH2_FREELIST_MASK);
-            //Going to return the later block
-            cf += blockSize-blocksNeeded;
-        }
-    }else{
-        //cf is the block starting the free space at the end of the heap
-        //Is there enough remaining heap space to allocate the desired number of blocks?
-        u16 newEndOfHeap = cf + blocksNeeded; //The block to mark the end of the heap
-        if(newEndOfHeap >= VGMH2_NUMBLOCKS){
-            //The end of heap block would be outside the memory segment
-            xTaskResumeAll(); //Leave critical section
-            return malloc(size); //Allocate in primary heap instead
-        }
-        VGMH2_NFREE(VGMH2_PFREE(cf)) = newEndOfHeap; //Previous-next point to the end of the heap
-        memcpy(&VGMH2_BLOCK(newEndOfHeap), &VGMH2_BLOCK(cf), sizeof(vgmh2_block)); //Copied data: NBLOCK and NFREE are zeros, PFREE is whatever the last free block is, and PBLOCK will be overwritten next
-        VGMH2_PBLOCK(newEndOfHeap) = cf; //Previous of the end of the heap is current
-        VGMH2_NBLOCK(cf)           = newEndOfHeap; //Next of current is the end of the heap
+    cf = vgmh2_alloc(vgmh2_blocks(size));
+    if(!cf){
+        ++vgmh2_stats.fallbacks;
+        xTaskResumeAll(); //Leave critical section
+        return malloc(size); //Allocate in primary heap instead
     }
 
-    vgmh2_numusedblocks += blocksNeeded; //Count the number of blocks used
+    ++vgmh2_stats.allocs;
+    vgmh2_clock_out(starttime);
     xTaskResumeAll(); //Leave critical section
     return((void *)&VGMH2_DATA(cf)); //Return a pointer to the data section of the current block
 }
@@ -196,15 +304,16 @@ void *vgmh2_realloc(void *ptr, size_t size){
         //The pointer is outside this heap, it must have been created with normal malloc
         return realloc(ptr, size);
     }
-    u16 blocksNeeded, curSizeBlocks, c, new_numusedblocks;
+    u16 blocksNeeded, curSizeBlocks, c, n, nn, p;
     size_t curSizeBytes;
+    u32 starttime;
     vTaskSuspendAll(); //Enter critical section
+    starttime = VGM_Player_GetHRTime();
 
     blocksNeeded = vgmh2_blocks(size);
     c = (ptr-(void *)(VGMH2_HEAPSTART))/sizeof(vgmh2_block); //What block this pointer points to
-    curSizeBlocks = (VGMH2_NBLOCK(c) - c); //Current size of region in blocks
+    curSizeBlocks = VGMH2_SIZE(c); //Current size of region in blocks
     curSizeBytes  = (curSizeBlocks*8)-4; //Current size of region in bytes
-    new_numusedblocks = vgmh2_numusedblocks + blocksNeeded - curSizeBlocks; //Save the overall change in number of used blocks for if we succeed, because the malloc and free operations in here will mess up vgmh2_numusedblocks
 
     if(curSizeBlocks == blocksNeeded){
         //No change, or change by less than a block
@@ -212,46 +321,76 @@ void *vgmh2_realloc(void *ptr, size_t size){
         return(ptr);
     }
 
-    //Combine this block with any free space following it (this checks whether the next block is free)
-    vgmh2_assimilate_up(c);
+    if(curSizeBlocks > blocksNeeded){
+        //Shrink: split off the unused upper portion and free it
+        vgmh2_split(c, blocksNeeded);
+        vgmh2_numusedblocks -= curSizeBlocks - blocksNeeded;
+        vgmh2_release(c+blocksNeeded);
+        ++vgmh2_stats.reallocs_inplace;
+        vgmh2_clock_out(starttime);
+        xTaskResumeAll(); //Leave critical section
+        return(ptr);
+    }
 
-    //If the previous block is free, and the combined previous and current blocks
-    //would be enough space, combine them and move the data down to the lower block
-    if((VGMH2_NBLOCK(VGMH2_PBLOCK(c)) & VGMH2_FREELIST_MASK) &&
-            (blocksNeeded <= (VGMH2_NBLOCK(c)-VGMH2_PBLOCK(c)))){
-        vgmh2_disconnect_from_free_list(VGMH2_PBLOCK(c)); //Mark lower block as not free
-        c = vgmh2_assimilate_down(c, 0); //Combine the blocks, don't mark lower block as free, and now point to the lower one
+    //Grow: find the first block after any free space following this one
+    n = VGMH2_NBLOCK(c);
+    nn = VGMH2_ISFREE(n) ? (VGMH2_NBLOCK(n) & VGMH2_BLOCKNO_MASK) : n;
+    p = VGMH2_PBLOCK(c);
+    if(nn == vgmh2_end && c + blocksNeeded < VGMH2_NUMBLOCKS){
+        //Only free space up to the end of the heap, grow into it
+        if(n != nn) vgmh2_free_unlink(n);
+        vgmh2_set_end(c, blocksNeeded);
+        ++vgmh2_stats.reallocs_inplace;
+    }else if(nn - c >= blocksNeeded){
+        //Enough free space directly after this block
+        if(n != nn) vgmh2_free_unlink(n);
+        vgmh2_join(c, nn);
+        if(nn - c > blocksNeeded){
+            //Give back what we don't need
+            vgmh2_split(c, blocksNeeded);
+            vgmh2_free_insert(c+blocksNeeded);
+        }
+        ++vgmh2_stats.reallocs_inplace;
+    }else if(VGMH2_ISFREE(p) && nn - p >= blocksNeeded){
+        //The previous block is free, and the combined previous, current and
+        //any free next blocks would be enough space; move the data down
+        vgmh2_free_unlink(p);
+        if(n != nn) vgmh2_free_unlink(n);
+        vgmh2_join(p, nn);
+        c = p;
         memmove((void *)&VGMH2_DATA(c), ptr, curSizeBytes); //Move the original data down
         ptr = (void *)&VGMH2_DATA(c); //Make the returnable data pointer point to the new location
-    }
-
-    curSizeBlocks = (VGMH2_NBLOCK(c) - c); //Calculate the block size again
-    if(curSizeBlocks == blocksNeeded){
-        //do nothing, return the existing pointer
-    }else if(curSizeBlocks > blocksNeeded){
-        //Make a new block in the upper (unused) portion; mark the lower one as used
-        vgmh2_make_new_block(c, blocksNeeded, 0);
-        //Free the new (upper) block
-        vgmh2_free((void *)&VGMH2_DATA(c+blocksNeeded));
-    }else{
-        //We still don't have enough room
-        void *oldptr = ptr; //Save original pointer
-        ptr = vgmh2_malloc(size); //Malloc a new block that's actually big enough
-        if(ptr != NULL){
-            memcpy(ptr, oldptr, curSizeBytes); //Copy our data to it
+        if(nn - c > blocksNeeded){
+            vgmh2_split(c, blocksNeeded);
+            vgmh2_free_insert(c+blocksNeeded);
         }
-        vgmh2_free(oldptr); //In both cases free the original pointer
-        //Return ptr whether it's null or not
-    }
-
-    if(ptr != NULL){
-        //Realloc succeeded, store the new size (calculated above):
-        vgmh2_numusedblocks = new_numusedblocks;
+        ++vgmh2_stats.reallocs_moved;
     }else{
-        //New malloc failed, so free already took away and un-counted the used
-        //memory; vgmh2_numusedblocks was only updated by free, and is now correct
+        //We don't have enough room here; move the data to a new block.
+        //Counted and timed once, as a moved realloc, not as an alloc too
+        ++vgmh2_stats.reallocs_moved;
+        n = vgmh2_alloc(blocksNeeded);
+        if(!n){
+            //This heap is full, move to the primary heap instead
+            vgmh2_clock_out(starttime);
+            xTaskResumeAll(); //Leave critical section
+            void *newptr = malloc(size);
+            if(newptr != NULL){
+                memcpy(newptr, ptr, curSizeBytes); //Copy our data to it
+            }
+            vgmh2_free(ptr); //In both cases free the original pointer
+            return(newptr); //Return it whether it's null or not
+        }
+        memcpy((void *)&VGMH2_DATA(n), ptr, curSizeBytes); //Copy our data to it
+        vgmh2_numusedblocks -= curSizeBlocks;
+        vgmh2_release(c); //Overwrites the start of the data, so after the copy
+        vgmh2_clock_out(starttime);
+        xTaskResumeAll(); //Leave critical section
+        return((void *)&VGMH2_DATA(n));
     }
 
+    vgmh2_numusedblocks += blocksNeeded - curSizeBlocks;
+    vgmh2_clock_out(starttime);
     xTaskResumeAll(); //Leave critical section
     return(ptr);
 }
@@ -266,23 +405,26 @@ void vgmh2_free(void *ptr){
     u16 c;
     vTaskSuspendAll(); //Enter critical section
     c = (ptr-(void *)(&(vgmh2_heap[0])))/sizeof(vgmh2_block); //What block this pointer points to
-    vgmh2_numusedblocks -= (VGMH2_NBLOCK(c) - c); //Mark the size of this block as unused
-
-    //Combine this block with the next if possible
-    vgmh2_assimilate_up(c);
+    vgmh2_numusedblocks -= VGMH2_SIZE(c); //Mark the size of this block as unused
+    vgmh2_release(c);
+    xTaskResumeAll(); //Leave critical section
+}
 
-    //If the previous block is free,
-    if(VGMH2_NBLOCK(VGMH2_PBLOCK(c)) & VGMH2_FREELIST_MASK){
-        //combine this with it, marking the lower block as free
-        c = vgmh2_assimilate_down(c, VGMH2_FREELIST_MASK);
-    }else{
-        //Add this block to the head of the free list
-        VGMH2_PFREE(VGMH2_NFREE(0)) = c; //Previous of the first free block points to current one
-        VGMH2_NFREE(c)              = VGMH2_NFREE(0); //Current-next points to originally first free
-        VGMH2_PFREE(c)              = 0; //Previous of current is the head
-        VGMH2_NFREE(0)              = c; //First free block (next of head) is current
-        VGMH2_NBLOCK(c)          |= VGMH2_FREELIST_MASK; //Mark current block as free
+void vgmh2_get_freeinfo(vgmh2_freeinfo_t* info){
+    u8 cls;
+    u16 c, size;
+    info->regions = 0;
+    info->blocks = 0;
+    info->largest = 0;
+    vTaskSuspendAll(); //Enter critical section
+    for(cls=0; cls<VGMH2_NUMCLASSES; ++cls){
+        for(c = vgmh2_freelist[cls]; c; c = VGMH2_NFREE(c)){
+            size = VGMH2_SIZE(c);
+            ++info->regions;
+            info->blocks += size;
+            if(size > info->largest) info->largest = size;
+        }
     }
+    info->top = VGMH2_NUMBLOCKS - 1 - vgmh2_end;
     xTaskResumeAll(); //Leave critical section
 }
-
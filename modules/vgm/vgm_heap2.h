@@ -39,4 +39,25 @@ extern void vgmh2_free(void* ptr);
 
 extern volatile u16 vgmh2_numusedblocks;
 
+typedef struct {
+    u32 allocs;           //Allocations served by this heap
+    u32 fallbacks;        //Allocations which didn't fit and went to the primary heap
+    u32 reallocs_inplace; //Reallocs which kept their data where it was
+    u32 reallocs_moved;   //Reallocs which had to move their data
+    u32 alloctime_total;  //hr_ticks spent in vgmh2_malloc/vgmh2_realloc
+    u32 alloctime_max;    //Longest single call, in hr_ticks
+} vgmh2_stats_t;
+
+extern vgmh2_stats_t vgmh2_stats;
+
+typedef struct {
+    u16 regions; //Number of free regions on the free lists
+    u16 blocks;  //Total size of those, in blocks
+    u16 largest; //Largest of those, in blocks
+    u16 top;     //Unallocated blocks after the end of the heap
+} vgmh2_freeinfo_t;
+
+// Walks all free lists, don't call from time-critical code
+extern void vgmh2_get_freeinfo(vgmh2_freeinfo_t* info);
+
 #endif /* _VGM_HEAP2_H */
@@ -18,6 +18,7 @@
 #include <genesis.h>
 #include "vgm_heap2.h"
 #include "vgmtuning.h"
+#include "vgmplayer.h"
 
 VgmHead* vgm_heads[VGM_HEAD_MAXNUM];
 u32 vgm_numheads;
@@ -55,6 +56,7 @@ VgmHead* VGM_Head_Create(VgmSource* source, u32 freqmult, u32 tempomult, u32 tlo
     head->iswait = 1;
     head->iswrite = 0;
     head->isdone = 0;
+    head->schednext = NULL;
     if(source->type == VGM_SOURCE_TYPE_RAM){
         head->data = VGM_HeadRAM_Create(source);
     }else if(source->type == VGM_SOURCE_TYPE_STREAM){
@@ -70,6 +72,7 @@ VgmHead* VGM_Head_Create(VgmSource* source, u32 freqmult, u32 tempomult, u32 tlo
     }
     vgm_heads[vgm_numheads] = head;
     ++vgm_numheads;
+    VGM_Player_Reschedule();
     MIOS32_IRQ_Enable();
     return head;
 }
@@ -85,6 +88,7 @@ s32 VGM_Head_Delete(VgmHead* head){
             }
             vgm_heads[i] = NULL;
             --vgm_numheads;
+            VGM_Player_Reschedule();
             ret = 0;
             break;
         }
@@ -112,6 +116,7 @@ void VGM_Head_Restart(VgmHead* head, u32 vgm_time){
     }else if(head->source->type == VGM_SOURCE_TYPE_QUEUE){
         VGM_HeadQueue_Restart(head);
     }
+    VGM_Player_Reschedule();
 }
 void VGM_Head_cmdNext(VgmHead* head, u32 vgm_time){
     if(head == NULL) return;
@@ -40,7 +40,7 @@ typedef union {
 } VgmHead_Channel;
 
 typedef union {
-    u8 ALL[48];
+    u8 ALL[56];
     struct{
         VgmSource* source;
         void* data;
@@ -63,6 +63,7 @@ typedef union {
         u8 psgfreq0to1:1;
         u8 psglastchannel:2;
         u32 dummy:24;
+        void* schednext; //Used by the player's scheduler, don't touch
     };
 } VgmHead;
 
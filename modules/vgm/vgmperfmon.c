@@ -19,6 +19,7 @@
 static u32 timers[VGM_PERFMON_NUM_TASKS];
 static u8 percents[VGM_PERFMON_NUM_TASKS];
 static u32 last_time;
+static u32 stream_underflows;
 
 void VGM_PerfMon_ClockIn(u8 task){
     if(task >= VGM_PERFMON_NUM_TASKS) return;
@@ -43,6 +44,13 @@ u8 VGM_PerfMon_GetTaskCPU(u8 task){
     return percents[task];
 }
 
+void VGM_PerfMon_StreamUnderflow(){
+    ++stream_underflows;
+}
+u32 VGM_PerfMon_GetStreamUnderflows(){
+    return stream_underflows;
+}
+
 vgm_meminfo_t VGM_PerfMon_GetMemInfo(){
     vgm_meminfo_t ret;
     ret.main_total = configTOTAL_HEAP_SIZE >> 3;
@@ -51,3 +59,22 @@ vgm_meminfo_t VGM_PerfMon_GetMemInfo(){
     ret.vgmh2_used = vgmh2_numusedblocks;
     return ret;
 }
+
+vgm_heapinfo_t VGM_PerfMon_GetHeapInfo(){
+    vgm_heapinfo_t ret;
+    vgmh2_freeinfo_t fi;
+    vgmh2_get_freeinfo(&fi);
+    u32 totalfree = (u32)fi.blocks + fi.top;
+    u32 largest = (fi.largest > fi.top) ? fi.largest : fi.top;
+    u32 calls = vgmh2_stats.allocs + vgmh2_stats.reallocs_inplace + vgmh2_stats.reallocs_moved;
+    ret.freeregions = fi.regions;
+    ret.largestfree = largest;
+    ret.fragmentation = (totalfree == 0) ? 0 : (u8)((totalfree - largest) * 100 / totalfree);
+    ret.fallbackpercent = (vgmh2_stats.allocs + vgmh2_stats.fallbacks == 0) ? 0 :
+            (u8)(vgmh2_stats.fallbacks * 100 / (vgmh2_stats.allocs + vgmh2_stats.fallbacks));
+    ret.alloctime_mean = (calls == 0) ? 0 : (u16)(vgmh2_stats.alloctime_total / calls);
+    ret.alloctime_max = vgmh2_stats.alloctime_max;
+    ret.reallocs_inplace = vgmh2_stats.reallocs_inplace;
+    ret.reallocs_moved = vgmh2_stats.reallocs_moved;
+    return ret;
+}
@@ -24,6 +24,10 @@ extern void VGM_PerfMon_ClockIn(u8 task);
 extern void VGM_PerfMon_ClockOut(u8 task);
 
 extern void VGM_PerfMon_Periodic();
+
+// Called by stream heads each time they run out of prefetched data
+extern void VGM_PerfMon_StreamUnderflow();
+extern u32 VGM_PerfMon_GetStreamUnderflows();
 extern u8 VGM_PerfMon_GetTaskCPU(u8 task);
 
 typedef struct {
@@ -35,4 +39,17 @@ typedef struct {
 
 extern vgm_meminfo_t VGM_PerfMon_GetMemInfo();
 
+typedef struct {
+    u16 freeregions;    //Number of free regions in vgm_heap2 (excluding the end)
+    u16 largestfree;    //Largest contiguous free space, in blocks
+    u8 fragmentation;   //Percent of free vgm_heap2 space not in the largest free space
+    u8 fallbackpercent; //Percent of allocations which didn't fit and went to the main heap
+    u16 alloctime_mean; //Mean time per vgmh2_malloc/vgmh2_realloc, in hr_ticks
+    u32 alloctime_max;  //Longest vgmh2_malloc/vgmh2_realloc, in hr_ticks
+    u32 reallocs_inplace;
+    u32 reallocs_moved;
+} vgm_heapinfo_t;
+
+extern vgm_heapinfo_t VGM_PerfMon_GetHeapInfo();
+
 #endif /* _VGMPERFMON_H */
@@ -18,8 +18,8 @@
 
 
 typedef struct {
-    u32 opn2_lastwritetime;
-    u32 psg_lastwritetime;
+    u32 opn2_readytime; //TIM2 time at which the OPN2 may be written again
+    u32 psg_readytime;  //TIM2 time at which the PSG may be written again
 } vgmp_chipdata;
 
 static vgmp_chipdata chipdata[GENESIS_COUNT];
@@ -27,6 +27,131 @@ u8 VGM_Player_docapture;
 static u8 nextchiptocapture;
 static u32 lasttimecaptured;
 
+////////////////////////////////////////////////////////////////////////////////
+// Head scheduler
+//
+// Every head is in exactly one of three places:
+// - waitheap: binary min-heap of heads whose current command is a wait, keyed
+//   by the VGM time at which the wait ends (head->ticks)
+// - writeq: per-chip FIFO (linked through head->schednext) of heads whose
+//   current command is a write to that chip. Index is chip*2 + (OPN2 ? 1 : 0).
+// - parked: heads which are not playing, are done, or have no command; these
+//   are only polled for their playing flag.
+// Each callback therefore only touches due heads and chips which are ready.
+// A head which is paused while it is queued is parked once it comes up, it is
+// neither advanced nor written to the chip.
+// Anything that changes a head from outside the work callback (create, delete,
+// restart, seek, play/pause, setting head->ticks) must call
+// VGM_Player_Reschedule(), which rebuilds all of this from vgm_heads[] at the
+// beginning of the next callback.
+////////////////////////////////////////////////////////////////////////////////
+
+#define VGMP_NUMWRITEQ (GENESIS_COUNT*2)
+
+typedef struct {
+    VgmHead* first;
+    VgmHead* last;
+} vgmp_writeq;
+
+static VgmHead* waitheap[VGM_HEAD_MAXNUM];
+static u8 waitheap_n;
+static VgmHead* parked[VGM_HEAD_MAXNUM];
+static u8 parked_n;
+static vgmp_writeq writeq[VGMP_NUMWRITEQ];
+static volatile u8 needreschedule;
+
+//Wraparound-safe comparison of VGM times
+#define VGMP_TIMEBEFORE(a,b) ((s32)((a) - (b)) < 0)
+
+static void WaitHeap_Push(VgmHead* head){
+    u8 i = waitheap_n++, p;
+    while(i > 0){
+        p = (i - 1) >> 1;
+        if(!VGMP_TIMEBEFORE(head->ticks, waitheap[p]->ticks)) break;
+        waitheap[i] = waitheap[p];
+        i = p;
+    }
+    waitheap[i] = head;
+}
+static VgmHead* WaitHeap_Pop(){
+    VgmHead* top = waitheap[0];
+    VgmHead* last = waitheap[--waitheap_n];
+    u8 i = 0, c;
+    while(1){
+        c = (i << 1) + 1;
+        if(c >= waitheap_n) break;
+        if(c+1 < waitheap_n && VGMP_TIMEBEFORE(waitheap[c+1]->ticks, waitheap[c]->ticks)) ++c;
+        if(!VGMP_TIMEBEFORE(waitheap[c]->ticks, last->ticks)) break;
+        waitheap[i] = waitheap[c];
+        i = c;
+    }
+    waitheap[i] = last;
+    return top;
+}
+
+static void WriteQ_Push(u8 q, VgmHead* head){
+    head->schednext = NULL;
+    if(writeq[q].last == NULL){
+        writeq[q].first = head;
+    }else{
+        writeq[q].last->schednext = head;
+    }
+    writeq[q].last = head;
+}
+static VgmHead* WriteQ_Pop(u8 q){
+    VgmHead* head = writeq[q].first;
+    writeq[q].first = head->schednext;
+    if(writeq[q].first == NULL) writeq[q].last = NULL;
+    head->schednext = NULL;
+    return head;
+}
+
+//Put a head where it belongs according to its current command
+//Returns the write queue the head has been put into, or VGMP_NUMWRITEQ
+static u8 ScheduleHead(VgmHead* head, u32 vgm_time){
+    VgmChipWriteCmd cmd;
+    u8 chip, subcmd;
+    while(1){
+        if(!head->playing || head->isdone || !(head->iswait || head->iswrite)){
+            parked[parked_n++] = head;
+            return VGMP_NUMWRITEQ;
+        }
+        if(head->iswait){
+            WaitHeap_Push(head);
+            return VGMP_NUMWRITEQ;
+        }
+        cmd = head->writecmd;
+        chip = (cmd.cmd >> 4);
+        subcmd = (cmd.cmd & 0x0F);
+        if(chip >= GENESIS_COUNT || subcmd > 4 || subcmd == 1){
+            //Not a valid write (e.g. muted by mapping), skip it
+            VGM_Head_cmdNext(head, vgm_time);
+            continue;
+        }
+        WriteQ_Push((chip << 1) | (subcmd != 0), head);
+        return (chip << 1) | (subcmd != 0);
+    }
+}
+
+static void RebuildSchedule(u32 vgm_time){
+    u8 i;
+    VgmHead* h;
+    needreschedule = 0;
+    waitheap_n = 0;
+    parked_n = 0;
+    for(i=0; i<VGMP_NUMWRITEQ; ++i){
+        writeq[i].first = writeq[i].last = NULL;
+    }
+    for(i=0; i<vgm_numheads; ++i){
+        h = vgm_heads[i];
+        if(h != NULL) ScheduleHead(h, vgm_time);
+    }
+}
+
+void VGM_Player_Reschedule(){
+    needreschedule = 1;
+}
+
 u16 VgmPlayer_WorkCallback(){
     ////////////////////////////////////////////////////////////////////////
     // PLAY VGMS
@@ -37,80 +162,112 @@ u16 VgmPlayer_WorkCallback(){
     u32 minwait = 0xFFFFFFFF; s32 s; u32 u;
     u32 vgm_time = TIM5->CNT;
     VgmChipWriteCmd cmd;
-    u8 wrotetochip, chip, subcmd;
-    //Scan all VGMs for delays
-    u8 i;
-    for(i=0; i<vgm_numheads; ++i){
-        h = vgm_heads[i];
-        if(h != NULL && h->playing){
-            //Check for delay
-            if(VGM_Head_cmdIsWait(h)){
-                s = VGM_Head_cmdGetWaitRemaining(h, vgm_time);
-                if(s <= 0){
-                    //Advance to next command
-                    VGM_Head_cmdNext(h, vgm_time);
-                }else{
-                    u = s * VGMP_HRTICKSPERSAMPLE;
-                    if(u < minwait){
-                        //Store it as the shortest remaining time
-                        minwait = u;
-                    }
-                }
-            }
+    u8 chip, q, r, i, n, firstq, requeue;
+    static VgmHead* advanced[VGM_HEAD_MAXNUM];
+    if(needreschedule) RebuildSchedule(vgm_time);
+    //Check parked heads for having been (re)started
+    for(i=0; i<parked_n; ){
+        h = parked[i];
+        if(h->playing && !h->isdone && (h->iswait || h->iswrite)){
+            parked[i] = parked[--parked_n];
+            ScheduleHead(h, vgm_time);
+        }else{
+            ++i;
+        }
+    }
+    //Advance all heads whose wait has expired. Each head advances by at most
+    //one wait per callback; heads still waiting afterwards are scheduled
+    //again only after the heap has been drained, so that a zero-length wait
+    //(e.g. stream head waiting for the SD card) can't lock up the callback.
+    n = 0;
+    while(waitheap_n > 0 && !VGMP_TIMEBEFORE(vgm_time, waitheap[0]->ticks)){
+        h = WaitHeap_Pop();
+        if(!h->playing){
+            //Paused while waiting, resume starts it again from the parked list
+            parked[parked_n++] = h;
+            continue;
         }
+        VGM_Head_cmdNext(h, vgm_time);
+        advanced[n++] = h;
+    }
+    for(i=0; i<n; ++i){
+        ScheduleHead(advanced[i], vgm_time);
     }
-    //Scan all VGMs for pending chip write commands
-    wrotetochip = 1;
-    while(wrotetochip){
-        wrotetochip = 0;
-        for(i=0; i<vgm_numheads; ++i){
-            h = vgm_heads[i];
-            if(h != NULL && h->playing){
-                //Check for command
-                if(VGM_Head_cmdIsChipWrite(h)){
+    //Write to every chip which is ready and has heads waiting to write to it.
+    //A head whose next write goes to a queue which has already been handled
+    //causes another pass from that queue.
+    requeue = 0;
+    do{
+        firstq = requeue;
+        requeue = VGMP_NUMWRITEQ;
+        for(q=firstq; q<VGMP_NUMWRITEQ; ++q){
+            chip = q >> 1;
+            while(writeq[q].first != NULL){
+                if(!writeq[q].first->playing){
+                    //Paused: don't write anything more to the chip
+                    h = WriteQ_Pop(q);
+                    parked[parked_n++] = h;
+                    continue;
+                }
+#ifdef GENESIS_USE_WRITEQUEUE
+                //The driver does the busy timing, we only need room in its queue
+                if(!Genesis_WriteQueue_Free(chip)){
+                    if(VGMP_PSGBUSYDELAY < minwait) minwait = VGMP_PSGBUSYDELAY;
+                    break;
+                }
+                h = WriteQ_Pop(q);
+                cmd = h->writecmd;
+                if(q & 1){
+                    Genesis_OPN2Write(chip, (cmd.cmd & 0x01), cmd.addr, cmd.data);
+                }else{
+                    Genesis_PSGWrite(chip, cmd.data);
+                }
+#else
+                u32 hr_time = TIM2->CNT;
+                if(q & 1){
+                    //OPN2 write
+                    if(VGMP_TIMEBEFORE(hr_time, chipdata[chip].opn2_readytime)){
+                        u = chipdata[chip].opn2_readytime - hr_time;
+                        if(u < minwait) minwait = u;
+                        break;
+                    }
+                    h = WriteQ_Pop(q);
                     cmd = h->writecmd;
-                    chip = (cmd.cmd >> 4);
-                    subcmd = (cmd.cmd & 0x0F);
-                    if(chip >= GENESIS_COUNT || subcmd > 4 || subcmd == 1){
-                        VGM_Head_cmdNext(h, vgm_time);
-                        wrotetochip = 1;
-                    }else if(subcmd == 0){
-                        //PSG write
-                        u = TIM2->CNT - chipdata[chip].psg_lastwritetime;
-                        if(u < VGMP_PSGBUSYDELAY){
-                            u = VGMP_PSGBUSYDELAY - u;
-                            if(u < minwait){
-                                minwait = u;
-                            }
-                        }else{
-                            Genesis_PSGWrite(chip, cmd.data);
-                            VGM_Head_cmdNext(h, vgm_time);
-                            chipdata[chip].psg_lastwritetime = TIM2->CNT;
-                            wrotetochip = 1;
-                        }
+                    Genesis_OPN2Write(chip, (cmd.cmd & 0x01), cmd.addr, cmd.data);
+                    //Don't delay after 0x2x commands
+                    if(cmd.addr >= 0x20 && cmd.addr < 0x2F && cmd.addr != 0x28){
+                        chipdata[chip].opn2_readytime = TIM2->CNT;
                     }else{
-                        //OPN2 write
-                        u = TIM2->CNT - chipdata[chip].opn2_lastwritetime;
-                        if(u < VGMP_OPN2BUSYDELAY){
-                            u = VGMP_OPN2BUSYDELAY - u;
-                            if(u < minwait){
-                                minwait = u;
-                            }
-                        }else{
-                            Genesis_OPN2Write(chip, (cmd.cmd & 0x01), cmd.addr, cmd.data);
-                            VGM_Head_cmdNext(h, vgm_time);
-                            //Don't delay after 0x2x commands
-                            if(cmd.addr >= 0x20 && cmd.addr < 0x2F && cmd.addr != 0x28){
-                                chipdata[chip].opn2_lastwritetime = TIM2->CNT - VGMP_OPN2BUSYDELAY;
-                            }else{
-                                chipdata[chip].opn2_lastwritetime = TIM2->CNT;
-                            }
-                            wrotetochip = 1;
-                        }
+                        chipdata[chip].opn2_readytime = TIM2->CNT + VGMP_OPN2BUSYDELAY;
                     }
+                }else{
+                    //PSG write
+                    if(VGMP_TIMEBEFORE(hr_time, chipdata[chip].psg_readytime)){
+                        u = chipdata[chip].psg_readytime - hr_time;
+                        if(u < minwait) minwait = u;
+                        break;
+                    }
+                    h = WriteQ_Pop(q);
+                    cmd = h->writecmd;
+                    Genesis_PSGWrite(chip, cmd.data);
+                    chipdata[chip].psg_readytime = TIM2->CNT + VGMP_PSGBUSYDELAY;
                 }
+#endif
+                VGM_Head_cmdNext(h, vgm_time);
+                r = ScheduleHead(h, vgm_time);
+                if(r < q && r < requeue) requeue = r;
             }
         }
+    }while(requeue < VGMP_NUMWRITEQ);
+    //Earliest wait still pending
+    if(waitheap_n > 0){
+        s = (s32)(waitheap[0]->ticks - vgm_time);
+        if(s <= 0){
+            minwait = 0;
+        }else{
+            u = s * VGMP_HRTICKSPERSAMPLE;
+            if(u < minwait) minwait = u;
+        }
     }
     //Set up next delay
     if(minwait < 100){
@@ -119,7 +276,11 @@ u16 VgmPlayer_WorkCallback(){
     }else if(minwait > VGMP_MAXDELAY){
         if(VGM_Player_docapture 
                 && (TIM2->CNT - lasttimecaptured >= 30000)
-                && (TIM2->CNT - chipdata[nextchiptocapture].opn2_lastwritetime >= VGMP_OPN2BUSYDELAY)){
+#ifdef GENESIS_USE_WRITEQUEUE
+                //The capture would perform the queued writes in this interrupt
+                && Genesis_WriteQueue_Free(nextchiptocapture) == GENESIS_WRITEQUEUE_LENGTH
+#endif
+                && !VGMP_TIMEBEFORE(TIM2->CNT, chipdata[nextchiptocapture].opn2_readytime)){
             //If we have plenty of time, capture some operator states
             Genesis_CaptureOPN2OpStates(nextchiptocapture);
             lasttimecaptured = TIM2->CNT;
@@ -188,6 +349,13 @@ void VGM_Player_Init(){
     TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE); //Enable interrupts
     MIOS32_IRQ_Install(TIM3_IRQn, MIOS32_IRQ_PRIO_INSANE); //highest priority!
     TIM_Cmd(TIM3, ENABLE); //Start counting!
+    //Init scheduler
+    u8 i;
+    for(i=0; i<GENESIS_COUNT; ++i){
+        chipdata[i].opn2_readytime = TIM2->CNT;
+        chipdata[i].psg_readytime = TIM2->CNT;
+    }
+    VGM_Player_Reschedule();
     //Init capture
     VGM_Player_docapture = 0;
     nextchiptocapture = 0;
@@ -32,6 +32,11 @@ static inline u32 VGM_Player_GetVGMTime() { return TIM5->CNT; }
 // Call at startup
 extern void VGM_Player_Init();
 
+// Call after changing the set of heads or the state of a head from outside the
+// player (create, delete, restart, seek, play/pause, setting head->ticks); the
+// head schedule will be rebuilt at the start of the next work callback
+extern void VGM_Player_Reschedule();
+
 extern u8 VGM_Player_docapture;
 
 
@@ -200,10 +200,12 @@ s32 VGM_HeadRAM_Forward1(VgmHead* head){
     if(head->srcaddr == vsr->numcmds){
         //Don't loop back
         head->isdone = 1;
+        VGM_Player_Reschedule();
         return 0;
     }
     //Otherwise, prepare the next command
     VGM_HeadRAM_InternalCmdNext(head, vsr, vhr);
+    VGM_Player_Reschedule();
     return 0;
 }
 s32 VGM_HeadRAM_Backward1(VgmHead* head){
@@ -281,6 +283,7 @@ s32 VGM_HeadRAM_Backward1(VgmHead* head){
     }
     //Prepare the next command
     VGM_HeadRAM_InternalCmdNext(head, vsr, vhr);
+    VGM_Player_Reschedule();
     return 0;
 }
 s32 VGM_HeadRAM_SeekTo(VgmHead* head, u32 newaddr){
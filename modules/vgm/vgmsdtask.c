@@ -31,25 +31,38 @@ u8 vgm_sdtask_usingsdcard;
 static void VGM_SDTask(void* pvParameters){
     portTickType xLastExecutionTime;
     xLastExecutionTime = xTaskGetTickCount();
-    u8 i, fi = 0;
+    u8 i;
+    u16 loads;
+    s32 u, bestu;
     VgmHead* vh;
+    VgmHead* best;
     while(1){
         vTaskDelayUntil(&xLastExecutionTime, 1 / portTICK_RATE_MS);
-        i = fi;
-        while(1){
-            if(vgm_sdtask_disable){
-                fi = i; //start back where you are now
-                break; //stop immediately
-            }
+        //Track how fast each stream is being read
+        for(i=0; i<vgm_numheads; ++i){
             vh = vgm_heads[i];
-            if(vh != NULL){
-                if(vh->playing && vh->source->type == VGM_SOURCE_TYPE_STREAM){
-                    VGM_HeadStream_BackgroundBuffer(vh);
+            if(vh != NULL && vh->playing && vh->source->type == VGM_SOURCE_TYPE_STREAM){
+                VGM_HeadStream_UpdateRate(vh);
+            }
+        }
+        //Keep loading the stream closest to running out, until all rings are
+        //full (bounded, in case the player keeps jumping around)
+        for(loads=0; loads<VGM_HEAD_MAXNUM*VGM_HEADSTREAM_NUMBUFS; ++loads){
+            if(vgm_sdtask_disable) break; //stop immediately
+            best = NULL;
+            bestu = 0x7FFFFFFF;
+            for(i=0; i<vgm_numheads; ++i){
+                vh = vgm_heads[i];
+                if(vh != NULL && vh->playing && vh->source->type == VGM_SOURCE_TYPE_STREAM){
+                    u = VGM_HeadStream_BufferUrgency(vh);
+                    if(u >= 0 && u < bestu){
+                        best = vh;
+                        bestu = u;
+                    }
                 }
             }
-            ++i;
-            if(i >= vgm_numheads) i = 0;
-            if(i == fi) break; //Have done them all
+            if(best == NULL) break; //Nothing to load
+            VGM_HeadStream_BackgroundBuffer(best);
         }
     }
 }
@@ -18,23 +18,46 @@
 #include "vgmtuning.h"
 #include "vgm_heap2.h"
 #include <genesis.h>
+#include <string.h>
 
 
+#define RINGOFFSET(addr) ((addr) & (VGM_HEADSTREAM_RINGSIZE-1))
+
+//Is [addr, addr+len) loaded in the ring?
+static inline u8 VGM_HeadStream_isLoaded(VgmHeadStream* vhs, u32 addr, u32 len){
+    return vhs->validgen == vhs->wantgen && addr >= vhs->validstart && addr + len <= vhs->validend;
+}
+
+//Continue reading at addr; returns 0 if the ring has to be reloaded first
+static u8 VGM_HeadStream_jumpTo(VgmHead* head, VgmHeadStream* vhs, u32 addr){
+    head->srcaddr = addr;
+    vhs->subbufferlen = 0;
+    if(VGM_HeadStream_isLoaded(vhs, addr, 1)) return 1;
+    vhs->wantaddr = addr;
+    ++vhs->wantgen;
+    return 0;
+}
+
 u8 VGM_HeadStream_bufferNextCommand(VgmHead* head, VgmHeadStream* vhs, VgmSourceStream* vss){
     if(vhs->subbufferlen == VGM_HEADSTREAM_SUBBUFFER_MAXLEN) return 0;
-    u8 type = VGM_HeadStream_getByte(vss, vhs, head->srcaddr);
-    u8 len = VGM_Cmd_GetCmdLen(type);
-    if(len + 1 + vhs->subbufferlen <= VGM_HEADSTREAM_SUBBUFFER_MAXLEN){
-        ++head->srcaddr;
-        vhs->subbuffer[vhs->subbufferlen++] = type;
-        u8 i;
-        for(i=0; i<len; ++i){
-            vhs->subbuffer[vhs->subbufferlen++] = VGM_HeadStream_getByte(vss, vhs, head->srcaddr++);
-        }
-        return 1;
+    u32 addr = head->srcaddr;
+    if(!VGM_HeadStream_isLoaded(vhs, addr, 1)) return 0;
+    u8 len = VGM_Cmd_GetCmdLen(vhs->ring[RINGOFFSET(addr)]) + 1;
+    if(len + vhs->subbufferlen > VGM_HEADSTREAM_SUBBUFFER_MAXLEN) return 0;
+    if(!VGM_HeadStream_isLoaded(vhs, addr, len)) return 0;
+    //Copy the whole command out of the ring at once
+    u8* dest = &vhs->subbuffer[vhs->subbufferlen];
+    u32 ofs = RINGOFFSET(addr);
+    if(ofs + len <= VGM_HEADSTREAM_RINGSIZE){
+        memcpy(dest, &vhs->ring[ofs], len);
     }else{
-        return 0;
+        u32 first = VGM_HEADSTREAM_RINGSIZE - ofs;
+        memcpy(dest, &vhs->ring[ofs], first);
+        memcpy(dest + first, vhs->ring, len - first);
     }
+    head->srcaddr += len;
+    vhs->subbufferlen += len;
+    return 1;
 }
 void VGM_HeadStream_unBuffer(VgmHeadStream* vhs, u8 len){
     if(len > vhs->subbufferlen) len = vhs->subbufferlen;
@@ -49,30 +72,30 @@ VgmHeadStream* VGM_HeadStream_Create(VgmSource* source){
     VgmHeadStream* vhs = vgmh2_malloc(sizeof(VgmHeadStream));
     vhs->srcblockaddr = 0;
     vhs->subbufferlen = 0;
-    vhs->buffer1 = malloc(VGM_SOURCESTREAM_BUFSIZE); //Buffers accessed using DMA,
-    vhs->buffer2 = malloc(VGM_SOURCESTREAM_BUFSIZE); //have to use normal malloc
-    vhs->buffer1addr = 0xFFFFFFFF;
-    vhs->buffer2addr = 0xFFFFFFFF;
-    vhs->wantbuffer = 0;
-    vhs->wantbufferaddr = 0;
+    vhs->ring = malloc(VGM_HEADSTREAM_RINGSIZE); //Buffers accessed using DMA, have to use normal malloc
+    vhs->validstart = 0;
+    vhs->validend = 0;
+    vhs->wantaddr = 0;
+    vhs->wantgen = 1; //Nothing loaded yet
+    vhs->validgen = 0;
+    vhs->stalled = 0;
+    vhs->lastsrcaddr = 0;
+    vhs->rate = 0;
+    vhs->underflows = 0;
     return vhs;
 }
 void VGM_HeadStream_Delete(void* headstream){
     VgmHeadStream* vhs = (VgmHeadStream*)headstream;
-    free(vhs->buffer1);
-    free(vhs->buffer2);
+    free(vhs->ring);
     vgmh2_free(vhs);
 }
 void VGM_HeadStream_Restart(VgmHead* head){
     VgmHeadStream* vhs = (VgmHeadStream*)head->data;
     VgmSourceStream* vss = (VgmSourceStream*)head->source->data;
-    head->srcaddr = (head->source->markstart < vss->vgmdatastartaddr) 
-            ? vss->vgmdatastartaddr : head->source->markstart;
     vhs->srcblockaddr = 0;
-    vhs->buffer1addr = 0xFFFFFFFF;
-    vhs->buffer2addr = 0xFFFFFFFF;
-    vhs->wantbufferaddr = head->srcaddr;
-    vhs->wantbuffer = 1;
+    VGM_HeadStream_jumpTo(head, vhs, (head->source->markstart < vss->vgmdatastartaddr) 
+            ? vss->vgmdatastartaddr : head->source->markstart);
+    vhs->lastsrcaddr = head->srcaddr;
     DBG("HeadStream_Restart srcaddr=%d", head->srcaddr);
     VGM_HeadStream_cmdNext(head, VGM_Player_GetVGMTime());
 }
@@ -83,54 +106,40 @@ u8 VGM_HeadStream_cmdNext(VgmHead* head, u32 vgm_time){
     head->iswait = head->iswrite = 0;
     u8 dontunbuffer;
     while(!(head->iswait || head->iswrite || head->isdone)){
-        //Check if we will have to skip a data block (buffer miss)
         if(vhs->subbufferlen != 0 && vhs->subbuffer[0] == 0x67){ //There's a command buffered, and it's data block
             //Load the block parameters and skip
             u32 l = vhs->subbuffer[3] | ((u32)vhs->subbuffer[4] << 8) 
                 | ((u32)vhs->subbuffer[5] << 16) | ((u32)vhs->subbuffer[6] << 24);
-            head->srcaddr += l;
-            VGM_HeadStream_unBuffer(vhs, 7); //Remove this command from subbuffer
-            //Set up the stream where the block ends
-            vhs->wantbufferaddr = head->srcaddr;
-            vhs->wantbuffer = 1;
-            head->iswait = 1; //Act as a wait for 0 (or negative) time
-            return 0; //Report that the command couldn't be loaded
-        }else if(vhs->subbufferlen == 0){
-            //Check if we're about to run out of buffer
-            if(head->srcaddr >= vhs->buffer1addr && head->srcaddr < (vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE)){
-                //We're in buffer1
-                if((vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE - head->srcaddr) < VGM_HEADSTREAM_SUBBUFFER_MAXLEN 
-                        && vhs->buffer2addr != (vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE)){
-                    //About to run out of buffer1, and buffer2 isn't ready
-                    vhs->wantbufferaddr = (vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE);
-                    vhs->wantbuffer = 2; //in case you didn't know already
-                    head->iswait = 1; //Act as a wait for 0 (or negative) time
-                    return 0; //Report that the command couldn't be loaded
-                }
-            }else if(head->srcaddr >= vhs->buffer2addr && head->srcaddr < (vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE)){
-                //We're in buffer2
-                if((vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE - head->srcaddr) < VGM_HEADSTREAM_SUBBUFFER_MAXLEN 
-                        && vhs->buffer1addr != (vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE)){
-                    //About to run out of buffer2, and buffer1 isn't ready
-                    vhs->wantbufferaddr = (vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE);
-                    vhs->wantbuffer = 1; //in case you didn't know already
-                    head->iswait = 1; //Act as a wait for 0 (or negative) time
-                    return 0; //Report that the command couldn't be loaded
-                }
-            }else{
-                //We're not in either buffer
-                vhs->wantbufferaddr = head->srcaddr;
-                vhs->wantbuffer = 1; //in case you didn't know already
+            if(!VGM_HeadStream_jumpTo(head, vhs, head->srcaddr + l)){
                 head->iswait = 1; //Act as a wait for 0 (or negative) time
                 return 0; //Report that the command couldn't be loaded
             }
+            continue;
+        }
+        //Make sure a whole subbuffer's worth of data is loaded (or the rest
+        //of the file), so no command below can run off the end of the ring
+        if(!VGM_HeadStream_isLoaded(vhs, head->srcaddr, VGM_HEADSTREAM_SUBBUFFER_MAXLEN - vhs->subbufferlen)
+                && !(vhs->validend >= vss->datalen && VGM_HeadStream_isLoaded(vhs, head->srcaddr, 0))){
+            if(vhs->validgen == vhs->wantgen && !vhs->stalled){
+                //Not waiting for a reload, the SD task didn't keep up
+                vhs->stalled = 1;
+                ++vhs->underflows;
+                VGM_PerfMon_StreamUnderflow();
+            }
+            head->iswait = 1; //Act as a wait for 0 (or negative) time
+            return 0; //Report that the command couldn't be loaded
         }
+        vhs->stalled = 0;
         if(head->srcaddr > head->source->markend){
             head->isdone = 1;
             break;
         }
         if(vhs->subbufferlen == 0){
-            VGM_HeadStream_bufferNextCommand(head, vhs, vss); //Should never return 0
+            if(!VGM_HeadStream_bufferNextCommand(head, vhs, vss)){
+                //Truncated command at the end of the file
+                head->isdone = 1;
+                break;
+            }
         }
         type = vhs->subbuffer[0];
         cmdlen = VGM_Cmd_GetCmdLen(type);
@@ -225,11 +234,7 @@ u8 VGM_HeadStream_cmdNext(VgmHead* head, u32 vgm_time){
             //End of data
             if(head->source->loopaddr >= vss->vgmdatastartaddr && head->source->loopaddr < vss->datalen){
                 //Jump to loop point
-                head->srcaddr = head->source->loopaddr;
-                VGM_HeadStream_unBuffer(vhs, 1); //Remove this command from subbuffer
-                //Set up to stream from here
-                vhs->wantbufferaddr = head->srcaddr;
-                vhs->wantbuffer = 1;
+                VGM_HeadStream_jumpTo(head, vhs, head->source->loopaddr);
                 head->iswait = 1; //Act as a wait for 0 (or negative) time
                 return 0; //Report that the command couldn't be loaded
             }else{
@@ -242,14 +247,11 @@ u8 VGM_HeadStream_cmdNext(VgmHead* head, u32 vgm_time){
             //a = vhs->subbuffer[2]; //== 0, format other than uncompressed YM2612 PCM not supported
             u32 l = vhs->subbuffer[3] | ((u32)vhs->subbuffer[4] << 8) 
                     | ((u32)vhs->subbuffer[5] << 16) | ((u32)vhs->subbuffer[6] << 24);
-            head->srcaddr += l;
-            VGM_HeadStream_unBuffer(vhs, 7); //Remove this command from subbuffer
-            //Set up the stream where the block ends
-            vhs->wantbufferaddr = head->srcaddr;
-            vhs->wantbuffer = 1;
-            head->iswait = 1; //Act as a wait for 0 (or negative) time
-            return 0; //Report that the command couldn't be loaded
-            //}
+            if(!VGM_HeadStream_jumpTo(head, vhs, head->srcaddr + l)){
+                head->iswait = 1; //Act as a wait for 0 (or negative) time
+                return 0; //Report that the command couldn't be loaded
+            }
+            continue;
         }else if(type == 0xE0){
             //Seek in data block
             vhs->srcblockaddr = vhs->subbuffer[1] | ((u32)vhs->subbuffer[2] << 8) 
@@ -263,38 +265,72 @@ u8 VGM_HeadStream_cmdNext(VgmHead* head, u32 vgm_time){
 }
 u8 VGM_HeadStream_getByte(VgmSourceStream* vss, VgmHeadStream* vhs, u32 addr){
     if(addr >= vss->datalen) return 0;
-    if(addr >= vhs->buffer1addr && addr < (vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE)){
-        if(vhs->buffer2addr != vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE){
-            //Set up to background buffer next
-            vhs->wantbuffer = 2;
-            vhs->wantbufferaddr = vhs->buffer1addr + VGM_SOURCESTREAM_BUFSIZE;
-        }
-        return vhs->buffer1[addr - vhs->buffer1addr];
-    }
-    if(addr >= vhs->buffer2addr && addr < (vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE)){
-        if(vhs->buffer1addr != vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE){
-            //Set up to background buffer next
-            vhs->wantbuffer = 1;
-            vhs->wantbufferaddr = vhs->buffer2addr + VGM_SOURCESTREAM_BUFSIZE;
-        }
-        return vhs->buffer2[addr - vhs->buffer2addr];
-    }
+    if(VGM_HeadStream_isLoaded(vhs, addr, 1)) return vhs->ring[RINGOFFSET(addr)];
     DBG("VGM_HeadStream_getByte() buffer underflow!");
     return 0x66; //error, stop stream
 }
+
+void VGM_HeadStream_UpdateRate(VgmHead* head){
+    VgmHeadStream* vhs = (VgmHeadStream*)head->data;
+    u32 srcaddr = head->srcaddr;
+    u32 consumed = srcaddr - vhs->lastsrcaddr;
+    vhs->lastsrcaddr = srcaddr;
+    if(consumed > VGM_HEADSTREAM_RINGSIZE) consumed = 0; //Jumped, don't count it
+    //Moving average over about 8 periods
+    vhs->rate = vhs->rate - (vhs->rate >> 3) + (u16)((consumed << 4) >> 3);
+}
+s32 VGM_HeadStream_BufferUrgency(VgmHead* head){
+    VgmHeadStream* vhs = (VgmHeadStream*)head->data;
+    VgmSourceStream* vss = (VgmSourceStream*)head->source->data;
+    if(vhs->validgen != vhs->wantgen) return 0;
+    u32 validend = vhs->validend;
+    u32 srcaddr = head->srcaddr;
+    if(validend >= vss->datalen) return -1; //Rest of file is loaded
+    //Buffers from the one srcaddr is in onwards are still needed
+    if(validend - (srcaddr & ~(VGM_SOURCESTREAM_BUFSIZE-1)) > VGM_HEADSTREAM_RINGSIZE - VGM_SOURCESTREAM_BUFSIZE) return -1;
+    u32 ahead = (srcaddr < validend) ? (validend - srcaddr) : 0;
+    return (s32)((ahead << 4) / ((u32)vhs->rate + 1));
+}
 void VGM_HeadStream_BackgroundBuffer(VgmHead* head){
     VgmHeadStream* vhs = (VgmHeadStream*)head->data;
     VgmSourceStream* vss = (VgmSourceStream*)head->source->data;
-    u8* bufferto = NULL;
-    u32* addrto = NULL;
-    if(vhs->wantbuffer == 1){
-        bufferto = vhs->buffer1;
-        addrto = &(vhs->buffer1addr);
-    }else if(vhs->wantbuffer == 2){
-        bufferto = vhs->buffer2;
-        addrto = &(vhs->buffer2addr);
+    u32 start, len, keep, slot, n;
+    u8 gen, reload;
+    MIOS32_IRQ_Disable();
+    gen = vhs->wantgen;
+    reload = (vhs->validgen != gen);
+    if(reload){
+        start = vhs->wantaddr & ~(VGM_SOURCESTREAM_BUFSIZE-1);
+        n = VGM_HEADSTREAM_NUMBUFS;
+    }else{
+        start = vhs->validend;
+        if(start >= vss->datalen){
+            MIOS32_IRQ_Enable();
+            return;
+        }
+        //Buffers from the one srcaddr is in onwards are still needed
+        keep = (start - (head->srcaddr & ~(VGM_SOURCESTREAM_BUFSIZE-1)) + VGM_SOURCESTREAM_BUFSIZE - 1) / VGM_SOURCESTREAM_BUFSIZE;
+        if(keep >= VGM_HEADSTREAM_NUMBUFS){
+            MIOS32_IRQ_Enable();
+            return;
+        }
+        n = VGM_HEADSTREAM_NUMBUFS - keep;
+    }
+    //Can only read up to the end of the ring in one go
+    slot = RINGOFFSET(start) / VGM_SOURCESTREAM_BUFSIZE;
+    if(n > VGM_HEADSTREAM_NUMBUFS - slot) n = VGM_HEADSTREAM_NUMBUFS - slot;
+    len = n * VGM_SOURCESTREAM_BUFSIZE;
+    if(!reload && start + len > vhs->validstart + VGM_HEADSTREAM_RINGSIZE){
+        //Invalidate the old data we're about to overwrite before doing so
+        vhs->validstart = start + len - VGM_HEADSTREAM_RINGSIZE;
+    }
+    MIOS32_IRQ_Enable();
+    if(start >= vss->datalen){
+        len = 0;
+    }else if(start + len > vss->datalen){
+        len = vss->datalen - start;
     }
-    if(bufferto != NULL){
+    if(len > 0){
         vgm_sdtask_usingsdcard = 1;
         MUTEX_SDCARD_TAKE;
         
@@ -302,10 +338,38 @@ void VGM_HeadStream_BackgroundBuffer(VgmHead* head){
         MIOS32_BOARD_LED_Set(0b1111, 0b0100);
         VGM_PerfMon_ClockIn(VGM_PERFMON_TASK_CARD);
         
-        FILE_ReadReOpen(&vss->file);
-        FILE_ReadSeek(vhs->wantbufferaddr);
-        FILE_ReadBuffer(bufferto, VGM_SOURCESTREAM_BUFSIZE);
-        FILE_ReadClose(&vss->file);
+        s32 ok;
+#if FILE_HANDLE_NUM > 0
+        if(vss->handle == -1 && vss->filepath != NULL){
+            //Keep the file open, so we don't have to reopen and seek through
+            //the cluster chain on every refill
+            s32 h = FILE_HandleOpenRead(vss->filepath);
+            vss->handle = (h >= 0) ? h : -2;
+            if(h >= 0){
+                //If the file is too fragmented for the map, seeks just
+                //fall back to following the cluster chain
+                FILE_HandleClusterMapSet(h, vss->clmap, VGM_SOURCESTREAM_CLMAPLEN);
+            }
+        }
+        if(vss->handle >= 0){
+            ok = FILE_HandleSeek(vss->handle, start) >= 0
+                && FILE_HandleRead(vss->handle, &vhs->ring[RINGOFFSET(start)], len) == (s32)len;
+            if(!ok){
+                //E.g. the card has been remounted: open the file again on the
+                //next refill
+                FILE_HandleClose(vss->handle);
+                vss->handle = -1;
+            }
+        }else
+#endif
+        {
+            ok = FILE_ReadReOpen(&vss->file) >= 0;
+            if(ok){
+                ok = FILE_ReadSeek(start) >= 0
+                    && FILE_ReadBuffer(&vhs->ring[RINGOFFSET(start)], len) >= 0;
+                FILE_ReadClose(&vss->file);
+            }
+        }
         
         VGM_PerfMon_ClockOut(VGM_PERFMON_TASK_CARD);
         MIOS32_BOARD_LED_Set(0b1111, leds);
@@ -313,9 +377,19 @@ void VGM_HeadStream_BackgroundBuffer(VgmHead* head){
         MUTEX_SDCARD_GIVE_NOYIELD;
         vgm_sdtask_usingsdcard = 0;
         
-        vhs->wantbuffer = 0;
-        *addrto = vhs->wantbufferaddr;
+        //Don't publish garbage, the next refill tries it again
+        if(!ok) return;
     }
+    //Publish, unless the player jumped somewhere else in the meantime
+    MIOS32_IRQ_Disable();
+    if(vhs->wantgen == gen){
+        if(reload){
+            vhs->validstart = start;
+            vhs->validgen = gen;
+        }
+        vhs->validend = start + len;
+    }
+    MIOS32_IRQ_Enable();
 }
 
 VgmSource* VGM_SourceStream_Create(){
@@ -337,6 +411,7 @@ VgmSource* VGM_SourceStream_Create(){
     vss->vgmdatastartaddr = 0;
     vss->block = NULL;
     vss->blocklen = 0;
+    vss->handle = -1;
     return source;
 }
 void VGM_SourceStream_Delete(void* sourcestream){
@@ -347,6 +422,11 @@ void VGM_SourceStream_Delete(void* sourcestream){
     if(vss->block != NULL){
         free(vss->block);
     }
+#if FILE_HANDLE_NUM > 0
+    if(vss->handle >= 0){
+        FILE_HandleClose(vss->handle);
+    }
+#endif
     vgmh2_free(vss);
 }
 
@@ -22,29 +22,50 @@
 #define VGM_SOURCESTREAM_BUFSIZE 512
 #endif
 
+#ifndef VGM_HEADSTREAM_NUMBUFS
+#define VGM_HEADSTREAM_NUMBUFS 4 //Must be a power of two, as must VGM_SOURCESTREAM_BUFSIZE
+#endif
+#define VGM_HEADSTREAM_RINGSIZE (VGM_SOURCESTREAM_BUFSIZE * VGM_HEADSTREAM_NUMBUFS)
+
 #define VGM_HEADSTREAM_SUBBUFFER_MAXLEN 16
 
+#ifndef VGM_SOURCESTREAM_CLMAPLEN
+#define VGM_SOURCESTREAM_CLMAPLEN 8 //Words of cluster link map, enough for 3 file fragments
+#endif
+
+/*
+The stream head reads from a ring of VGM_HEADSTREAM_NUMBUFS contiguous buffers:
+file address a is at ring[a % VGM_HEADSTREAM_RINGSIZE] whenever
+validstart <= a < validend. The SD task fills the ring ahead of srcaddr; the
+player only ever moves forward through it, or asks for the ring to be
+reloaded from wantaddr by incrementing wantgen. Ring contents are valid only
+while validgen == wantgen.
+*/
 typedef union {
-    u8 ALL[28+VGM_HEADSTREAM_SUBBUFFER_MAXLEN];
+    u8 ALL[32+VGM_HEADSTREAM_SUBBUFFER_MAXLEN];
     struct{
         u32 srcblockaddr;
         
-        u8* buffer1;
-        u8* buffer2;
-        u32 buffer1addr;
-        u32 buffer2addr;
+        u8* ring;
+        u32 validstart;
+        u32 validend;
+        u32 wantaddr;
+        u32 lastsrcaddr; //srcaddr at the last consumption rate update
         
         u8 subbuffer[VGM_HEADSTREAM_SUBBUFFER_MAXLEN];
         u8 subbufferlen;
         
-        u8 wantbuffer;
-        u16 dummy2;
-        u32 wantbufferaddr;
+        u8 wantgen;
+        u8 validgen;
+        u8 stalled:1; //Currently waiting for the SD task because the ring ran dry
+        u8 dummy:7;
+        u16 rate; //Bytes consumed per SD task period, 12.4 fixed point, averaged
+        u16 underflows; //Number of times the ring ran dry
     };
 } VgmHeadStream;
 
 typedef union {
-    u8 ALL[20+sizeof(file_t)];
+    u8 ALL[24+sizeof(file_t)+4*VGM_SOURCESTREAM_CLMAPLEN];
     struct{
         file_t file;
         char* filepath;
@@ -54,6 +75,9 @@ typedef union {
         
         u8* block;
         u32 blocklen;
+        
+        s8 handle; //File handle kept open for streaming, -1 not opened yet, -2 none available
+        u32 clmap[VGM_SOURCESTREAM_CLMAPLEN]; //Cluster link map of the handle, for seeking without FAT reads
     };
 } VgmSourceStream;
 
@@ -63,6 +87,13 @@ extern void VGM_HeadStream_Delete(void* headstream);
 extern void VGM_HeadStream_Restart(VgmHead* head);
 extern u8 VGM_HeadStream_cmdNext(VgmHead* head, u32 vgm_time);
 extern u8 VGM_HeadStream_getByte(VgmSourceStream* vss, VgmHeadStream* vhs, u32 addr);
+
+// Called by the SD task: once per period to track how fast the head reads
+extern void VGM_HeadStream_UpdateRate(VgmHead* head);
+// Estimated SD task periods until the head runs out of data; 0 if the ring
+// must be reloaded, -1 if there's nothing to load
+extern s32 VGM_HeadStream_BufferUrgency(VgmHead* head);
+// Load as many free buffers of the ring as possible in one read
 extern void VGM_HeadStream_BackgroundBuffer(VgmHead* head);
 
 extern VgmSource* VGM_SourceStream_Create();
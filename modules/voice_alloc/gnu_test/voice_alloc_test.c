@@ -0,0 +1,282 @@
+// Unit test of the voice allocator
+//
+// - a note which is played several times occupies several voices, and a
+//   single Note Off releases all of them
+// - retriggering with VOICE_ALLOC_STEAL_SAME_NOTE
+// - steal order of VOICE_ALLOC_STEAL_OLDEST and VOICE_ALLOC_STEAL_QUIETEST
+// - allowed voice masks with 31 and 32 voices
+// - random note streams: the lists, velocity classes, note chains and the
+//   held notes are checked against a simple model after each step
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mios32.h>
+#include "voice_alloc.h"
+
+static u32 num_errors;
+
+#define CHECK(cond, ...) do { if( !(cond) ) { printf("ERROR: " __VA_ARGS__); printf("\n"); ++num_errors; } } while(0)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+s32 MIOS32_MIDI_SendDebugMessage(const char *format, ...) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Consistency check of the internal lists
+/////////////////////////////////////////////////////////////////////////////
+static int check_lists(voice_alloc_t *va)
+{
+  u32 seen = 0;
+  int num_assigned = 0;
+  u8 voice, prev;
+  int i;
+
+  // assigned list
+  for(prev=VOICE_ALLOC_NONE, voice=va->assigned_first; voice != VOICE_ALLOC_NONE; prev=voice, voice=va->voices[voice].next) {
+    if( voice >= va->num_voices || (seen & ((u32)1 << voice)) || va->voices[voice].prev != prev || !va->voices[voice].assigned )
+      return -1;
+    seen |= (u32)1 << voice;
+    ++num_assigned;
+  }
+  if( va->assigned_last != prev )
+    return -2;
+
+  // free list
+  for(prev=VOICE_ALLOC_NONE, voice=va->free_first; voice != VOICE_ALLOC_NONE; prev=voice, voice=va->voices[voice].next) {
+    if( voice >= va->num_voices || (seen & ((u32)1 << voice)) || va->voices[voice].prev != prev || va->voices[voice].assigned )
+      return -3;
+    seen |= (u32)1 << voice;
+  }
+  if( va->free_last != prev )
+    return -4;
+
+  if( seen != ((va->num_voices >= 32) ? 0xffffffff : (((u32)1 << va->num_voices) - 1)) )
+    return -5;
+
+  // velocity classes: each assigned voice once, in the class of its velocity
+  int num_vel = 0;
+  for(i=0; i<VOICE_ALLOC_VELOCITY_CLASSES; ++i) {
+    if( ((va->vel_mask >> i) & 1) != (va->vel_first[i] != VOICE_ALLOC_NONE) )
+      return -6;
+    for(prev=VOICE_ALLOC_NONE, voice=va->vel_first[i]; voice != VOICE_ALLOC_NONE; prev=voice, voice=va->voices[voice].vel_next) {
+      if( !va->voices[voice].assigned || ((va->voices[voice].velocity & 0x7f) >> 4) != i || va->voices[voice].vel_prev != prev )
+	return -7;
+      ++num_vel;
+    }
+    if( va->vel_last[i] != prev )
+      return -8;
+  }
+  if( num_vel != num_assigned )
+    return -9;
+
+  // note chains: exactly the assigned voices which play the note
+  int num_chained = 0;
+  for(i=0; i<128; ++i) {
+    for(prev=VOICE_ALLOC_NONE, voice=va->note_voice[i]; voice != VOICE_ALLOC_NONE; prev=voice, voice=va->voices[voice].note_next) {
+      if( !va->voices[voice].assigned || va->voices[voice].note != i || va->voices[voice].note_prev != prev )
+	return -10;
+      if( ++num_chained > va->num_voices )
+	return -11;
+    }
+  }
+  int num_with_note = 0;
+  for(i=0; i<va->num_voices; ++i)
+    if( va->voices[i].assigned && va->voices[i].note != VOICE_ALLOC_NONE )
+      ++num_with_note;
+  if( num_chained != num_with_note )
+    return -12;
+
+  return 0;
+}
+
+static int num_free(voice_alloc_t *va)
+{
+  int num = 0;
+  u8 voice;
+  for(voice=va->free_first; voice != VOICE_ALLOC_NONE; voice=va->voices[voice].next)
+    ++num;
+  return num;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_repeated_note(voice_alloc_steal_t steal_mode)
+{
+  voice_alloc_t va;
+  voice_alloc_voice_t voices[4];
+  voice_alloc_held_t held;
+
+  VOICE_ALLOC_Init(&va, steal_mode, voices, 4, &held);
+
+  s32 v1 = VOICE_ALLOC_NoteOn(&va, 60, 100, 0);
+  s32 v2 = VOICE_ALLOC_NoteOn(&va, 60, 90, 0);
+  s32 v3 = VOICE_ALLOC_NoteOn(&va, 64, 80, 0);
+  CHECK(v1 >= 0 && v2 >= 0 && v3 >= 0 && v1 != v2, "repeated note %d: voices %d %d", steal_mode, (int)v1, (int)v2);
+  CHECK(VOICE_ALLOC_NumHeld(&va) == 2, "repeated note %d: %d notes held", steal_mode, (int)VOICE_ALLOC_NumHeld(&va));
+  CHECK(check_lists(&va) == 0, "repeated note %d: lists (%d)", steal_mode, check_lists(&va));
+
+  // a single Note Off releases both voices
+  s32 released = VOICE_ALLOC_NoteOff(&va, 60);
+  CHECK(released == v2, "repeated note %d: Note Off returned %d, expected the youngest voice %d", steal_mode, (int)released, (int)v2);
+  CHECK(va.released_voices == (((u32)1 << v1) | ((u32)1 << v2)), "repeated note %d: released voices 0x%x",
+	steal_mode, (unsigned)va.released_voices);
+  CHECK(!voices[v1].assigned && !voices[v2].assigned && voices[v3].assigned, "repeated note %d: voices not released", steal_mode);
+  CHECK(num_free(&va) == 3, "repeated note %d: %d free voices", steal_mode, num_free(&va));
+  CHECK(VOICE_ALLOC_NoteOff(&va, 60) < 0 && va.released_voices == 0, "repeated note %d: second Note Off", steal_mode);
+  CHECK(VOICE_ALLOC_HeldLast(&va, NULL) == 64, "repeated note %d: last held note", steal_mode);
+
+  // the youngest voice is released at last, and will be taken at last
+  CHECK(va.free_last == v2, "repeated note %d: free order", steal_mode);
+
+  VOICE_ALLOC_NoteOff(&va, 64);
+  CHECK(num_free(&va) == 4 && VOICE_ALLOC_NumHeld(&va) == 0, "repeated note %d: not all voices free", steal_mode);
+  CHECK(check_lists(&va) == 0, "repeated note %d: lists (%d)", steal_mode, check_lists(&va));
+}
+
+static void test_same_note(void)
+{
+  voice_alloc_t va;
+  voice_alloc_voice_t voices[4];
+
+  VOICE_ALLOC_Init(&va, VOICE_ALLOC_STEAL_SAME_NOTE, voices, 4, NULL);
+
+  s32 v1 = VOICE_ALLOC_NoteOn(&va, 60, 100, 0);
+  VOICE_ALLOC_NoteOn(&va, 62, 100, 0);
+  s32 v2 = VOICE_ALLOC_NoteOn(&va, 60, 100, 0);
+  CHECK(v1 == v2 && va.stolen_note == 60, "same note: retriggered voice %d, expected %d", (int)v2, (int)v1);
+  CHECK(num_free(&va) == 2, "same note: %d free voices", num_free(&va));
+  CHECK(VOICE_ALLOC_NoteOff(&va, 60) == v1, "same note: Note Off");
+  CHECK(check_lists(&va) == 0, "same note: lists (%d)", check_lists(&va));
+}
+
+static void test_steal_order(void)
+{
+  voice_alloc_t va;
+  voice_alloc_voice_t voices[3];
+
+  // oldest
+  VOICE_ALLOC_Init(&va, VOICE_ALLOC_STEAL_OLDEST, voices, 3, NULL);
+  VOICE_ALLOC_NoteOn(&va, 60, 100, 0); // voice 0
+  VOICE_ALLOC_NoteOn(&va, 61, 100, 0); // voice 1
+  VOICE_ALLOC_NoteOn(&va, 62, 100, 0); // voice 2
+  VOICE_ALLOC_NoteOff(&va, 61);        // voice 1 free
+  CHECK(VOICE_ALLOC_NoteOn(&va, 63, 100, 0) == 1 && va.stolen_note == VOICE_ALLOC_NONE, "oldest: free voice not taken");
+  CHECK(VOICE_ALLOC_NoteOn(&va, 64, 100, 0) == 0 && va.stolen_note == 60, "oldest: oldest voice not stolen");
+  CHECK(VOICE_ALLOC_NoteOff(&va, 60) < 0, "oldest: stolen note still assigned");
+
+  // quietest
+  VOICE_ALLOC_Init(&va, VOICE_ALLOC_STEAL_QUIETEST, voices, 3, NULL);
+  VOICE_ALLOC_NoteOn(&va, 60, 100, 0); // voice 0
+  VOICE_ALLOC_NoteOn(&va, 61, 20, 0);  // voice 1
+  VOICE_ALLOC_NoteOn(&va, 62, 20, 0);  // voice 2
+  CHECK(VOICE_ALLOC_NoteOn(&va, 63, 127, 0) == 1 && va.stolen_note == 61, "quietest: voice 1 not stolen");
+  CHECK(VOICE_ALLOC_NoteOn(&va, 64, 127, 0) == 2 && va.stolen_note == 62, "quietest: voice 2 not stolen");
+  CHECK(VOICE_ALLOC_NoteOn(&va, 65, 127, 0) == 0 && va.stolen_note == 60, "quietest: voice 0 not stolen");
+  CHECK(check_lists(&va) == 0, "quietest: lists (%d)", check_lists(&va));
+}
+
+static void test_allowed_voices(void)
+{
+  voice_alloc_t va;
+  voice_alloc_voice_t voices[32];
+  int num_voices;
+
+  for(num_voices=31; num_voices<=32; ++num_voices) {
+    VOICE_ALLOC_Init(&va, VOICE_ALLOC_STEAL_OLDEST, voices, num_voices, NULL);
+
+    u8 top = num_voices - 1;
+    CHECK(VOICE_ALLOC_Assign(&va, 60, 100, 0, (u32)1 << top) == top, "%d voices: top voice not assigned", num_voices);
+    CHECK(VOICE_ALLOC_Assign(&va, 61, 100, 0, (u32)1 << top) == top && va.stolen_note == 60, "%d voices: top voice not stolen", num_voices);
+    CHECK(VOICE_ALLOC_Assign(&va, 62, 100, 0, 0xffffffff) == 0, "%d voices: voice 0 not assigned", num_voices);
+    if( num_voices < 32 )
+      CHECK(VOICE_ALLOC_Assign(&va, 63, 100, 0, 0x80000000) < 0, "%d voices: invalid voice allowed", num_voices);
+    CHECK(check_lists(&va) == 0, "%d voices: lists (%d)", num_voices, check_lists(&va));
+  }
+}
+
+static void test_random(voice_alloc_steal_t steal_mode, u8 num_voices)
+{
+  voice_alloc_t va;
+  voice_alloc_voice_t voices[VOICE_ALLOC_MAX_VOICES];
+  voice_alloc_held_t held;
+  u8 model_held[128];
+  int step;
+
+  VOICE_ALLOC_Init(&va, steal_mode, voices, num_voices, &held);
+  memset(model_held, 0, sizeof(model_held));
+  srand(steal_mode * 100 + num_voices);
+
+  for(step=0; step<200000; ++step) {
+    u8 note = 48 + (rand() % 16); // small range: many repeated notes
+    int op = rand() % 8;
+
+    if( op < 4 ) {
+      VOICE_ALLOC_NoteOn(&va, note, rand() % 128, 0);
+      model_held[note] = 1;
+    } else if( op < 7 ) {
+      s32 voice = VOICE_ALLOC_NoteOff(&va, note);
+      model_held[note] = 0;
+      if( voice >= 0 && !(va.released_voices & ((u32)1 << voice)) ) {
+	printf("ERROR: random stream: returned voice not in released voices\n");
+	++num_errors;
+	return;
+      }
+      if( va.note_voice[note] != VOICE_ALLOC_NONE ) {
+	printf("ERROR: random stream: note still played after Note Off\n");
+	++num_errors;
+	return;
+      }
+    } else {
+      u32 allowed = rand() & ((num_voices >= 32) ? 0xffffffff : (((u32)1 << num_voices) - 1));
+      if( allowed ) {
+	s32 voice = VOICE_ALLOC_Assign(&va, note, rand() % 128, 1, allowed);
+	if( voice < 0 || !(allowed & ((u32)1 << voice)) ) {
+	  printf("ERROR: random stream: voice %d not allowed\n", (int)voice);
+	  ++num_errors;
+	  return;
+	}
+      }
+    }
+
+    int status = check_lists(&va);
+    int num_held = 0, i;
+    for(i=0; i<128; ++i)
+      num_held += model_held[i];
+    if( status < 0 || VOICE_ALLOC_NumHeld(&va) != num_held ) {
+      printf("ERROR: random stream (mode %d, %d voices) inconsistent at step %d (%d)\n", steal_mode, num_voices, step, status);
+      ++num_errors;
+      return;
+    }
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_repeated_note(VOICE_ALLOC_STEAL_OLDEST);
+  test_repeated_note(VOICE_ALLOC_STEAL_QUIETEST);
+  test_same_note();
+  test_steal_order();
+  test_allowed_voices();
+  test_random(VOICE_ALLOC_STEAL_OLDEST, 6);
+  test_random(VOICE_ALLOC_STEAL_QUIETEST, 8);
+  test_random(VOICE_ALLOC_STEAL_SAME_NOTE, 6);
+  test_random(VOICE_ALLOC_STEAL_OLDEST, 32);
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,351 @@
+// Comparison of the MIDIbox SID/CV voice queues with their previous implementation
+//
+// MbSidVoiceQueue and MbCvVoiceQueue are compiled from the apps and run
+// against a copy of the previous queue (OldVoiceQueue below):
+//
+// 1) without released voices (all voices are stolen), both have to return
+//    the same voices for random get/getLast sequences with all voice
+//    assignments, mono/stereo voice numbers and exclusive voices
+//
+// 2) the intended behaviour change ("free voices first"): with one held
+//    note and five played+released notes, the previous queue drops the
+//    held note, the new one takes a free voice
+//
+// 3) random sequences with releases: the new queue has to take the free
+//    voice which has been released at first, and only steals the oldest
+//    assigned voice if no allowed voice is free. The number of cases in
+//    which the previous queue dropped a sounding voice although an allowed
+//    voice was free is printed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MbSidVoiceQueue.h"
+#include "MbCvVoiceQueue.h"
+
+#define NUM_VOICES 6
+
+static unsigned num_errors;
+
+// voices of the previous queue which haven't been released yet
+static bool old_sounding[NUM_VOICES];
+
+
+/////////////////////////////////////////////////////////////////////////////
+// MIOS32 stubs
+/////////////////////////////////////////////////////////////////////////////
+
+extern "C" s32 MIOS32_MIDI_SendDebugMessage(const char *format, ...) { return 0; }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Previous implementation of MbSidVoiceQueue/MbCvVoiceQueue (identical for
+// both, only the drum exclusive flags of initExclusive() aren't copied)
+/////////////////////////////////////////////////////////////////////////////
+
+typedef union {
+  struct {
+    u16 ALL;
+  };
+  struct {
+    u8 voice:6;
+    u8 ASSIGNED:1;
+    u8 EXCLUSIVE:1;
+    u8 instrument;
+  };
+} old_voice_queue_item_t;
+
+class OldVoiceQueue
+{
+public:
+    void init(void)
+    {
+        old_voice_queue_item_t *item = &queue[0];
+        for(int voice=0; voice<NUM_VOICES; ++voice, ++item) {
+            item->voice = voice;
+            item->ASSIGNED = 0;
+            item->EXCLUSIVE = 0;
+            item->instrument = 0xff; // invalid instrument
+        }
+    }
+
+    u8 get(u8 instrument, u8 voice_asg, u8 num_voices)
+    {
+        if( num_voices > NUM_VOICES )
+            num_voices = NUM_VOICES;
+
+        u32 allowed_voice_mask = allowedMask(voice_asg, num_voices);
+
+        old_voice_queue_item_t *item = &queue[0];
+        for(int voice=0; voice<NUM_VOICES; ++voice, ++item) {
+            if( allowed_voice_mask & (1 << item->voice) &&
+                (!item->EXCLUSIVE || (item->instrument == instrument) || (voice_asg >= 3)) ) {
+                item->ASSIGNED = 1;
+                item->EXCLUSIVE = (voice_asg >= 3) ? 1 : 0;
+                item->instrument = instrument;
+                moveToEnd(voice);
+                return queue[NUM_VOICES-1].voice;
+            }
+        }
+
+        return 0;
+    }
+
+    u8 getLast(u8 instrument, u8 voice_asg, u8 num_voices, u8 search_voice)
+    {
+        old_voice_queue_item_t *item = &queue[0];
+        for(int voice=0; voice<NUM_VOICES; ++voice, ++item)
+            if( item->voice == search_voice ) {
+                if( item->instrument != instrument )
+                    break;
+                if( item->voice >= num_voices )
+                    break;
+
+                item->ASSIGNED = 1;
+                moveToEnd(voice);
+                return queue[NUM_VOICES-1].voice;
+            }
+
+        return get(instrument, voice_asg, num_voices);
+    }
+
+    u8 release(u8 release_voice)
+    {
+        old_voice_queue_item_t *item = &queue[0];
+        for(int voice=0; voice<NUM_VOICES; ++voice, ++item)
+            if( item->voice == release_voice ) {
+                item->ASSIGNED = 0;
+                return item->voice;
+            }
+        return 0;
+    }
+
+    bool isAssigned(u8 voice)
+    {
+        for(int i=0; i<NUM_VOICES; ++i)
+            if( queue[i].voice == voice )
+                return queue[i].ASSIGNED;
+        return false;
+    }
+
+    static u32 allowedMask(u8 voice_asg, u8 num_voices)
+    {
+        switch( voice_asg ) {
+        case 0: return (1 << NUM_VOICES)-1;
+        case 1: return (1 << (NUM_VOICES/2))-1;
+        case 2:
+            if( num_voices <= (NUM_VOICES/2) )
+                return (1 << (NUM_VOICES/2))-1;
+            return ((1 << (NUM_VOICES/2))-1) << (NUM_VOICES/2);
+        }
+        return 1 << ((voice_asg-3) % num_voices);
+    }
+
+private:
+    old_voice_queue_item_t queue[NUM_VOICES];
+
+    void moveToEnd(int voice)
+    {
+        if( voice < (NUM_VOICES-1) ) {
+            old_voice_queue_item_t stored_item = queue[voice];
+            for(int i=voice; i<(NUM_VOICES-1); ++i)
+                queue[i] = queue[i+1];
+            queue[NUM_VOICES-1] = stored_item;
+        }
+    }
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests, templated for MbSidVoiceQueue and MbCvVoiceQueue
+/////////////////////////////////////////////////////////////////////////////
+
+template <class Queue, class Patch>
+static void test_without_release(const char *name)
+{
+    Queue queue;
+    Patch patch;
+    OldVoiceQueue old;
+    u8 last_voice[6];
+    int num_ops = 0;
+
+    memset(&patch, 0, sizeof(patch));
+    queue.init(&patch);
+    old.init();
+    memset(last_voice, 0, sizeof(last_voice));
+    srand(1);
+
+    for(int step=0; step<200000; ++step) {
+        u8 instrument = rand() % 6;
+        u8 voice_asg = rand() % 6; // all, left, right and dedicated voices
+        u8 num_voices = (rand() % 4) ? NUM_VOICES : (NUM_VOICES/2); // stereo/mono
+
+        u8 voice, old_voice;
+        if( rand() % 2 ) {
+            voice = queue.get(instrument, voice_asg, num_voices);
+            old_voice = old.get(instrument, voice_asg, num_voices);
+        } else {
+            voice = queue.getLast(instrument, voice_asg, num_voices, last_voice[instrument]);
+            old_voice = old.getLast(instrument, voice_asg, num_voices, last_voice[instrument]);
+        }
+        ++num_ops;
+
+        if( voice != old_voice ) {
+            printf("ERROR: %s without releases: step %d took voice %d, previous queue %d\n", name, step, voice, old_voice);
+            ++num_errors;
+            return;
+        }
+        last_voice[instrument] = voice;
+    }
+
+    printf("%s without releases: %d get/getLast calls identical\n", name, num_ops);
+}
+
+
+template <class Queue, class Patch>
+static void test_free_first(const char *name)
+{
+    Queue queue;
+    Patch patch;
+    OldVoiceQueue old;
+
+    memset(&patch, 0, sizeof(patch));
+    queue.init(&patch);
+    old.init();
+
+    // voice 0 is held
+    u8 held = queue.get(0, 0, NUM_VOICES);
+    u8 old_held = old.get(0, 0, NUM_VOICES);
+
+    // voices 1..5 are played and released
+    for(int i=1; i<NUM_VOICES; ++i) {
+        queue.release(queue.get(0, 0, NUM_VOICES));
+        old.release(old.get(0, 0, NUM_VOICES));
+    }
+
+    u8 voice = queue.get(0, 0, NUM_VOICES);
+    u8 old_voice = old.get(0, 0, NUM_VOICES);
+
+    if( old_voice != old_held ) {
+        printf("ERROR: %s: previous queue didn't drop the held voice\n", name);
+        ++num_errors;
+    }
+    if( voice == held || voice != 1 ) {
+        printf("ERROR: %s: took voice %d, expected the first released voice 1\n", name, voice);
+        ++num_errors;
+    }
+
+    printf("%s free voices first: new queue takes released voice %d, previous queue dropped held voice %d\n", name, voice, old_voice);
+}
+
+
+template <class Queue, class Patch>
+static void test_with_release(const char *name)
+{
+    Queue queue;
+    Patch patch;
+    OldVoiceQueue old;
+    unsigned age;
+    unsigned assign_age[NUM_VOICES];
+    unsigned release_age[NUM_VOICES];
+    bool assigned[NUM_VOICES];
+    int num_gets = 0, num_steals = 0, old_drops = 0;
+
+    memset(&patch, 0, sizeof(patch));
+    queue.init(&patch);
+    old.init();
+    for(int voice=0; voice<NUM_VOICES; ++voice) {
+        assign_age[voice] = 0;
+        release_age[voice] = voice; // initial order of the free voices
+        assigned[voice] = false;
+    }
+    age = NUM_VOICES;
+    srand(2);
+
+    for(int step=0; step<200000; ++step) {
+        u8 instrument = rand() % 6;
+        u8 voice_asg = rand() % 3; // no dedicated voices, so that no voice is exclusive
+        u32 allowed = OldVoiceQueue::allowedMask(voice_asg, NUM_VOICES);
+
+        if( rand() % 2 ) {
+            // expected: the allowed free voice which has been released at first,
+            // otherwise the allowed voice which has been assigned at first
+            int expected = -1;
+            for(int voice=0; voice<NUM_VOICES; ++voice)
+                if( (allowed & (1 << voice)) && !assigned[voice] &&
+                    (expected < 0 || release_age[voice] < release_age[expected]) )
+                    expected = voice;
+            if( expected < 0 ) {
+                for(int voice=0; voice<NUM_VOICES; ++voice)
+                    if( (allowed & (1 << voice)) &&
+                        (expected < 0 || assign_age[voice] < assign_age[expected]) )
+                        expected = voice;
+                ++num_steals;
+            }
+
+            u8 voice = queue.get(instrument, voice_asg, NUM_VOICES);
+            ++num_gets;
+            if( voice != expected ) {
+                printf("ERROR: %s with releases: step %d took voice %d, expected %d\n", name, step, voice, expected);
+                ++num_errors;
+                return;
+            }
+            assigned[voice] = true;
+            assign_age[voice] = ++age;
+
+            // the previous queue follows its own history: count the sounding voices
+            // which have been dropped although an allowed voice was free
+            bool old_free = false;
+            for(int v=0; v<NUM_VOICES; ++v)
+                if( (allowed & (1 << v)) && !old.isAssigned(v) )
+                    old_free = true;
+            u8 old_voice = old.get(instrument, voice_asg, NUM_VOICES);
+            bool old_was_assigned = old_sounding[old_voice];
+            old_sounding[old_voice] = true;
+            if( old_free && old_was_assigned )
+                ++old_drops;
+        } else {
+            u8 voice = rand() % NUM_VOICES;
+            if( assigned[voice] ) {
+                queue.release(voice);
+                assigned[voice] = false;
+                release_age[voice] = ++age;
+            }
+            if( old_sounding[voice] ) {
+                old.release(voice);
+                old_sounding[voice] = false;
+            }
+        }
+    }
+
+    printf("%s with releases: %d gets (%d steals) as expected, previous queue dropped a sounding voice %d times although an allowed voice was free\n",
+           name, num_gets, num_steals, old_drops);
+    if( old_drops == 0 ) {
+        printf("ERROR: %s: behaviour change not covered\n", name);
+        ++num_errors;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    test_without_release<MbSidVoiceQueue, sid_patch_t>("MbSidVoiceQueue");
+    test_without_release<MbCvVoiceQueue, cv_patch_t>("MbCvVoiceQueue");
+
+    test_free_first<MbSidVoiceQueue, sid_patch_t>("MbSidVoiceQueue");
+    test_free_first<MbCvVoiceQueue, cv_patch_t>("MbCvVoiceQueue");
+
+    memset(old_sounding, 0, sizeof(old_sounding));
+    test_with_release<MbSidVoiceQueue, sid_patch_t>("MbSidVoiceQueue");
+    memset(old_sounding, 0, sizeof(old_sounding));
+    test_with_release<MbCvVoiceQueue, cv_patch_t>("MbCvVoiceQueue");
+
+    if( num_errors ) {
+        printf("FAILED with %u errors\n", num_errors);
+        return 1;
+    }
+
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,535 @@
+// $Id$
+//! \defgroup VOICE_ALLOC
+//!
+//! Generic Voice Allocator Module
+//!
+//! Assigns notes to a fixed number of voices. Free and assigned voices are
+//! kept in intrusive lists which are ordered by their age, so that note-on,
+//! note-off and voice stealing don't need to search or shift arrays.
+//!
+//! If no free voice is available, a voice will be stolen depending on the
+//! steal mode:
+//! <UL>
+//!   <LI>VOICE_ALLOC_STEAL_OLDEST: the voice which has been assigned first
+//!   <LI>VOICE_ALLOC_STEAL_QUIETEST: the oldest voice of the lowest velocity class
+//!   <LI>VOICE_ALLOC_STEAL_SAME_NOTE: a voice which already plays the same note
+//!       will be retriggered, otherwise like VOICE_ALLOC_STEAL_OLDEST
+//! </UL>
+//!
+//! Held notes are stored in a 128-bit map. Optionally the order of the held
+//! notes is tracked as well (see VOICE_ALLOC_HeldLast)
+//!
+//! Usage Examples:
+//!   $MIOS32_PATH/apps/synthesizers/midibox_sid_v3/core/components/MbSidVoiceQueue.cpp
+//!   $MIOS32_PATH/apps/synthesizers/nI2S_synth/engine.c
+//!
+//! \{
+/* ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+/////////////////////////////////////////////////////////////////////////////
+// Include files
+/////////////////////////////////////////////////////////////////////////////
+
+#include <mios32.h>
+#include "voice_alloc.h"
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local definitions
+/////////////////////////////////////////////////////////////////////////////
+
+#define VELOCITY_CLASS(velocity) (((velocity) & 0x7f) >> 4)
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Local Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+static void VOICE_ALLOC_ListRemove(voice_alloc_t *va, u8 *first, u8 *last, u8 voice);
+static void VOICE_ALLOC_ListAppend(voice_alloc_t *va, u8 *first, u8 *last, u8 voice);
+static void VOICE_ALLOC_VelRemove(voice_alloc_t *va, u8 voice);
+static void VOICE_ALLOC_VelAppend(voice_alloc_t *va, u8 voice);
+static void VOICE_ALLOC_NoteRemove(voice_alloc_t *va, u8 voice);
+static void VOICE_ALLOC_NoteInsert(voice_alloc_t *va, u8 voice);
+static u8 VOICE_ALLOC_ListSearch(voice_alloc_t *va, u8 voice, u32 allowed_voices);
+static u8 VOICE_ALLOC_QuietestSearch(voice_alloc_t *va, u32 allowed_voices, u8 all_voices);
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Initializes a voice allocator
+//!
+//! Has to be called before the other VOICE_ALLOC_* functions are used!
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] steal_mode VOICE_ALLOC_STEAL_OLDEST, VOICE_ALLOC_STEAL_QUIETEST or VOICE_ALLOC_STEAL_SAME_NOTE
+//! \param[in] *voices pointer to voice_alloc_voice_t array which stores the voice states
+//! \param[in] num_voices number of voices stored in the array (1..VOICE_ALLOC_MAX_VOICES)
+//! \param[in] *held optional pointer to a structure which stores the order of held notes (can be NULL)
+//! \return < 0 if initialisation failed
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_Init(voice_alloc_t *va, voice_alloc_steal_t steal_mode, voice_alloc_voice_t *voices, u8 num_voices, voice_alloc_held_t *held)
+{
+  if( num_voices == 0 || num_voices > VOICE_ALLOC_MAX_VOICES )
+    return -1; // invalid number of voices
+
+  va->voices = voices;
+  va->held = held;
+  va->num_voices = num_voices;
+  va->steal_mode = steal_mode;
+
+  return VOICE_ALLOC_Clear(va);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Releases all voices and held notes
+//! The tags of the voices are set to VOICE_ALLOC_NONE
+//! \param[in] *va pointer to the voice allocator structure
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_Clear(voice_alloc_t *va)
+{
+  int i;
+
+  va->free_first = va->free_last = VOICE_ALLOC_NONE;
+  va->assigned_first = va->assigned_last = VOICE_ALLOC_NONE;
+  for(i=0; i<VOICE_ALLOC_VELOCITY_CLASSES; ++i)
+    va->vel_first[i] = va->vel_last[i] = VOICE_ALLOC_NONE;
+  va->vel_mask = 0;
+  va->stolen_note = VOICE_ALLOC_NONE;
+  va->released_voices = 0;
+
+  for(i=0; i<va->num_voices; ++i) {
+    voice_alloc_voice_t *v = &va->voices[i];
+    v->note = VOICE_ALLOC_NONE;
+    v->velocity = 0;
+    v->tag = VOICE_ALLOC_NONE;
+    v->assigned = 0;
+    v->vel_prev = v->vel_next = VOICE_ALLOC_NONE;
+    v->note_prev = v->note_next = VOICE_ALLOC_NONE;
+    VOICE_ALLOC_ListAppend(va, &va->free_first, &va->free_last, i);
+  }
+
+  for(i=0; i<4; ++i)
+    va->held_notes[i] = 0;
+
+  for(i=0; i<128; ++i)
+    va->note_voice[i] = VOICE_ALLOC_NONE;
+
+  if( va->held ) {
+    va->held->first = va->held->last = VOICE_ALLOC_NONE;
+  }
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Assigns a voice to a note.\n
+//! A free voice will be taken first (the one which has been released at
+//! first), otherwise a voice will be stolen depending on the steal mode.\n
+//! If all voices are allowed, this function takes constant time.
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] note the note number (0..127) or VOICE_ALLOC_NONE if the voice isn't assigned to a note
+//! \param[in] velocity the velocity (used by VOICE_ALLOC_STEAL_QUIETEST)
+//! \param[in] tag an optional tag which is bundled with the voice, e.g. the instrument number
+//! \param[in] allowed_voices each bit selects a voice which can be taken (0xffffffff: all voices)
+//! \return < 0 if no voice is allowed
+//! \return >= 0: the assigned voice. va->stolen_note contains the note of the
+//!         previous assignment if the voice was still active, otherwise VOICE_ALLOC_NONE
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_Assign(voice_alloc_t *va, u8 note, u8 velocity, u8 tag, u32 allowed_voices)
+{
+  u32 all_mask = (va->num_voices >= 32) ? 0xffffffff : (((u32)1 << va->num_voices) - 1);
+  u8 all_voices;
+  u8 voice = VOICE_ALLOC_NONE;
+  voice_alloc_voice_t *v;
+
+  allowed_voices &= all_mask;
+  if( !allowed_voices )
+    return -1; // no voice allowed
+  all_voices = allowed_voices == all_mask;
+
+  if( note >= 128 )
+    note = VOICE_ALLOC_NONE;
+
+  // retrigger the voice which plays the same note?
+  if( va->steal_mode == VOICE_ALLOC_STEAL_SAME_NOTE && note != VOICE_ALLOC_NONE ) {
+    u8 same_voice = va->note_voice[note];
+    if( same_voice != VOICE_ALLOC_NONE && (allowed_voices & ((u32)1 << same_voice)) )
+      voice = same_voice;
+  }
+
+  // take a free voice
+  if( voice == VOICE_ALLOC_NONE )
+    voice = all_voices ? va->free_first : VOICE_ALLOC_ListSearch(va, va->free_first, allowed_voices);
+
+  // steal an assigned voice
+  if( voice == VOICE_ALLOC_NONE ) {
+    if( va->steal_mode == VOICE_ALLOC_STEAL_QUIETEST )
+      voice = VOICE_ALLOC_QuietestSearch(va, allowed_voices, all_voices);
+    else
+      voice = all_voices ? va->assigned_first : VOICE_ALLOC_ListSearch(va, va->assigned_first, allowed_voices);
+  }
+
+  if( voice == VOICE_ALLOC_NONE )
+    return -2; // should never happen
+
+  // remove voice from its current lists
+  v = &va->voices[voice];
+  if( v->assigned ) {
+    va->stolen_note = v->note;
+    VOICE_ALLOC_ListRemove(va, &va->assigned_first, &va->assigned_last, voice);
+    VOICE_ALLOC_VelRemove(va, voice);
+    VOICE_ALLOC_NoteRemove(va, voice);
+  } else {
+    va->stolen_note = VOICE_ALLOC_NONE;
+    VOICE_ALLOC_ListRemove(va, &va->free_first, &va->free_last, voice);
+  }
+
+  // assign voice as the youngest one
+  v->note = note;
+  v->velocity = velocity;
+  v->tag = tag;
+  v->assigned = 1;
+  VOICE_ALLOC_ListAppend(va, &va->assigned_first, &va->assigned_last, voice);
+  VOICE_ALLOC_VelAppend(va, voice);
+  VOICE_ALLOC_NoteInsert(va, voice);
+
+  return voice;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Releases a voice, so that it is free for VOICE_ALLOC_Assign.\n
+//! The voice will keep its note and tag.
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] voice the voice number
+//! \return < 0 if invalid voice
+//! \return the released voice
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_Release(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v;
+
+  if( voice >= va->num_voices )
+    return -1; // invalid voice
+
+  v = &va->voices[voice];
+  if( !v->assigned )
+    return voice; // already free
+
+  VOICE_ALLOC_ListRemove(va, &va->assigned_first, &va->assigned_last, voice);
+  VOICE_ALLOC_VelRemove(va, voice);
+  VOICE_ALLOC_NoteRemove(va, voice);
+  VOICE_ALLOC_ListAppend(va, &va->free_first, &va->free_last, voice);
+  v->assigned = 0;
+
+  return voice;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Assigns a voice again without changing note and tag.\n
+//! The voice will be handled as the youngest one.
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] voice the voice number
+//! \return < 0 if invalid voice
+//! \return the assigned voice
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_Touch(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v;
+
+  if( voice >= va->num_voices )
+    return -1; // invalid voice
+
+  v = &va->voices[voice];
+  if( v->assigned ) {
+    VOICE_ALLOC_ListRemove(va, &va->assigned_first, &va->assigned_last, voice);
+    VOICE_ALLOC_VelRemove(va, voice);
+  } else {
+    VOICE_ALLOC_ListRemove(va, &va->free_first, &va->free_last, voice);
+    v->assigned = 1;
+    VOICE_ALLOC_NoteInsert(va, voice);
+  }
+
+  VOICE_ALLOC_ListAppend(va, &va->assigned_first, &va->assigned_last, voice);
+  VOICE_ALLOC_VelAppend(va, voice);
+
+  return voice;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Marks a note as held and assigns a voice to it (any voice allowed)
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] note the note number (0..127)
+//! \param[in] velocity the velocity
+//! \param[in] tag an optional tag which is bundled with the voice
+//! \return < 0 on errors
+//! \return >= 0: the assigned voice (see also VOICE_ALLOC_Assign)
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_NoteOn(voice_alloc_t *va, u8 note, u8 velocity, u8 tag)
+{
+  if( note >= 128 )
+    return -1; // invalid note
+
+  if( va->held ) {
+    voice_alloc_held_t *h = va->held;
+
+    // if the note is already held, move it to the end
+    if( va->held_notes[note >> 5] & ((u32)1 << (note & 0x1f)) ) {
+      if( h->prev[note] != VOICE_ALLOC_NONE ) h->next[h->prev[note]] = h->next[note]; else h->first = h->next[note];
+      if( h->next[note] != VOICE_ALLOC_NONE ) h->prev[h->next[note]] = h->prev[note]; else h->last = h->prev[note];
+    }
+
+    h->prev[note] = h->last;
+    h->next[note] = VOICE_ALLOC_NONE;
+    if( h->last != VOICE_ALLOC_NONE ) h->next[h->last] = note; else h->first = note;
+    h->last = note;
+    h->velocity[note] = velocity;
+  }
+
+  va->held_notes[note >> 5] |= ((u32)1 << (note & 0x1f));
+
+  return VOICE_ALLOC_Assign(va, note, velocity, tag, 0xffffffff);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Marks a note as released and releases all voices which play it.\n
+//! A note which has been played several times (e.g. with
+//! VOICE_ALLOC_STEAL_OLDEST) can be assigned to multiple voices, but it's
+//! only held once, therefore all of them are released.
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] note the note number (0..127)
+//! \return < 0 if the note isn't played by any voice
+//! \return >= 0: the youngest released voice. va->released_voices contains
+//!         a bit for each released voice
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_NoteOff(voice_alloc_t *va, u8 note)
+{
+  u8 voice;
+
+  va->released_voices = 0;
+
+  if( note >= 128 )
+    return -1; // invalid note
+
+  if( va->held_notes[note >> 5] & ((u32)1 << (note & 0x1f)) ) {
+    va->held_notes[note >> 5] &= ~((u32)1 << (note & 0x1f));
+
+    if( va->held ) {
+      voice_alloc_held_t *h = va->held;
+      if( h->prev[note] != VOICE_ALLOC_NONE ) h->next[h->prev[note]] = h->next[note]; else h->first = h->next[note];
+      if( h->next[note] != VOICE_ALLOC_NONE ) h->prev[h->next[note]] = h->prev[note]; else h->last = h->prev[note];
+    }
+  }
+
+  voice = va->note_voice[note];
+  if( voice == VOICE_ALLOC_NONE )
+    return -1; // note not played
+
+  // release the older voices first, so that the youngest one will be taken at last
+  {
+    u8 release_voice;
+    while( (release_voice = va->voices[voice].note_next) != VOICE_ALLOC_NONE ) {
+      VOICE_ALLOC_Release(va, release_voice);
+      va->released_voices |= ((u32)1 << release_voice);
+    }
+  }
+
+  va->released_voices |= ((u32)1 << voice);
+  return VOICE_ALLOC_Release(va, voice);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[in] note the note number (0..127)
+//! \return 1 if the note is held, 0 if not
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_NoteHeld(voice_alloc_t *va, u8 note)
+{
+  if( note >= 128 )
+    return 0;
+
+  return (va->held_notes[note >> 5] & ((u32)1 << (note & 0x1f))) ? 1 : 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! \param[in] *va pointer to the voice allocator structure
+//! \return the number of held notes
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_NumHeld(voice_alloc_t *va)
+{
+  s32 num = 0;
+  int i;
+
+  for(i=0; i<4; ++i) {
+    u32 mask = va->held_notes[i];
+    // bit counting in parallel
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    num += ((((mask + (mask >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24) & 0xff; // (u32 can be wider on emulation)
+  }
+
+  return num;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Returns the note which has been pressed at last and is still held.\n
+//! Only available if a voice_alloc_held_t structure has been passed to VOICE_ALLOC_Init
+//! \param[in] *va pointer to the voice allocator structure
+//! \param[out] *velocity the velocity of the note (optional, can be NULL)
+//! \return < 0 if no note is held
+//! \return >= 0: the note number
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_HeldLast(voice_alloc_t *va, u8 *velocity)
+{
+  u8 note;
+
+  if( !va->held || va->held->last == VOICE_ALLOC_NONE )
+    return -1; // no note held
+
+  note = va->held->last;
+  if( velocity )
+    *velocity = va->held->velocity[note];
+
+  return note;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sends the voice assignments to the MIOS Terminal
+//! \param[in] *va pointer to the voice allocator structure
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 VOICE_ALLOC_SendDebugMessage(voice_alloc_t *va)
+{
+  u8 voice;
+
+  MIOS32_MIDI_SendDebugMessage("Voice Allocator (voices=%d, held notes=%d)\n", va->num_voices, VOICE_ALLOC_NumHeld(va));
+  MIOS32_MIDI_SendDebugMessage("Assigned voices (oldest first):\n");
+  for(voice=va->assigned_first; voice != VOICE_ALLOC_NONE; voice=va->voices[voice].next) {
+    voice_alloc_voice_t *v = &va->voices[voice];
+    MIOS32_MIDI_SendDebugMessage("  V:%d  N:0x%02x  Vel:%d  T:0x%02x\n", voice, v->note, v->velocity, v->tag);
+  }
+  MIOS32_MIDI_SendDebugMessage("Free voices (next first):\n");
+  for(voice=va->free_first; voice != VOICE_ALLOC_NONE; voice=va->voices[voice].next) {
+    voice_alloc_voice_t *v = &va->voices[voice];
+    MIOS32_MIDI_SendDebugMessage("  V:%d  N:0x%02x  T:0x%02x\n", voice, v->note, v->tag);
+  }
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Help functions for the intrusive lists
+/////////////////////////////////////////////////////////////////////////////
+static void VOICE_ALLOC_ListRemove(voice_alloc_t *va, u8 *first, u8 *last, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+
+  if( v->prev != VOICE_ALLOC_NONE ) va->voices[v->prev].next = v->next; else *first = v->next;
+  if( v->next != VOICE_ALLOC_NONE ) va->voices[v->next].prev = v->prev; else *last = v->prev;
+}
+
+static void VOICE_ALLOC_ListAppend(voice_alloc_t *va, u8 *first, u8 *last, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+
+  v->prev = *last;
+  v->next = VOICE_ALLOC_NONE;
+  if( *last != VOICE_ALLOC_NONE ) va->voices[*last].next = voice; else *first = voice;
+  *last = voice;
+}
+
+static void VOICE_ALLOC_VelRemove(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+  u8 vel_class = VELOCITY_CLASS(v->velocity);
+
+  if( v->vel_prev != VOICE_ALLOC_NONE ) va->voices[v->vel_prev].vel_next = v->vel_next; else va->vel_first[vel_class] = v->vel_next;
+  if( v->vel_next != VOICE_ALLOC_NONE ) va->voices[v->vel_next].vel_prev = v->vel_prev; else va->vel_last[vel_class] = v->vel_prev;
+
+  if( va->vel_first[vel_class] == VOICE_ALLOC_NONE )
+    va->vel_mask &= ~(1 << vel_class);
+}
+
+static void VOICE_ALLOC_VelAppend(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+  u8 vel_class = VELOCITY_CLASS(v->velocity);
+
+  v->vel_prev = va->vel_last[vel_class];
+  v->vel_next = VOICE_ALLOC_NONE;
+  if( va->vel_last[vel_class] != VOICE_ALLOC_NONE ) va->voices[va->vel_last[vel_class]].vel_next = voice; else va->vel_first[vel_class] = voice;
+  va->vel_last[vel_class] = voice;
+  va->vel_mask |= (1 << vel_class);
+}
+
+static void VOICE_ALLOC_NoteRemove(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+
+  if( v->note == VOICE_ALLOC_NONE )
+    return;
+
+  if( v->note_prev != VOICE_ALLOC_NONE ) va->voices[v->note_prev].note_next = v->note_next; else va->note_voice[v->note] = v->note_next;
+  if( v->note_next != VOICE_ALLOC_NONE ) va->voices[v->note_next].note_prev = v->note_prev;
+  v->note_prev = v->note_next = VOICE_ALLOC_NONE;
+}
+
+static void VOICE_ALLOC_NoteInsert(voice_alloc_t *va, u8 voice)
+{
+  voice_alloc_voice_t *v = &va->voices[voice];
+
+  if( v->note == VOICE_ALLOC_NONE )
+    return;
+
+  v->note_prev = VOICE_ALLOC_NONE;
+  v->note_next = va->note_voice[v->note];
+  if( v->note_next != VOICE_ALLOC_NONE ) va->voices[v->note_next].note_prev = voice;
+  va->note_voice[v->note] = voice;
+}
+
+static u8 VOICE_ALLOC_ListSearch(voice_alloc_t *va, u8 voice, u32 allowed_voices)
+{
+  for(; voice != VOICE_ALLOC_NONE; voice=va->voices[voice].next)
+    if( allowed_voices & ((u32)1 << voice) )
+      break;
+
+  return voice;
+}
+
+static u8 VOICE_ALLOC_QuietestSearch(voice_alloc_t *va, u32 allowed_voices, u8 all_voices)
+{
+  int vel_class;
+
+  for(vel_class=0; vel_class<VOICE_ALLOC_VELOCITY_CLASSES; ++vel_class) {
+    if( va->vel_mask & (1 << vel_class) ) {
+      u8 voice = va->vel_first[vel_class];
+      if( all_voices )
+        return voice;
+
+      for(; voice != VOICE_ALLOC_NONE; voice=va->voices[voice].vel_next)
+        if( allowed_voices & ((u32)1 << voice) )
+          return voice;
+    }
+  }
+
+  return VOICE_ALLOC_NONE;
+}
+
+//! \}
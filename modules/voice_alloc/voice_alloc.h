@@ -0,0 +1,117 @@
+// $Id$
+/*
+ * Header file for Voice Allocator module
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2016 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _VOICE_ALLOC_H
+#define _VOICE_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Global definitions
+/////////////////////////////////////////////////////////////////////////////
+
+// marks an invalid voice or note
+#define VOICE_ALLOC_NONE 0xff
+
+// maximum number of voices (limited by the allowed voice mask)
+#define VOICE_ALLOC_MAX_VOICES 32
+
+// voices are grouped into velocity classes for the quietest steal mode
+#define VOICE_ALLOC_VELOCITY_CLASSES 8
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Global Types
+/////////////////////////////////////////////////////////////////////////////
+
+typedef enum {
+  VOICE_ALLOC_STEAL_OLDEST = 0,
+  VOICE_ALLOC_STEAL_QUIETEST,
+  VOICE_ALLOC_STEAL_SAME_NOTE
+} voice_alloc_steal_t;
+
+
+typedef struct {
+  u8 prev;      // age ordered list of free or assigned voices
+  u8 next;
+  u8 vel_prev;  // age ordered list of assigned voices with the same velocity class
+  u8 vel_next;
+  u8 note_prev; // list of assigned voices which play the same note, youngest first
+  u8 note_next;
+  u8 note;      // the (last) played note, VOICE_ALLOC_NONE if no note
+  u8 velocity;
+  u8 tag;       // e.g. the instrument number, will be kept after release
+  u8 assigned;
+} voice_alloc_voice_t;
+
+
+// optional: order and velocity of the held notes, e.g. for a mono voice with last note priority
+typedef struct {
+  u8 prev[128];
+  u8 next[128];
+  u8 velocity[128];
+  u8 first;
+  u8 last;
+} voice_alloc_held_t;
+
+
+typedef struct {
+  voice_alloc_voice_t *voices;
+  voice_alloc_held_t  *held;
+  u8  num_voices;
+  u8  steal_mode;
+  u8  free_first;
+  u8  free_last;
+  u8  assigned_first;
+  u8  assigned_last;
+  u8  vel_first[VOICE_ALLOC_VELOCITY_CLASSES];
+  u8  vel_last[VOICE_ALLOC_VELOCITY_CLASSES];
+  u8  vel_mask;
+  u8  stolen_note;
+  u32 released_voices; // voices which have been released by the last VOICE_ALLOC_NoteOff
+  u32 held_notes[4];
+  u8  note_voice[128]; // the youngest voice which plays the note
+} voice_alloc_t;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Prototypes
+/////////////////////////////////////////////////////////////////////////////
+
+extern s32 VOICE_ALLOC_Init(voice_alloc_t *va, voice_alloc_steal_t steal_mode, voice_alloc_voice_t *voices, u8 num_voices, voice_alloc_held_t *held);
+extern s32 VOICE_ALLOC_Clear(voice_alloc_t *va);
+
+extern s32 VOICE_ALLOC_Assign(voice_alloc_t *va, u8 note, u8 velocity, u8 tag, u32 allowed_voices);
+extern s32 VOICE_ALLOC_Release(voice_alloc_t *va, u8 voice);
+extern s32 VOICE_ALLOC_Touch(voice_alloc_t *va, u8 voice);
+
+extern s32 VOICE_ALLOC_NoteOn(voice_alloc_t *va, u8 note, u8 velocity, u8 tag);
+extern s32 VOICE_ALLOC_NoteOff(voice_alloc_t *va, u8 note);
+extern s32 VOICE_ALLOC_NoteHeld(voice_alloc_t *va, u8 note);
+extern s32 VOICE_ALLOC_NumHeld(voice_alloc_t *va);
+extern s32 VOICE_ALLOC_HeldLast(voice_alloc_t *va, u8 *velocity);
+
+extern s32 VOICE_ALLOC_SendDebugMessage(voice_alloc_t *va);
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Export global variables
+/////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _VOICE_ALLOC_H */
@@ -0,0 +1,116 @@
+// Minimal host replacement of <mios32.h> for the WS2812 tests:
+// the STM32F4 timer/DMA setup is stubbed, the DMA interrupt flags
+// are set by the test before WS2812_DMA_IRQHandler() is called
+
+#ifndef _MIOS32_H
+#define _MIOS32_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef unsigned long u32; // like the emulation: large enough for pointers
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef long     s32;
+
+#define MIOS32_FAMILY_STM32F4xx
+#define MIOS32_SYS_CPU_FREQUENCY 168000000
+
+#define ENABLE  1
+#define DISABLE 0
+
+// peripherals
+typedef struct {
+  volatile u32 CCR1;
+} TIM_TypeDef;
+
+typedef struct {
+  volatile u32 LISR;
+  volatile u32 LIFCR;
+} DMA_TypeDef;
+
+extern TIM_TypeDef  stub_tim4;
+extern DMA_TypeDef  stub_dma1;
+
+#define TIM4 (&stub_tim4)
+#define DMA1 (&stub_dma1)
+#define GPIOB         0
+#define DMA1_Stream0  0
+#define DMA1_Stream0_IRQn 0
+
+#define DMA_FLAG_FEIF0 0x00000001
+#define DMA_FLAG_TEIF0 0x00000008
+#define DMA_FLAG_HTIF0 0x00000010
+#define DMA_FLAG_TCIF0 0x00000020
+
+// init structures
+typedef struct {
+  u32 GPIO_Pin, GPIO_Mode, GPIO_Speed, GPIO_OType;
+} GPIO_InitTypeDef;
+
+typedef struct {
+  u32 TIM_Period, TIM_Prescaler, TIM_ClockDivision, TIM_CounterMode;
+} TIM_TimeBaseInitTypeDef;
+
+typedef struct {
+  u32 TIM_OCMode, TIM_OutputState, TIM_Pulse, TIM_OCPolarity;
+} TIM_OCInitTypeDef;
+
+typedef struct {
+  u32 DMA_Channel, DMA_Mode, DMA_DIR, DMA_Memory0BaseAddr, DMA_BufferSize;
+  u32 DMA_PeripheralBaseAddr, DMA_PeripheralInc, DMA_MemoryInc;
+  u32 DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Priority;
+} DMA_InitTypeDef;
+
+#define GPIO_Pin_6 0
+#define GPIO_PinSource6 0
+#define GPIO_AF_TIM4 0
+#define GPIO_Speed_2MHz 0
+#define GPIO_Mode_AF 0
+#define GPIO_OType_OD 0
+#define RCC_APB1Periph_TIM4 0
+#define TIM_CounterMode_Up 0
+#define TIM_OCMode_PWM1 0
+#define TIM_OutputState_Enable 0
+#define TIM_OCPolarity_High 0
+#define TIM_OCPreload_Enable 0
+#define TIM_DMA_CC1 0
+#define DMA_Channel_2 0
+#define DMA_Mode_Circular 0
+#define DMA_DIR_MemoryToPeripheral 0
+#define DMA_PeripheralInc_Disable 0
+#define DMA_MemoryInc_Enable 0
+#define DMA_PeripheralDataSize_HalfWord 0
+#define DMA_MemoryDataSize_HalfWord 0
+#define DMA_Priority_VeryHigh 0
+#define DMA_IT_HT 0
+#define DMA_IT_TC 0
+#define MIOS32_IRQ_PRIO_HIGHEST 0
+
+#define GPIO_PinAFConfig(...)        do {} while(0)
+#define GPIO_StructInit(s)           memset(s, 0, sizeof(*(s)))
+#define GPIO_Init(...)               do {} while(0)
+#define RCC_APB1PeriphClockCmd(...)  do {} while(0)
+#define TIM_TimeBaseStructInit(s)    memset(s, 0, sizeof(*(s)))
+#define TIM_TimeBaseInit(...)        do {} while(0)
+#define TIM_OCStructInit(s)          memset(s, 0, sizeof(*(s)))
+#define TIM_OC1Init(...)             do {} while(0)
+#define TIM_OC1PreloadConfig(...)    do {} while(0)
+#define TIM_ARRPreloadConfig(...)    do {} while(0)
+#define TIM_DMACmd(...)              do {} while(0)
+#define TIM_Cmd(...)                 do {} while(0)
+#define DMA_Cmd(...)                 do {} while(0)
+#define DMA_ClearFlag(...)           do {} while(0)
+#define DMA_StructInit(s)            memset(s, 0, sizeof(*(s)))
+#define DMA_Init(...)                do {} while(0)
+#define DMA_ITConfig(...)            do {} while(0)
+static inline s32 MIOS32_IRQ_Install(u8 IRQn, u8 priority) { return 0; }
+
+static inline s32 MIOS32_IRQ_Disable(void) { return 0; }
+static inline s32 MIOS32_IRQ_Enable(void) { return 0; }
+
+#endif /* _MIOS32_H */
@@ -0,0 +1,396 @@
+// Colour conversion test of the WS2812 driver
+//
+// The integer conversions are checked over the complete input space:
+// - WS2812_HSVtoRGB against the float conversion of the previous
+//   WS2812_LED_SetHSV() (within 0.5 of the unrounded result)
+// - RGB->HSV->RGB round-trips with WS2812_RGBtoHSV (within 1)
+// - HSV->RGB->HSV round-trips, the hue is only checked for saturated
+//   and bright colours, since it's ambiguous otherwise
+// - WS2812_HSLtoRGB against a float HSL conversion (within 1.5, since
+//   the intermediate HSV value is rounded)
+// - WS2812_LED_GetHSVi for a black LED
+//
+// The cycles per conversion are printed for the integer and float variants
+// (TSC cycles on x86, otherwise nS).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../ws2812.c"
+
+TIM_TypeDef stub_tim4;
+DMA_TypeDef stub_dma1;
+
+static u32 num_errors;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Cycle counter
+/////////////////////////////////////////////////////////////////////////////
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cycles"
+static unsigned long long cycles_now(void) { return __rdtsc(); }
+#else
+#define CYCLE_UNIT "nS"
+static unsigned long long cycles_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Float references
+/////////////////////////////////////////////////////////////////////////////
+
+// conversion of the previous WS2812_LED_SetHSV(), without the truncation to u8
+static void ref_HSVtoRGB(float h, float s, float v, float *rgb)
+{
+  // from https://www.cs.rit.edu/~ncs/color/t_convert.html
+  int i;
+  float f, p, q, t;
+  float r, g, b;
+
+  if( s == 0 ) {
+    // achromatic (grey)
+    r = g = b = v;
+  } else {
+    h /= 60;			// sector 0 to 5
+    i = floor( h );
+    f = h - i;			// factorial part of h
+    p = v * ( 1 - s );
+    q = v * ( 1 - s * f );
+    t = v * ( 1 - s * ( 1 - f ) );
+
+    switch( i ) {
+    case 0:  r = v; g = t; b = p; break;
+    case 1:  r = q; g = v; b = p; break;
+    case 2:  r = p; g = v; b = t; break;
+    case 3:  r = p; g = q; b = v; break;
+    case 4:  r = t; g = p; b = v; break;
+    default: r = v; g = p; b = q; break; // case 5
+    }
+  }
+
+  rgb[0] = r*255;
+  rgb[1] = g*255;
+  rgb[2] = b*255;
+}
+
+// conversion of WS2812_LED_GetHSV()
+static void ref_RGBtoHSV(const u8 *rgb, float *h, float *s, float *v)
+{
+  float r = rgb[0] / 255.0;
+  float g = rgb[1] / 255.0;
+  float b = rgb[2] / 255.0;
+  float min, max, delta;
+
+  min = r;
+  if( g < min ) min = g;
+  if( b < min ) min = b;
+  max = r;
+  if( g > max ) max = g;
+  if( b > max ) max = b;
+
+  *v = max;
+  delta = max - min;
+  if( max == 0 || delta == 0 ) {
+    *s = 0;
+    *h = 0;
+    return;
+  }
+  *s = delta / max;
+
+  if( r == max )
+    *h = ( g - b ) / delta;
+  else if( g == max )
+    *h = 2 + ( b - r ) / delta;
+  else
+    *h = 4 + ( r - g ) / delta;
+  *h *= 60;
+  if( *h < 0 )
+    *h += 360;
+}
+
+static void ref_HSLtoRGB(float h, float s, float l, float *rgb)
+{
+  float v = l + s * ((l < 0.5) ? l : (1 - l));
+  float s_v = v ? (2 * (1 - l / v)) : 0;
+  ref_HSVtoRGB(h, s_v, v, rgb);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_hsv_to_rgb(void)
+{
+  u32 h, s, v;
+  int c;
+  float max_error = 0;
+
+  for(h=0; h<WS2812_HUE_RANGE; ++h) {
+    for(s=0; s<256; ++s) {
+      for(v=0; v<256; ++v) {
+	u8 rgb[3];
+	float ref[3];
+
+	if( WS2812_HSVtoRGB(h, s, v, rgb) < 0 ) {
+	  printf("ERROR: HSVtoRGB(%u, %u, %u) failed\n", (unsigned)h, (unsigned)s, (unsigned)v);
+	  ++num_errors;
+	  return;
+	}
+	ref_HSVtoRGB(h * (360.0 / WS2812_HUE_RANGE), s / 255.0, v / 255.0, ref);
+
+	for(c=0; c<3; ++c) {
+	  float error = fabsf(rgb[c] - ref[c]);
+	  if( error > max_error )
+	    max_error = error;
+	}
+      }
+    }
+  }
+
+  printf("HSVtoRGB: max. error %.3f against the float conversion\n", max_error);
+  if( max_error > 0.501 ) { // float precision
+    printf("ERROR: HSVtoRGB error too large\n");
+    ++num_errors;
+  }
+
+  u8 rgb[3];
+  if( WS2812_HSVtoRGB(WS2812_HUE_RANGE, 255, 255, rgb) >= 0 ) {
+    printf("ERROR: HSVtoRGB accepts an invalid hue\n");
+    ++num_errors;
+  }
+}
+
+static void test_rgb_roundtrip(void)
+{
+  u32 r, g, b;
+  int c;
+  int max_error = 0;
+
+  for(r=0; r<256; ++r) {
+    for(g=0; g<256; ++g) {
+      for(b=0; b<256; ++b) {
+	u8 rgb[3] = { r, g, b };
+	u8 rgb2[3];
+	u16 h;
+	u8 s, v;
+
+	s32 status = WS2812_RGBtoHSV(rgb, &h, &s, &v);
+	if( (status == -2) != (r == 0 && g == 0 && b == 0) || (status < 0 && status != -2) || h >= WS2812_HUE_RANGE ) {
+	  printf("ERROR: RGBtoHSV(%u, %u, %u) returned %d, h=%u\n", (unsigned)r, (unsigned)g, (unsigned)b, (int)status, h);
+	  ++num_errors;
+	  return;
+	}
+
+	WS2812_HSVtoRGB(h, s, v, rgb2);
+	for(c=0; c<3; ++c) {
+	  int error = abs((int)rgb2[c] - (int)rgb[c]);
+	  if( error > max_error )
+	    max_error = error;
+	}
+      }
+    }
+  }
+
+  printf("RGB->HSV->RGB: max. error %d\n", max_error);
+  if( max_error > 1 ) {
+    printf("ERROR: RGB round-trip error too large\n");
+    ++num_errors;
+  }
+}
+
+static void test_hsv_roundtrip(void)
+{
+  u32 h, s, v;
+  int max_error_h = 0, max_error_s = 0, max_error_v = 0;
+
+  for(h=0; h<WS2812_HUE_RANGE; ++h) {
+    for(s=0; s<256; ++s) {
+      for(v=0; v<256; ++v) {
+	u8 rgb[3];
+	u16 h2;
+	u8 s2, v2;
+
+	WS2812_HSVtoRGB(h, s, v, rgb);
+	WS2812_RGBtoHSV(rgb, &h2, &s2, &v2);
+
+	int error = abs((int)v2 - (int)v);
+	if( error > max_error_v )
+	  max_error_v = error;
+
+	// saturation is resolved with 8bit RGB values for bright colours
+	if( v >= 128 ) {
+	  error = abs((int)s2 - (int)s);
+	  if( error > max_error_s )
+	    max_error_s = error;
+	}
+
+	// hue: only for saturated and bright colours, the resolution decreases with s*v
+	if( s == 255 && v == 255 ) {
+	  error = abs((int)h2 - (int)h);
+	  if( error > WS2812_HUE_RANGE/2 )
+	    error = WS2812_HUE_RANGE - error;
+	  if( error > max_error_h )
+	    max_error_h = error;
+	}
+      }
+    }
+  }
+
+  printf("HSV->RGB->HSV: max. error h=%d (s=v=255), s=%d (v>=128), v=%d\n", max_error_h, max_error_s, max_error_v);
+  if( max_error_v > 0 || max_error_s > 2 || max_error_h > 1 ) {
+    printf("ERROR: HSV round-trip error too large\n");
+    ++num_errors;
+  }
+}
+
+static void test_hsl_to_rgb(void)
+{
+  u32 h, s, l;
+  int c;
+  float max_error = 0;
+
+  for(h=0; h<WS2812_HUE_RANGE; h += 3) {
+    for(s=0; s<256; ++s) {
+      for(l=0; l<256; ++l) {
+	u8 rgb[3];
+	float ref[3];
+
+	if( WS2812_HSLtoRGB(h, s, l, rgb) < 0 ) {
+	  printf("ERROR: HSLtoRGB(%u, %u, %u) failed\n", (unsigned)h, (unsigned)s, (unsigned)l);
+	  ++num_errors;
+	  return;
+	}
+	ref_HSLtoRGB(h * (360.0 / WS2812_HUE_RANGE), s / 255.0, l / 255.0, ref);
+
+	for(c=0; c<3; ++c) {
+	  float error = fabsf(rgb[c] - ref[c]);
+	  if( error > max_error )
+	    max_error = error;
+	}
+      }
+    }
+  }
+
+  printf("HSLtoRGB: max. error %.3f against the float conversion\n", max_error);
+  if( max_error > 1.5 ) { // the intermediate HSV value is rounded
+    printf("ERROR: HSLtoRGB error too large\n");
+    ++num_errors;
+  }
+}
+
+static void test_led_functions(void)
+{
+  u16 h;
+  u8 s, v;
+
+  WS2812_Init(0);
+
+  WS2812_LED_FillRGB(0, 1, 0, 0, 0);
+  h = 1; s = 1; v = 1;
+  if( WS2812_LED_GetHSVi(0, &h, &s, &v) != 0 || h != 0 || s != 0 || v != 0 ) {
+    printf("ERROR: GetHSVi of a black LED\n");
+    ++num_errors;
+  }
+
+  WS2812_LED_SetHSVi(0, 2*256, 255, 200); // green
+  if( WS2812_LED_GetHSVi(0, &h, &s, &v) != 0 || h != 2*256 || s != 255 || v != 200 ) {
+    printf("ERROR: GetHSVi returned h=%u s=%u v=%u\n", h, s, v);
+    ++num_errors;
+  }
+
+  if( WS2812_LED_GetHSVi(WS2812_NUM_LEDS, &h, &s, &v) >= 0 ) {
+    printf("ERROR: GetHSVi accepts an invalid LED\n");
+    ++num_errors;
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Cycles per conversion
+/////////////////////////////////////////////////////////////////////////////
+
+static volatile u32 sink;
+
+static void test_cycles(void)
+{
+  const u32 runs = 1000000;
+  u32 i;
+  unsigned long long t;
+
+  t = cycles_now();
+  for(i=0; i<runs; ++i) {
+    u8 rgb[3];
+    WS2812_HSVtoRGB(i % WS2812_HUE_RANGE, (i >> 3) & 0xff, (i >> 5) & 0xff, rgb);
+    sink += rgb[0] + rgb[1] + rgb[2];
+  }
+  double hsv_int = (double)(cycles_now() - t) / runs;
+
+  t = cycles_now();
+  for(i=0; i<runs; ++i) {
+    float rgb[3];
+    ref_HSVtoRGB((i % WS2812_HUE_RANGE) * (360.0 / WS2812_HUE_RANGE), ((i >> 3) & 0xff) / 255.0, ((i >> 5) & 0xff) / 255.0, rgb);
+    sink += (u8)rgb[0] + (u8)rgb[1] + (u8)rgb[2];
+  }
+  double hsv_float = (double)(cycles_now() - t) / runs;
+
+  t = cycles_now();
+  for(i=0; i<runs; ++i) {
+    u8 rgb[3] = { i, i >> 8, i >> 16 };
+    u16 h;
+    u8 s, v;
+    WS2812_RGBtoHSV(rgb, &h, &s, &v);
+    sink += h + s + v;
+  }
+  double rgb_int = (double)(cycles_now() - t) / runs;
+
+  t = cycles_now();
+  for(i=0; i<runs; ++i) {
+    u8 rgb[3] = { i, i >> 8, i >> 16 };
+    float h, s, v;
+    ref_RGBtoHSV(rgb, &h, &s, &v);
+    sink += (u32)h + (u32)(s*255) + (u32)(v*255);
+  }
+  double rgb_float = (double)(cycles_now() - t) / runs;
+
+  t = cycles_now();
+  for(i=0; i<runs; ++i) {
+    u8 rgb[3];
+    WS2812_HSLtoRGB(i % WS2812_HUE_RANGE, (i >> 3) & 0xff, (i >> 5) & 0xff, rgb);
+    sink += rgb[0] + rgb[1] + rgb[2];
+  }
+  double hsl_int = (double)(cycles_now() - t) / runs;
+
+  printf("Per conversion (%s): HSVtoRGB %.1f (float %.1f), RGBtoHSV %.1f (float %.1f), HSLtoRGB %.1f\n",
+	 CYCLE_UNIT, hsv_int, hsv_float, rgb_int, rgb_float, hsl_int);
+}
+
+
+int main(int argc, char *argv[])
+{
+  test_hsv_to_rgb();
+  test_rgb_roundtrip();
+  test_hsv_roundtrip();
+  test_hsl_to_rgb();
+  test_led_functions();
+  test_cycles();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
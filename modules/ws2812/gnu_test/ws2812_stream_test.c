@@ -0,0 +1,375 @@
+// PWM stream test of the WS2812 driver
+//
+// The circular DMA transfer is emulated: the two halves of the double
+// buffer are sent alternately, and WS2812_DMA_IRQHandler() is called with
+// the HT/TC flag after each half. The PWM words are decoded by an emulated
+// LED chain, which latches the received bits after a reset phase.
+//
+// The stream is compared with the per-bit reference of the previous driver
+// (one LED per half buffer, reset frame and all LEDs in each cycle):
+// - each PWM word has to be a valid LOW/HIGH/RESET value, and each frame
+//   has to consist of complete LEDs
+// - after a frame, the chain has to show the mapped RGB values, and it has
+//   to match with the chain which is driven by the reference stream
+// - a frame has to end after the highest changed LED
+// - without changes, the buffer isn't refilled and no bits are sent
+//
+// The number of interrupts and the fill time per LED are printed for both.
+// The makefile builds variants with different WS2812_LEDS_PER_HALF_BUFFER
+// and WS2812_NUM_LEDS to cover the half buffer indexing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// static variables of the driver are accessed directly
+#include "../ws2812.c"
+
+TIM_TypeDef stub_tim4;
+DMA_TypeDef stub_dma1;
+
+static u32 num_errors;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Emulated LED chain
+/////////////////////////////////////////////////////////////////////////////
+
+// WS2812 latches after > 50 uS low level
+#define CHAIN_RESET_WORDS 40
+
+typedef struct {
+  u8  leds[WS2812_NUM_LEDS][3]; // latched values
+  u8  shift[WS2812_NUM_LEDS][3];
+  u32 num_bits;        // bits received since the last latch
+  u32 reset_words;
+  u32 num_frames;
+  u32 last_frame_bits; // bits of the last latched frame
+  u32 total_bits;
+} chain_t;
+
+static void chain_init(chain_t *chain)
+{
+  memset(chain, 0, sizeof(chain_t));
+  memset(chain->leds, 0xaa, sizeof(chain->leds)); // power-on garbage
+}
+
+static void chain_put(chain_t *chain, u16 word)
+{
+  if( word == WS2812_TIM_CC_RESET ) {
+    if( ++chain->reset_words >= CHAIN_RESET_WORDS && chain->num_bits ) {
+      if( chain->num_bits % 24 ) {
+	printf("ERROR: frame with incomplete LED (%u bits)\n", (unsigned)chain->num_bits);
+	++num_errors;
+      }
+      u32 num_leds = chain->num_bits / 24;
+      memcpy(chain->leds, chain->shift, 3*num_leds);
+      chain->last_frame_bits = chain->num_bits;
+      chain->num_bits = 0;
+      ++chain->num_frames;
+    }
+    return;
+  }
+
+  if( word != WS2812_TIM_CC_LOW && word != WS2812_TIM_CC_HIGH ) {
+    printf("ERROR: invalid PWM value %u\n", word);
+    ++num_errors;
+    return;
+  }
+
+  chain->reset_words = 0;
+  ++chain->total_bits;
+
+  // the first LED takes the first 24 bits, the remaining bits are forwarded
+  if( chain->num_bits < 24*WS2812_NUM_LEDS ) {
+    u8 *value = &chain->shift[chain->num_bits / 24][(chain->num_bits / 8) % 3];
+    u8 mask = 0x80 >> (chain->num_bits % 8);
+    if( word == WS2812_TIM_CC_HIGH )
+      *value |= mask;
+    else
+      *value &= ~mask;
+  }
+  ++chain->num_bits;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Reference: per-bit expansion of the previous driver
+/////////////////////////////////////////////////////////////////////////////
+
+static u16 ref_buffer[2*24];
+static u16 ref_state_ctr;
+
+static void ref_SetPWM(u16 *buffer)
+{
+  if( ref_state_ctr < WS2812_RESET_CYCLES ) {
+    int i;
+    for(i=0; i<24; ++i)
+      *(buffer++) = WS2812_TIM_CC_RESET;
+  } else {
+    int i, j;
+    u8 *rgb_values = &ws2812_rgb_values[ref_state_ctr-WS2812_RESET_CYCLES][0];
+    u8 mask;
+
+    for(i=0; i<3; ++i, ++rgb_values) {
+      u8 value = ws2812_value_map[*(rgb_values)]; // brightness/gamma weren't supported before
+      for(j=0, mask=0x80; j<8; ++j, mask >>= 1) {
+	*(buffer++) = (value & mask) ? WS2812_TIM_CC_HIGH : WS2812_TIM_CC_LOW;
+      }
+    }
+  }
+
+  if( ++ref_state_ctr >= (WS2812_RESET_CYCLES + WS2812_NUM_LEDS) ) {
+    ref_state_ctr = 0;
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// DMA emulation
+/////////////////////////////////////////////////////////////////////////////
+
+static chain_t chain;
+static chain_t ref_chain;
+static u8  dma_half;
+static u32 num_irqs;
+static u8  ref_half;
+
+static void dma_init(void)
+{
+  chain_init(&chain);
+  dma_half = 0;
+  num_irqs = 0;
+}
+
+// sends one half of the double buffer and calls the DMA interrupt
+static void dma_send_half(void)
+{
+  u16 *buffer = &ws2812_send_double_buffer[dma_half * WS2812_HALF_BUFFER_SIZE];
+  int i;
+  for(i=0; i<WS2812_HALF_BUFFER_SIZE; ++i)
+    chain_put(&chain, buffer[i]);
+
+  stub_dma1.LISR = dma_half ? DMA_FLAG_TCIF0 : DMA_FLAG_HTIF0;
+  WS2812_DMA_IRQHandler();
+  stub_dma1.LISR = 0;
+  ++num_irqs;
+
+  dma_half ^= 1;
+}
+
+static void ref_init(void)
+{
+  int i;
+  chain_init(&ref_chain);
+  for(i=0; i<2*24; ++i)
+    ref_buffer[i] = WS2812_TIM_CC_RESET;
+  ref_state_ctr = 0;
+  ref_half = 0;
+}
+
+static void ref_send_half(void)
+{
+  u16 *buffer = &ref_buffer[ref_half * 24];
+  int i;
+  for(i=0; i<24; ++i)
+    chain_put(&ref_chain, buffer[i]);
+
+  ref_SetPWM(buffer);
+
+  ref_half ^= 1;
+}
+
+// number of halves which are required to send all LEDs and the reset phase
+#define FRAME_HALVES (2*((WS2812_NUM_LEDS + WS2812_LEDS_PER_HALF_BUFFER - 1) / WS2812_LEDS_PER_HALF_BUFFER + WS2812_RESET_HALF_BUFFERS + 2))
+
+static void dma_run(u32 num_halves)
+{
+  while( num_halves-- )
+    dma_send_half();
+}
+
+// the reference needs two complete cycles: the first one could have been started before the change
+static void ref_run(void)
+{
+  u32 num_halves = 2*(WS2812_RESET_CYCLES + WS2812_NUM_LEDS) + 2;
+  while( num_halves-- )
+    ref_send_half();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Checks
+/////////////////////////////////////////////////////////////////////////////
+
+static void check_chain(const char *test)
+{
+  int led, c;
+
+  for(led=0; led<WS2812_NUM_LEDS; ++led) {
+    for(c=0; c<3; ++c) {
+      u8 expected = ws2812_value_map[ws2812_rgb_values[led][c]];
+      if( chain.leds[led][c] != expected ) {
+	printf("ERROR in %s: LED %d colour %d is %d, expected %d\n", test, led, c, chain.leds[led][c], expected);
+	++num_errors;
+	return;
+      }
+    }
+  }
+
+  ref_run();
+  if( memcmp(chain.leds, ref_chain.leds, sizeof(chain.leds)) != 0 ) {
+    printf("ERROR in %s: chain doesn't match with the reference\n", test);
+    ++num_errors;
+  }
+}
+
+static u32 rnd_seed = 1;
+static u8 rnd8(void)
+{
+  rnd_seed = rnd_seed * 1103515245 + 12345;
+  return (rnd_seed >> 16) & 0xff;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Tests
+/////////////////////////////////////////////////////////////////////////////
+
+static void test_init(void)
+{
+  WS2812_Init(0);
+  dma_init();
+  ref_init();
+
+  dma_run(FRAME_HALVES);
+  if( chain.num_frames != 1 ) {
+    printf("ERROR: %u frames sent after init, expected 1\n", (unsigned)chain.num_frames);
+    ++num_errors;
+  }
+  check_chain("init");
+}
+
+static void test_full_update(void)
+{
+  int led, c;
+  for(led=0; led<WS2812_NUM_LEDS; ++led)
+    for(c=0; c<3; ++c)
+      WS2812_LED_SetRGB(led, c, rnd8());
+
+  // count the interrupts until the frame has been latched
+  u32 irqs = num_irqs;
+  u32 frames = chain.num_frames;
+  while( chain.num_frames == frames && (num_irqs - irqs) < FRAME_HALVES )
+    dma_send_half();
+  check_chain("full update");
+
+  printf("Full update of %d LEDs: %u interrupts incl. reset phase (reference: %d per cycle)\n",
+	 WS2812_NUM_LEDS, (unsigned)(num_irqs - irqs), WS2812_RESET_CYCLES + WS2812_NUM_LEDS);
+}
+
+static void test_frame_length(void)
+{
+  int led;
+  for(led=0; led<WS2812_NUM_LEDS; led += (led < 10) ? 1 : 7) {
+    u32 frames = chain.num_frames;
+    WS2812_LED_SetRGB(led, rnd8() % 3, ws2812_rgb_values[led][0] ^ 0x55);
+    dma_run(FRAME_HALVES);
+
+    if( chain.num_frames != (frames + 1) || chain.last_frame_bits != 24*(led+1) ) {
+      printf("ERROR: change of LED %d sent %u frames with %u bits\n",
+	     led, (unsigned)(chain.num_frames - frames), (unsigned)chain.last_frame_bits);
+      ++num_errors;
+      return;
+    }
+  }
+  check_chain("frame length");
+}
+
+static void test_idle(void)
+{
+  u32 bits = chain.total_bits;
+  dma_run(1000);
+
+  if( chain.total_bits != bits || ws2812_half_buffer_reset != 3 ) {
+    printf("ERROR: bits sent without changes\n");
+    ++num_errors;
+  }
+}
+
+static void test_changes_during_frame(void)
+{
+  int i;
+  for(i=0; i<20000; ++i) {
+    WS2812_LED_SetRGB(rnd8() % WS2812_NUM_LEDS, rnd8() % 3, rnd8());
+    if( (rnd8() % 4) == 0 )
+      dma_send_half();
+  }
+
+  dma_run(2*FRAME_HALVES);
+  check_chain("changes during frame");
+}
+
+static void test_brightness_gamma(void)
+{
+  WS2812_BrightnessSet(100);
+  WS2812_GammaSet(2.2);
+  dma_run(FRAME_HALVES);
+  check_chain("brightness/gamma");
+
+  WS2812_BrightnessSet(255);
+  WS2812_GammaSet(1.0);
+  dma_run(FRAME_HALVES);
+  check_chain("brightness/gamma off");
+}
+
+static void test_fill_time(void)
+{
+  int i, led;
+  const int runs = 2000;
+  u16 buffer[WS2812_HALF_BUFFER_SIZE];
+  clock_t t;
+
+  t = clock();
+  for(i=0; i<runs; ++i) {
+    ref_state_ctr = WS2812_RESET_CYCLES;
+    for(led=0; led<WS2812_NUM_LEDS; ++led)
+      ref_SetPWM(buffer);
+  }
+  double ref_ns = (double)(clock() - t) * 1e9 / CLOCKS_PER_SEC / (runs * WS2812_NUM_LEDS);
+
+  t = clock();
+  for(i=0; i<runs; ++i) {
+    ws2812_reset_ctr = 0;
+    ws2812_frame_led = 0;
+    ws2812_frame_len = WS2812_NUM_LEDS;
+    while( ws2812_frame_led < ws2812_frame_len )
+      WS2812_DMA_IRQHandler_SetPWM(buffer, 0);
+  }
+  double new_ns = (double)(clock() - t) * 1e9 / CLOCKS_PER_SEC / (runs * WS2812_NUM_LEDS);
+
+  printf("Fill time per LED: per-bit reference %.1f nS, nibble LUT %.1f nS\n", ref_ns, new_ns);
+}
+
+
+int main(int argc, char *argv[])
+{
+  printf("WS2812_NUM_LEDS=%d, WS2812_LEDS_PER_HALF_BUFFER=%d\n", WS2812_NUM_LEDS, WS2812_LEDS_PER_HALF_BUFFER);
+
+  test_init();
+  test_full_update();
+  test_frame_length();
+  test_idle();
+  test_changes_during_frame();
+  test_brightness_gamma();
+  test_fill_time();
+
+  if( num_errors ) {
+    printf("FAILED with %u errors\n", (unsigned)num_errors);
+    return 1;
+  }
+
+  printf("All tests passed\n");
+  return 0;
+}
@@ -45,6 +45,14 @@
 //! Update 2018-01-05: reset phase has been enhanced from ca. 50 uS to 300 uS
 //! See also http://midibox.org/forums/topic/19752-rgb-hue-sweep/?page=2
 //! 
+//! Each half of the DMA double buffer now services WS2812_LEDS_PER_HALF_BUFFER
+//! LEDs, so that the DMA interrupt isn't triggered for each LED anymore.
+//! The bits are expanded to PWM values nibble-wise with a lookup table, and
+//! global brightness and gamma correction are applied in the same pass.
+//! A frame is only sent if a LED has been changed. It ends after the last
+//! changed LED, since the remaining LEDs of the chain keep their values.
+//! Without changes, the DMA keeps sending the reset level.
+//! 
 //! \{
 /* ==========================================================================
  *
@@ -99,7 +107,13 @@
 #define WS2812_DMA_IRQHandler   DMA1_Stream0_IRQHandler
 
 
-#define WS2812_RESET_CYCLES 10 // number of cycles required for reset frame
+#define WS2812_RESET_CYCLES 10 // number of LED cycles required for reset frame
+
+// number of words in each half of the double buffer
+#define WS2812_HALF_BUFFER_SIZE (24*WS2812_LEDS_PER_HALF_BUFFER)
+
+// number of half buffers required for the reset frame
+#define WS2812_RESET_HALF_BUFFERS ((WS2812_RESET_CYCLES + WS2812_LEDS_PER_HALF_BUFFER - 1) / WS2812_LEDS_PER_HALF_BUFFER)
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -107,25 +121,50 @@
 /////////////////////////////////////////////////////////////////////////////
 
 // organized as a double buffer, switching between lower and upper half
-// one buffer sends 24 words to a LED, which will take 30 uS
-static u16 ws2812_send_double_buffer[2*24];
+// one half sends 24 words to each of WS2812_LEDS_PER_HALF_BUFFER LEDs, which will take 30 uS per LED
+static u16 ws2812_send_double_buffer[2*WS2812_HALF_BUFFER_SIZE];
 
-// state counter:
-// - first 10 (WS2812_RESET_CYCLES) ticks used for reset frame
-// - tick 10..WS2812_NUM_LEDS+10: send RGB values for each led
-//   - each even number will use lower half of the buffer
-//   - each odd number will use upper half of the buffer
-// 
-static u16 ws2812_state_ctr;
+// frame scheduler:
+// - ws2812_reset_ctr: number of half buffers which still have to send the reset level
+// - ws2812_frame_led..ws2812_frame_len-1: LEDs which still have to be sent in the current frame
+// - ws2812_dirty_leds: number of LEDs (starting from the first one) which have to be sent with the next frame
+static u8  ws2812_reset_ctr;
+static u16 ws2812_frame_led;
+static u16 ws2812_frame_len;
+static volatile u16 ws2812_dirty_leds;
+
+// bit 0/1: lower/upper half of the double buffer only contains the reset level
+static u8 ws2812_half_buffer_reset;
 
 // RGB values for all LEDs
 static u8 ws2812_rgb_values[WS2812_NUM_LEDS][3];
 
+// PWM values for each nibble, MSB first
+static const u16 ws2812_nibble_pwm[16][4] = {
+#define L WS2812_TIM_CC_LOW
+#define H WS2812_TIM_CC_HIGH
+  { L, L, L, L }, { L, L, L, H }, { L, L, H, L }, { L, L, H, H },
+  { L, H, L, L }, { L, H, L, H }, { L, H, H, L }, { L, H, H, H },
+  { H, L, L, L }, { H, L, L, H }, { H, L, H, L }, { H, L, H, H },
+  { H, H, L, L }, { H, H, L, H }, { H, H, H, L }, { H, H, H, H },
+#undef L
+#undef H
+};
+
+// brightness and gamma correction applied to the RGB values
+static u8 ws2812_brightness;
+static float ws2812_gamma;
+static u8 ws2812_value_map[256];
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Local Prototypes
 /////////////////////////////////////////////////////////////////////////////
 
+static s32 WS2812_ValueMapUpdate(void);
+static void WS2812_DirtyMark(u16 num_leds);
+static u16 WS2812_RangeClip(u16 first_led, u16 num_leds);
+
 
 /////////////////////////////////////////////////////////////////////////////
 //! Initializes WS2812 driver
@@ -139,13 +178,8 @@ s32 WS2812_Init(u32 mode)
 #if !WS2812_SUPPORTED
   return -1;
 #else
-  ws2812_state_ctr = 0;
   {
     int i;
-    for(i=0; i<2*24; ++i) {
-      ws2812_send_double_buffer[i] = WS2812_TIM_CC_RESET;
-    }
-
     for(i=0; i<WS2812_NUM_LEDS; ++i) {
       ws2812_rgb_values[i][0] = 0;
       ws2812_rgb_values[i][1] = 0;
@@ -153,7 +187,24 @@ s32 WS2812_Init(u32 mode)
     }
   }
 
+  // send the cleared LEDs
+  ws2812_dirty_leds = WS2812_NUM_LEDS;
+
   if( mode == 0 ) {
+    int i;
+    for(i=0; i<2*WS2812_HALF_BUFFER_SIZE; ++i) {
+      ws2812_send_double_buffer[i] = WS2812_TIM_CC_RESET;
+    }
+    ws2812_half_buffer_reset = 3;
+
+    ws2812_reset_ctr = WS2812_RESET_HALF_BUFFERS;
+    ws2812_frame_led = 0;
+    ws2812_frame_len = 0;
+
+    ws2812_brightness = 255;
+    ws2812_gamma = 1.0;
+    WS2812_ValueMapUpdate();
+
     // WS2812 coding: see following nice overview page: http://www.mikrocontroller.net/articles/WS2812_Ansteuerung
     // We take the timer based approach since TIM4 isn't used by MIOS32 (yet), and J4B.SC is normally not used by apps
     // Programming Example for STM32F4: 
@@ -206,7 +257,7 @@ s32 WS2812_Init(u32 mode)
       DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
       DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
       DMA_InitStructure.DMA_Memory0BaseAddr = (u32)&ws2812_send_double_buffer[0];
-      DMA_InitStructure.DMA_BufferSize = 2*24;
+      DMA_InitStructure.DMA_BufferSize = 2*WS2812_HALF_BUFFER_SIZE;
       DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)&WS2812_TIM_CCR;
       DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
       DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
@@ -234,27 +285,60 @@ s32 WS2812_Init(u32 mode)
 //! DMA Channel interrupt is triggered on HT and TC interrupts
 /////////////////////////////////////////////////////////////////////////////
 #if WS2812_SUPPORTED
-void WS2812_DMA_IRQHandler_SetPWM(u16 *buffer)
+void WS2812_DMA_IRQHandler_SetPWM(u16 *buffer, u8 half)
 {
-  if( ws2812_state_ctr < WS2812_RESET_CYCLES ) {
-    int i;
-    for(i=0; i<24; ++i)
-      *(buffer++) = WS2812_TIM_CC_RESET;
-  } else {
-    int i, j;
-    u8 *rgb_values = &ws2812_rgb_values[ws2812_state_ctr-WS2812_RESET_CYCLES][0];
-    u8 mask;
-
-    for(i=0; i<3; ++i, ++rgb_values) {
-      u8 value = *(rgb_values);
-      for(j=0, mask=0x80; j<8; ++j, mask >>= 1) {
-	*(buffer++) = (value & mask) ? WS2812_TIM_CC_HIGH : WS2812_TIM_CC_LOW;
-      }
+  u8 half_mask = 1 << half;
+
+  // start a new frame if LEDs have been changed
+  if( !ws2812_reset_ctr && ws2812_frame_led >= ws2812_frame_len && ws2812_dirty_leds ) {
+    ws2812_frame_len = ws2812_dirty_leds;
+    ws2812_dirty_leds = 0;
+    ws2812_frame_led = 0;
+  }
+
+  if( ws2812_reset_ctr || ws2812_frame_led >= ws2812_frame_len ) {
+    // reset level, buffer only has to be filled once
+    if( !(ws2812_half_buffer_reset & half_mask) ) {
+      int i;
+      for(i=0; i<WS2812_HALF_BUFFER_SIZE; ++i)
+	*(buffer++) = WS2812_TIM_CC_RESET;
+      ws2812_half_buffer_reset |= half_mask;
     }
+
+    if( ws2812_reset_ctr )
+      --ws2812_reset_ctr;
+    return;
+  }
+
+  ws2812_half_buffer_reset &= ~half_mask;
+
+  int num_leds = ws2812_frame_len - ws2812_frame_led;
+  if( num_leds > WS2812_LEDS_PER_HALF_BUFFER )
+    num_leds = WS2812_LEDS_PER_HALF_BUFFER;
+
+  u8 *rgb_values = &ws2812_rgb_values[ws2812_frame_led][0];
+  int i;
+  for(i=0; i<3*num_leds; ++i) {
+    u8 value = ws2812_value_map[*(rgb_values++)];
+    const u16 *pwm_high = &ws2812_nibble_pwm[value >> 4][0];
+    const u16 *pwm_low = &ws2812_nibble_pwm[value & 0xf][0];
+    buffer[0] = pwm_high[0];
+    buffer[1] = pwm_high[1];
+    buffer[2] = pwm_high[2];
+    buffer[3] = pwm_high[3];
+    buffer[4] = pwm_low[0];
+    buffer[5] = pwm_low[1];
+    buffer[6] = pwm_low[2];
+    buffer[7] = pwm_low[3];
+    buffer += 8;
   }
 
-  if( ++ws2812_state_ctr >= (WS2812_RESET_CYCLES + WS2812_NUM_LEDS) ) {
-    ws2812_state_ctr = 0;
+  ws2812_frame_led += num_leds;
+  if( ws2812_frame_led >= ws2812_frame_len ) {
+    // end of frame: fill the remaining buffer with the reset level and latch the values
+    for(i=24*num_leds; i<WS2812_HALF_BUFFER_SIZE; ++i)
+      *(buffer++) = WS2812_TIM_CC_RESET;
+    ws2812_reset_ctr = WS2812_RESET_HALF_BUFFERS;
   }
 }
 
@@ -265,14 +349,14 @@ void WS2812_DMA_IRQHandler(void)
     DMA1->LIFCR = DMA_FLAG_HTIF0;
 
     // state 0: lower buffer range has been transfered and can be updated
-    WS2812_DMA_IRQHandler_SetPWM(&ws2812_send_double_buffer[0]);
+    WS2812_DMA_IRQHandler_SetPWM(&ws2812_send_double_buffer[0], 0);
   }
 
   if( DMA1->LISR & DMA_FLAG_TCIF0 ) {
     DMA1->LIFCR = DMA_FLAG_TCIF0;
 
     // state 1: upper buffer range has been transfered and can be updated
-    WS2812_DMA_IRQHandler_SetPWM(&ws2812_send_double_buffer[24]);
+    WS2812_DMA_IRQHandler_SetPWM(&ws2812_send_double_buffer[WS2812_HALF_BUFFER_SIZE], 1);
   }
 
   DMA1->LIFCR = DMA_FLAG_TEIF0 | DMA_FLAG_FEIF0;
@@ -307,7 +391,12 @@ s32 WS2812_LED_SetRGB(u16 led, u8 colour, u8 value)
     return -2; // unsupported colour
 
   u8 *rgb_values = &ws2812_rgb_values[led][0];
-  rgb_values[colour_ix] = value;
+  if( rgb_values[colour_ix] != value ) {
+    rgb_values[colour_ix] = value;
+
+    // LED has to be sent with the next frame
+    WS2812_DirtyMark(led + 1);
+  }
   return value;
 #endif
 }
@@ -345,6 +434,8 @@ s32 WS2812_LED_GetRGB(u16 led, u8 colour)
 
 /////////////////////////////////////////////////////////////////////////////
 //! Configures the LED according to a HSV value (Hue/Saturation/Value)
+//! The conversion is done with WS2812_HSVtoRGB, the float values are only
+//! scaled once to avoid floating point maths on derivatives without FPU.
 //! \param[in] led should be in the range 0..WS2812_NUM_LEDS-1
 //! \param[in] h the hue (0..360.0)
 //! \param[in] s the saturation (0.0..1.0)
@@ -353,65 +444,16 @@ s32 WS2812_LED_GetRGB(u16 led, u8 colour)
 /////////////////////////////////////////////////////////////////////////////
 s32 WS2812_LED_SetHSV(u16 led, float h, float s, float v)
 {
-  // from https://www.cs.rit.edu/~ncs/color/t_convert.html
-  int i;
-  float f, p, q, t;
-  float r, g, b;
-
   if( led >= WS2812_NUM_LEDS )
     return -1; // unsupported LED
 
-  if( s == 0 ) {
-    // achromatic (grey)
-    r = g = b = v;
-  } else {
-    h /= 60;			// sector 0 to 5
-    i = floor( h );
-    f = h - i;			// factorial part of h
-    p = v * ( 1 - s );
-    q = v * ( 1 - s * f );
-    t = v * ( 1 - s * ( 1 - f ) );
-
-    switch( i ) {
-    case 0:
-      r = v;
-      g = t;
-      b = p;
-      break;
-    case 1:
-      r = q;
-      g = v;
-      b = p;
-      break;
-    case 2:
-      r = p;
-      g = v;
-      b = t;
-      break;
-    case 3:
-      r = p;
-      g = q;
-      b = v;
-      break;
-    case 4:
-      r = t;
-      g = p;
-      b = v;
-      break;
-    default: // case 5:
-      r = v;
-      g = p;
-      b = q;
-      break;
-    }
-  }
+  s32 hi = (s32)(h * (WS2812_HUE_RANGE / 360.0) + 0.5);
+  s32 si = (s32)(s * 255 + 0.5);
+  s32 vi = (s32)(v * 255 + 0.5);
+  if( si < 0 ) si = 0; else if( si > 255 ) si = 255;
+  if( vi < 0 ) vi = 0; else if( vi > 255 ) vi = 255;
 
-  s32 status = 0;
-  status |= WS2812_LED_SetRGB(led, 0, r*255);
-  status |= WS2812_LED_SetRGB(led, 1, g*255);
-  status |= WS2812_LED_SetRGB(led, 2, b*255);
-
-  return status;
+  return WS2812_LED_SetHSVi(led, (u16)(hi % WS2812_HUE_RANGE), si, vi);
 }
 
 
@@ -471,4 +513,457 @@ s32 WS2812_LED_GetHSV(u16 led, float *h, float *s, float *v)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+//! Converts a HSV value to RGB with integer maths only
+//! \param[in] h the hue (0..WS2812_HUE_RANGE-1), each 256 steps cover one sector (60 degrees)
+//! \param[in] s the saturation (0..255)
+//! \param[in] v the brightness (0..255)
+//! \param[out] rgb three bytes for R, G and B
+//! \return < 0 if invalid hue
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_HSVtoRGB(u16 h, u8 s, u8 v, u8 *rgb)
+{
+  if( h >= WS2812_HUE_RANGE )
+    return -1; // invalid hue
+
+  if( s == 0 ) {
+    // achromatic (grey)
+    rgb[0] = rgb[1] = rgb[2] = v;
+    return 0; // no error
+  }
+
+  u32 f = h & 0xff; // fractional part of h in 1/256 steps
+  u8 p = (v * (255 - s) + 127) / 255;
+  u8 q = (v * (255*256 - s * f) + 255*128) / (255*256);
+  u8 t = (v * (255*256 - s * (256 - f)) + 255*128) / (255*256);
+
+  switch( h >> 8 ) {
+  case 0:  rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+  case 1:  rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+  case 2:  rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+  case 3:  rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+  case 4:  rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+  default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break; // case 5
+  }
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Converts a RGB value to HSV with integer maths only
+//! \param[in] rgb three bytes for R, G and B
+//! \param[out] h the hue (0..WS2812_HUE_RANGE-1)
+//! \param[out] s the saturation (0..255)
+//! \param[out] v the brightness (0..255)
+//! \return -2 if the colour is black (hue and saturation are 0 in this case)
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_RGBtoHSV(const u8 *rgb, u16 *h, u8 *s, u8 *v)
+{
+  s32 r = rgb[0];
+  s32 g = rgb[1];
+  s32 b = rgb[2];
+
+  s32 min = r;
+  if( g < min ) min = g;
+  if( b < min ) min = b;
+
+  s32 max = r;
+  if( g > max ) max = g;
+  if( b > max ) max = b;
+
+  *v = max;
+  if( max == 0 ) {
+    *s = 0;
+    *h = 0;
+    return -2;
+  }
+
+  s32 delta = max - min;
+  *s = (delta * 255 + max/2) / max;
+  if( delta == 0 ) {
+    *h = 0;
+    return 0; // no error
+  }
+
+  s32 hue;
+  if( r == max )
+    hue = (256 * (g - b)) / delta;       // between yellow & magenta
+  else if( g == max )
+    hue = 512 + (256 * (b - r)) / delta; // between cyan & yellow
+  else
+    hue = 1024 + (256 * (r - g)) / delta; // between magenta & cyan
+
+  if( hue < 0 )
+    hue += WS2812_HUE_RANGE;
+  *h = hue;
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Converts a HSL value to RGB with integer maths only
+//! \param[in] h the hue (0..WS2812_HUE_RANGE-1)
+//! \param[in] s the saturation (0..255)
+//! \param[in] l the lightness (0..255)
+//! \param[out] rgb three bytes for R, G and B
+//! \return < 0 if invalid hue
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_HSLtoRGB(u16 h, u8 s, u8 l, u8 *rgb)
+{
+  // map to HSV: v = l + s * min(l, 1-l), s_v = 2 * (1 - l / v)
+  u32 v = l + (s * ((l < 128) ? l : (255 - l)) + 127) / 255;
+  u32 s_v = v ? ((2 * 255 * (v - l) + v/2) / v) : 0;
+  if( s_v > 255 )
+    s_v = 255;
+
+  return WS2812_HSVtoRGB(h, s_v, v, rgb);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Configures the LED according to a HSV value with integer maths only
+//! \param[in] led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] h the hue (0..WS2812_HUE_RANGE-1)
+//! \param[in] s the saturation (0..255)
+//! \param[in] v the brightness (0..255)
+//! \return < 0 if invalid LED or hue
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_SetHSVi(u16 led, u16 h, u8 s, u8 v)
+{
+  u8 rgb[3];
+
+  if( WS2812_HSVtoRGB(h, s, v, rgb) < 0 )
+    return -3; // invalid hue
+
+  return WS2812_LED_BlitRGB(led, 1, rgb);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Returns the HSV values of the LED with integer maths only
+//! \param[in] led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[out] h the hue (0..WS2812_HUE_RANGE-1)
+//! \param[out] s the saturation (0..255)
+//! \param[out] v the brightness (0..255)
+//! \return < 0 if invalid LED (a black LED returns h=0, s=0, v=0 without error)
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_GetHSVi(u16 led, u16 *h, u8 *s, u8 *v)
+{
+  if( led >= WS2812_NUM_LEDS )
+    return -1; // unsupported LED
+
+  u8 rgb[3];
+  rgb[0] = WS2812_LED_GetRGB(led, 0);
+  rgb[1] = WS2812_LED_GetRGB(led, 1);
+  rgb[2] = WS2812_LED_GetRGB(led, 2);
+
+  // -2 (black) isn't an error here: the LED has a valid HSV value with h=0
+  WS2812_RGBtoHSV(rgb, h, s, v);
+
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Configures the LED according to a HSL value with integer maths only
+//! \param[in] led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] h the hue (0..WS2812_HUE_RANGE-1)
+//! \param[in] s the saturation (0..255)
+//! \param[in] l the lightness (0..255)
+//! \return < 0 if invalid LED or hue
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_SetHSLi(u16 led, u16 h, u8 s, u8 l)
+{
+  u8 rgb[3];
+
+  if( WS2812_HSLtoRGB(h, s, l, rgb) < 0 )
+    return -3; // invalid hue
+
+  return WS2812_LED_BlitRGB(led, 1, rgb);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets a range of LEDs to the same RGB value
+//! The LEDs are marked for the next frame at once.
+//! \param[in] first_led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] num_leds number of LEDs, will be clipped at the end of the chain
+//! \param[in] r, g, b the colour (0..255)
+//! \return < 0 if invalid LED
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_FillRGB(u16 first_led, u16 num_leds, u8 r, u8 g, u8 b)
+{
+#if !WS2812_SUPPORTED
+  return -1;
+#else
+  if( first_led >= WS2812_NUM_LEDS )
+    return -1; // unsupported LED
+
+  num_leds = WS2812_RangeClip(first_led, num_leds);
+
+  u8 *rgb_values = &ws2812_rgb_values[first_led][0];
+  int i;
+  for(i=0; i<num_leds; ++i) {
+    *(rgb_values++) = g; // stored in GRB order
+    *(rgb_values++) = r;
+    *(rgb_values++) = b;
+  }
+
+  WS2812_DirtyMark(first_led + num_leds);
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets a range of LEDs to a linear RGB gradient
+//! \param[in] first_led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] num_leds number of LEDs, will be clipped at the end of the chain
+//! \param[in] rgb_from colour of the first LED (R, G, B)
+//! \param[in] rgb_to colour of the last LED (R, G, B)
+//! \return < 0 if invalid LED
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_GradientRGB(u16 first_led, u16 num_leds, const u8 *rgb_from, const u8 *rgb_to)
+{
+#if !WS2812_SUPPORTED
+  return -1;
+#else
+  if( first_led >= WS2812_NUM_LEDS )
+    return -1; // unsupported LED
+
+  // the gradient covers the requested range, even if it's clipped
+  s32 steps = (num_leds > 1) ? (num_leds - 1) : 1;
+  num_leds = WS2812_RangeClip(first_led, num_leds);
+
+  u8 *rgb_values = &ws2812_rgb_values[first_led][0];
+  int i, colour;
+  for(i=0; i<num_leds; ++i) {
+    for(colour=0; colour<3; ++colour) {
+      s32 from = rgb_from[colour];
+      s32 diff = rgb_to[colour] - from;
+      s32 value = from + (diff * i + ((diff < 0) ? -steps/2 : steps/2)) / steps;
+      rgb_values[(colour == 0) ? 1 : ((colour == 1) ? 0 : 2)] = value; // stored in GRB order
+    }
+    rgb_values += 3;
+  }
+
+  WS2812_DirtyMark(first_led + num_leds);
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets a range of LEDs to a hue gradient with constant saturation and brightness
+//! \param[in] first_led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] num_leds number of LEDs, will be clipped at the end of the chain
+//! \param[in] h_from hue of the first LED (0..WS2812_HUE_RANGE-1)
+//! \param[in] h_to hue of the last LED (0..WS2812_HUE_RANGE-1), h_to < h_from counts downwards
+//! \param[in] s the saturation (0..255)
+//! \param[in] v the brightness (0..255)
+//! \return < 0 if invalid LED or hue
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_GradientHSV(u16 first_led, u16 num_leds, u16 h_from, u16 h_to, u8 s, u8 v)
+{
+#if !WS2812_SUPPORTED
+  return -1;
+#else
+  if( first_led >= WS2812_NUM_LEDS )
+    return -1; // unsupported LED
+
+  if( h_from >= WS2812_HUE_RANGE || h_to >= WS2812_HUE_RANGE )
+    return -3; // invalid hue
+
+  s32 steps = (num_leds > 1) ? (num_leds - 1) : 1;
+  s32 diff = h_to - h_from;
+  num_leds = WS2812_RangeClip(first_led, num_leds);
+
+  u8 *rgb_values = &ws2812_rgb_values[first_led][0];
+  int i;
+  for(i=0; i<num_leds; ++i) {
+    u8 rgb[3];
+    WS2812_HSVtoRGB(h_from + (diff * i) / steps, s, v, rgb);
+    *(rgb_values++) = rgb[1]; // stored in GRB order
+    *(rgb_values++) = rgb[0];
+    *(rgb_values++) = rgb[2];
+  }
+
+  WS2812_DirtyMark(first_led + num_leds);
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Copies RGB values into a range of LEDs
+//! \param[in] first_led should be in the range 0..WS2812_NUM_LEDS-1
+//! \param[in] num_leds number of LEDs, will be clipped at the end of the chain
+//! \param[in] rgb 3*num_leds bytes in R, G, B order
+//! \return < 0 if invalid LED
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_BlitRGB(u16 first_led, u16 num_leds, const u8 *rgb)
+{
+#if !WS2812_SUPPORTED
+  return -1;
+#else
+  if( first_led >= WS2812_NUM_LEDS )
+    return -1; // unsupported LED
+
+  num_leds = WS2812_RangeClip(first_led, num_leds);
+
+  // only mark the range up to the last changed LED
+  u8 *rgb_values = &ws2812_rgb_values[first_led][0];
+  u16 dirty = 0;
+  int i;
+  for(i=0; i<num_leds; ++i, rgb+=3, rgb_values+=3) {
+    if( rgb_values[0] != rgb[1] || rgb_values[1] != rgb[0] || rgb_values[2] != rgb[2] ) {
+      rgb_values[0] = rgb[1]; // stored in GRB order
+      rgb_values[1] = rgb[0];
+      rgb_values[2] = rgb[2];
+      dirty = first_led + i + 1;
+    }
+  }
+
+  if( dirty )
+    WS2812_DirtyMark(dirty);
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Scales all LEDs by the given factor, e.g. for fade-out effects
+//! \param[in] scale 0..255 (255: keep the current values)
+//! \return < 0 on errors
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_LED_FadeAll(u8 scale)
+{
+#if !WS2812_SUPPORTED
+  return -1;
+#else
+  if( scale == 255 )
+    return 0; // nothing to do
+
+  u8 *rgb_values = &ws2812_rgb_values[0][0];
+  u16 dirty = 0;
+  int i;
+  for(i=0; i<3*WS2812_NUM_LEDS; ++i, ++rgb_values) {
+    u8 value = *rgb_values;
+    if( value ) {
+      *rgb_values = (value * (scale + 1)) >> 8;
+      dirty = i/3 + 1;
+    }
+  }
+
+  if( dirty )
+    WS2812_DirtyMark(dirty);
+
+  return 0; // no error
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets the global brightness which is applied to all LEDs
+//! \param[in] brightness 0..255 (255: full brightness)
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_BrightnessSet(u8 brightness)
+{
+  ws2812_brightness = brightness;
+  return WS2812_ValueMapUpdate();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the global brightness
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_BrightnessGet(void)
+{
+  return ws2812_brightness;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Sets the gamma correction which is applied to all LEDs
+//! \param[in] gamma typically 2.2 for a perceived linear brightness, 1.0 disables the correction
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_GammaSet(float gamma)
+{
+  if( gamma <= 0 )
+    return -1; // invalid gamma
+
+  ws2812_gamma = gamma;
+  return WS2812_ValueMapUpdate();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//! \return the gamma correction
+/////////////////////////////////////////////////////////////////////////////
+float WS2812_GammaGet(void)
+{
+  return ws2812_gamma;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Requests a transfer of all LEDs with the next frame, e.g. after the
+//! LED chain has been powered on separately
+/////////////////////////////////////////////////////////////////////////////
+s32 WS2812_UpdateRequest(void)
+{
+  ws2812_dirty_leds = WS2812_NUM_LEDS;
+  return 0; // no error
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which updates the mapping of RGB values to the sent
+//! values based on brightness and gamma correction
+/////////////////////////////////////////////////////////////////////////////
+static s32 WS2812_ValueMapUpdate(void)
+{
+  int i;
+  for(i=0; i<256; ++i) {
+    u32 value = (i * (ws2812_brightness + 1)) >> 8;
+    if( ws2812_gamma != 1.0 )
+      value = (u32)(255.0 * powf(value / 255.0, ws2812_gamma) + 0.5);
+    ws2812_value_map[i] = value;
+  }
+
+  // all LEDs have to be sent again
+  ws2812_dirty_leds = WS2812_NUM_LEDS;
+
+  return 0; // no error
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which marks the first num_leds LEDs for the next frame
+/////////////////////////////////////////////////////////////////////////////
+static void WS2812_DirtyMark(u16 num_leds)
+{
+  MIOS32_IRQ_Disable();
+  if( ws2812_dirty_leds < num_leds )
+    ws2812_dirty_leds = num_leds;
+  MIOS32_IRQ_Enable();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! Help function which clips a LED range at the end of the chain
+/////////////////////////////////////////////////////////////////////////////
+static u16 WS2812_RangeClip(u16 first_led, u16 num_leds)
+{
+  if( (u32)first_led + num_leds > WS2812_NUM_LEDS )
+    return WS2812_NUM_LEDS - first_led;
+  return num_leds;
+}
+
+
 //! \}
@@ -28,6 +28,15 @@ extern "C" {
 #define WS2812_NUM_LEDS 256
 #endif
 
+// Number of LEDs which are serviced with each half of the DMA double buffer
+// Each LED will consume 2*48 bytes, but reduces the number of DMA interrupts
+#ifndef WS2812_LEDS_PER_HALF_BUFFER
+#define WS2812_LEDS_PER_HALF_BUFFER 8
+#endif
+
+// range of the hue used by the integer colour functions: 6 sectors with 256 steps each
+#define WS2812_HUE_RANGE (6*256)
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Global Types
@@ -46,6 +55,27 @@ extern s32 WS2812_LED_GetRGB(u16 led, u8 colour);
 extern s32 WS2812_LED_SetHSV(u16 led, float h, float s, float v);
 extern s32 WS2812_LED_GetHSV(u16 led, float *h, float *s, float *v);
 
+extern s32 WS2812_LED_SetHSVi(u16 led, u16 h, u8 s, u8 v);
+extern s32 WS2812_LED_GetHSVi(u16 led, u16 *h, u8 *s, u8 *v);
+extern s32 WS2812_LED_SetHSLi(u16 led, u16 h, u8 s, u8 l);
+
+extern s32 WS2812_HSVtoRGB(u16 h, u8 s, u8 v, u8 *rgb);
+extern s32 WS2812_RGBtoHSV(const u8 *rgb, u16 *h, u8 *s, u8 *v);
+extern s32 WS2812_HSLtoRGB(u16 h, u8 s, u8 l, u8 *rgb);
+
+extern s32 WS2812_LED_FillRGB(u16 first_led, u16 num_leds, u8 r, u8 g, u8 b);
+extern s32 WS2812_LED_GradientRGB(u16 first_led, u16 num_leds, const u8 *rgb_from, const u8 *rgb_to);
+extern s32 WS2812_LED_GradientHSV(u16 first_led, u16 num_leds, u16 h_from, u16 h_to, u8 s, u8 v);
+extern s32 WS2812_LED_BlitRGB(u16 first_led, u16 num_leds, const u8 *rgb);
+extern s32 WS2812_LED_FadeAll(u8 scale);
+
+extern s32 WS2812_BrightnessSet(u8 brightness);
+extern s32 WS2812_BrightnessGet(void);
+extern s32 WS2812_GammaSet(float gamma);
+extern float WS2812_GammaGet(void);
+
+extern s32 WS2812_UpdateRequest(void);
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Export global variables
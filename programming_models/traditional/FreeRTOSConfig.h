@@ -72,7 +72,9 @@
 #ifndef configGENERATE_RUN_TIME_STATS // can be changed in mios32_config.h
 #define configGENERATE_RUN_TIME_STATS           0
 #endif
+#ifndef configUSE_TRACE_FACILITY // can be changed in mios32_config.h
 #define configUSE_TRACE_FACILITY                0
+#endif
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
 /* Co-routine related definitions. */
@@ -0,0 +1,484 @@
+/* -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*- */
+// $Id$
+/*
+ * Bootloader emulator for the pipelined MIOS32 upload
+ *
+ * Emulates the flash programming of $MIOS32_PATH/bootloader/src/bsl_sysex.c
+ * (STM32F1 page erase at page start, STM32F4 sector erase once per upload,
+ * LPC17 sector erase at sector start) behind a lossy USB MIDI link, and
+ * drives UploadWindow the same way UploadHandlerThread::uploadMios32Pipelined()
+ * does. After each upload the emulated flash is compared with the firmware.
+ *
+ * Prints the upload time and throughput with a window of 8 blocks compared
+ * with a single block in flight.
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2010 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include "../src/UploadWindow.h"
+
+
+//==============================================================================
+// from mios32_midi.h
+#define DISACK_WRONG_CHECKSUM 0x03
+#define DISACK_WRITE_FAILED   0x04
+
+static const unsigned blockSize = 0x100;
+
+static unsigned rndState = 1;
+static unsigned rnd(unsigned range)
+{
+    rndState = rndState * 1103515245 + 12345;
+    return ((rndState >> 16) & 0x7fff) % range;
+}
+
+
+//==============================================================================
+enum Family {
+    STM32F1_1K,
+    STM32F1_2K,
+    STM32F4,
+    LPC17,
+};
+
+static const char *familyName[] = { "STM32F1 (1k pages)", "STM32F1 (2k pages)", "STM32F4", "LPC17" };
+
+struct LinkConfig {
+    const char *name;
+    unsigned blockLossPerMille;    // SysEx block lost on the way to the core
+    unsigned blockCorruptPerMille; // SysEx block corrupted, core answers with wrong checksum
+    unsigned ackLossPerMille;      // acknowledge lost on the way to MIOS Studio
+    unsigned writeFailPerMille;    // flash programming reports an error (error code 4)
+    unsigned errorZeroPerMille;    // core answers with error code 0
+};
+
+static const LinkConfig links[] = {
+    { "clean",         0,  0,  0, 0, 0 },
+    { "block loss",   20,  0,  0, 0, 0 },
+    { "corrupted",     0, 20,  0, 0, 0 },
+    { "ack loss",      0,  0, 20, 0, 0 },
+    { "write errors",  0,  0,  0, 5, 5 },
+    { "everything",   10, 10, 10, 5, 5 },
+};
+
+
+//==============================================================================
+// Core emulation
+//==============================================================================
+class Core
+{
+public:
+    Core(Family _family, const LinkConfig &_link)
+        : family(_family)
+        , link(_link)
+        , flashBase((_family == LPC17) ? 0x00000000 : 0x08000000)
+        , flash(0x80000, 0x00)
+        , busyUntil(0)
+        , f4EraseDone(0)
+    {
+        // flash contains an old firmware
+        for(unsigned i=0; i<flash.size(); ++i)
+            flash[i] = rnd(256);
+    }
+
+    struct Message {
+        unsigned time;
+        unsigned address;
+        const unsigned char *data;
+        unsigned char checksum;
+        bool corrupted;
+    };
+
+    struct Response {
+        unsigned time;
+        int value; // checksum (>= 0) or -1-errorCode
+    };
+
+    Family family;
+    LinkConfig link;
+    unsigned flashBase;
+    std::vector<unsigned char> flash;
+    std::deque<Message> received;
+    std::deque<Response> responses;
+    unsigned busyUntil;
+    unsigned f4EraseDone;
+
+    //==============================================================================
+    void send(unsigned time, unsigned address, const unsigned char *data, unsigned char checksum)
+    {
+        if( rnd(1000) < link.blockLossPerMille )
+            return;
+
+        Message m;
+        m.time = time + 2; // ca. 300 bytes over USB MIDI
+        m.address = address;
+        m.data = data;
+        m.checksum = checksum;
+        m.corrupted = rnd(1000) < link.blockCorruptPerMille;
+        received.push_back(m);
+    }
+
+    //==============================================================================
+    // processes the blocks received until the given time
+    void run(unsigned time)
+    {
+        while( !received.empty() ) {
+            Message &m = received.front();
+            unsigned start = (m.time > busyUntil) ? m.time : busyUntil;
+            if( start > time )
+                break;
+
+            unsigned duration = 3; // programming 256 bytes
+            int response;
+            if( m.corrupted ) {
+                duration = 0;
+                response = -1 - DISACK_WRONG_CHECKSUM;
+            } else if( rnd(1000) < link.errorZeroPerMille ) {
+                duration = 0;
+                response = -1 - 0;
+            } else {
+                int error = writeMem(m.address, m.data, duration);
+                if( !error && rnd(1000) < link.writeFailPerMille )
+                    error = DISACK_WRITE_FAILED; // e.g. program error in the middle of the block
+                response = error ? (-1 - error) : m.checksum;
+            }
+
+            busyUntil = start + duration;
+            received.pop_front();
+
+            if( rnd(1000) >= link.ackLossPerMille ) {
+                Response r;
+                r.time = busyUntil + 1;
+                r.value = response;
+                responses.push_back(r);
+            }
+        }
+    }
+
+    //==============================================================================
+    // see BSL_SYSEX_WriteMem()
+    int writeMem(unsigned address, const unsigned char *data, unsigned &duration)
+    {
+        unsigned offset = address - flashBase;
+
+        switch( family ) {
+        case STM32F1_1K:
+        case STM32F1_2K: {
+            unsigned pageSize = (family == STM32F1_1K) ? 0x400 : 0x800;
+            for(unsigned i=0; i<blockSize; i+=2) {
+                if( ((offset + i) % pageSize) == 0 ) {
+                    memset(&flash[offset + i], 0xff, pageSize);
+                    duration += 20;
+                }
+                // a halfword can only be programmed if it has been erased
+                if( flash[offset + i] != 0xff || flash[offset + i + 1] != 0xff )
+                    return DISACK_WRITE_FAILED;
+                flash[offset + i + 0] = data[i + 0];
+                flash[offset + i + 1] = data[i + 1];
+            }
+        } break;
+
+        case STM32F4: {
+            // sectors 1..3: 16k, 4: 64k, 5..: 128k
+            static const unsigned sectorStart[] = { 0x4000, 0x8000, 0xc000, 0x10000, 0x20000, 0x40000, 0x60000 };
+            for(unsigned sector=0; sector<sizeof(sectorStart)/sizeof(unsigned); ++sector) {
+                if( offset == sectorStart[sector] ) {
+                    if( offset == 0x4000 )
+                        f4EraseDone = 0;
+                    if( !(f4EraseDone & (1 << sector)) ) {
+                        f4EraseDone |= (1 << sector);
+                        unsigned sectorSize = (sector == 3) ? 0x10000 : (sector < 3) ? 0x4000 : 0x20000;
+                        memset(&flash[offset], 0xff, sectorSize);
+                        duration += (sectorSize >= 0x20000) ? 1500 : 300; // can take more than the timeout
+                    }
+                }
+            }
+            // bits can only be cleared
+            for(unsigned i=0; i<blockSize; ++i)
+                flash[offset + i] &= data[i];
+        } break;
+
+        case LPC17: {
+            unsigned sectorSize = (offset < 0x10000) ? 0x1000 : 0x8000;
+            if( (offset % sectorSize) == 0 ) {
+                memset(&flash[offset], 0xff, sectorSize);
+                duration += 100;
+            }
+            // flash lines can't be written twice (ECC), the result is garbage
+            for(unsigned i=0; i<blockSize; ++i)
+                flash[offset + i] = (flash[offset + i] == 0xff) ? data[i] : (flash[offset + i] & data[i] & 0x5a);
+        } break;
+        }
+
+        return 0;
+    }
+};
+
+
+//==============================================================================
+// Firmware
+//==============================================================================
+struct Firmware {
+    std::vector<unsigned> addresses;
+    std::vector<unsigned char> checksums;
+    std::vector<unsigned char> data;
+};
+
+// same checksum as HexFileLoader::createMidiMessageForBlock()
+static unsigned char blockChecksum(unsigned address, const unsigned char *data)
+{
+    unsigned char checksum = 0;
+    checksum += (address >> 25) & 0x7f;
+    checksum += (address >> 18) & 0x7f;
+    checksum += (address >> 11) & 0x7f;
+    checksum += (address >> 4) & 0x7f;
+    checksum += (blockSize >> 25) & 0x7f;
+    checksum += (blockSize >> 18) & 0x7f;
+    checksum += (blockSize >> 11) & 0x7f;
+    checksum += (blockSize >> 4) & 0x7f;
+
+    unsigned char m = 0;
+    int mCounter = 0;
+    for(unsigned offset=0; offset<blockSize; ++offset) {
+        unsigned char b = data[offset];
+        for(int bCounter=0; bCounter<8; ++bCounter) {
+            m = (m << 1) | (b & 0x80 ? 0x01 : 0x00);
+            b <<= 1;
+            if( ++mCounter == 7 ) {
+                checksum += m;
+                m = 0;
+                mCounter = 0;
+            }
+        }
+    }
+    if( mCounter > 0 ) {
+        while( mCounter < 7 ) {
+            m <<= 1;
+            ++mCounter;
+        }
+        checksum += m;
+    }
+
+    return -(int)checksum & 0x7f;
+}
+
+static void createFirmware(Firmware &fw, unsigned flashBase, unsigned size)
+{
+    // bootloader range (16k) is excluded, some erase units at the end are left out
+    for(unsigned offset=0x4000; offset<size; offset+=blockSize) {
+        if( offset >= 0x38000 && offset < 0x40000 )
+            continue;
+        fw.addresses.push_back(flashBase + offset);
+    }
+
+    fw.data.resize(fw.addresses.size() * blockSize);
+    for(unsigned i=0; i<fw.data.size(); ++i) {
+        // code like data: some repeating patterns, so that checksums repeat as well
+        fw.data[i] = rnd(4) ? rnd(256) : (i & 0xff);
+    }
+
+    for(unsigned block=0; block<fw.addresses.size(); ++block)
+        fw.checksums.push_back(blockChecksum(fw.addresses[block], &fw.data[block*blockSize]));
+}
+
+
+//==============================================================================
+// Upload like UploadHandlerThread::uploadMios32Pipelined()
+//==============================================================================
+struct UploadResult {
+    bool ok;
+    unsigned time;
+    unsigned retries;
+    unsigned sentBlocks;
+};
+
+static UploadResult upload(Family family, const LinkConfig &link, const Firmware &fw, int maxWindow)
+{
+    Core core(family, link);
+    UploadWindow uploadWindow(fw.addresses, fw.checksums, family == LPC17, maxWindow);
+    UploadResult result = { false, 0, 0, 0 };
+
+    const int maxRetries = 16;
+    const unsigned timeout = 1000;
+    unsigned time = 0;
+    unsigned oldestSentTime = 0;
+    int retry = 0;
+
+    while( !uploadWindow.isDone() ) {
+        int block;
+        while( (block=uploadWindow.getNextBlock()) >= 0 ) {
+            core.send(time, fw.addresses[block], &fw.data[block*blockSize], fw.checksums[block]);
+            ++result.sentBlocks;
+            if( block == uploadWindow.getAckedBlocks() )
+                oldestSentTime = time;
+        }
+
+        // wait for a response or the timeout
+        std::vector<int> responses;
+        while( time < (oldestSentTime + timeout) ) {
+            ++time;
+            core.run(time);
+            while( !core.responses.empty() && core.responses.front().time <= time ) {
+                responses.push_back(core.responses.front().value);
+                core.responses.pop_front();
+            }
+            if( !responses.empty() )
+                break;
+        }
+
+        bool failed = false;
+        for(unsigned i=0; i<responses.size() && !failed; ++i) {
+            if( responses[i] >= 0 ) {
+                int ackedBlocks = uploadWindow.getAckedBlocks();
+                if( !uploadWindow.handleAcknowledge(responses[i]) ) {
+                    failed = true;
+                } else if( uploadWindow.getAckedBlocks() != ackedBlocks ) {
+                    oldestSentTime = time;
+                    retry = 0;
+                }
+            } else {
+                failed = true;
+            }
+        }
+
+        if( !failed && uploadWindow.isInFlight() && (time - oldestSentTime) >= timeout )
+            failed = true;
+
+        if( failed ) {
+            ++result.retries;
+            if( ++retry >= maxRetries ) {
+                result.time = time;
+                return result;
+            }
+
+            // wait until the bootloader has processed the remaining blocks in flight
+            for(int i=0; i<20; ++i) {
+                unsigned numResponses = 0;
+                for(int t=0; t<100; ++t) {
+                    ++time;
+                    core.run(time);
+                    while( !core.responses.empty() && core.responses.front().time <= time ) {
+                        ++numResponses;
+                        core.responses.pop_front();
+                    }
+                }
+                if( i > 0 && numResponses == 0 )
+                    break;
+            }
+
+            uploadWindow.rewind();
+        }
+    }
+
+    // finish the remaining operations and compare the flash with the firmware
+    core.run(time + 10000);
+    result.time = time;
+    result.ok = true;
+    for(unsigned block=0; block<fw.addresses.size(); ++block) {
+        if( memcmp(&core.flash[fw.addresses[block] - core.flashBase], &fw.data[block*blockSize], blockSize) != 0 ) {
+            result.ok = false;
+            break;
+        }
+    }
+
+    return result;
+}
+
+
+//==============================================================================
+// unit tests of the acknowledge assignment
+//==============================================================================
+static int errors;
+
+#define CHECK(cond, msg) do { if( !(cond) ) { ++errors; printf("FAIL: %s\n", msg); } } while(0)
+
+static void testAcknowledges(void)
+{
+    std::vector<unsigned> addresses;
+    std::vector<unsigned char> checksums;
+    for(unsigned block=0; block<16; ++block) {
+        addresses.push_back(0x08004000 + block*blockSize);
+        checksums.push_back(block);
+    }
+    checksums[1] = checksums[3] = 0x11; // same checksum
+
+    UploadWindow w(addresses, checksums, false, 8);
+    CHECK(w.getNextBlock() == 0 && w.getNextBlock() == 1 && w.getNextBlock() == -1, "window starts with 2 blocks");
+    CHECK(w.handleAcknowledge(0) && w.getAckedBlocks() == 1, "ack of block 0");
+    CHECK(w.getNextBlock() == 2, "window grows");
+    CHECK(w.getNextBlock() == -1, "block 3 isn't sent while block 1 with the same checksum is in flight");
+    CHECK(w.handleAcknowledge(0x11) && w.getAckedBlocks() == 2, "ack of block 1");
+    CHECK(w.handleAcknowledge(0x11) && w.getAckedBlocks() == 2, "late ack of block 1 is ignored");
+    CHECK(w.getNextBlock() == 3, "block 3 is sent after block 1 has been acknowledged");
+    CHECK(!w.handleAcknowledge(0x11), "ack of block 3 while block 2 is missing");
+
+    // rewind to the start of the 2k page
+    w.rewind();
+    CHECK(w.getAckedBlocks() == 0 && !w.isInFlight(), "rewind to page start");
+    w.getNextBlock();
+    for(int block=0; block<9; ++block) {
+        int next;
+        while( (next=w.getNextBlock()) >= 0 )
+            ;
+        w.handleAcknowledge(checksums[w.getAckedBlocks()]);
+    }
+    CHECK(w.getAckedBlocks() == 9, "9 blocks acknowledged");
+    w.rewind();
+    CHECK(w.getAckedBlocks() == 8, "rewind to second page");
+
+    // LPC17: 4k sectors below 0x10000, 32k sectors above
+    std::vector<unsigned> lpcAddresses;
+    std::vector<unsigned char> lpcChecksums;
+    for(unsigned address=0x4000; address<0x20000; address+=blockSize) {
+        lpcAddresses.push_back(address);
+        lpcChecksums.push_back(lpcAddresses.size() & 0x7f);
+    }
+    UploadWindow lpc(lpcAddresses, lpcChecksums, true, 8);
+    CHECK(lpc.getEraseUnitStart(0x5300) == 0x5000, "LPC17 4k sector");
+    CHECK(lpc.getEraseUnitStart(0x17f00) == 0x10000, "LPC17 32k sector");
+}
+
+
+//==============================================================================
+int main(int argc, char **argv)
+{
+    testAcknowledges();
+
+    for(int family=STM32F1_1K; family<=LPC17; ++family) {
+        Firmware fw;
+        unsigned flashBase = (family == LPC17) ? 0x00000000 : 0x08000000;
+        createFirmware(fw, flashBase, 0x70000);
+        unsigned kb = fw.addresses.size() * blockSize / 1024;
+
+        for(unsigned l=0; l<sizeof(links)/sizeof(LinkConfig); ++l) {
+            for(int maxWindow=1; maxWindow<=8; maxWindow*=8) {
+                UploadResult r = upload((Family)family, links[l], fw, maxWindow);
+                printf("%-18s %-12s window %d: %s %4u kb in %6.1fs (%5.1f kb/s), %3u retries, %5u blocks sent\n",
+                       familyName[family], links[l].name, maxWindow, r.ok ? "ok    " : "FAILED",
+                       kb, r.time / 1000.0, r.time ? (kb * 1000.0 / r.time) : 0.0, r.retries, r.sentBlocks);
+                if( !r.ok ) {
+                    ++errors;
+                }
+            }
+        }
+    }
+
+    if( errors ) {
+        printf("%d errors\n", errors);
+        return 1;
+    }
+
+    printf("all tests passed\n");
+    return 0;
+}
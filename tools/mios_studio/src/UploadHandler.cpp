@@ -241,6 +241,29 @@ bool UploadHandler::checkAndDisplaySingleRange(LogBox* logbox, uint32 startAddre
 }
 
 
+//==============================================================================
+int UploadHandler::getUploadWindowSize(void)
+{
+    // blocks can only be pipelined if the MIDI interface has a flow control, which is the case
+    // for the USB MIDI connection to the core. MIDI interfaces which forward to the UART of the
+    // core would drop data while the bootloader is busy with flash programming
+    // -> stop-and-wait if the core isn't directly connected
+    // the "uploadWindowSize" setting allows to overrule this selection
+    PropertiesFile *propertiesFile = MiosStudioProperties::getInstance()->getCommonSettings(true);
+    int windowSize = propertiesFile ? propertiesFile->getIntValue(T("uploadWindowSize"), 0) : 0;
+    if( windowSize > 0 )
+        return windowSize;
+
+    String midiOut(miosStudio->getMidiOutput());
+    if( midiOut.containsIgnoreCase(T("MIOS32")) ||
+        midiOut.containsIgnoreCase(T("MBHP")) ||
+        midiOut.containsIgnoreCase(T("MIDIbox")) )
+        return 8;
+
+    return 1;
+}
+
+
 //==============================================================================
 void UploadHandler::handleIncomingMidiMessage(MidiInput* source, const MidiMessage& message)
 {
@@ -330,6 +353,25 @@ void UploadHandler::handleIncomingMidiMessage(MidiInput* source, const MidiMessa
 
     }
 
+    // acknowledges during pipelined upload are queued, they are checked by the run() thread
+    if( uploadHandlerThread->pipelineActive ) {
+        bool isResponse = false;
+        int response = 0;
+        if( SysexHelper::isValidMios32Acknowledge(data, size, currentDeviceId) ) {
+            isResponse = true;
+            response = (size >= 9) ? data[7] : 0; // data[7] contains checksum
+        } else if( SysexHelper::isValidMios32Error(data, size, currentDeviceId) ) {
+            isResponse = true;
+            response = -1 - data[7]; // data[7] contains error code, 0 is stored as -1
+        }
+
+        if( isResponse ) {
+            const ScopedLock sl(uploadHandlerThread->pipelineResponsesLock);
+            uploadHandlerThread->pipelineResponses.add(response);
+        }
+        uploadHandlerThread->notify(); // wakeup run() thread
+    }
+
     // acknowledge on write block initiated by MIOS Studio?
     if( uploadHandlerThread->mios32UploadRequest ) {
         if( SysexHelper::isValidMios32Acknowledge(data, size, currentDeviceId) ) {
@@ -387,6 +429,7 @@ UploadHandlerThread::UploadHandlerThread(MiosStudio *_miosStudio, UploadHandler
     , mios32RebootRequest(0)
     , uploadErrorCode(-1)
     , autoStartOnUploadRequest(0)
+    , pipelineActive(false)
 {
     // update status variables of caller
     uploadHandler->excludedBlocks = 0;
@@ -763,7 +806,15 @@ void UploadHandlerThread::run()
     //////////////////////////////////////////////////////////////////////////////////////
     int64 timeUploadBegin = Time::getCurrentTime().toMilliseconds();
 
-    for(int block=0; block<uploadHandler->totalBlocks; ++block) {
+    int uploadWindowSize = forMios32 ? uploadHandler->getUploadWindowSize() : 1;
+    if( uploadWindowSize > 1 ) {
+        uploadMios32Pipelined(forMios32_LPC17, uploadWindowSize);
+        if( errorStatusMessage != String::empty )
+            return;
+    }
+
+    // stop-and-wait (MIOS8, or MIOS32 connected via MIDI interface without flow control)
+    for(int block=0; uploadWindowSize <= 1 && block<uploadHandler->totalBlocks; ++block) {
         uploadHandler->currentBlock = block;
 
         if( threadShouldExit() )
@@ -855,3 +906,141 @@ void UploadHandlerThread::run()
         }
     }
 }
+
+
+//==============================================================================
+// Uploads the MIOS32 blocks with up to maxWindow blocks in flight.
+// The bootloader handles the blocks in the order they are received, and
+// acknowledges each one with its checksum. UploadWindow assigns the
+// acknowledges to the blocks in flight.
+// The window starts with 2 blocks, is increased with each acknowledged block,
+// and halved on errors and timeouts.
+// On errors, the upload continues at the start of the flash page/sector of
+// the failed block: the bootloader only erases a page when its first block
+// is written, the failed block can't be programmed again without erasing it.
+void UploadHandlerThread::uploadMios32Pipelined(bool forMios32_LPC17, int maxWindow)
+{
+    // collect blocks which have to be uploaded
+    std::vector<unsigned> addresses;
+    std::vector<unsigned char> checksums;
+    std::vector<MidiMessage> messages;
+    for(int block=0; block<uploadHandler->totalBlocks; ++block) {
+        uint32 blockAddress = uploadHandler->hexFileLoader.hexDumpAddressBlocks[block];
+        if( forMios32_LPC17 ) {
+            if( blockAddress >= uploadHandler->hexFileLoader.HEX_RANGE_MIOS32_LPC17_BL_START &&
+                blockAddress <= uploadHandler->hexFileLoader.HEX_RANGE_MIOS32_LPC17_BL_END ) {
+                ++uploadHandler->excludedBlocks;
+                continue; // skip bootloader range
+            }
+        } else {
+            if( blockAddress >= uploadHandler->hexFileLoader.HEX_RANGE_MIOS32_STM32_BL_START &&
+                blockAddress <= uploadHandler->hexFileLoader.HEX_RANGE_MIOS32_STM32_BL_END ) {
+                ++uploadHandler->excludedBlocks;
+                continue; // skip bootloader range
+            }
+        }
+        MidiMessage message = uploadHandler->hexFileLoader.createMidiMessageForBlock(deviceId, blockAddress, true);
+        addresses.push_back(blockAddress);
+        checksums.push_back(message.getRawData()[message.getRawDataSize()-2]);
+        messages.push_back(message);
+    }
+
+    const int maxRetries = 16;
+    const int timeout = 1000; // mS for the oldest block in flight
+    UploadWindow uploadWindow(addresses, checksums, forMios32_LPC17, maxWindow);
+    int retry = 0;
+    int64 oldestSentTime = 0;
+
+    {
+        const ScopedLock sl(pipelineResponsesLock);
+        pipelineResponses.clear();
+    }
+    pipelineActive = true;
+
+    while( !uploadWindow.isDone() ) {
+        if( threadShouldExit() ) {
+            pipelineActive = false;
+            return;
+        }
+
+        // fill the window
+        int block;
+        while( (block=uploadWindow.getNextBlock()) >= 0 ) {
+            miosStudio->sendMidiMessage(messages[block]);
+
+            if( block == uploadWindow.getAckedBlocks() )
+                oldestSentTime = Time::getCurrentTime().toMilliseconds();
+        }
+
+        uploadHandler->currentBlock = uploadHandler->excludedBlocks + uploadWindow.getAckedBlocks();
+
+        // wait for wakeup from handleIncomingMidiMessage()
+        int64 elapsed = Time::getCurrentTime().toMilliseconds() - oldestSentTime;
+        if( elapsed < timeout )
+            wait(timeout - (int)elapsed);
+
+        Array<int> responses;
+        {
+            const ScopedLock sl(pipelineResponsesLock);
+            responses = pipelineResponses;
+            pipelineResponses.clear();
+        }
+
+        bool failed = false;
+        for(int i=0; i<responses.size() && !failed; ++i) {
+            if( responses[i] >= 0 ) {
+                int ackedBlocks = uploadWindow.getAckedBlocks();
+                if( !uploadWindow.handleAcknowledge(responses[i]) ) {
+                    uploadErrorCode = -1; // acknowledges got lost
+                    failed = true;
+                } else if( uploadWindow.getAckedBlocks() != ackedBlocks ) {
+                    oldestSentTime = Time::getCurrentTime().toMilliseconds();
+                    retry = 0;
+                }
+            } else {
+                // error acknowledge
+                uploadErrorCode = -1 - responses[i];
+                failed = true;
+            }
+        }
+
+        if( !failed && uploadWindow.isInFlight() &&
+            (Time::getCurrentTime().toMilliseconds() - oldestSentTime) >= timeout ) {
+            uploadErrorCode = -1;
+            failed = true;
+        }
+
+        if( failed ) {
+            if( ++retry >= maxRetries ) {
+                if( uploadErrorCode >= 0 ) {
+                    errorStatusMessage += "Upload aborted due to error #" + String(uploadErrorCode) + ": ";
+                    errorStatusMessage += SysexHelper::decodeMiosErrorCode(uploadErrorCode);
+                } else {
+                    errorStatusMessage += "No response from core after " + String(maxRetries) + " retries!";
+                }
+                pipelineActive = false;
+                return;
+            }
+            ++uploadHandler->recoveredErrorsCounter; // counter is only relevant if the procedure passes
+
+            // wait until the bootloader has processed the remaining blocks in flight
+            // (e.g. a sector erase can take more than 1 second)
+            for(int i=0; i<20; ++i) {
+                int numResponses;
+                {
+                    const ScopedLock sl(pipelineResponsesLock);
+                    numResponses = pipelineResponses.size();
+                    pipelineResponses.clear();
+                }
+                if( i > 0 && numResponses == 0 )
+                    break;
+                wait(100);
+            }
+
+            // continue at the start of the flash page/sector
+            uploadWindow.rewind();
+        }
+    }
+
+    pipelineActive = false;
+}
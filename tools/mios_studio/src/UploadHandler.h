@@ -18,6 +18,7 @@
 #include "includes.h"
 #include "HexFileLoader.h"
 #include "SysexHelper.h"
+#include "UploadWindow.h"
 #include "gui/LogBox.h"
 
 
@@ -65,7 +66,13 @@ public:
 
     volatile int uploadErrorCode;
 
+    // pipelined MIOS32 upload: acknowledge checksums (>= 0) or -1-errorCode (< 0) in the order received
+    volatile bool pipelineActive;
+    CriticalSection pipelineResponsesLock;
+    Array<int> pipelineResponses;
+
 protected:
+    void uploadMios32Pipelined(bool forMios32_LPC17, int maxWindow);
     void sendMios8Query(void);
     void sendMios32Query(uint8 query);
     void sendMios8InvalidBlock(void);
@@ -107,6 +114,9 @@ public:
     bool checkAndDisplayRanges(LogBox* logbox);
     bool checkAndDisplaySingleRange(LogBox* logbox, uint32 startAddress, uint32 endAddress);
 
+    // max. number of blocks in flight during a MIOS32 upload, 1 selects stop-and-wait
+    int getUploadWindowSize(void);
+
     //==============================================================================
     uint8 getDeviceId();
     void setDeviceId(uint8 id);
@@ -0,0 +1,134 @@
+/* -*- mode:C++; tab-width:4; c-basic-offset:4; indent-tabs-mode:nil -*- */
+// $Id$
+/*
+ * Upload Window
+ *
+ * Bookkeeping of a pipelined MIOS32 upload: decides which block is sent
+ * next, assigns the acknowledges of the bootloader to the blocks in flight,
+ * and rewinds the upload after failures.
+ *
+ * Doesn't depend on Juce, so that it can be tested against the bootloader
+ * emulator in $MIOS32_PATH/tools/mios_studio/gnu_test
+ *
+ * ==========================================================================
+ *
+ *  Copyright (C) 2010 Thorsten Klose (tk@midibox.org)
+ *  Licensed for personal non-commercial use only.
+ *  All other rights reserved.
+ *
+ * ==========================================================================
+ */
+
+#ifndef _UPLOAD_WINDOW_H
+#define _UPLOAD_WINDOW_H
+
+#include <vector>
+
+
+class UploadWindow
+{
+public:
+    //==============================================================================
+    // addresses and checksums of the blocks which have to be uploaded, in ascending order
+    UploadWindow(const std::vector<unsigned> &_addresses, const std::vector<unsigned char> &_checksums, bool _forLPC17, int _maxWindow)
+        : addresses(_addresses)
+        , checksums(_checksums)
+        , forLPC17(_forLPC17)
+        , maxWindow(_maxWindow)
+        , window(_maxWindow < 2 ? _maxWindow : 2)
+        , nextBlock(0)
+        , ackedBlocks(0)
+    {
+    }
+
+    //==============================================================================
+    bool isDone(void) const { return ackedBlocks >= (int)addresses.size(); }
+
+    // index of the oldest block which hasn't been acknowledged yet
+    int getAckedBlocks(void) const { return ackedBlocks; }
+
+    bool isInFlight(void) const { return nextBlock > ackedBlocks; }
+
+    //==============================================================================
+    // returns the index of the next block which should be sent, or -1 if the window is full.
+    // The bootloader acknowledges a block with its 7bit checksum. A block isn't sent while
+    // another block with the same checksum is in flight, so that each acknowledge can only
+    // belong to a single block.
+    int getNextBlock(void)
+    {
+        if( nextBlock >= (int)addresses.size() || (nextBlock - ackedBlocks) >= window )
+            return -1;
+
+        for(int block=ackedBlocks; block<nextBlock; ++block)
+            if( checksums[block] == checksums[nextBlock] )
+                return -1;
+
+        return nextBlock++;
+    }
+
+    //==============================================================================
+    // handles the acknowledge of a block, returns false if the upload has to be rewound
+    bool handleAcknowledge(unsigned char checksum)
+    {
+        for(int block=ackedBlocks; block<nextBlock; ++block) {
+            if( checksums[block] == checksum ) {
+                if( block != ackedBlocks )
+                    return false; // the acknowledges of the older blocks are missing
+
+                ++ackedBlocks;
+                if( window < maxWindow )
+                    ++window;
+                return true;
+            }
+        }
+
+        // doesn't belong to a block in flight: late acknowledge of a block before the last rewind
+        return true;
+    }
+
+    //==============================================================================
+    // called on error acknowledges and timeouts.
+    // The upload continues at the first block of the flash page/sector which contains
+    // the oldest unacknowledged block: the bootloader only erases a page/sector when a
+    // block is written to its start address, and on STM32F1 and LPC17 flash which has
+    // already been programmed can't be written again without erasing it.
+    // STM32F4 erases each sector only once per upload, the blocks of the sector are
+    // written again with the same data.
+    void rewind(void)
+    {
+        if( ackedBlocks < (int)addresses.size() ) {
+            unsigned eraseStart = getEraseUnitStart(addresses[ackedBlocks]);
+            while( ackedBlocks > 0 && addresses[ackedBlocks-1] >= eraseStart )
+                --ackedBlocks;
+        }
+
+        nextBlock = ackedBlocks;
+        window = (window > 1) ? (window / 2) : 1;
+    }
+
+    //==============================================================================
+    // start address of the flash page (STM32F1: 1k or 2k) or sector (LPC17: 4k/32k)
+    // which contains the given address. For STM32 the largest page size is taken,
+    // it also matches the 1k pages of smaller derivatives.
+    unsigned getEraseUnitStart(unsigned address) const
+    {
+        if( forLPC17 ) {
+            if( address < 0x00010000 )
+                return address & ~0x00000fff;
+            return address & ~0x00007fff;
+        }
+
+        return address & ~0x000007ff;
+    }
+
+protected:
+    std::vector<unsigned> addresses;
+    std::vector<unsigned char> checksums;
+    bool forLPC17;
+    int maxWindow;
+    int window;
+    int nextBlock;
+    int ackedBlocks;
+};
+
+#endif /* _UPLOAD_WINDOW_H */
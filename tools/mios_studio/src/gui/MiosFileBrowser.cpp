@@ -170,8 +170,13 @@ MiosFileBrowser::MiosFileBrowser(MiosStudio *_miosStudio)
     , currentReadError(false)
     , currentWriteInProgress(false)
     , currentWriteError(false)
+    , currentWriteWindowed(false)
     , writeBlockCtrDefault(32) // send 32 blocks (=two 512 byte SD Card Sectors) at once to speed-up write operations
     , writeBlockSizeDefault(32) // send 32 bytes per block
+    , writeWindowSizeDefault(32) // up to 32 unacknowledged blocks in windowed mode (limited by the selective ack map of the core)
+    , writeWindowTimeout(1000) // re-send unacknowledged blocks after 1 second
+    , writeWindowMaxRetries(5)
+    , writeCompressionEnabled(true)
 {
     addAndMakeVisible(editLabel = new Label(T("Edit"), String::empty));
     editLabel->setJustificationType(Justification::left);
@@ -884,12 +889,120 @@ bool MiosFileBrowser::uploadBuffer(String filename, const Array<uint8>& buffer)
     currentWriteFirstBlockOffset = 0;
     currentWriteBlockCtr = writeBlockCtrDefault;
     currentWriteStartTime = Time::currentTimeMillis();
-    sendCommand(T("write ") + currentWriteFileName + T(" ") + String(currentWriteSize));
+
+    // try the windowed transfer first, we will fall back to the old protocol if it isn't supported by the core
+    currentWriteWindowed = true;
+    currentWriteAckedOffset = 0;
+    currentWriteNextOffset = 0;
+    currentWriteAckMap = 0;
+    currentWriteRetries = 0;
+    currentWriteFastRetransmitOffset = (unsigned)-1;
+    currentWriteTransmittedBytes = 0;
+    sendCommand(T("writew ") + currentWriteFileName + T(" ") + String(currentWriteSize) + T(" ") + String(writeBlockSizeDefault));
     startTimer(5000);
 
     return true;
 }
 
+//==============================================================================
+// Compresses a block for the "writedataz" command, the format is decoded by
+// FILE_BrowserLzDecode() in $MIOS32_PATH/modules/file/file.c:
+//   0x00..0x7f: literal run, (c+1) bytes are following
+//   0x80..0xff: match of ((c & 0x7f) + 3) bytes, followed by distance-1
+// Matches only refer to the same block, so that blocks can be received in any order.
+// Returns the compressed length, or -1 if the compressed data wouldn't be smaller
+static int compressBlock(const uint8 *src, int len, uint8 *dst, int maxLen)
+{
+    int dstPos = 0;
+    int literalStart = 0;
+    int pos = 0;
+
+    while( pos <= len ) {
+        int bestLen = 0;
+        int bestDistance = 0;
+
+        if( pos < len ) {
+            for(int distance=1; distance<=pos && distance<=256; ++distance) {
+                int matchLen = 0;
+                while( (pos+matchLen) < len && matchLen < (0x7f+3) &&
+                       src[pos+matchLen-distance] == src[pos+matchLen] )
+                    ++matchLen;
+
+                if( matchLen > bestLen ) {
+                    bestLen = matchLen;
+                    bestDistance = distance;
+                }
+            }
+        }
+
+        // flush literals before a match, at the end, or if the literal run is full
+        int literalLen = pos - literalStart;
+        if( literalLen && (bestLen >= 3 || pos == len || literalLen == 0x80) ) {
+            if( (dstPos + 1 + literalLen) > maxLen )
+                return -1;
+            dst[dstPos++] = literalLen - 1;
+            for(int i=0; i<literalLen; ++i)
+                dst[dstPos++] = src[literalStart + i];
+            literalStart = pos;
+        }
+
+        if( pos == len )
+            break;
+
+        if( bestLen >= 3 ) {
+            if( (dstPos + 2) > maxLen )
+                return -1;
+            dst[dstPos++] = 0x80 | (bestLen - 3);
+            dst[dstPos++] = bestDistance - 1;
+            pos += bestLen;
+            literalStart = pos;
+        } else {
+            ++pos;
+        }
+    }
+
+    return (dstPos < len) ? dstPos : -1;
+}
+
+void MiosFileBrowser::sendWriteBlock(unsigned offset)
+{
+    int len = currentWriteSize - offset;
+    if( len > (int)writeBlockSizeDefault )
+        len = writeBlockSizeDefault;
+
+    uint8 compressed[256];
+    int compressedLen = -1;
+    if( writeCompressionEnabled )
+        compressedLen = compressBlock(&currentWriteData.getReference(offset), len, compressed, len-1);
+
+    String writeCommand;
+    if( compressedLen > 0 ) {
+        writeCommand = String::formatted(T("writedataz %08X "), offset);
+        for(int i=0; i<compressedLen; ++i) {
+            writeCommand += String::formatted(T("%02X"), compressed[i]);
+        }
+        currentWriteTransmittedBytes += compressedLen;
+    } else {
+        writeCommand = String::formatted(T("writedata %08X "), offset);
+        for(int i=0; i<len; ++i) {
+            writeCommand += String::formatted(T("%02X"), currentWriteData[offset + i]);
+        }
+        currentWriteTransmittedBytes += len;
+    }
+    sendCommand(writeCommand);
+}
+
+void MiosFileBrowser::sendWriteWindow(void)
+{
+    unsigned windowEnd = currentWriteAckedOffset + writeWindowSizeDefault*writeBlockSizeDefault;
+    while( currentWriteNextOffset < currentWriteSize && currentWriteNextOffset < windowEnd ) {
+        sendWriteBlock(currentWriteNextOffset);
+        currentWriteNextOffset += writeBlockSizeDefault;
+    }
+
+    startTimer(writeWindowTimeout);
+}
+
 bool MiosFileBrowser::uploadFinished(void)
 {
     currentWriteInProgress = false;
@@ -936,6 +1049,19 @@ bool MiosFileBrowser::uploadFinished(void)
 //==============================================================================
 void MiosFileBrowser::timerCallback()
 {
+    if( currentWriteInProgress && currentWriteWindowed && !currentWriteError &&
+        currentWriteNextOffset > 0 && currentWriteRetries < writeWindowMaxRetries ) {
+        // re-send all blocks which haven't been acknowledged yet
+        ++currentWriteRetries;
+        unsigned offset = currentWriteAckedOffset;
+        for(unsigned block=0; offset < currentWriteNextOffset; ++block, offset += writeBlockSizeDefault) {
+            if( block >= 32 || !(currentWriteAckMap & (1u << block)) )
+                sendWriteBlock(offset);
+        }
+        startTimer(writeWindowTimeout);
+        return;
+    }
+
     if( currentReadInProgress ) {
         if( currentReadError ) {
             setStatus(T("Invalid response from MIOS32 core during read operation!"));
@@ -973,7 +1099,13 @@ void MiosFileBrowser::receiveCommand(const String& command)
 
         ////////////////////////////////////////////////////////////////////
         case '?': {
-            statusMessage = String(T("Command not supported by MIOS32 application - please check if a firmware update is available!"));
+            if( currentWriteInProgress && currentWriteWindowed && currentWriteNextOffset == 0 ) {
+                // windowed transfer not supported by the core: fall back to the old protocol
+                currentWriteWindowed = false;
+                sendCommand(T("write ") + currentWriteFileName + T(" ") + String(currentWriteSize));
+            } else {
+                statusMessage = String(T("Command not supported by MIOS32 application - please check if a firmware update is available!"));
+            }
         } break;
 
         ////////////////////////////////////////////////////////////////////
@@ -1098,6 +1230,8 @@ void MiosFileBrowser::receiveCommand(const String& command)
         case 'W': {
             if( currentWriteError ) {
                 // ignore
+            } else if( !currentWriteInProgress && currentWriteWindowed ) {
+                // ignore: late response to a re-sent block
             } else if( !currentWriteInProgress ) {
                 statusMessage = String(T("There is a write operation in progress - please wait!"));
             } else if( command[1] == '!' ) {
@@ -1109,6 +1243,37 @@ void MiosFileBrowser::receiveCommand(const String& command)
             } else if( command[1] == '#' ) {
                 uploadFinished();
                 statusMessage = String::empty; // status has been updated by uploadFinished()
+            } else if( currentWriteWindowed ) {
+                // W<offset>:<map> - offset up to which the file has been received, map of following blocks
+                unsigned addressOffset = command.substring(1, 9).getHexValue32();
+                uint32 ackMap = command.substring(10).getHexValue32();
+
+                if( addressOffset > currentWriteAckedOffset ) {
+                    currentWriteAckedOffset = addressOffset;
+                    currentWriteRetries = 0;
+                }
+                if( addressOffset == currentWriteAckedOffset ) {
+                    currentWriteAckMap = ackMap;
+
+                    // blocks after a missing one have been received: re-send the missing block immediately (only once)
+                    if( ackMap && currentWriteFastRetransmitOffset != addressOffset ) {
+                        currentWriteFastRetransmitOffset = addressOffset;
+                        sendWriteBlock(addressOffset);
+                    }
+                }
+
+                sendWriteWindow();
+
+                uint32 currentWriteFinished = Time::currentTimeMillis();
+                float downloadTime = (float)(currentWriteFinished-currentWriteStartTime) / 1000.0;
+                float dataRate = ((float)addressOffset/1000.0) / downloadTime;
+
+                statusMessage = String(T("Uploading ") + currentWriteFileName + T(": ") +
+                                       String(addressOffset) + T(" bytes transmitted") +
+                                       String::formatted(T(" (%d%%, %2.1f kb/s, %d%% payload)"),
+                                                         (int)(100.0*(float)addressOffset/(float)currentWriteSize),
+                                                         dataRate,
+                                                         currentWriteNextOffset ? (int)(100.0*(float)currentWriteTransmittedBytes/(float)currentWriteNextOffset) : 100));
             } else {
                 unsigned addressOffset = command.substring(1).getHexValue32();
 
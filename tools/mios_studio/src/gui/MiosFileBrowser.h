@@ -95,6 +95,8 @@ public:
     bool uploadFile(String filename = String::empty);
     bool uploadBuffer(String filename, const Array<uint8>& buffer);
     bool uploadFinished(void);
+    void sendWriteBlock(unsigned offset);
+    void sendWriteWindow(void);
 
     //==============================================================================
     void timerCallback();
@@ -161,9 +163,20 @@ protected:
     unsigned     currentWriteFirstBlockOffset;
     unsigned     currentWriteBlockCtr;
     uint32       currentWriteStartTime;
+    bool         currentWriteWindowed;
+    unsigned     currentWriteAckedOffset;
+    unsigned     currentWriteNextOffset;
+    uint32       currentWriteAckMap;
+    unsigned     currentWriteRetries;
+    unsigned     currentWriteFastRetransmitOffset;
+    unsigned     currentWriteTransmittedBytes;
 
     unsigned     writeBlockCtrDefault;
     unsigned     writeBlockSizeDefault;
+    unsigned     writeWindowSizeDefault;
+    unsigned     writeWindowTimeout;
+    unsigned     writeWindowMaxRetries;
+    bool         writeCompressionEnabled;
 
     HexTextEditor* hexEditor;
     TextEditor*    textEditor;